@@ -0,0 +1,209 @@
+#include "AmbientOcclusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+// Same noise as shaders.hlsl, so both paths rotate the kernel identically per pixel.
+float InterleavedGradientNoise(float x, float y) {
+  float f = 0.06711056f * x + 0.00583715f * y;
+  f = 52.9829189f * (f - std::floor(f));
+  return f - std::floor(f);
+}
+
+// Cosine weighted golden angle spiral over the hemisphere, denser close to the shading point.
+XMFLOAT3 SsaoKernel(int i, int count, float rotation) {
+  float u = (static_cast<float>(i) + 0.5f) / static_cast<float>(count);
+  float phi = static_cast<float>(i) * 2.39996323f + rotation;
+  float sinTheta = std::sqrt(u);
+  float cosTheta = std::sqrt(1.f - u);
+  float scale = 0.1f + 0.9f * u * u;
+  return {std::cos(phi) * sinTheta * scale, std::sin(phi) * sinTheta * scale, cosTheta * scale};
+}
+
+// Full resolution pixel that a point sampler reads at "uv".
+size_t CameraTexel(const GBuffer& camera, float u, float v) {
+  int x = std::min(static_cast<int>(u * camera.width), camera.width - 1);
+  int y = std::min(static_cast<int>(v * camera.height), camera.height - 1);
+  return static_cast<size_t>(y) * camera.width + x;
+}
+
+// Reconstruct the view space position from the post-projection depth, like the GPU pass does.
+XMVECTOR ViewPosFromDepth(float u, float v, float viewDepth, const XMFLOAT4X4& proj,
+                          FXMMATRIX invProj) {
+  float ndcDepth = proj._33 + proj._43 / viewDepth;
+  auto ndc = XMVectorSet(u * 2.f - 1.f, 1.f - v * 2.f, ndcDepth, 1.f);
+  return XMVector3TransformCoord(ndc, invProj);
+}
+}  // namespace
+
+AmbientOcclusion ComputeSsao(const GBuffer& camera, FXMMATRIX view, CXMMATRIX proj,
+                             const SsaoSettings& settings) {
+  AmbientOcclusion ao;
+  ao.width = camera.width / 2;
+  ao.height = camera.height / 2;
+  ao.raw.assign(static_cast<size_t>(ao.width) * ao.height, 1.f);
+  ao.blurred.assign(ao.raw.size(), 1.f);
+
+  XMFLOAT4X4 proj4x4 = ToXMFloat4x4(proj);
+  auto invProj = XMMatrixInverse(nullptr, proj);
+
+  // Gather
+  GlobalThreadPool().ParallelFor(0, ao.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+      for (int x = 0; x < ao.width; ++x) {
+        float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(ao.width);
+        float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(ao.height);
+        size_t texel = CameraTexel(camera, u, v);
+        if (!camera.IsCovered(texel))
+          continue;
+
+        auto p = ViewPosFromDepth(u, v, camera.depth[texel], proj4x4, invProj);
+        auto worldNormal = ToXMVector(camera.normal[texel]);
+        auto n = XMVector3Normalize(XMVector3TransformNormal(worldNormal, view));
+
+        auto helper = std::abs(XMVectorGetY(n)) < 0.99f ? XMVectorSet(0.f, 1.f, 0.f, 0.f)
+                                                         : XMVectorSet(1.f, 0.f, 0.f, 0.f);
+        auto t = XMVector3Normalize(XMVector3Cross(helper, n));
+        auto b = XMVector3Cross(n, t);
+        float rotation =
+            InterleavedGradientNoise(static_cast<float>(x), static_cast<float>(y)) * XM_2PI;
+
+        float pz = XMVectorGetZ(p);
+        float occlusion = 0.f;
+        for (int i = 0; i < settings.sampleCount; ++i) {
+          auto k = SsaoKernel(i, settings.sampleCount, rotation);
+          auto s = p + (t * k.x + b * k.y + n * k.z) * settings.radius;
+
+          auto clip = XMVector3TransformCoord(s, proj);
+          float su = XMVectorGetX(clip) * 0.5f + 0.5f;
+          float sv = 0.5f - XMVectorGetY(clip) * 0.5f;
+          if (su < 0.f || su > 1.f || sv < 0.f || sv > 1.f)
+            continue;
+
+          float sceneZ = camera.depth[CameraTexel(camera, su, sv)];
+          float rangeCheck = std::min(1.f, settings.radius / std::abs(pz - sceneZ));
+          if (sceneZ <= XMVectorGetZ(s) - settings.bias)
+            occlusion += rangeCheck;
+        }
+
+        float visibility = std::clamp(1.f - occlusion / settings.sampleCount, 0.f, 1.f);
+        ao.raw[y * ao.width + x] = std::pow(visibility, settings.intensity);
+      }
+    }
+  });
+
+  // Bilateral blur: spatial Gaussian, weighted down across depth discontinuities
+  float sigma = 0.5f * static_cast<float>(settings.blurRadius) + 0.5f;
+  int r = settings.blurRadius;
+  GlobalThreadPool().ParallelFor(0, ao.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    for (int y = static_cast<int>(rowBegin); y < static_cast<int>(rowEnd); ++y) {
+      for (int x = 0; x < ao.width; ++x) {
+        auto depthAt = [&](int hx, int hy) {
+          float u = (static_cast<float>(hx) + 0.5f) / static_cast<float>(ao.width);
+          float v = (static_cast<float>(hy) + 0.5f) / static_cast<float>(ao.height);
+          return camera.depth[CameraTexel(camera, u, v)];
+        };
+
+        float centerZ = depthAt(x, y);
+        if (centerZ == FLT_MAX)
+          continue;
+
+        float sum = 0.f;
+        float weightSum = 0.f;
+        for (int dy = -r; dy <= r; ++dy) {
+          for (int dx = -r; dx <= r; ++dx) {
+            int sx = x + dx;
+            int sy = y + dy;
+            if (sx < 0 || sx >= ao.width || sy < 0 || sy >= ao.height)
+              continue;
+
+            float z = depthAt(sx, sy);
+            if (z == FLT_MAX)
+              continue;
+
+            float w = std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.f * sigma * sigma)) *
+                      std::exp(-std::abs(z - centerZ) * settings.blurSharpness / centerZ);
+            sum += w * ao.raw[static_cast<size_t>(sy) * ao.width + sx];
+            weightSum += w;
+          }
+        }
+        ao.blurred[static_cast<size_t>(y) * ao.width + x] = sum / weightSum;
+      }
+    }
+  });
+
+  return ao;
+}
+
+Image AmbientOcclusionImage(const AmbientOcclusion& ao, int width, int height) {
+  Image image{width, height};
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      float a = ao.At(x, y);
+      image.At(x, y) = {a, a, a};
+    }
+  }
+  return image;
+}
+
+Image ModulateIndirect(const Image& indirect, const AmbientOcclusion& ao) {
+  Image result = indirect;
+  for (int y = 0; y < result.height; ++y) {
+    for (int x = 0; x < result.width; ++x) {
+      auto& c = result.At(x, y);
+      float a = ao.At(x, y);
+      c = {c.x * a, c.y * a, c.z * a};
+    }
+  }
+  return result;
+}
+
+std::vector<float> BakeVertexAmbientOcclusion(const CpuScene& scene, const Bvh& bvh,
+                                              const VertexAoSettings& settings) {
+  DirectionIntegrator integrator{GenerateDirections(
+      SampleDomain::CosineHemisphere, settings.sequence, settings.sampleCount, settings.seed)};
+  const auto& d = integrator.Directions();
+
+  // The integral of the visibility times cos is pi for an open hemisphere
+  std::vector<float> ao(scene.positions.size());
+  integrator.Integrate(ao.size(), 1, [&](size_t v, size_t first, size_t count, float* values) {
+    auto p = ToXMVector(scene.positions[v]);
+    auto n = XMVector3Normalize(ToXMVector(scene.normals[v]));
+    auto helper = std::abs(XMVectorGetX(n)) < 0.9f ? XMVectorSet(1.f, 0.f, 0.f, 0.f)
+                                                    : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+    auto t = XMVector3Normalize(XMVector3Cross(helper, n));
+    auto b = XMVector3Cross(n, t);
+    float offset = 1e-4f * (1.f + XMVectorGetX(XMVector3Length(p)));
+    auto origin = ToXMFloat3(p + n * offset);
+
+    RayPacket packet;
+    size_t packetSamples[RayPacket::s_size];
+    int packetSize = 0;
+    auto flush = [&] {
+      int occluded = bvh.OccludedPacket(packet, (1 << packetSize) - 1);
+      for (int i = 0; i < packetSize; ++i) {
+        values[packetSamples[i]] = occluded & (1 << i) ? 0.f : 1.f / XM_PI;
+      }
+      packetSize = 0;
+    };
+    for (size_t k = 0; k < count; ++k) {
+      size_t s = first + k;
+      Ray ray;
+      ray.origin = origin;
+      ray.direction = ToXMFloat3(t * d.x[s] + b * d.y[s] + n * d.z[s]);
+      ray.tMax = settings.maxDistance;
+      packet.Set(packetSize, ray);
+      packetSamples[packetSize] = k;
+      if (++packetSize == RayPacket::s_size)
+        flush();
+    }
+    if (packetSize > 0)
+      flush();
+  }, ao.data());
+  return ao;
+}
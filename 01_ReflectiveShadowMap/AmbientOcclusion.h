@@ -0,0 +1,66 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "CpuRaster.h"
+#include "CpuScene.h"
+#include "Image.h"
+#include "Sampling.h"
+
+// Parameters of the screen-space ambient occlusion pass, shared by the GPU pass and the CPU path.
+struct SsaoSettings {
+  float radius = 0.5f;  // World space radius of the sampled hemisphere
+  float bias = 0.05f;   // Depth bias against self-occlusion
+  float intensity = 1.5f;
+  int sampleCount = 16;
+  int blurRadius = 2;  // Half width of the bilateral blur kernel, in half resolution pixels
+  float blurSharpness = 8.f;
+};
+
+/**
+ * Ambient occlusion computed at half of the camera resolution.
+ * The full resolution pixel (x, y) reads the half resolution pixel (x / 2, y / 2), which is what
+ * point sampling the half resolution target with screen UVs does.
+ */
+struct AmbientOcclusion {
+  int width = 0;  // Half resolution size
+  int height = 0;
+  std::vector<float> raw;      // After the gather
+  std::vector<float> blurred;  // After the bilateral blur
+
+  float At(int fullX, int fullY) const {
+    int x = std::min(fullX / 2, width - 1);
+    int y = std::min(fullY / 2, height - 1);
+    return blurred[static_cast<size_t>(y) * width + x];
+  }
+};
+
+// CPU version of the SSAO gather and bilateral blur, sample for sample the same as shaders.hlsl.
+AmbientOcclusion ComputeSsao(const GBuffer& camera, DirectX::FXMMATRIX view,
+                             DirectX::CXMMATRIX proj, const SsaoSettings& settings);
+
+// Grayscale full resolution image of the blurred occlusion.
+Image AmbientOcclusionImage(const AmbientOcclusion& ao, int width, int height);
+
+// Multiply every pixel of "indirect" by its ambient occlusion.
+Image ModulateIndirect(const Image& indirect, const AmbientOcclusion& ao);
+
+struct VertexAoSettings {
+  int sampleCount = 256;
+  SampleSequence sequence = SampleSequence::Sobol;
+  float maxDistance = FLT_MAX;  // Occluders further away do not count
+  std::uint32_t seed = 0;
+};
+
+/**
+ * Ray traced ambient occlusion of every vertex of a CpuScene: the cosine weighted fraction of the
+ * hemisphere around the normal that is open, 1 when nothing is in the way. All vertices share one
+ * cosine distributed set of directions, turned to their normals, through DirectionIntegrator.
+ */
+std::vector<float> BakeVertexAmbientOcclusion(const CpuScene& scene, const Bvh& bvh,
+                                              const VertexAoSettings& settings);
@@ -0,0 +1,123 @@
+#include "AnalyticLights.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr int s_probeOrder = 3;  // L2, like IrradianceProbeGrid
+constexpr float s_minDistance2 = 1e-6f;
+
+// Clamped cosine lobe convolution per band [Ramamoorthi and Hanrahan 2001]
+constexpr float s_cosineLobe[IrradianceProbeGrid::s_coefficientCount] = {
+    XM_PI,
+    2.f * XM_PI / 3.f, 2.f * XM_PI / 3.f, 2.f * XM_PI / 3.f,
+    XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f,
+};
+
+// The SH library has the Condon-Shortley phase, the basis of IrradianceProbeGrid does not: the
+// coefficients with odd m change sign.
+constexpr float s_probeBasisSign[IrradianceProbeGrid::s_coefficientCount] = {
+    1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f,
+};
+
+float SmoothStep(float edge0, float edge1, float x) {
+  if (edge0 == edge1)
+    return x < edge0 ? 0.f : 1.f;
+  float t = std::clamp((x - edge0) / (edge1 - edge0), 0.f, 1.f);
+  return t * t * (3.f - 2.f * t);
+}
+
+// Directional lights, which look the same from every point
+void AddDirectionalLights(const AnalyticLights& lights, ShZonalBatch* batch) {
+  float delta[s_shMaxOrder];
+  ShZonalDelta(batch->Order(), delta);
+  for (const auto& light : lights.directional) {
+    batch->Add(ToXMFloat3(-XMVector3Normalize(ToXMVector(light.dir))), light.color, delta);
+  }
+}
+
+// Spot, sphere and disc lights, which look different from every point
+void AddLocalLights(const AnalyticLights& lights, XMFLOAT3 p, ShZonalBatch* batch) {
+  int order = batch->Order();
+  float delta[s_shMaxOrder];
+  ShZonalDelta(order, delta);
+  float cone[s_shMaxOrder];
+  auto pv = ToXMVector(p);
+
+  for (const auto& light : lights.spots) {
+    auto toLight = XMVectorSubtract(ToXMVector(light.pos), pv);
+    float d2 = std::max(XMVectorGetX(XMVector3LengthSq(toLight)), s_minDistance2);
+    auto l = XMVectorScale(toLight, 1.f / std::sqrt(d2));
+    float cosAngle = -XMVectorGetX(XMVector3Dot(l, XMVector3Normalize(ToXMVector(light.dir))));
+    float falloff =
+        SmoothStep(std::cos(light.outerAngle), std::cos(light.innerAngle), cosAngle) / d2;
+    if (falloff <= 0.f)
+      continue;
+    batch->Add(ToXMFloat3(l), ToXMFloat3(XMVectorScale(ToXMVector(light.color), falloff)), delta);
+  }
+
+  for (const auto& light : lights.spheres) {
+    auto toLight = XMVectorSubtract(ToXMVector(light.pos), pv);
+    float d = std::sqrt(std::max(XMVectorGetX(XMVector3LengthSq(toLight)), s_minDistance2));
+    // Inside the sphere the light comes from everywhere
+    float sinHalfAngle = light.radius / d;
+    float cosHalfAngle = sinHalfAngle < 1.f ? std::sqrt(1.f - sinHalfAngle * sinHalfAngle) : -1.f;
+    ShZonalCone(order, cosHalfAngle, cone);
+    batch->Add(ToXMFloat3(XMVectorScale(toLight, 1.f / d)), light.color, cone);
+  }
+
+  for (const auto& light : lights.discs) {
+    auto toLight = XMVectorSubtract(ToXMVector(light.pos), pv);
+    float d = std::sqrt(std::max(XMVectorGetX(XMVector3LengthSq(toLight)), s_minDistance2));
+    auto l = XMVectorScale(toLight, 1.f / d);
+    float cosEmit = -XMVectorGetX(XMVector3Dot(l, XMVector3Normalize(ToXMVector(light.normal))));
+    if (cosEmit <= 0.f)
+      continue;
+    // Solid angle of the disc seen from its axis at distance d, foreshortened by cosEmit
+    float r2 = light.radius * light.radius;
+    float solidAngle = 2.f * XM_PI * (1.f - d / std::sqrt(d * d + r2)) * cosEmit;
+    ShZonalCone(order, 1.f - solidAngle / (2.f * XM_PI), cone);
+    batch->Add(ToXMFloat3(l), light.color, cone);
+  }
+}
+}  // namespace
+
+ShRgb ProjectAnalyticLights(const AnalyticLights& lights, XMFLOAT3 p, ShZonalBatch* batch) {
+  batch->Clear();
+  AddDirectionalLights(lights, batch);
+  AddLocalLights(lights, p, batch);
+  return batch->Project();
+}
+
+void AddAnalyticLights(const AnalyticLights& lights, IrradianceProbeGrid* probes) {
+  if (lights.Count() == 0)
+    return;
+
+  // Directional lights are the same everywhere, they are projected once
+  ShZonalBatch directionalBatch{s_probeOrder};
+  AddDirectionalLights(lights, &directionalBatch);
+  auto directional = directionalBatch.Project();
+
+  // Irradiance coefficients in the basis of the probes
+  auto toProbe = [](const ShRgb& radiance, int c, int k) {
+    return s_cosineLobe[k] * s_probeBasisSign[k] * radiance.channels[c][k];
+  };
+
+  GlobalThreadPool().ParallelFor(0, probes->ProbeCount(), 16, [&](size_t begin, size_t end) {
+    ShZonalBatch batch{s_probeOrder};
+    for (size_t probe = begin; probe < end; ++probe) {
+      batch.Clear();
+      AddLocalLights(lights, probes->ProbePosition(probe), &batch);
+      auto local = batch.Project();
+      for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < IrradianceProbeGrid::s_coefficientCount; ++k) {
+          probes->Coefficients(c, k)[probe] += toProbe(directional, c, k) + toProbe(local, c, k);
+        }
+      }
+    }
+  });
+}
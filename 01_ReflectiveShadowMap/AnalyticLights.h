@@ -0,0 +1,62 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <vector>
+
+#include "DirectionalLight.h"
+#include "IrradianceProbes.h"
+#include "ShZonal.h"
+#include "SphericalHarmonics.h"
+
+// Point light limited to a cone, with a smooth falloff from "innerAngle" to "outerAngle".
+struct SpotLight {
+  DirectX::XMFLOAT3 pos = {0.f, 0.f, 0.f};
+  DirectX::XMFLOAT3 dir = {0.f, -1.f, 0.f};
+  DirectX::XMFLOAT3 color = {1.f, 1.f, 1.f};  // Intensity, irradiance at distance 1
+  float innerAngle = 0.3f;                     // Half angles in radians
+  float outerAngle = 0.5f;
+};
+
+// Sphere of constant radiance.
+struct SphereLight {
+  DirectX::XMFLOAT3 pos = {0.f, 0.f, 0.f};
+  float radius = 0.1f;
+  DirectX::XMFLOAT3 color = {1.f, 1.f, 1.f};  // Radiance
+};
+
+// Disc of constant radiance, emitting on the side of "normal" only.
+struct DiscLight {
+  DirectX::XMFLOAT3 pos = {0.f, 0.f, 0.f};
+  DirectX::XMFLOAT3 normal = {0.f, -1.f, 0.f};
+  float radius = 0.1f;
+  DirectX::XMFLOAT3 color = {1.f, 1.f, 1.f};  // Radiance
+};
+
+struct AnalyticLights {
+  std::vector<DirectionalLight> directional;  // Only "dir" and "color", the irradiance, are used
+  std::vector<SpotLight> spots;
+  std::vector<SphereLight> spheres;
+  std::vector<DiscLight> discs;
+
+  size_t Count() const {
+    return directional.size() + spots.size() + spheres.size() + discs.size();
+  }
+};
+
+/**
+ * Radiance arriving at "p" from "lights" as SH coefficients, in the convention of the SH library
+ * (with the Condon-Shortley phase). Without shadows, every light seen from a point is symmetric
+ * around the direction to it: directional and spot lights are deltas, spheres are cones of
+ * asin(radius / distance). A disc is replaced by the cone of the same solid angle around its
+ * center, which is exact on its axis and close enough off it for diffuse lighting.
+ * Irradiance, albedo times it being the units of PS, is the convolution with the cosine lobe.
+ * "batch" is scratch space of order "order", reused between calls.
+ */
+ShRgb ProjectAnalyticLights(const AnalyticLights& lights, DirectX::XMFLOAT3 p, ShZonalBatch* batch);
+
+/**
+ * Add the irradiance of "lights" to every probe of "probes". Probes are spread over the shared
+ * thread pool. IrradianceProbeGrid::Update() only rewrites a slice of the probes, so moving lights
+ * are folded into a copy of the grid every frame rather than into the grid itself.
+ */
+void AddAnalyticLights(const AnalyticLights& lights, IrradianceProbeGrid* probes);
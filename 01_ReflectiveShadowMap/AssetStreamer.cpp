@@ -0,0 +1,226 @@
+#include "AssetStreamer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+
+using DX::ThrowIfFailed;
+using Microsoft::WRL::ComPtr;
+
+namespace {
+// Smallest chunk a buffer is copied in, short of its last one, so that the end of the ring is
+// skipped rather than split into slivers
+constexpr size_t s_minChunkSize = 64 << 10;
+}  // namespace
+
+AssetStreamer::AssetStreamer(ID3D12Device* device, size_t stagingSize)
+    : device_{device},
+      staging_{device, stagingSize} {
+  D3D12_COMMAND_QUEUE_DESC queueDesc{};
+  queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+  queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+  ThrowIfFailed(
+      device_->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(copyQueue_.ReleaseAndGetAddressOf())));
+
+  ComPtr<ID3D12CommandAllocator> allocator;
+  ThrowIfFailed(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+                                                IID_PPV_ARGS(allocator.GetAddressOf())));
+  ThrowIfFailed(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, allocator.Get(),
+                                           nullptr,
+                                           IID_PPV_ARGS(commandList_.ReleaseAndGetAddressOf())));
+  ThrowIfFailed(commandList_->Close());
+  freeAllocators_.push_back(std::move(allocator));
+
+  ThrowIfFailed(device_->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+                                     IID_PPV_ARGS(fence_.ReleaseAndGetAddressOf())));
+}
+
+AssetStreamer::~AssetStreamer() {
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    decodedCv_.wait(lock, [this] { return decodingCount_ == 0; });
+  }
+  if (!batches_.empty())
+    WaitForFence(batches_.back().fenceValue);
+}
+
+size_t AssetStreamer::Request(std::function<MeshAssetData()> decode) {
+  size_t id = assets_.size();
+  assets_.push_back(std::make_unique<MeshAsset>());
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++decodingCount_;
+  }
+
+  GlobalThreadPool().Enqueue([this, id, decode = std::move(decode)] {
+    Decoded result{id, {}, nullptr};
+    try {
+      result.data = decode();
+    } catch (...) {
+      result.error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    decoded_.push_back(std::move(result));
+    --decodingCount_;
+    decodedCv_.notify_all();
+  });
+  return id;
+}
+
+std::vector<size_t> AssetStreamer::Pump() {
+  std::vector<size_t> resident;
+  auto completedValue = fence_->GetCompletedValue();
+  while (!batches_.empty() && batches_.front().fenceValue <= completedValue) {
+    auto& batch = batches_.front();
+    stagingUsed_ -= batch.stagingBytes;
+    for (auto id : batch.completedIds) {
+      assets_[id]->resident = true;
+      resident.push_back(id);
+    }
+    residentCount_ += batch.completedIds.size();
+    freeAllocators_.push_back(std::move(batch.allocator));
+    batches_.pop_front();
+  }
+
+  std::deque<Decoded> decoded;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    decoded.swap(decoded_);
+  }
+  for (auto& d : decoded) {
+    if (d.error)
+      std::rethrow_exception(d.error);
+    auto& asset = *assets_[d.id];
+    asset.data = std::move(d.data);
+
+    // Nothing to copy from a file without meshes
+    if (asset.data.submeshes.empty()) {
+      asset.resident = true;
+      resident.push_back(d.id);
+      ++residentCount_;
+      continue;
+    }
+    if (asset.data.VertexCount() == 0 || asset.data.IndexDataByteSize() == 0)
+      throw std::runtime_error{"streamed mesh without vertices or indices"};
+    asset.vBuffer = std::make_unique<DefaultBuffer>(
+        device_, asset.data.VertexCount() * sizeof(QuantizedVertex));
+    asset.iBuffer = std::make_unique<DefaultBuffer>(device_, asset.data.IndexDataByteSize());
+    uploads_.push_back({d.id});
+  }
+  if (uploads_.empty())
+    return resident;
+
+  ComPtr<ID3D12CommandAllocator> allocator;
+  if (freeAllocators_.empty()) {
+    ThrowIfFailed(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+                                                  IID_PPV_ARGS(allocator.GetAddressOf())));
+  } else {
+    allocator = std::move(freeAllocators_.back());
+    freeAllocators_.pop_back();
+  }
+  ThrowIfFailed(allocator->Reset());
+  ThrowIfFailed(commandList_->Reset(allocator.Get(), nullptr));
+
+  // As many chunks as the ring has room for. The buffers start in the common state and are
+  // promoted to copy destinations and decay back with the batch, so no barriers are needed.
+  Batch batch{0, 0, std::move(allocator), {}};
+  bool recorded = false;
+  while (!uploads_.empty()) {
+    auto& upload = uploads_.front();
+    auto& asset = *assets_[upload.id];
+    const auto* source = upload.buffer == 0
+                             ? reinterpret_cast<const std::uint8_t*>(asset.data.Vertices())
+                             : asset.data.IndexData();
+    auto* destination = upload.buffer == 0 ? asset.vBuffer.get() : asset.iBuffer.get();
+    size_t remaining = destination->BufferByteSize() - upload.byteOffset;
+
+    size_t offset = 0;
+    size_t chunk = AllocateStaging(remaining, std::min(remaining, s_minChunkSize), &offset,
+                                   &batch.stagingBytes);
+    if (chunk == 0)
+      break;
+    staging_.LoadBuffer(offset, source + upload.byteOffset, chunk);
+    commandList_->CopyBufferRegion(destination->Resource(), upload.byteOffset,
+                                   staging_.Resource(), offset, chunk);
+    recorded = true;
+
+    upload.byteOffset += chunk;
+    if (upload.byteOffset < destination->BufferByteSize())
+      continue;
+    if (upload.buffer == 0) {
+      upload.buffer = 1;
+      upload.byteOffset = 0;
+      continue;
+    }
+    batch.completedIds.push_back(upload.id);
+    uploads_.pop_front();
+  }
+  ThrowIfFailed(commandList_->Close());
+  if (!recorded) {
+    freeAllocators_.push_back(std::move(batch.allocator));
+    return resident;
+  }
+
+  ID3D12CommandList* commandLists[] = {commandList_.Get()};
+  copyQueue_->ExecuteCommandLists(_countof(commandLists), commandLists);
+  batch.fenceValue = ++nextFenceValue_;
+  ThrowIfFailed(copyQueue_->Signal(fence_.Get(), batch.fenceValue));
+  batches_.push_back(std::move(batch));
+  return resident;
+}
+
+void AssetStreamer::ReleaseCpuCopy(size_t id) {
+  auto& asset = *assets_[id];
+  if (!asset.resident)
+    throw std::runtime_error{"releasing the CPU copy of a mesh that is not resident"};
+  asset.data.ReleaseCpuCopy();
+}
+
+void AssetStreamer::WaitForProgress() {
+  if (!batches_.empty()) {
+    WaitForFence(batches_.front().fenceValue);
+    return;
+  }
+  std::unique_lock<std::mutex> lock{mutex_};
+  decodedCv_.wait(lock, [this] { return !decoded_.empty() || decodingCount_ == 0; });
+}
+
+size_t AssetStreamer::AllocateStaging(size_t size, size_t minSize, size_t* offset,
+                                      size_t* batchBytes) {
+  size_t capacity = staging_.BufferByteSize();
+  if (stagingUsed_ == 0)
+    stagingHead_ = 0;
+  if (stagingUsed_ == capacity)
+    return 0;
+
+  // The free bytes run from the head to the tail, around the end of the ring when the tail is
+  // not ahead of the head. A too short run up to the end is skipped and freed with the batch.
+  size_t tail = (stagingHead_ + capacity - stagingUsed_) % capacity;
+  size_t contiguous = tail > stagingHead_ ? tail - stagingHead_ : capacity - stagingHead_;
+  if (contiguous < minSize && tail <= stagingHead_ && tail >= minSize) {
+    stagingUsed_ += contiguous;
+    *batchBytes += contiguous;
+    stagingHead_ = 0;
+    contiguous = tail;
+  }
+
+  size_t allocated = std::min(size, contiguous);
+  if (allocated < minSize)
+    return 0;
+  *offset = stagingHead_;
+  stagingHead_ = (stagingHead_ + allocated) % capacity;
+  stagingUsed_ += allocated;
+  *batchBytes += allocated;
+  return allocated;
+}
+
+void AssetStreamer::WaitForFence(UINT64 fenceValue) const {
+  if (fence_->GetCompletedValue() >= fenceValue)
+    return;
+  auto event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  ThrowIfFailed(fence_->SetEventOnCompletion(fenceValue, event));
+  WaitForSingleObject(event, INFINITE);
+  CloseHandle(event);
+}
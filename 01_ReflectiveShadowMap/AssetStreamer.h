@@ -0,0 +1,151 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "DefaultBuffer.h"
+#include "Model.h"
+#include "UploadBuffer.h"
+
+/**
+ * Vertices, indices and meshlets of a mesh, with its submeshes. The vertices and indices stay in
+ * "model", mapped from the mesh cache or imported, and are staged from there without another
+ * copy. Generated meshes keep theirs in the owned arrays.
+ */
+struct MeshAssetData {
+  std::unique_ptr<ObjModel> model;
+  std::vector<QuantizedVertex> ownedVertices;
+  std::vector<std::uint8_t> ownedIndexData;
+  std::vector<Meshlet> meshlets;  // Kept after ReleaseCpuCopy(), for meshlet culling
+  std::vector<Submesh> submeshes;
+
+  const QuantizedVertex* Vertices() const {
+    return model ? model->QuantizedVerticesBegin() : ownedVertices.data();
+  }
+
+  size_t VertexCount() const { return model ? model->VertexCount() : ownedVertices.size(); }
+
+  const std::uint8_t* IndexData() const {
+    return model ? model->IndexData() : ownedIndexData.data();
+  }
+
+  size_t IndexDataByteSize() const {
+    return model ? model->IndexDataByteSize() : ownedIndexData.size();
+  }
+
+  // Drop the vertices and indices, unmapping the cache of "model"
+  void ReleaseCpuCopy() {
+    model.reset();
+    ownedVertices = {};
+    ownedIndexData = {};
+  }
+};
+
+// A streamed mesh in a vertex and an index buffer of its own.
+struct MeshAsset {
+  // CPU side, until the PRT bake and the CPU reference renderers no longer need the vertices
+  MeshAssetData data;
+  std::unique_ptr<DefaultBuffer> vBuffer;
+  std::unique_ptr<DefaultBuffer> iBuffer;
+  bool resident = false;  // Its buffers are filled and may be drawn from
+};
+
+/**
+ * Streams meshes onto the GPU without blocking the render loop. Meshes are decoded on the global
+ * thread pool, staged into one ring of upload memory, and copied on a copy queue in one batch per
+ * Pump(), large meshes in chunks over several batches. A mesh becomes resident once the fence of
+ * the batch with its last chunk completes, and the ring space of a batch is reused from then on.
+ */
+class AssetStreamer {
+public:
+  static constexpr size_t s_defaultStagingSize = 32 << 20;
+
+  explicit AssetStreamer(ID3D12Device* device, size_t stagingSize = s_defaultStagingSize);
+
+  AssetStreamer(const AssetStreamer& other) = delete;
+  AssetStreamer& operator=(const AssetStreamer& other) = delete;
+
+  // Waits for the decodes and copies in flight.
+  ~AssetStreamer();
+
+  // Decode a mesh with "decode" on a worker thread. Returns its id, the index of its asset.
+  size_t Request(std::function<MeshAssetData()> decode);
+
+  /**
+   * Stage the meshes decoded so far, submit their copies as one batch, and return the ids of the
+   * meshes that became resident since the last call. Called once per frame on the render thread.
+   * Rethrows what a decode threw.
+   */
+  std::vector<size_t> Pump();
+
+  // Block until a copy batch completes or a decode finishes, if any is in flight.
+  void WaitForProgress();
+
+  const MeshAsset& Asset(size_t id) const { return *assets_[id]; }
+
+  // Drop the CPU copy of the vertices and indices of a resident mesh, see MeshAssetData.
+  void ReleaseCpuCopy(size_t id);
+
+  size_t AssetCount() const { return assets_.size(); }
+
+  // Whether every requested mesh is resident
+  bool IsIdle() const { return residentCount_ == assets_.size(); }
+
+private:
+  struct Decoded {
+    size_t id;
+    MeshAssetData data;
+    std::exception_ptr error;
+  };
+
+  // Bytes of a decoded mesh left to copy
+  struct Upload {
+    size_t id;
+    size_t buffer = 0;  // 0 for the vertices, 1 for the indices
+    size_t byteOffset = 0;
+  };
+
+  struct Batch {
+    UINT64 fenceValue;
+    size_t stagingBytes;  // Of the ring, wrapped around ones included
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+    std::vector<size_t> completedIds;  // Resident once the batch completes
+  };
+
+  ID3D12Device* device_;
+  Microsoft::WRL::ComPtr<ID3D12CommandQueue> copyQueue_;
+  Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList_;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> freeAllocators_;
+  Microsoft::WRL::ComPtr<ID3D12Fence> fence_;
+  UINT64 nextFenceValue_ = 0;
+
+  // Staging ring, allocated from "stagingHead_" on and freed in batch order
+  UploadBuffer<std::uint8_t> staging_;
+  size_t stagingHead_ = 0;
+  size_t stagingUsed_ = 0;
+
+  std::vector<std::unique_ptr<MeshAsset>> assets_;
+  size_t residentCount_ = 0;
+  std::deque<Upload> uploads_;
+  std::deque<Batch> batches_;
+
+  // Shared with the decoding workers
+  std::mutex mutex_;
+  std::condition_variable decodedCv_;
+  std::deque<Decoded> decoded_;
+  size_t decodingCount_ = 0;
+
+  // Up to "size" contiguous bytes of the ring and at least "minSize" of them, or 0 bytes
+  size_t AllocateStaging(size_t size, size_t minSize, size_t* offset, size_t* batchBytes);
+
+  void WaitForFence(UINT64 fenceValue) const;
+};
@@ -0,0 +1,495 @@
+#include "Bvh.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DirectX;
+
+namespace {
+constexpr int s_binCount = 16;
+constexpr int s_stackSize = 128;
+
+// Vector version of the inverse in Traverse(), for the four rays of a packet
+__m128 SafeInverse(__m128 d) {
+  const __m128 tiny = _mm_set1_ps(1e-20f);
+  const __m128 signMask = _mm_set1_ps(-0.f);
+  __m128 magnitude = _mm_andnot_ps(signMask, d);
+  __m128 replaced = _mm_or_ps(tiny, _mm_and_ps(signMask, d));
+  __m128 small = _mm_cmple_ps(magnitude, tiny);
+  __m128 safe = _mm_or_ps(_mm_and_ps(small, replaced), _mm_andnot_ps(small, d));
+  return _mm_div_ps(_mm_set1_ps(1.f), safe);
+}
+
+float SurfaceArea(const Bounds& b) {
+  auto e = b.Extent();
+  if (e.x < 0.f)
+    return 0.f;
+  return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void Merge(Bounds* a, const Bounds& b) {
+  a->Expand(b.min);
+  a->Expand(b.max);
+}
+
+float Axis(const XMFLOAT3& v, int axis) {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Binary tree built first, collapsed into the 4-wide layout afterwards
+struct BuildNode {
+  Bounds bounds;
+  int left = -1;  // -1 for leaves
+  int right = -1;
+  std::uint32_t first = 0;
+  std::uint32_t count = 0;
+};
+
+class BinaryBuilder {
+public:
+  BinaryBuilder(std::vector<Bounds> triangleBounds, std::vector<XMFLOAT3> centroids)
+      : triangleBounds_{std::move(triangleBounds)}, centroids_{std::move(centroids)} {
+    order.resize(triangleBounds_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = static_cast<std::uint32_t>(i);
+    }
+  }
+
+  int Build(std::uint32_t first, std::uint32_t count) {
+    BuildNode node;
+    Bounds centroidBounds;
+    for (std::uint32_t i = first; i < first + count; ++i) {
+      Merge(&node.bounds, triangleBounds_[order[i]]);
+      centroidBounds.Expand(centroids_[order[i]]);
+    }
+
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(node);
+
+    if (count <= static_cast<std::uint32_t>(Bvh::s_maxLeafSize)) {
+      nodes[index].first = first;
+      nodes[index].count = count;
+      return index;
+    }
+
+    std::uint32_t mid = Split(first, count, centroidBounds);
+    int left = Build(first, mid - first);
+    int right = Build(mid, first + count - mid);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+  }
+
+  std::vector<BuildNode> nodes;
+  std::vector<std::uint32_t> order;
+
+private:
+  std::vector<Bounds> triangleBounds_;
+  std::vector<XMFLOAT3> centroids_;
+
+  // Binned SAH split along the longest centroid axis. Falls back to a median split when all
+  // centroids land in one bin.
+  std::uint32_t Split(std::uint32_t first, std::uint32_t count, const Bounds& centroidBounds) {
+    auto extent = centroidBounds.Extent();
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    float lo = Axis(centroidBounds.min, axis);
+    float size = Axis(extent, axis);
+
+    auto begin = order.begin() + first;
+    auto end = begin + count;
+    auto medianSplit = [&] {
+      std::nth_element(begin, begin + count / 2, end, [&](std::uint32_t a, std::uint32_t b) {
+        return Axis(centroids_[a], axis) < Axis(centroids_[b], axis);
+      });
+      return first + count / 2;
+    };
+    if (size <= 0.f)
+      return medianSplit();
+
+    auto binOf = [&](std::uint32_t tri) {
+      int bin = static_cast<int>((Axis(centroids_[tri], axis) - lo) / size * s_binCount);
+      return std::clamp(bin, 0, s_binCount - 1);
+    };
+
+    std::array<Bounds, s_binCount> binBounds;
+    std::array<std::uint32_t, s_binCount> binCounts{};
+    for (auto it = begin; it != end; ++it) {
+      int bin = binOf(*it);
+      Merge(&binBounds[bin], triangleBounds_[*it]);
+      ++binCounts[bin];
+    }
+
+    // Sweep from the right to get the cost of every right side, then from the left
+    std::array<float, s_binCount> rightCost{};
+    Bounds right;
+    std::uint32_t rightCount = 0;
+    for (int i = s_binCount - 1; i > 0; --i) {
+      Merge(&right, binBounds[i]);
+      rightCount += binCounts[i];
+      rightCost[i] = rightCount ? SurfaceArea(right) * rightCount : 0.f;
+    }
+
+    Bounds left;
+    std::uint32_t leftCount = 0;
+    float bestCost = FLT_MAX;
+    int bestBin = -1;
+    for (int i = 0; i < s_binCount - 1; ++i) {
+      Merge(&left, binBounds[i]);
+      leftCount += binCounts[i];
+      if (leftCount == 0 || leftCount == count)
+        continue;
+      float cost = SurfaceArea(left) * leftCount + rightCost[i + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestBin = i;
+      }
+    }
+    if (bestBin < 0)
+      return medianSplit();
+
+    auto mid = std::partition(begin, end, [&](std::uint32_t tri) { return binOf(tri) <= bestBin; });
+    return first + static_cast<std::uint32_t>(mid - begin);
+  }
+};
+}  // namespace
+
+Bvh::Bvh(const CpuScene& scene) {
+  size_t triangleCount = scene.TriangleCount();
+  if (triangleCount == 0)
+    throw std::runtime_error{"cannot build a BVH over an empty scene"};
+
+  std::vector<Bounds> triangleBounds(triangleCount);
+  std::vector<XMFLOAT3> centroids(triangleCount);
+  for (size_t i = 0; i < triangleCount; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      triangleBounds[i].Expand(scene.positions[scene.indices[3 * i + k]]);
+    }
+    centroids[i] = triangleBounds[i].Center();
+  }
+
+  BinaryBuilder builder{std::move(triangleBounds), std::move(centroids)};
+  builder.Build(0, static_cast<std::uint32_t>(triangleCount));
+
+  // Triangle data in leaf order
+  triangles_.resize(triangleCount);
+  triangleIds_ = builder.order;
+  for (size_t i = 0; i < triangleCount; ++i) {
+    size_t tri = triangleIds_[i];
+    auto v0 = ToXMVector(scene.positions[scene.indices[3 * tri]]);
+    auto v1 = ToXMVector(scene.positions[scene.indices[3 * tri + 1]]);
+    auto v2 = ToXMVector(scene.positions[scene.indices[3 * tri + 2]]);
+    triangles_[i] = {ToXMFloat3(v0), ToXMFloat3(v1 - v0), ToXMFloat3(v2 - v0)};
+  }
+
+  // Collapse: every 4-wide node opens the largest inner children of a binary node until it has
+  // four of them.
+  const auto& binary = builder.nodes;
+  auto collapse = [&](auto&& self, int binaryIndex) -> std::int32_t {
+    std::vector<int> children = {binary[binaryIndex].left, binary[binaryIndex].right};
+    while (children.size() < 4) {
+      int largest = -1;
+      float largestArea = -1.f;
+      for (size_t i = 0; i < children.size(); ++i) {
+        const auto& c = binary[children[i]];
+        if (c.left >= 0 && SurfaceArea(c.bounds) > largestArea) {
+          largestArea = SurfaceArea(c.bounds);
+          largest = static_cast<int>(i);
+        }
+      }
+      if (largest < 0)
+        break;
+      int opened = children[largest];
+      children[largest] = binary[opened].left;
+      children.push_back(binary[opened].right);
+    }
+
+    auto index = static_cast<std::int32_t>(nodes_.size());
+    nodes_.push_back(EmptyNode());
+    nodes_[index].childCount = static_cast<int>(children.size());
+    for (int i = 0; i < nodes_[index].childCount; ++i) {
+      Node& node = nodes_[index];
+      const auto& c = binary[children[i]];
+      node.minX[i] = c.bounds.min.x;
+      node.minY[i] = c.bounds.min.y;
+      node.minZ[i] = c.bounds.min.z;
+      node.maxX[i] = c.bounds.max.x;
+      node.maxY[i] = c.bounds.max.y;
+      node.maxZ[i] = c.bounds.max.z;
+
+      std::int32_t child;
+      if (c.left < 0) {
+        child = ~static_cast<std::int32_t>(leaves_.size());
+        leaves_.push_back({c.first, c.count});
+      } else {
+        child = self(self, children[i]);
+      }
+      nodes_[index].child[i] = child;  // "node" may dangle after the recursion grew nodes_
+    }
+    return index;
+  };
+
+  if (binary[0].left < 0) {
+    // A single leaf: wrap it into a root with one used slot
+    leaves_.push_back({binary[0].first, binary[0].count});
+    Node root = EmptyNode();
+    root.childCount = 1;
+    root.child[0] = ~static_cast<std::int32_t>(0);
+    root.minX[0] = binary[0].bounds.min.x;
+    root.minY[0] = binary[0].bounds.min.y;
+    root.minZ[0] = binary[0].bounds.min.z;
+    root.maxX[0] = binary[0].bounds.max.x;
+    root.maxY[0] = binary[0].bounds.max.y;
+    root.maxZ[0] = binary[0].bounds.max.z;
+    nodes_.push_back(root);
+  } else {
+    collapse(collapse, 0);
+  }
+}
+
+Bvh::Node Bvh::EmptyNode() {
+  Node node{};
+  for (int i = 0; i < 4; ++i) {
+    node.minX[i] = node.minY[i] = node.minZ[i] = 0.f;
+    node.maxX[i] = node.maxY[i] = node.maxZ[i] = 0.f;
+    node.child[i] = 0;
+  }
+  node.childCount = 0;
+  return node;
+}
+
+size_t Bvh::MemoryByteSize() const {
+  return nodes_.size() * sizeof(Node) + leaves_.size() * sizeof(Leaf) +
+         triangles_.size() * sizeof(Triangle) + triangleIds_.size() * sizeof(std::uint32_t);
+}
+
+void RayPacket::Set(int i, const Ray& ray) {
+  originX[i] = ray.origin.x;
+  originY[i] = ray.origin.y;
+  originZ[i] = ray.origin.z;
+  directionX[i] = ray.direction.x;
+  directionY[i] = ray.direction.y;
+  directionZ[i] = ray.direction.z;
+  tMax[i] = ray.tMax;
+}
+
+bool Bvh::Intersect(const Ray& ray, RayHit* hit) const {
+  return Traverse<false>(ray, hit);
+}
+
+bool Bvh::Occluded(const Ray& ray) const {
+  RayHit hit;
+  return Traverse<true>(ray, &hit);
+}
+
+template<bool anyHit>
+bool Bvh::Traverse(const Ray& ray, RayHit* hit) const {
+  // Avoid infinities (and 0 * inf = NaN) in the slab test for axis-parallel rays
+  auto safeInverse = [](float d) {
+    constexpr float tiny = 1e-20f;
+    return 1.f / (std::abs(d) > tiny ? d : std::copysign(tiny, d));
+  };
+  const auto& d = ray.direction;
+  const auto& o = ray.origin;
+  float invX = safeInverse(d.x);
+  float invY = safeInverse(d.y);
+  float invZ = safeInverse(d.z);
+
+  __m128 originX = _mm_set1_ps(o.x);
+  __m128 originY = _mm_set1_ps(o.y);
+  __m128 originZ = _mm_set1_ps(o.z);
+  __m128 inverseX = _mm_set1_ps(invX);
+  __m128 inverseY = _mm_set1_ps(invY);
+  __m128 inverseZ = _mm_set1_ps(invZ);
+
+  float tMax = ray.tMax;
+  bool found = false;
+
+  std::int32_t stack[s_stackSize];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    std::int32_t entry = stack[--stackSize];
+
+    if (entry < 0) {
+      // Leaf
+      const Leaf& leaf = leaves_[~entry];
+      for (std::uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+        const Triangle& tri = triangles_[i];
+        // Moller-Trumbore
+        float px = d.y * tri.e2.z - d.z * tri.e2.y;
+        float py = d.z * tri.e2.x - d.x * tri.e2.z;
+        float pz = d.x * tri.e2.y - d.y * tri.e2.x;
+        float det = tri.e1.x * px + tri.e1.y * py + tri.e1.z * pz;
+        if (std::abs(det) < 1e-12f)
+          continue;
+        float invDet = 1.f / det;
+
+        float sx = o.x - tri.v0.x;
+        float sy = o.y - tri.v0.y;
+        float sz = o.z - tri.v0.z;
+        float u = (sx * px + sy * py + sz * pz) * invDet;
+        if (u < 0.f || u > 1.f)
+          continue;
+
+        float qx = sy * tri.e1.z - sz * tri.e1.y;
+        float qy = sz * tri.e1.x - sx * tri.e1.z;
+        float qz = sx * tri.e1.y - sy * tri.e1.x;
+        float v = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+        if (v < 0.f || u + v > 1.f)
+          continue;
+
+        float t = (tri.e2.x * qx + tri.e2.y * qy + tri.e2.z * qz) * invDet;
+        if (t <= 0.f || t >= tMax)
+          continue;
+
+        if constexpr (anyHit) {
+          return true;
+        }
+        tMax = t;
+        found = true;
+        hit->t = t;
+        hit->triangle = triangleIds_[i];
+        hit->u = u;
+        hit->v = v;
+      }
+      continue;
+    }
+
+    // Four slab tests at once
+    const Node& node = nodes_[entry];
+    __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX);
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+    __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+    __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+    __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                              _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+    __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                             _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & ((1 << node.childCount) - 1);
+    if (mask == 0)
+      continue;
+
+    alignas(16) float nearDistances[4];
+    _mm_store_ps(nearDistances, tNear);
+
+    // Push far children first so the nearest one is popped next
+    int order[4];
+    int hitCount = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (mask & (1 << i)) {
+        int j = hitCount++;
+        while (j > 0 && nearDistances[order[j - 1]] < nearDistances[i]) {
+          order[j] = order[j - 1];
+          --j;
+        }
+        order[j] = i;
+      }
+    }
+    for (int i = 0; i < hitCount; ++i) {
+      stack[stackSize++] = node.child[order[i]];
+    }
+  }
+
+  return found;
+}
+
+int Bvh::OccludedPacket(const RayPacket& packet, int activeMask) const {
+  __m128 ox = _mm_load_ps(packet.originX);
+  __m128 oy = _mm_load_ps(packet.originY);
+  __m128 oz = _mm_load_ps(packet.originZ);
+  __m128 dx = _mm_load_ps(packet.directionX);
+  __m128 dy = _mm_load_ps(packet.directionY);
+  __m128 dz = _mm_load_ps(packet.directionZ);
+  __m128 tMax = _mm_load_ps(packet.tMax);
+  __m128 invX = SafeInverse(dx);
+  __m128 invY = SafeInverse(dy);
+  __m128 invZ = SafeInverse(dz);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+
+  int occluded = 0;
+
+  std::int32_t stack[s_stackSize];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0 && occluded != activeMask) {
+    std::int32_t entry = stack[--stackSize];
+    int pending = activeMask & ~occluded;
+
+    if (entry < 0) {
+      // Leaf: Moller-Trumbore for the four rays against one triangle at a time
+      const Leaf& leaf = leaves_[~entry];
+      for (std::uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+        const Triangle& tri = triangles_[i];
+        __m128 e1x = _mm_set1_ps(tri.e1.x);
+        __m128 e1y = _mm_set1_ps(tri.e1.y);
+        __m128 e1z = _mm_set1_ps(tri.e1.z);
+        __m128 e2x = _mm_set1_ps(tri.e2.x);
+        __m128 e2y = _mm_set1_ps(tri.e2.y);
+        __m128 e2z = _mm_set1_ps(tri.e2.z);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                                _mm_mul_ps(e1z, pz));
+        __m128 invDet = _mm_div_ps(one, det);
+
+        __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(tri.v0.x));
+        __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(tri.v0.y));
+        __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(tri.v0.z));
+        __m128 u = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)),
+            invDet);
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+            invDet);
+        __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+            invDet);
+
+        // A zero determinant gives infinities or NaNs, which fail these comparisons
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, tMax)));
+        occluded |= _mm_movemask_ps(inside) & pending;
+        if (occluded == activeMask)
+          break;
+      }
+      continue;
+    }
+
+    // Enter a child if any still pending ray hits its box
+    const Node& node = nodes_[entry];
+    for (int c = 0; c < node.childCount; ++c) {
+      __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minX[c]), ox), invX);
+      __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxX[c]), ox), invX);
+      __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minY[c]), oy), invY);
+      __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxY[c]), oy), invY);
+      __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minZ[c]), oz), invZ);
+      __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxZ[c]), oz), invZ);
+
+      __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                _mm_max_ps(_mm_min_ps(t0z, t1z), zero));
+      __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                               _mm_min_ps(_mm_max_ps(t0z, t1z), tMax));
+      if (_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & pending)
+        stack[stackSize++] = node.child[c];
+    }
+  }
+
+  return occluded;
+}
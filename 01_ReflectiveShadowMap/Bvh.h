@@ -0,0 +1,94 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "CpuScene.h"
+
+struct Ray {
+  DirectX::XMFLOAT3 origin;
+  DirectX::XMFLOAT3 direction;  // Need not be normalized, "t" is in units of its length
+  float tMax = FLT_MAX;
+};
+
+struct RayHit {
+  float t = FLT_MAX;
+  std::uint32_t triangle = 0;  // Index into CpuScene's triangles
+  float u = 0.f;               // Barycentric weight of the second vertex
+  float v = 0.f;               // Barycentric weight of the third vertex
+};
+
+// Four rays in structure of arrays layout, traced together by Bvh::OccludedPacket().
+struct RayPacket {
+  static constexpr int s_size = 4;
+
+  alignas(16) float originX[s_size];
+  alignas(16) float originY[s_size];
+  alignas(16) float originZ[s_size];
+  alignas(16) float directionX[s_size];
+  alignas(16) float directionY[s_size];
+  alignas(16) float directionZ[s_size];
+  alignas(16) float tMax[s_size];
+
+  void Set(int i, const Ray& ray);
+};
+
+/**
+ * Bounding volume hierarchy with four children per node over the triangles of a CpuScene.
+ * Built as a binary tree with binned SAH, then collapsed so that each traversal step tests four
+ * boxes at once with SSE. Leaves hold up to s_maxLeafSize triangles.
+ */
+class Bvh {
+public:
+  static constexpr int s_maxLeafSize = 4;
+
+  explicit Bvh(const CpuScene& scene);
+
+  // Closest hit with t in (0, ray.tMax).
+  bool Intersect(const Ray& ray, RayHit* hit) const;
+
+  // Whether anything is hit with t in (0, ray.tMax). Stops at the first hit.
+  bool Occluded(const Ray& ray) const;
+
+  // Any-hit test of the rays of "packet" selected by "activeMask". Returns a mask of the rays that
+  // are occluded. A node is entered if any active ray hits its box, so this pays off for coherent
+  // rays such as shadow rays leaving one point.
+  int OccludedPacket(const RayPacket& packet, int activeMask) const;
+
+  size_t NodeCount() const { return nodes_.size(); }
+
+  size_t MemoryByteSize() const;
+
+private:
+  // Children are inner nodes (index >= 0) or leaves (~index into leaves_). Only the first
+  // "childCount" slots are used.
+  struct alignas(16) Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    std::int32_t child[4];
+    int childCount;
+  };
+
+  struct Leaf {
+    std::uint32_t first;
+    std::uint32_t count;
+  };
+
+  // Vertex and edges for Moller-Trumbore, in the order of "triangles_"
+  struct Triangle {
+    DirectX::XMFLOAT3 v0;
+    DirectX::XMFLOAT3 e1;
+    DirectX::XMFLOAT3 e2;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<Leaf> leaves_;
+  std::vector<Triangle> triangles_;
+  std::vector<std::uint32_t> triangleIds_;  // Scene triangle index of triangles_[i]
+
+  static Node EmptyNode();
+
+  template<bool anyHit>
+  bool Traverse(const Ray& ray, RayHit* hit) const;
+};
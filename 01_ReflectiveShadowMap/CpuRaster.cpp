@@ -0,0 +1,121 @@
+#include "CpuRaster.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+struct ClipVertex {
+  float x, y;   // Pixel coordinates
+  float invW;   // 1 / clip w
+  float viewZ;  // Linear view depth
+};
+
+// Rows handled by one task. Each task rasterizes every triangle clipped to its own rows,
+// so no two tasks ever write the same pixel.
+constexpr int s_rowsPerTask = 16;
+}  // namespace
+
+GBuffer RasterizeGBuffer(const CpuScene& scene, FXMMATRIX view, CXMMATRIX proj, int width,
+                         int height) {
+  GBuffer g;
+  g.width = width;
+  g.height = height;
+  g.depth.assign(g.PixelCount(), FLT_MAX);
+  g.position.assign(g.PixelCount(), {0.f, 0.f, 0.f});
+  g.normal.assign(g.PixelCount(), {0.f, 0.f, 0.f});
+  g.albedo.assign(g.PixelCount(), {0.f, 0.f, 0.f});
+
+  auto viewProj = XMMatrixMultiply(view, proj);
+
+  std::vector<ClipVertex> verts(scene.positions.size());
+  std::vector<bool> visible(scene.positions.size());
+  for (size_t i = 0; i < scene.positions.size(); ++i) {
+    auto p = ToXMVector(scene.positions[i]);
+    auto clip = XMVector4Transform(XMVectorSetW(p, 1.f), viewProj);
+    float w = XMVectorGetW(clip);
+    auto& v = verts[i];
+    v.viewZ = XMVectorGetZ(XMVector3TransformCoord(p, view));
+    visible[i] = w > 1e-6f && v.viewZ > 0.f;
+    v.invW = visible[i] ? 1.f / w : 0.f;
+    v.x = (XMVectorGetX(clip) * v.invW + 1.f) * 0.5f * width;
+    v.y = (1.f - XMVectorGetY(clip) * v.invW) * 0.5f * height;
+  }
+
+  int taskCount = (height + s_rowsPerTask - 1) / s_rowsPerTask;
+  GlobalThreadPool().ParallelFor(0, taskCount, 1, [&](size_t taskBegin, size_t taskEnd) {
+    for (size_t task = taskBegin; task < taskEnd; ++task) {
+      int rowBegin = static_cast<int>(task) * s_rowsPerTask;
+      int rowEnd = std::min(rowBegin + s_rowsPerTask, height);
+
+      for (size_t t = 0; t < scene.TriangleCount(); ++t) {
+        auto i0 = scene.indices[3 * t];
+        auto i1 = scene.indices[3 * t + 1];
+        auto i2 = scene.indices[3 * t + 2];
+        // No near plane clipping. Triangles crossing the near plane are dropped entirely.
+        if (!visible[i0] || !visible[i1] || !visible[i2])
+          continue;
+
+        const auto& a = verts[i0];
+        const auto& b = verts[i1];
+        const auto& c = verts[i2];
+
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::abs(area) < 1e-12f)
+          continue;
+
+        int minX = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+        int maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+        int minY = std::max(rowBegin, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+        int maxY = std::min(rowEnd - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+        if (minX > maxX || minY > maxY)
+          continue;
+
+        float invArea = 1.f / area;
+        for (int y = minY; y <= maxY; ++y) {
+          float py = y + 0.5f;
+          for (int x = minX; x <= maxX; ++x) {
+            float px = x + 0.5f;
+            float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * invArea;
+            float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * invArea;
+            float w2 = 1.f - w0 - w1;
+            if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+              continue;
+
+            // Perspective correct barycentrics
+            float p0 = w0 * a.invW;
+            float p1 = w1 * b.invW;
+            float p2 = w2 * c.invW;
+            float norm = 1.f / (p0 + p1 + p2);
+            p0 *= norm;
+            p1 *= norm;
+            p2 *= norm;
+
+            float z = p0 * a.viewZ + p1 * b.viewZ + p2 * c.viewZ;
+            size_t pixel = static_cast<size_t>(y) * width + x;
+            if (z >= g.depth[pixel])
+              continue;
+
+            auto interpolate = [&](const std::vector<XMFLOAT3>& attr) {
+              const auto& v0 = attr[i0];
+              const auto& v1 = attr[i1];
+              const auto& v2 = attr[i2];
+              return XMFLOAT3{p0 * v0.x + p1 * v1.x + p2 * v2.x, p0 * v0.y + p1 * v1.y + p2 * v2.y,
+                              p0 * v0.z + p1 * v1.z + p2 * v2.z};
+            };
+
+            g.depth[pixel] = z;
+            g.position[pixel] = interpolate(scene.positions);
+            g.normal[pixel] = ToXMFloat3(XMVector3Normalize(ToXMVector(interpolate(scene.normals))));
+            g.albedo[pixel] = scene.albedos[t];
+          }
+        }
+      }
+    }
+  });
+
+  return g;
+}
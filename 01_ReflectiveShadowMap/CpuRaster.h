@@ -0,0 +1,29 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <vector>
+
+#include "CpuScene.h"
+
+/**
+ * Per-pixel surface attributes seen from one view.
+ * Pixel (0, 0) is the top-left one, the same as D3D render targets.
+ * "depth" is the linear view space depth, or +inf if no triangle covers the pixel.
+ */
+struct GBuffer {
+  int width = 0;
+  int height = 0;
+  std::vector<float> depth;
+  std::vector<DirectX::XMFLOAT3> position;  // World position
+  std::vector<DirectX::XMFLOAT3> normal;    // World normal
+  std::vector<DirectX::XMFLOAT3> albedo;
+
+  size_t PixelCount() const { return static_cast<size_t>(width) * height; }
+
+  bool IsCovered(size_t i) const { return depth[i] < FLT_MAX; }
+};
+
+// Rasterize the scene with the same conventions as the D3D pipeline (row vectors, LH, z in [0, 1]).
+// Works for both perspective and orthographic projections. No back-face culling.
+GBuffer RasterizeGBuffer(const CpuScene& scene, DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj,
+                         int width, int height);
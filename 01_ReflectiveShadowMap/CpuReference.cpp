@@ -0,0 +1,333 @@
+#include "CpuReference.h"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#include "AnalyticLights.h"
+#include "Bvh.h"
+#include "CpuRaster.h"
+#include "PathTracer.h"
+#include "PrtRuntime.h"
+#include "Random.h"
+#include "RsmVisibility.h"
+#include "Timer.h"
+
+namespace {
+class StageTimer {
+public:
+  explicit StageTimer(std::ofstream* report) : report_{report} {}
+
+  void Begin() {
+    timer_.Reset();
+    timer_.Start();
+  }
+
+  void End(const std::string& stage) {
+    timer_.Pause();
+    *report_ << stage << ": " << timer_.TimeElapsed().count() << " ms\n";
+  }
+
+private:
+  std::ofstream* report_;
+  Timer<FloatMilliseconds> timer_;
+};
+
+// Sum of all channels of all pixels
+double Energy(const Image& image) {
+  return std::accumulate(image.pixels.begin(), image.pixels.end(), 0.0,
+                         [](double sum, const DirectX::XMFLOAT3& c) {
+    return sum + c.x + c.y + c.z;
+  });
+}
+
+// Vertices per millisecond that PrtRelighter shades at every order, on one thread and on all of
+// them. The transfer is random, which costs the same as a baked one.
+void BenchmarkPrtRelight(const CpuScene& scene, std::ofstream* report) {
+  constexpr int repeats = 20;
+  for (int order = 3; order <= 6; ++order) {
+    PrtTransfer transfer;
+    transfer.order = order;
+    transfer.vertexCount = scene.positions.size();
+    transfer.coefficients.resize(transfer.vertexCount * transfer.CoefficientCount());
+    Rng rng{Hash(static_cast<std::uint32_t>(order))};
+    for (auto& t : transfer.coefficients) {
+      t = rng.Next() - 0.5f;
+    }
+
+    PrtRelighter relighter{transfer, scene.meshes};
+    auto light = ProjectDirectionalLight(MakeSceneDefaultDirectionalLight(), order);
+    std::vector<DirectX::XMFLOAT4> colors;
+
+    *report << "prt relight order " << order << ":";
+    for (bool parallel : {false, true}) {
+      relighter.Relight(light, parallel, &colors);  // Warm up
+      Timer<FloatMilliseconds> timer;
+      timer.Start();
+      for (int i = 0; i < repeats; ++i) {
+        relighter.Relight(light, parallel, &colors);
+      }
+      timer.Pause();
+      double vertices = static_cast<double>(transfer.vertexCount) * repeats;
+      *report << (parallel ? ", all threads " : " one thread ")
+              << vertices / timer.TimeElapsed().count() << " vertices/ms";
+    }
+    *report << "\n";
+  }
+}
+
+// Vertex AO through the shared integrator: the time of a bake with many samples, and how far
+// bakes with fewer samples of every sequence are from it
+void BenchmarkAoBake(const CpuScene& scene, const Bvh& bvh, std::ofstream* report) {
+  VertexAoSettings settings;
+  settings.sampleCount = 4096;
+  Timer<FloatMilliseconds> timer;
+  timer.Start();
+  auto reference = BakeVertexAmbientOcclusion(scene, bvh, settings);
+  timer.Pause();
+  *report << "ao bake: " << reference.size() << " vertices, " << settings.sampleCount
+          << " samples, " << timer.TimeElapsed().count() << " ms\n";
+
+  const std::pair<SampleSequence, const char*> sequences[] = {
+      {SampleSequence::Random, "random"},
+      {SampleSequence::Stratified, "stratified"},
+      {SampleSequence::Sobol, "sobol"},
+      {SampleSequence::Fibonacci, "fibonacci"}};
+  for (auto [sequence, name] : sequences) {
+    *report << "ao bake rms error, " << name << ":";
+    for (int sampleCount : {16, 64, 256}) {
+      settings.sampleCount = sampleCount;
+      settings.sequence = sequence;
+      settings.seed = 1;
+      auto ao = BakeVertexAmbientOcclusion(scene, bvh, settings);
+      double squaredError = 0.0;
+      for (size_t v = 0; v < ao.size(); ++v) {
+        squaredError += static_cast<double>(ao[v] - reference[v]) * (ao[v] - reference[v]);
+      }
+      *report << " " << std::sqrt(squaredError / std::max<size_t>(ao.size(), 1)) << " ("
+              << sampleCount << " samples)";
+    }
+    *report << "\n";
+  }
+}
+
+// "countPerType" lights of every analytic type, scattered over the scene bounds
+AnalyticLights MakeRandomLights(const Bounds& bounds, size_t countPerType) {
+  Rng rng{7};
+  auto point = [&] {
+    return DirectX::XMFLOAT3{bounds.min.x + rng.Next() * (bounds.max.x - bounds.min.x),
+                             bounds.min.y + rng.Next() * (bounds.max.y - bounds.min.y),
+                             bounds.min.z + rng.Next() * (bounds.max.z - bounds.min.z)};
+  };
+  auto color = [&] {
+    return DirectX::XMFLOAT3{rng.Next(), rng.Next(), rng.Next()};
+  };
+  DirectX::XMFLOAT3 down{0.f, -1.f, 0.f};
+
+  AnalyticLights lights;
+  for (size_t i = 0; i < countPerType; ++i) {
+    auto light = MakeSceneDefaultDirectionalLight();
+    light.color = color();
+    lights.directional.push_back(light);
+    lights.spots.push_back({point(), down, color(), 0.3f, 0.6f});
+    lights.spheres.push_back({point(), 0.05f + 0.1f * rng.Next(), color()});
+    lights.discs.push_back({point(), down, 0.05f + 0.1f * rng.Next(), color()});
+  }
+  return lights;
+}
+
+void SaveShaded(const Image& direct, const Image& indirect, const std::string& prefix) {
+  SavePng(direct, prefix + "_direct.png");
+  SavePng(indirect, prefix + "_indirect.png");
+  SavePng(Add(direct, indirect), prefix + ".png");
+}
+}  // namespace
+
+void RunCpuReference(const CpuScene& scene, const Camera& camera, const DirectionalLight& light,
+                     const CpuReferenceSettings& settings, const std::string& outputDir) {
+  std::filesystem::create_directories(outputDir);
+
+  std::ofstream report{outputDir + "/benchmark.txt"};
+  if (!report)
+    throw std::runtime_error{"failed to open benchmark report in " + outputDir};
+
+  report << "triangles: " << scene.TriangleCount() << "\n";
+  report << "resolution: " << settings.width << "x" << settings.height << "\n";
+
+  StageTimer timer{&report};
+
+  timer.Begin();
+  auto gbuffer = RasterizeGBuffer(scene, MatView(&camera), MatProj(&camera), settings.width,
+                                  settings.height);
+  timer.End("camera gbuffer");
+
+  timer.Begin();
+  auto rsm = RenderCpuRsm(scene, light, settings.rsmSize);
+  timer.End("rsm");
+
+  // RSM gather, as the second pass does it
+  timer.Begin();
+  auto gather = ShadeRsmGather(gbuffer, rsm, light, settings.gather);
+  timer.End("rsm gather");
+  SaveShaded(gather.direct, gather.indirect, outputDir + "/rsm_gather");
+
+  // Screen-space ambient occlusion on the RSM indirect term
+  timer.Begin();
+  auto ao = ComputeSsao(gbuffer, MatView(&camera), MatProj(&camera), settings.ssao);
+  timer.End("ssao");
+  SavePng(AmbientOcclusionImage(ao, settings.width, settings.height), outputDir + "/ssao.png");
+  auto ssaoIndirect = ModulateIndirect(gather.indirect, ao);
+  SaveShaded(gather.direct, ssaoIndirect, outputDir + "/rsm_ssao");
+
+  // Voxel cone tracing
+  SparseVoxelGrid grid{scene.bounds, settings.voxel};
+
+  timer.Begin();
+  grid.Voxelize(scene);
+  timer.End("vct voxelize");
+
+  timer.Begin();
+  grid.InjectRsm(rsm, light);
+  timer.End("vct inject");
+
+  timer.Begin();
+  grid.BuildMips();
+  timer.End("vct mips");
+
+  timer.Begin();
+  auto vctIndirect = ShadeVoxelConeTracing(gbuffer, grid);
+  timer.End("vct cone tracing");
+  SaveShaded(gather.direct, vctIndirect, outputDir + "/vct");
+
+  report << "vct bricks: " << grid.BrickCount() << "\n";
+  report << "vct memory: " << grid.MemoryByteSize() << " bytes (dense: " << grid.DenseByteSize()
+         << " bytes)\n";
+
+  // SH irradiance probes: one full bake, then the cost of a single amortized update
+  IrradianceProbeGrid probes{light, scene.bounds, settings.probes};
+
+  timer.Begin();
+  probes.UpdateAll(rsm);
+  timer.End("probes full update");
+
+  timer.Begin();
+  probes.Update(rsm);
+  timer.End("probes slice update");
+
+  timer.Begin();
+  auto probeIndirect = ShadeIrradianceProbes(gbuffer, probes);
+  timer.End("probes lookup");
+  SaveShaded(gather.direct, probeIndirect, outputDir + "/probes");
+
+  report << "probes: " << probes.ProbeCount() << " (" << settings.probes.probesPerUpdate
+         << " per update), memory: " << probes.MemoryByteSize() << " bytes\n";
+
+  // Compressed probes: memory, coefficient error and how much the shaded image changes
+  const ProbeCompressionSettings storageModes[] = {
+      {ProbeFormat::Half, ShWindow::None},
+      {ProbeFormat::HalfScaled, ShWindow::None},
+      {ProbeFormat::HalfScaled, ShWindow::Hanning},
+      {ProbeFormat::HalfScaled, ShWindow::Lanczos},
+  };
+  const char* formatNames[] = {"half", "half scaled"};
+  const char* windowNames[] = {"no window", "hanning", "lanczos"};
+  auto probeImage = Add(gather.direct, probeIndirect);
+  for (const auto& mode : storageModes) {
+    auto compressed = CompressProbes(probes, mode);
+    auto error = MeasureProbeError(probes, compressed);
+    IrradianceProbeGrid decoded = probes;
+    DecompressProbes(compressed, &decoded);
+    auto image = Add(gather.direct, ShadeIrradianceProbes(gbuffer, decoded));
+    report << "probes " << formatNames[static_cast<int>(mode.format)] << ", "
+           << windowNames[static_cast<int>(mode.window)] << ": " << compressed.MemoryByteSize()
+           << " bytes (" << 100.0 * compressed.MemoryByteSize() / probes.MemoryByteSize()
+           << " %), coefficient rms " << error.relativeRmsError * 100.f
+           << " %, image rms vs float probes " << RmsError(image, probeImage) << "\n";
+  }
+
+  {
+    std::ofstream out{outputDir + "/probes.bin", std::ios::binary};
+    WriteCompressedProbes(probes, settings.probeStorage, out);
+  }
+  timer.Begin();
+  std::ifstream in{outputDir + "/probes.bin", std::ios::binary};
+  auto loaded = ReadCompressedProbes(in);
+  IrradianceProbeGrid loadedProbes = probes;
+  DecompressProbes(loaded, &loadedProbes);
+  timer.End("probes load and decompress");
+
+  // The reloaded probes against the float ones, expected to match compressing in memory
+  auto loadedError = MeasureProbeError(probes, loaded);
+  auto inMemoryError = MeasureProbeError(probes, CompressProbes(probes, settings.probeStorage));
+  report << "probes.bin round trip: coefficient max " << loadedError.maxError << ", rms "
+         << loadedError.relativeRmsError * 100.f << " % (in memory: max "
+         << inMemoryError.maxError << ", rms " << inMemoryError.relativeRmsError * 100.f
+         << " %), image rms vs float probes "
+         << RmsError(Add(gather.direct, ShadeIrradianceProbes(gbuffer, loadedProbes)), probeImage)
+         << "\n";
+
+  // Timing only: dynamic analytic lights folded into a copy of the probes, as they would be every
+  // frame. The path tracer does not see these lights, so the lit probes have no reference.
+  auto analyticLights = MakeRandomLights(scene.bounds, 64);
+  IrradianceProbeGrid litProbes = probes;
+  timer.Begin();
+  AddAnalyticLights(analyticLights, &litProbes);
+  timer.End("probes fold " + std::to_string(analyticLights.Count()) + " analytic lights");
+
+  BenchmarkPrtRelight(scene, &report);
+
+  // Path traced ground truth, and how far every mode is from it
+  timer.Begin();
+  Bvh bvh{scene};
+  timer.End("bvh build");
+
+  // RSM gather with ray traced VPL visibility. The second frame takes its visibility from the
+  // cache the first one filled.
+  VplVisibilityCache visibilityCache;
+  RsmVisibilityStats visibilityStats;
+  timer.Begin();
+  auto visibleIndirect = ShadeRsmGatherVisible(gbuffer, rsm, bvh, settings.gather,
+                                               settings.visibility, &visibilityCache,
+                                               &visibilityStats);
+  timer.End("rsm visibility gather");
+
+  RsmVisibilityStats cachedStats;
+  timer.Begin();
+  ShadeRsmGatherVisible(gbuffer, rsm, bvh, settings.gather, settings.visibility,
+                        &visibilityCache, &cachedStats);
+  timer.End("rsm visibility gather, cached");
+  SaveShaded(gather.direct, visibleIndirect, outputDir + "/rsm_visible");
+
+  // Light that reaches a point through geometry in the plain gather
+  double gatherEnergy = Energy(gather.indirect);
+  double leak = gatherEnergy > 0.0 ? 1.0 - Energy(visibleIndirect) / gatherEnergy : 0.0;
+  report << "rsm visibility: " << visibilityStats.rays << " shadow rays, "
+         << cachedStats.cachedPixels << "/" << cachedStats.cachedPixels + cachedStats.tracedPixels
+         << " pixels cached in the second frame, cache memory: "
+         << visibilityCache.MemoryByteSize() << " bytes\n";
+  report << "rsm gather light leak: " << leak * 100.0 << " % of the indirect energy\n";
+
+  PathTracer pathTracer{scene, bvh, light, camera, settings.width, settings.height,
+                        settings.pathTracer};
+  timer.Begin();
+  pathTracer.Render();
+  timer.End("path tracing");
+  auto reference = Add(pathTracer.Direct(), pathTracer.Indirect());
+  SaveShaded(pathTracer.Direct(), pathTracer.Indirect(), outputDir + "/path_tracer");
+
+  report << "path tracer: " << pathTracer.SampleCount() << " spp, " << pathTracer.RayCount()
+         << " rays, " << pathTracer.RayCount() / pathTracer.Seconds() / 1e6 << " Mrays/s\n";
+  report << "bvh: " << bvh.NodeCount() << " nodes, " << bvh.MemoryByteSize() << " bytes\n";
+
+  BenchmarkAoBake(scene, bvh, &report);
+
+  report << "rms error vs path tracer:\n";
+  report << "  rsm gather: " << RmsError(Add(gather.direct, gather.indirect), reference) << "\n";
+  report << "  rsm visible: " << RmsError(Add(gather.direct, visibleIndirect), reference) << "\n";
+  report << "  rsm ssao: " << RmsError(Add(gather.direct, ssaoIndirect), reference) << "\n";
+  report << "  vct: " << RmsError(Add(gather.direct, vctIndirect), reference) << "\n";
+  report << "  probes: " << RmsError(Add(gather.direct, probeIndirect), reference) << "\n";
+}
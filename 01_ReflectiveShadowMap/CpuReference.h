@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+
+#include "AmbientOcclusion.h"
+#include "Camera.h"
+#include "CpuScene.h"
+#include "DirectionalLight.h"
+#include "IrradianceProbes.h"
+#include "PathTracer.h"
+#include "ProbeStorage.h"
+#include "RsmReference.h"
+#include "RsmVisibility.h"
+#include "VoxelConeTracing.h"
+
+struct CpuReferenceSettings {
+  int width = 1280;
+  int height = 720;
+  int rsmSize = 512;
+  RsmGatherSettings gather;
+  RsmVisibilitySettings visibility;
+  SsaoSettings ssao;
+  VoxelConeTracingSettings voxel;
+  IrradianceProbeSettings probes;
+  ProbeCompressionSettings probeStorage;
+  PathTracerSettings pathTracer;
+};
+
+/**
+ * Render the scene once with every CPU global illumination mode.
+ * For each mode "<mode>_direct.png", "<mode>_indirect.png" and "<mode>.png" are written into
+ * "outputDir", together with "benchmark.txt" listing the time spent in every stage.
+ */
+void RunCpuReference(const CpuScene& scene, const Camera& camera, const DirectionalLight& light,
+                     const CpuReferenceSettings& settings, const std::string& outputDir);
@@ -0,0 +1,33 @@
+#include "CpuScene.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+void CpuScene::AddMesh(const Vertex* vertices, const std::uint32_t* meshIndices,
+                       size_t indexCount, const XMFLOAT4X4& model, XMFLOAT3 albedo) {
+  auto m = ToXMMatrix(model);
+  auto normalMatrix = XMMatrixTranspose(ToXMMatrix(Float4x4Inverse(model)));
+
+  // Only copy the vertices referenced by this draw. Rects share one vertex range, for example.
+  std::uint32_t maxIndex = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    maxIndex = std::max(maxIndex, meshIndices[i]);
+  }
+
+  auto base = static_cast<std::uint32_t>(positions.size());
+  for (size_t i = 0; i <= maxIndex; ++i) {
+    auto p = XMVector3TransformCoord(ToXMVector(vertices[i].pos), m);
+    auto n = XMVector3Normalize(XMVector3TransformNormal(ToXMVector(vertices[i].normal),
+                                                         normalMatrix));
+    positions.push_back(ToXMFloat3(p));
+    normals.push_back(ToXMFloat3(n));
+    bounds.Expand(positions.back());
+  }
+
+  for (size_t i = 0; i < indexCount; ++i) {
+    indices.push_back(base + meshIndices[i]);
+  }
+  albedos.insert(albedos.end(), indexCount / 3, albedo);
+  meshes.push_back({base, positions.size() - base, albedo});
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Model.h"
+
+// Vertex range of one render item in a CpuScene
+struct CpuMesh {
+  size_t firstVertex = 0;
+  size_t vertexCount = 0;
+  DirectX::XMFLOAT3 albedo;
+};
+
+/**
+ * World space copy of everything drawn by the renderer, used by the CPU reference renderers.
+ * Every render item is flattened into one indexed triangle list. Albedos are stored per triangle.
+ */
+struct CpuScene {
+  std::vector<DirectX::XMFLOAT3> positions;
+  std::vector<DirectX::XMFLOAT3> normals;
+  std::vector<std::uint32_t> indices;
+  std::vector<DirectX::XMFLOAT3> albedos;
+  std::vector<CpuMesh> meshes;  // In the order of AddMesh() calls
+  Bounds bounds;
+
+  size_t TriangleCount() const { return indices.size() / 3; }
+
+  // Transform a mesh by "model" and append it.
+  void AddMesh(const Vertex* vertices, const std::uint32_t* meshIndices, size_t indexCount,
+               const DirectX::XMFLOAT4X4& model, DirectX::XMFLOAT3 albedo);
+};
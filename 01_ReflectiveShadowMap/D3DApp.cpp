@@ -1,21 +1,75 @@
 #include "D3DApp.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <unordered_map>
+
 #include "D3DUtils.h"
+#include "MeshSimplify.h"
 #include "Rect.h"
+#include "ThreadPool.h"
 
 using DX::ThrowIfFailed;
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 
-D3DApp::D3DApp(std::wstring name, int viewportWidth, int viewportHeight)
+namespace {
+// Runs on a worker thread of the AssetStreamer
+MeshAssetData DecodeSceneMesh(const SceneMesh& mesh) {
+  MeshAssetData data;
+  if (mesh.file.empty()) {
+    RectXZ rect{mesh.rectSpanX, mesh.rectSpanZ};
+    auto rectVertices = RectXZVertices(rect);
+    auto rectIndices = RectXZIndices(rect);
+    data.submeshes.push_back(AppendSubmesh(rectVertices.data(), rectVertices.size(),
+                                           rectIndices.data(), rectIndices.size(),
+                                           &data.ownedVertices, &data.ownedIndexData));
+    return data;
+  }
+
+  // Mapped from the mesh cache after the first launch, which skips Assimp
+  data.model = std::make_unique<ObjModel>(ObjModel::LoadCached(mesh.file, "cache"));
+  const auto& model = *data.model;
+  const auto& stats = model.OptimizationStats();
+  char message[256];
+  std::snprintf(message, sizeof(message), "%s ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                mesh.name.c_str(), stats.before.Acmr(), stats.after.Acmr(), stats.before.Atvr(),
+                stats.after.Atvr());
+  OutputDebugStringA(message);
+  data.meshlets.assign(model.Meshlets(), model.Meshlets() + model.MeshletCount());
+  data.submeshes = model.Submeshes();
+  return data;
+}
+
+D3D12_INDEX_BUFFER_VIEW IndexBufferView(const DefaultBuffer& iBuffer, const Submesh& submesh) {
+  D3D12_INDEX_BUFFER_VIEW view{};
+  view.BufferLocation = iBuffer.GpuVirtualAddress() + submesh.indexByteOffset;
+  view.SizeInBytes = static_cast<UINT>(submesh.indexCount * IndexSize(submesh.indexFormat));
+  view.Format = submesh.indexFormat == IndexFormat::Uint16 ? DXGI_FORMAT_R16_UINT
+                                                           : DXGI_FORMAT_R32_UINT;
+  return view;
+}
+}  // namespace
+
+D3DApp::D3DApp(std::wstring name, int viewportWidth, int viewportHeight,
+               const std::string& sceneFile)
     : name_{std::move(name)},
       viewport_{
           MakeViewport(static_cast<float>(viewportWidth), static_cast<float>(viewportHeight))},
-      scissorRect_{MakeScissorRect(viewportWidth, viewportHeight)} {
+      scissorRect_{MakeScissorRect(viewportWidth, viewportHeight)},
+      scene_{LoadSceneFile(sceneFile)} {
 
+  const auto& camera = scene_.camera;
   camera_ = std::make_unique<Camera>(
-      XMFLOAT3{0.0f, 2.0f, -10.0f}, XMFLOAT3{0.0f, 0.0f, 1.0f},
-      static_cast<float>(viewportWidth) / static_cast<float>(viewportHeight), 60.0f, 1.f, 100.0f);
+      camera.position, camera.lookTo,
+      static_cast<float>(viewportWidth) / static_cast<float>(viewportHeight), camera.vFovDeg,
+      camera.zNear, camera.zFar);
+  directionalLight_ = scene_.light;
+  ssaoSettings_ = scene_.ssao;
+  prtSettings_ = scene_.prt;
 }
 
 void D3DApp::Initialize(HWND window) {
@@ -63,7 +117,7 @@ void D3DApp::Initialize(HWND window) {
     frameIndex_ = swapChain_->GetCurrentBackBufferIndex();
   }
 
-  rtvHeap_ = MakeRtvHeap(device_.Get(), 6);
+  rtvHeap_ = MakeRtvHeap(device_.Get(), 10);
   dsvHeap_ = MakeDsvHeap(device_.Get(), 2);
   cbvSrvHeap_ = MakeCbvSrvUavHeap(device_.Get(), 9);
 
@@ -117,18 +171,27 @@ void D3DApp::Initialize(HWND window) {
   {
     CD3DX12_DESCRIPTOR_RANGE range[3];
     range[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);  // b0
-    range[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);  // b1
-    range[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0);  // t0-t3
+    range[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0);  // t0-t3
+    range[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 4);  // t4-t7
 
-    CD3DX12_ROOT_PARAMETER rootParameter[3];
+    CD3DX12_ROOT_PARAMETER rootParameter[6];
     // register b0: pass constant
     rootParameter[0].InitAsDescriptorTable(1, range, D3D12_SHADER_VISIBILITY_ALL);
 
-    // register b1: model constant
-    rootParameter[1].InitAsDescriptorTable(1, &range[1], D3D12_SHADER_VISIBILITY_ALL);
+    // register b1: draw constant
+    rootParameter[1].InitAsConstants(sizeof(DrawConstant) / 4, 1);
+
+    // register t0-t3: textures
+    rootParameter[2].InitAsDescriptorTable(1, &range[1]);
 
-    // register t0-t2: textures
-    rootParameter[2].InitAsDescriptorTable(1, &range[2]);
+    // register t4-t7: camera depth, camera normal and SSAO textures
+    rootParameter[3].InitAsDescriptorTable(1, &range[2]);
+
+    // register t8: instance buffer
+    rootParameter[4].InitAsShaderResourceView(8);
+
+    // register t9: PRT colors
+    rootParameter[5].InitAsShaderResourceView(9);
 
 
     CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc{};
@@ -150,6 +213,11 @@ void D3DApp::Initialize(HWND window) {
     ComPtr<ID3DBlob> pixelShader;
     ComPtr<ID3DBlob> lightVertexShader;
     ComPtr<ID3DBlob> lightPixelShader;
+    ComPtr<ID3DBlob> gBufferVertexShader;
+    ComPtr<ID3DBlob> gBufferPixelShader;
+    ComPtr<ID3DBlob> fullscreenVertexShader;
+    ComPtr<ID3DBlob> ssaoPixelShader;
+    ComPtr<ID3DBlob> ssaoBlurPixelShader;
 
 #if defined(_DEBUG)
     UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -169,11 +237,28 @@ void D3DApp::Initialize(HWND window) {
     ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "PS", "ps_5_0",
                                      compileFlags, 0, pixelShader.GetAddressOf(), nullptr));
 
+    ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "VSGBuffer", "vs_5_0",
+                                     compileFlags, 0, gBufferVertexShader.GetAddressOf(),
+                                     nullptr));
+
+    ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "PSGBuffer", "ps_5_0",
+                                     compileFlags, 0, gBufferPixelShader.GetAddressOf(), nullptr));
+
+    ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "VSFullscreen", "vs_5_0",
+                                     compileFlags, 0, fullscreenVertexShader.GetAddressOf(),
+                                     nullptr));
+
+    ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "PSSsao", "ps_5_0",
+                                     compileFlags, 0, ssaoPixelShader.GetAddressOf(), nullptr));
+
+    ThrowIfFailed(D3DCompileFromFile(L"shaders.hlsl", nullptr, nullptr, "PSSsaoBlur", "ps_5_0",
+                                     compileFlags, 0, ssaoBlurPixelShader.GetAddressOf(), nullptr));
+
 
     D3D12_INPUT_ELEMENT_DESC inputElementDesc[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,
+        {"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0,
          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 16,
+        {"NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8,
          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
     };
 
@@ -220,6 +305,43 @@ void D3DApp::Initialize(HWND window) {
     ThrowIfFailed(device_->CreateGraphicsPipelineState(
         &pso2Desc, IID_PPV_ARGS(pipelineStatePass2_.ReleaseAndGetAddressOf())));
 
+    // Camera depth and normal, drawn with the final image's depth buffer
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC gBufferPsoDesc = pso2Desc;
+    gBufferPsoDesc.VS = CD3DX12_SHADER_BYTECODE(gBufferVertexShader.Get());
+    gBufferPsoDesc.PS = CD3DX12_SHADER_BYTECODE(gBufferPixelShader.Get());
+    gBufferPsoDesc.NumRenderTargets = 2;
+    gBufferPsoDesc.RTVFormats[0] = DXGI_FORMAT_R32_FLOAT;
+    gBufferPsoDesc.RTVFormats[1] = DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+    ThrowIfFailed(device_->CreateGraphicsPipelineState(
+        &gBufferPsoDesc, IID_PPV_ARGS(pipelineStateGBuffer_.ReleaseAndGetAddressOf())));
+
+    // SSAO gather and blur are fullscreen triangles without vertex input and depth test
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC ssaoPsoDesc{};
+    ssaoPsoDesc.InputLayout = {nullptr, 0};
+    ssaoPsoDesc.pRootSignature = rootSignature_.Get();
+    ssaoPsoDesc.VS = CD3DX12_SHADER_BYTECODE(fullscreenVertexShader.Get());
+    ssaoPsoDesc.PS = CD3DX12_SHADER_BYTECODE(ssaoPixelShader.Get());
+    ssaoPsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    ssaoPsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    ssaoPsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    ssaoPsoDesc.DepthStencilState.DepthEnable = FALSE;
+    ssaoPsoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+    ssaoPsoDesc.SampleMask = UINT_MAX;
+    ssaoPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    ssaoPsoDesc.NumRenderTargets = 1;
+    ssaoPsoDesc.RTVFormats[0] = DXGI_FORMAT_R16_FLOAT;
+    ssaoPsoDesc.SampleDesc.Count = 1;
+
+    ThrowIfFailed(device_->CreateGraphicsPipelineState(
+        &ssaoPsoDesc, IID_PPV_ARGS(pipelineStateSsao_.ReleaseAndGetAddressOf())));
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC ssaoBlurPsoDesc = ssaoPsoDesc;
+    ssaoBlurPsoDesc.PS = CD3DX12_SHADER_BYTECODE(ssaoBlurPixelShader.Get());
+
+    ThrowIfFailed(device_->CreateGraphicsPipelineState(
+        &ssaoBlurPsoDesc, IID_PPV_ARGS(pipelineStateSsaoBlur_.ReleaseAndGetAddressOf())));
+
     ThrowIfFailed(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
                                              commandAllocator_.Get(), nullptr,
                                              IID_PPV_ARGS(commandList_.ReleaseAndGetAddressOf())));
@@ -249,17 +371,41 @@ void D3DApp::Initialize(HWND window) {
   // Prepare RSM
   {
     // RSM rtv and srv
-    rsmDepth_ = std::make_unique<Rsm>(device_.Get(), rtvHeap_->CpuHandle(s_rsmRtvStartIndex),
+    rsmDepth_ = std::make_unique<Rsm>(device_.Get(), s_rsmSize, s_rsmSize,
+                                      rtvHeap_->CpuHandle(s_rsmRtvStartIndex),
                                       cbvSrvHeap_->CpuHandle(s_rsmSrvStartIndex),
                                       XMFLOAT4{1.f, 1.f, 1.f, 1.f});
-    rsmNormal_ = std::make_unique<Rsm>(device_.Get(), rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 1),
+    rsmNormal_ = std::make_unique<Rsm>(device_.Get(), s_rsmSize, s_rsmSize,
+                                       rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 1),
                                        cbvSrvHeap_->CpuHandle(s_rsmSrvStartIndex + 1));
-    rsmFlux_ = std::make_unique<Rsm>(device_.Get(), rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 2),
+    rsmFlux_ = std::make_unique<Rsm>(device_.Get(), s_rsmSize, s_rsmSize,
+                                     rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 2),
                                      cbvSrvHeap_->CpuHandle(s_rsmSrvStartIndex + 2));
-    rsmWorldPos_ = std::make_unique<Rsm>(device_.Get(), rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 3),
+    rsmWorldPos_ = std::make_unique<Rsm>(device_.Get(), s_rsmSize, s_rsmSize,
+                                         rtvHeap_->CpuHandle(s_rsmRtvStartIndex + 3),
                                          cbvSrvHeap_->CpuHandle(s_rsmSrvStartIndex + 3));
   }
 
+  // Prepare SSAO
+  {
+    auto width = static_cast<size_t>(viewport_.Width);
+    auto height = static_cast<size_t>(viewport_.Height);
+
+    // Camera depth clears to the far plane, occlusion clears to "not occluded"
+    cameraDepth_ = std::make_unique<RenderTarget<DXGI_FORMAT_R32_FLOAT>>(
+        device_.Get(), width, height, rtvHeap_->CpuHandle(s_ssaoRtvStartIndex),
+        cbvSrvHeap_->CpuHandle(s_ssaoSrvStartIndex), XMFLOAT4{1.f, 1.f, 1.f, 1.f});
+    cameraNormal_ = std::make_unique<RenderTarget<DXGI_FORMAT_R16G16B16A16_FLOAT>>(
+        device_.Get(), width, height, rtvHeap_->CpuHandle(s_ssaoRtvStartIndex + 1),
+        cbvSrvHeap_->CpuHandle(s_ssaoSrvStartIndex + 1));
+    ssao_ = std::make_unique<RenderTarget<DXGI_FORMAT_R16_FLOAT>>(
+        device_.Get(), width / 2, height / 2, rtvHeap_->CpuHandle(s_ssaoRtvStartIndex + 2),
+        cbvSrvHeap_->CpuHandle(s_ssaoSrvStartIndex + 2), XMFLOAT4{1.f, 1.f, 1.f, 1.f});
+    ssaoBlurred_ = std::make_unique<RenderTarget<DXGI_FORMAT_R16_FLOAT>>(
+        device_.Get(), width / 2, height / 2, rtvHeap_->CpuHandle(s_ssaoRtvStartIndex + 3),
+        cbvSrvHeap_->CpuHandle(s_ssaoSrvStartIndex + 3), XMFLOAT4{1.f, 1.f, 1.f, 1.f});
+  }
+
   // RSM depth stencil buffer
   {
     auto depthBufferHeapProp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
@@ -288,151 +434,122 @@ void D3DApp::Initialize(HWND window) {
 }
 
 void D3DApp::InitializeScene() {
-  ObjModel bunny{"stanford-bunny.obj"};
-
-  // Load vertices of bunny
-  UINT bunnyVBufferSize = bunny.VerticesByteSize();
-
-  UploadBuffer<Vertex> bunnyVBuffer{device_.Get(), bunny.VertexCount()};
-  bunnyVBuffer.LoadBuffer(0, bunny.VerticesBegin(), bunnyVBufferSize);
-
-  // Load indices of bunny
-  UINT bunnyIBufferSize = bunny.IndicesByteSize();
-
-  UploadBuffer<std::uint16_t> bunnyIBuffer{device_.Get(), bunny.IndexCount()};
-  bunnyIBuffer.LoadBuffer(0, bunny.IndicesBegin(), bunnyIBufferSize);
-
-  RectXZ rect{1.f, 1.f};
-  // Load plane vertices
-  auto&& rectVertices = RectXZVertices(rect);
-  UINT rectVBufferSize = rectVertices.size() * sizeof(Vertex);
-
-  UploadBuffer<Vertex> rectVBuffer{device_.Get(), rectVertices.size()};
-  rectVBuffer.LoadBuffer(0, rectVertices.data(), rectVBufferSize);
-
-  // Load plane indices
-  auto&& rectIndices = RectXZIndices(rect);
-  UINT rectIBufferSize = rectIndices.size() * sizeof(std::uint16_t);
+  streamer_ = std::make_unique<AssetStreamer>(device_.Get());
+
+  // A file is decoded once, however many meshes and instances use it
+  std::unordered_map<std::string, size_t> fileAssets;
+  std::vector<size_t> meshAssets;
+  meshAssets.reserve(scene_.meshes.size());
+  for (const auto& mesh : scene_.meshes) {
+    auto it = mesh.file.empty() ? fileAssets.end() : fileAssets.find(mesh.file);
+    if (it != fileAssets.end()) {
+      meshAssets.push_back(it->second);
+      continue;
+    }
+    meshAssets.push_back(streamer_->Request([mesh] { return DecodeSceneMesh(mesh); }));
+    if (!mesh.file.empty())
+      fileAssets.emplace(mesh.file, meshAssets.back());
+  }
+  assetInstances_.resize(streamer_->AssetCount());
+  for (size_t i = 0; i < scene_.instances.size(); ++i) {
+    assetInstances_[meshAssets[scene_.instances[i].mesh]].push_back(i);
+  }
 
-  UploadBuffer<std::uint16_t> rectIBuffer{device_.Get(), rectIndices.size()};
-  rectIBuffer.LoadBuffer(0, rectIndices.data(), rectIBufferSize);
+  sceneMaterials_.reserve(scene_.materials.size());
+  for (const auto& material : scene_.materials) {
+    sceneMaterials_.push_back(std::make_shared<Diffuse>(material.diffuse));
+  }
 
-  ThrowIfFailed(commandList_->Reset(commandAllocator_.Get(), pipelineStatePass1_.Get()));
+  prtColorBuffer_ = std::make_unique<UploadBuffer<XMFLOAT4>>(device_.Get(), 1);
+}
 
-  // Concatenate vertex buffers and send to default heap from temporary upload heap
-  UINT vBufferSize = bunnyVBufferSize + rectVBufferSize;
-  vBuffer_ = std::make_unique<DefaultBuffer>(device_.Get(), vBufferSize);
-  commandList_->CopyBufferRegion(vBuffer_->Resource(), 0, bunnyVBuffer.Resource(), 0,
-                                 bunnyVBuffer.BufferByteSize());
-  commandList_->CopyBufferRegion(vBuffer_->Resource(), bunnyVBufferSize, rectVBuffer.Resource(), 0,
-                                 rectVBufferSize);
-
-  // Concatenate index buffers and send to default heap from temporary upload heap
-  UINT iBufferSize = bunnyIBufferSize + rectIBufferSize;
-  iBuffer_ = std::make_unique<DefaultBuffer>(device_.Get(), iBufferSize);
-  commandList_->CopyBufferRegion(iBuffer_->Resource(), 0, bunnyIBuffer.Resource(), 0,
-                                 bunnyIBuffer.BufferByteSize());
-  commandList_->CopyBufferRegion(iBuffer_->Resource(), bunnyIBufferSize, rectIBuffer.Resource(), 0,
-                                 rectIBufferSize);
+void D3DApp::WaitForScene() {
+  StreamScene();
+  while (!prtRelighter_) {
+    if (prtBake_.valid()) {
+      prtBake_.wait();
+    } else {
+      streamer_->WaitForProgress();
+    }
+    StreamScene();
+  }
+}
 
-  ThrowIfFailed(commandList_->Close());
-  ExecuteCommandList();
-  WaitForGpuCompletion();
+void D3DApp::StreamScene() {
+  for (auto asset : streamer_->Pump()) {
+    AddRenderItems(asset);
+  }
 
-  // VBV and IBV about the final concatenated vertex and index buffer
-  vbv_.BufferLocation = vBuffer_->GpuVirtualAddress();
-  vbv_.SizeInBytes = vBufferSize;
-  vbv_.StrideInBytes = sizeof(Vertex);
+  // The transfer is of the whole scene, so it waits for the last mesh
+  if (streamer_->IsIdle() && !prtRelighter_ && !prtBake_.valid())
+    StartPrtBake();
+  if (prtBake_.valid() && prtBake_.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+    FinishPrtBake();
+}
 
-  ibv_.BufferLocation = iBuffer_->GpuVirtualAddress();
-  ibv_.SizeInBytes = iBufferSize;
-  ibv_.Format = DXGI_FORMAT_R16_UINT;
+void D3DApp::AddRenderItems(size_t asset) {
+  // Every submesh of the asset is registered once, and every instance gets a render item per
+  // submesh
+  const auto& submeshes = streamer_->Asset(asset).data.submeshes;
+  std::vector<size_t> meshes;
+  meshes.reserve(submeshes.size());
+  for (const auto& submesh : submeshes) {
+    meshes.push_back(RegisterMesh(asset, submesh));
+  }
 
-  // Render item of bunny
+  const auto& instances = assetInstances_[asset];
+  renderItems_.reserve(renderItems_.size() + instances.size() * meshes.size());
   auto origin = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-  {
-    RenderItem bunnyItem;
-    float s = 20.f;
-    auto translation = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-    auto rotation = XMQuaternionIdentity();
-    auto scale = XMVectorSet(s, s, s, 0.f);
+  for (auto i : instances) {
+    const auto& instance = scene_.instances[i];
+    auto translation = XMLoadFloat3(&instance.translation);
+    auto rotation = XMLoadFloat4(&instance.rotation);
+    auto scale = XMVectorSet(instance.scale, instance.scale, instance.scale, 0.f);
     auto transform = XMMatrixTransformation(origin, XMQuaternionIdentity(), scale, origin, rotation,
                                             translation);
-    XMStoreFloat4x4(&bunnyItem.model, transform);
-    bunnyItem.startIndexLocation = 0;
-    bunnyItem.indexCount = bunnyIBuffer.ElementCount();
-    bunnyItem.baseVertexLocation = 0;
-    bunnyItem.modelCBufferIndex = 0;  // Model constant buffer index [0]
-    bunnyItem.material = std::make_shared<Diffuse>();
-    renderItems_.push_back(bunnyItem);
+    for (auto mesh : meshes) {
+      RenderItem item;
+      XMStoreFloat4x4(&item.model, transform);
+      item.mesh = mesh;
+      item.material = sceneMaterials_[instance.material];
+      renderItems_.push_back(std::move(item));
+    }
   }
+}
 
-  // Render items of walls
-  float cornerSize = 5.f;
-  {
-    RenderItem rectXZ;
-    auto translation = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-    auto rotation = XMQuaternionIdentity();
-    auto scale = XMVectorSet(cornerSize, cornerSize, cornerSize, 0.f);
-    auto transform = XMMatrixTransformation(origin, XMQuaternionIdentity(), scale, origin, rotation,
-                                            translation);
-    XMStoreFloat4x4(&rectXZ.model, transform);
-    rectXZ.startIndexLocation = bunnyIBuffer.ElementCount();
-    rectXZ.indexCount = rectIBuffer.ElementCount();
-    rectXZ.baseVertexLocation = bunnyVBuffer.ElementCount();
-    rectXZ.modelCBufferIndex = 1;
-    rectXZ.material = std::make_shared<Diffuse>(Diffuse{XMFLOAT3{0.f, 0.8f, 0.f}});
-    renderItems_.push_back(rectXZ);
-  }
-  {
-    RenderItem rectXY;
-    auto translation = XMVectorSet(0.f, cornerSize / 2, cornerSize / 2, 0.f);
-    auto rotation = XMQuaternionRotationAxis(XMVectorSet(1.f, 0.f, 0.f, 0.f), -XM_PIDIV2);
-    auto scale = XMVectorSet(cornerSize, cornerSize, cornerSize, 0.f);
-    auto transform = XMMatrixTransformation(origin, XMQuaternionIdentity(), scale, origin, rotation,
-                                            translation);
-    XMStoreFloat4x4(&rectXY.model, transform);
-    rectXY.startIndexLocation = bunnyIBuffer.ElementCount();
-    rectXY.indexCount = rectIBuffer.ElementCount();
-    rectXY.baseVertexLocation = bunnyVBuffer.ElementCount();
-    rectXY.modelCBufferIndex = 2;
-    rectXY.material = std::make_shared<Diffuse>(Diffuse{XMFLOAT3{0.f, 0.f, 0.8f}});
-    renderItems_.push_back(rectXY);
+void D3DApp::StartPrtBake() {
+  prtScene_ = std::make_shared<CpuScene>(MakeCpuScene());
+
+  // The GPU has its own copy and meshlet culling only needs the meshlets
+  if (!retainCpuMeshes_) {
+    for (size_t asset = 0; asset < streamer_->AssetCount(); ++asset) {
+      streamer_->ReleaseCpuCopy(asset);
+    }
   }
-  {
-    RenderItem rectYZ;
-    auto translation = XMVectorSet(-cornerSize / 2, cornerSize / 2, 0.f, 0.f);
-    auto rotation = XMQuaternionRotationAxis(XMVectorSet(0.f, 0.f, 1.f, 0.f), -XM_PIDIV2);
-    auto scale = XMVectorSet(cornerSize, cornerSize, cornerSize, 0.f);
-    auto transform = XMMatrixTransformation(origin, XMQuaternionIdentity(), scale, origin, rotation,
-                                            translation);
-    XMStoreFloat4x4(&rectYZ.model, transform);
-    rectYZ.startIndexLocation = bunnyIBuffer.ElementCount();
-    rectYZ.indexCount = rectIBuffer.ElementCount();
-    rectYZ.baseVertexLocation = bunnyVBuffer.ElementCount();
-    rectYZ.modelCBufferIndex = 3;
-    rectYZ.material = std::make_shared<Diffuse>(Diffuse{XMFLOAT3{0.8f, 0.f, 0.f}});
-    renderItems_.push_back(rectYZ);
-  }
-
-  // Model constant buffers for render items
-  modelCBuffer_ = std::make_unique<ConstantBuffer<ModelConstant>>(device_.Get(),
-                                                                  renderItems_.size());
-
-  // CBVs for model constant buffer.
-  // Index 0 of cbvHeap is modelCbv to pass constant buffer, so start from index 1.
-  int index = 1;
-  for (auto& ri : renderItems_) {
-    auto cbv = cbvSrvHeap_->CpuHandle(index);
 
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc{};
-    cbvDesc.BufferLocation = modelCBuffer_->ElementGpuVirtualAddress(ri.modelCBufferIndex);
-    cbvDesc.SizeInBytes = modelCBuffer_->ElementPaddedSize();
-    device_->CreateConstantBufferView(&cbvDesc, cbv);
+  auto bake = std::make_shared<std::promise<PrtTransfer>>();
+  prtBake_ = bake->get_future();
+  GlobalThreadPool().Enqueue([bake, scene = prtScene_, settings = prtSettings_] {
+    try {
+      bake->set_value(LoadOrBakePrtTransfer(*scene, settings, "cache"));
+    } catch (...) {
+      bake->set_exception(std::current_exception());
+    }
+  });
+}
 
-    ri.modelCbv = cbvSrvHeap_->GpuHandle(index);
-    ++index;
+void D3DApp::FinishPrtBake() {
+  prtTransfer_ = prtBake_.get();
+  prtRelighter_ = std::make_unique<PrtRelighter>(prtTransfer_, prtScene_->meshes);
+
+  // The colors are relit in the vertex order of the baked scene, one mesh per render item
+  for (size_t i = 0; i < renderItems_.size(); ++i) {
+    renderItems_[i].cpuFirstVertex = prtScene_->meshes[i].firstVertex;
   }
+  prtColorBuffer_ =
+      std::make_unique<UploadBuffer<XMFLOAT4>>(device_.Get(),
+                                               std::max<size_t>(prtRelighter_->VertexCount(), 1));
+  prtScene_.reset();
 }
 
 void D3DApp::FrameStatistics() {
@@ -452,22 +569,138 @@ void D3DApp::FrameStatistics() {
 }
 
 void D3DApp::UpdateScene() {
-  // Update model constants for every render items
-  for (const auto& ri : renderItems_) {
-    ModelConstant c{};
-    c.model = ri.model;
-    c.invModel = Float4x4Inverse(ri.model);
-    c.color = ri.material->albedo;
-    modelCBuffer_->LoadElement(ri.modelCBufferIndex, c);
+  // Instance data of every render item, copied into the instance buffer in batch order
+  itemInstances_.resize(renderItems_.size());
+  for (size_t i = 0; i < renderItems_.size(); ++i) {
+    const auto& ri = renderItems_[i];
+    auto& instance = itemInstances_[i];
+    instance.model = ri.model;
+    instance.invModel = Float4x4Inverse(ri.model);
+    instance.color = ri.material->albedo;
+    instance.prtColorOffset =
+        prtRelighter_ ? static_cast<std::uint32_t>(ri.cpuFirstVertex) : s_noPrtColors;
+  }
+}
+
+void D3DApp::UpdateLods() {
+  // Screen size of a model unit: at the nearest point of the bounds for the perspective camera,
+  // and everywhere alike for the orthographic light
+  XMVECTOR eye = XMLoadFloat3(&camera_->worldPosition);
+  float cameraPixelsPerUnit =
+      viewport_.Height / (2.f * std::tan(XMConvertToRadians(camera_->vFovDeg) / 2.f));
+  float lightTexelsPerUnit =
+      s_rsmSize / std::max(directionalLight_.width, directionalLight_.height);
+
+  for (auto& ri : renderItems_) {
+    const auto& submesh = meshes_[ri.mesh].submesh;
+    XMMATRIX model = XMLoadFloat4x4(&ri.model);
+    float scale = std::max({XMVectorGetX(XMVector3Length(model.r[0])),
+                            XMVectorGetX(XMVector3Length(model.r[1])),
+                            XMVectorGetX(XMVector3Length(model.r[2]))});
+    auto localCenter = submesh.bounds.Center();
+    auto extent = submesh.bounds.Extent();
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&localCenter), model);
+    float radius = 0.5f * scale * XMVectorGetX(XMVector3Length(XMLoadFloat3(&extent)));
+    float distance = std::max(XMVectorGetX(XMVector3Length(center - eye)) - radius,
+                              camera_->zNear);
+
+    ri.cameraLod =
+        SelectLod(submesh, scale * cameraPixelsPerUnit / distance, s_cameraLodTolerance);
+    ri.lightLod = SelectLod(submesh, scale * lightTexelsPerUnit, s_lightLodTolerance);
+  }
+}
+
+void D3DApp::CullRenderItems(const MeshletCullView& cameraView,
+                             const MeshletCullView& lightView) {
+  // Bounding spheres of whole render items. Their meshlets are culled once they are batched.
+  for (auto& ri : renderItems_) {
+    const auto& submesh = meshes_[ri.mesh].submesh;
+    XMMATRIX model = XMLoadFloat4x4(&ri.model);
+    float scale = std::max({XMVectorGetX(XMVector3Length(model.r[0])),
+                            XMVectorGetX(XMVector3Length(model.r[1])),
+                            XMVectorGetX(XMVector3Length(model.r[2]))});
+    auto localCenter = submesh.bounds.Center();
+    auto extent = submesh.bounds.Extent();
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&localCenter), model);
+    float radius = 0.5f * scale * XMVectorGetX(XMVector3Length(XMLoadFloat3(&extent)));
+    ri.cameraVisible = IsSphereInView(cameraView, center, radius);
+    ri.lightVisible = IsSphereInView(lightView, center, radius);
   }
 }
 
+void D3DApp::UpdatePrtColors() {
+  if (!prtRelighter_)
+    return;
+  auto light = ProjectDirectionalLight(directionalLight_, prtTransfer_.order);
+  prtRelighter_->Relight(light, true, &prtColors_);
+  prtColorBuffer_->LoadBuffer(0, prtColors_.data(), prtColors_.size() * sizeof(XMFLOAT4));
+}
+
+void D3DApp::BuildBatches(const MeshletCullView& cameraView, const MeshletCullView& lightView) {
+  auto build = [this](DrawView view, const MeshletCullView& cullView,
+                      std::vector<DrawBatch>* batches) {
+    std::vector<DrawKey> keys;
+    std::vector<std::uint32_t> items;
+    for (size_t i = 0; i < renderItems_.size(); ++i) {
+      auto& ri = renderItems_[i];
+      auto& ranges = view == DrawView::Light ? ri.lightRanges : ri.cameraRanges;
+      ranges.clear();
+      if (!(view == DrawView::Light ? ri.lightVisible : ri.cameraVisible))
+        continue;
+      auto lod = view == DrawView::Light ? ri.lightLod : ri.cameraLod;
+      keys.push_back({static_cast<std::uint32_t>(ri.mesh), static_cast<std::uint32_t>(lod)});
+      items.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    // Only a render item drawn alone at LOD 0 is split into meshlets, and skipped when none of
+    // them are left. Culling the meshlets of instanced items would take a draw per item.
+    std::vector<std::uint32_t> order;
+    auto built = BuildDrawBatches(keys.data(), keys.size(), &order);
+    batches->clear();
+    for (auto batch : built) {
+      const auto& mesh = meshes_[batch.key.mesh];
+      if (batch.instanceCount == 1 && batch.key.lod == 0 && mesh.submesh.meshletCount > 0) {
+        auto& ri = renderItems_[items[order[batch.firstInstance]]];
+        auto& ranges = view == DrawView::Light ? ri.lightRanges : ri.cameraRanges;
+        const Meshlet* meshlets =
+            streamer_->Asset(mesh.asset).data.meshlets.data() + mesh.submesh.firstMeshlet;
+        CullMeshlets(meshlets, mesh.submesh.meshletCount, ri.model, cullView, &ranges);
+        if (ranges.empty())
+          continue;
+      }
+
+      auto first = batch.firstInstance;
+      batch.firstInstance = static_cast<std::uint32_t>(instanceItems_.size());
+      for (auto k = first; k < first + batch.instanceCount; ++k) {
+        instanceItems_.push_back(items[order[k]]);
+        instances_.push_back(itemInstances_[items[order[k]]]);
+      }
+      batches->push_back(batch);
+    }
+  };
+
+  instanceItems_.clear();
+  instances_.clear();
+  build(DrawView::Light, lightView, &lightBatches_);
+  build(DrawView::Camera, cameraView, &cameraBatches_);
+
+  // Grown as instances stream in. The GPU is done with the last frame by now.
+  if (!instanceBuffer_ || instanceBuffer_->ElementCount() < instances_.size()) {
+    instanceBuffer_ = std::make_unique<UploadBuffer<InstanceData>>(
+        device_.Get(), std::max<size_t>(2 * instances_.size(), 1));
+  }
+  instanceBuffer_->LoadBuffer(0, instances_.data(), instances_.size() * sizeof(InstanceData));
+}
+
 void D3DApp::Update() {
   if (!isRunning_)
     return;
 
   FrameStatistics();
+  StreamScene();
   UpdateScene();
+  UpdateLods();
+  UpdatePrtColors();
 
   // Update pass constant buffer
   passCBuffer_->ClearBuffer(0);
@@ -484,6 +717,13 @@ void D3DApp::Update() {
   XMMATRIX lightOrtho = MatLightOrtho(&directionalLight_);
   auto detLightOrtho = XMMatrixDeterminant(lightOrtho);
 
+  auto cameraCullView =
+      MakePerspectiveCullView(view * proj, XMLoadFloat3(&camera_->worldPosition));
+  auto lightCullView =
+      MakeOrthographicCullView(lightView * lightOrtho, XMLoadFloat3(&directionalLight_.dir));
+  CullRenderItems(cameraCullView, lightCullView);
+  BuildBatches(cameraCullView, lightCullView);
+
   PassConstant cbo{};
   XMStoreFloat4x4(&cbo.view, view);
   XMStoreFloat4x4(&cbo.invView, XMMatrixInverse(&detView, view));
@@ -502,6 +742,13 @@ void D3DApp::Update() {
   cbo.height = viewport_.Height;
   cbo.rsmSize = static_cast<float>(s_rsmSize);
   cbo.timeElapsed = totalTimeElapsed_;
+  cbo.ssaoRadius = ssaoSettings_.radius;
+  cbo.ssaoBias = ssaoSettings_.bias;
+  cbo.ssaoIntensity = ssaoSettings_.intensity;
+  cbo.ssaoSampleCount = ssaoSettings_.sampleCount;
+  cbo.ssaoBlurRadius = ssaoSettings_.blurRadius;
+  cbo.ssaoBlurSharpness = ssaoSettings_.blurSharpness;
+  cbo.prtBlend = prtBlend_;
   passCBuffer_->LoadElement(0, cbo);
 }
 
@@ -516,6 +763,11 @@ void D3DApp::Render() {
 
   WaitForGpuCompletion();
 
+  PopulateCommandListAmbientOcclusion();
+  ExecuteCommandList();
+
+  WaitForGpuCompletion();
+
   PopulateCommandListSecondPass();
   ExecuteCommandList();
 
@@ -567,10 +819,8 @@ void D3DApp::PopulateCommandListFirstPass() {
 
 
   commandList_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-  commandList_->IASetVertexBuffers(0, 1, &vbv_);
-  commandList_->IASetIndexBuffer(&ibv_);
 
-  DrawAllRenderItems();
+  DrawAllRenderItems(DrawView::Light);
 
 
   rsmDepth_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ);
@@ -581,6 +831,67 @@ void D3DApp::PopulateCommandListFirstPass() {
   ThrowIfFailed(commandList_->Close());
 }
 
+void D3DApp::PopulateCommandListAmbientOcclusion() {
+  ThrowIfFailed(commandAllocator_->Reset());
+  ThrowIfFailed(commandList_->Reset(commandAllocator_.Get(), pipelineStateGBuffer_.Get()));
+
+  commandList_->SetGraphicsRootSignature(rootSignature_.Get());
+
+  ID3D12DescriptorHeap* heaps[] = {cbvSrvHeap_->Heap()};
+  commandList_->SetDescriptorHeaps(_countof(heaps), heaps);
+
+  commandList_->SetGraphicsRootDescriptorTable(0, cbvSrvHeap_->GpuHandle(0));
+  commandList_->SetGraphicsRootDescriptorTable(3, cbvSrvHeap_->GpuHandle(s_ssaoSrvStartIndex));
+
+  // Camera depth and normal at full size
+  commandList_->SetPipelineState(pipelineStateGBuffer_.Get());
+
+  commandList_->RSSetViewports(1, &viewport_);
+  commandList_->RSSetScissorRects(1, &scissorRect_);
+
+  cameraDepth_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+  cameraNormal_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+  auto dsv = dsvHeap_->CpuHandle(0);
+  D3D12_CPU_DESCRIPTOR_HANDLE gBufferRtvs[] = {cameraDepth_->Rtv(), cameraNormal_->Rtv()};
+  commandList_->OMSetRenderTargets(2, gBufferRtvs, false, &dsv);
+
+  cameraDepth_->Clear(commandList_.Get());
+  cameraNormal_->Clear(commandList_.Get());
+  commandList_->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+
+  commandList_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+  DrawAllRenderItems(DrawView::Camera);
+
+  cameraDepth_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ);
+  cameraNormal_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ);
+
+  // Occlusion gather and bilateral blur at half size
+  auto halfViewport = MakeViewport(static_cast<float>(ssao_->Width()),
+                                   static_cast<float>(ssao_->Height()));
+  auto halfRect = MakeScissorRect(static_cast<LONG>(ssao_->Width()),
+                                  static_cast<LONG>(ssao_->Height()));
+  commandList_->RSSetViewports(1, &halfViewport);
+  commandList_->RSSetScissorRects(1, &halfRect);
+
+  commandList_->SetPipelineState(pipelineStateSsao_.Get());
+  ssao_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+  auto ssaoRtv = ssao_->Rtv();
+  commandList_->OMSetRenderTargets(1, &ssaoRtv, true, nullptr);
+  commandList_->DrawInstanced(3, 1, 0, 0);
+  ssao_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ);
+
+  commandList_->SetPipelineState(pipelineStateSsaoBlur_.Get());
+  ssaoBlurred_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+  auto ssaoBlurredRtv = ssaoBlurred_->Rtv();
+  commandList_->OMSetRenderTargets(1, &ssaoBlurredRtv, true, nullptr);
+  commandList_->DrawInstanced(3, 1, 0, 0);
+  ssaoBlurred_->TransitionTo(commandList_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ);
+
+  ThrowIfFailed(commandList_->Close());
+}
+
 void D3DApp::PopulateCommandListSecondPass() {
   ThrowIfFailed(commandAllocator_->Reset());
   ThrowIfFailed(commandList_->Reset(commandAllocator_.Get(), pipelineStatePass2_.Get()));
@@ -595,6 +906,7 @@ void D3DApp::PopulateCommandListSecondPass() {
   commandList_->SetGraphicsRootDescriptorTable(0, cbvSrvHeap_->GpuHandle(0));
 
   commandList_->SetGraphicsRootDescriptorTable(2, cbvSrvHeap_->GpuHandle(s_rsmSrvStartIndex));
+  commandList_->SetGraphicsRootDescriptorTable(3, cbvSrvHeap_->GpuHandle(s_ssaoSrvStartIndex));
 
   commandList_->RSSetViewports(1, &viewport_);
   commandList_->RSSetScissorRects(1, &scissorRect_);
@@ -615,10 +927,8 @@ void D3DApp::PopulateCommandListSecondPass() {
 
 
   commandList_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-  commandList_->IASetVertexBuffers(0, 1, &vbv_);
-  commandList_->IASetIndexBuffer(&ibv_);
 
-  DrawAllRenderItems();
+  DrawAllRenderItems(DrawView::Camera);
 
   Transition(renderTargets_[frameIndex_].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET,
              D3D12_RESOURCE_STATE_PRESENT);
@@ -626,14 +936,55 @@ void D3DApp::PopulateCommandListSecondPass() {
   ThrowIfFailed(commandList_->Close());
 }
 
-void D3DApp::DrawAllRenderItems() {
-  for (const auto& ri : renderItems_) {
-    commandList_->SetGraphicsRootDescriptorTable(1, ri.modelCbv);
-    commandList_->DrawIndexedInstanced(ri.indexCount, 1, ri.startIndexLocation,
-                                       ri.baseVertexLocation, 0);
+void D3DApp::DrawAllRenderItems(DrawView view) {
+  commandList_->SetGraphicsRootShaderResourceView(4, instanceBuffer_->ElementGpuVirtualAddress());
+  commandList_->SetGraphicsRootShaderResourceView(5, prtColorBuffer_->ElementGpuVirtualAddress());
+
+  // Vertex buffer views start at the first vertex of their submesh, so SV_VertexID is the index
+  // into the submesh and picks the PRT color of the vertex
+  const auto& batches = view == DrawView::Light ? lightBatches_ : cameraBatches_;
+  for (const auto& batch : batches) {
+    const auto& mesh = meshes_[batch.key.mesh];
+    DrawConstant c{};
+    c.positionOffset = mesh.submesh.dequantization.offset;
+    c.firstInstance = batch.firstInstance;
+    c.positionScale = mesh.submesh.dequantization.scale;
+    commandList_->SetGraphicsRoot32BitConstants(1, sizeof(c) / 4, &c, 0);
+    commandList_->IASetVertexBuffers(0, 1, &mesh.vbv);
+    commandList_->IASetIndexBuffer(&mesh.lodIbvs[batch.key.lod]);
+
+    // Ranges of meshlets are only left for a render item drawn alone
+    if (batch.instanceCount == 1 && batch.key.lod == 0 && mesh.submesh.meshletCount > 0) {
+      const auto& ri = renderItems_[instanceItems_[batch.firstInstance]];
+      const auto& ranges = view == DrawView::Light ? ri.lightRanges : ri.cameraRanges;
+      for (const auto& range : ranges) {
+        commandList_->DrawIndexedInstanced(static_cast<UINT>(range.indexCount), 1,
+                                           static_cast<UINT>(range.firstIndex), 0, 0);
+      }
+    } else {
+      auto indexCount = SubmeshAtLod(mesh.submesh, batch.key.lod).indexCount;
+      commandList_->DrawIndexedInstanced(static_cast<UINT>(indexCount), batch.instanceCount, 0,
+                                         0, 0);
+    }
   }
 }
 
+size_t D3DApp::RegisterMesh(size_t asset, const Submesh& submesh) {
+  const auto& meshAsset = streamer_->Asset(asset);
+  RegisteredMesh mesh;
+  mesh.asset = asset;
+  mesh.submesh = submesh;
+  mesh.vbv.BufferLocation =
+      meshAsset.vBuffer->GpuVirtualAddress() + submesh.firstVertex * sizeof(QuantizedVertex);
+  mesh.vbv.SizeInBytes = static_cast<UINT>(submesh.vertexCount * sizeof(QuantizedVertex));
+  mesh.vbv.StrideInBytes = sizeof(QuantizedVertex);
+  for (size_t lod = 0; lod <= submesh.lodCount; ++lod) {
+    mesh.lodIbvs[lod] = IndexBufferView(*meshAsset.iBuffer, SubmeshAtLod(submesh, lod));
+  }
+  meshes_.push_back(mesh);
+  return meshes_.size() - 1;
+}
+
 void D3DApp::Destroy() {
   WaitForGpuCompletion();
 }
@@ -642,6 +993,24 @@ Camera* D3DApp::GetCamera() const {
   return camera_.get();
 }
 
+CpuScene D3DApp::MakeCpuScene() const {
+  CpuScene scene;
+  for (const auto& ri : renderItems_) {
+    // Decoded like on the GPU, so both render the same vertices
+    const auto& submesh = meshes_[ri.mesh].submesh;
+    const auto& data = streamer_->Asset(meshes_[ri.mesh].asset).data;
+    if (data.VertexCount() == 0)
+      throw std::runtime_error{"CPU copies of the meshes are released, see RetainCpuMeshes()"};
+    std::vector<Vertex> vertices(submesh.vertexCount);
+    DequantizeVertices(data.Vertices() + submesh.firstVertex, submesh.vertexCount,
+                       submesh.dequantization, vertices.data());
+    auto indices = SubmeshIndices(data.IndexData(), submesh);
+    scene.AddMesh(vertices.data(), indices.data(), indices.size(),
+                  ri.model, ri.material->albedo);
+  }
+  return scene;
+}
+
 void D3DApp::WaitForGpuCompletion() {
   auto fenceValue = ++nextFenceValue_;
   ThrowIfFailed(commandQueue_->Signal(fence_.Get(), fenceValue));
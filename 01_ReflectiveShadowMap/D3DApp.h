@@ -6,16 +6,24 @@
 #include <wrl/client.h>
 
 #include <array>
+#include <future>
 #include <memory>
 
+#include "AmbientOcclusion.h"
+#include "AssetStreamer.h"
 #include "camera.h"
 #include "ConstantBuffer.h"
+#include "CpuScene.h"
 #include "DefaultBuffer.h"
 #include "DescriptorHeap.h"
 #include "DirectionalLight.h"
+#include "DrawBatch.h"
 #include "Material.h"
 #include "Model.h"
+#include "PrtBake.h"
+#include "PrtRuntime.h"
 #include "RenderTarget.h"
+#include "SceneFile.h"
 #include "Timer.h"
 
 struct PassConstant {
@@ -36,34 +44,82 @@ struct PassConstant {
   float height;   // Viewport height
   float rsmSize;  // Reflective shadow map size
   float timeElapsed;
+  float ssaoRadius;
+  float ssaoBias;
+  float ssaoIntensity;
+  int ssaoSampleCount;
+  int ssaoBlurRadius;
+  float ssaoBlurSharpness;
+  float prtBlend;  // 0: shadow mapped direct light, 1: PRT vertex radiance
 };
 
-struct ModelConstant {
+// Root constants of a draw.
+struct DrawConstant {
+  DirectX::XMFLOAT3 positionOffset;  // Dequantization of the submesh, see QuantizedVertex
+  std::uint32_t firstInstance;  // Of the draw in the instance buffer
+  DirectX::XMFLOAT3 positionScale;
+  float padding;
+};
+
+// Element of the instance buffer, one per instance of every draw of a frame.
+struct InstanceData {
   DirectX::XMFLOAT4X4 model;  // Model-to-model transform
   DirectX::XMFLOAT4X4 invModel;
   DirectX::XMFLOAT3 color;
+  std::uint32_t prtColorOffset;  // Of its first vertex, s_noPrtColors until the PRT bake is done
+};
+
+constexpr std::uint32_t s_noPrtColors = 0xffffffff;
+
+// Submesh of a streamed asset in the mesh registry, shared by all of its instances.
+struct RegisteredMesh {
+  size_t asset = 0;  // Of the AssetStreamer
+  Submesh submesh;
+  D3D12_VERTEX_BUFFER_VIEW vbv{};  // From the first vertex of "submesh" on
+  D3D12_INDEX_BUFFER_VIEW lodIbvs[1 + s_maxSubmeshLodCount]{};  // Every LOD of "submesh"
 };
 
+// Whose pass draws the render items, which decides the LODs they are drawn with.
+enum class DrawView {
+  Camera,
+  Light,
+};
+
+// Instance of a registered mesh.
 struct RenderItem {
   DirectX::XMFLOAT4X4 model = Float4x4Identity();  // Model-to-model transform
-  size_t startIndexLocation = 0;
-  size_t indexCount = 0;
-  size_t baseVertexLocation = 0;
-  size_t modelCBufferIndex = 0;
-  CD3DX12_GPU_DESCRIPTOR_HANDLE modelCbv;
+  size_t mesh = 0;  // Into the mesh registry
+  size_t cameraLod = 0;  // LODs chosen by UpdateLods() for the frame
+  size_t lightLod = 0;
+
+  // Whether the bounds are in the frustums, by CullRenderItems() for the frame
+  bool cameraVisible = false;
+  bool lightVisible = false;
+
+  // Meshlets of LOD 0 left by BuildBatches() for the frame, drawn instead of all of it. Only
+  // filled for items drawn without instancing, instanced ones are drawn whole.
+  std::vector<IndexRange> cameraRanges;
+  std::vector<IndexRange> lightRanges;
   std::shared_ptr<Diffuse> material;
+
+  size_t cpuFirstVertex = 0;  // In MakeCpuScene() and so in the PRT color buffer
 };
 
 class D3DApp {
 public:
   static constexpr int s_renderTargetCount = 2;
 
-  D3DApp(std::wstring name, int viewportWidth, int viewportHeight);
+  // The scene, its camera, light and settings come from "sceneFile", see LoadSceneFile().
+  D3DApp(std::wstring name, int viewportWidth, int viewportHeight, const std::string& sceneFile);
 
   void Initialize(HWND window);
 
+  // Request the meshes of the scene from the streamer, drawn as they become resident.
   void InitializeScene();
 
+  // Block until every mesh of the scene is resident and the PRT transfer is ready.
+  void WaitForScene();
+
   void Update();
 
   void ExecuteCommandList() const;
@@ -81,6 +137,22 @@ public:
 
   Camera* GetCamera() const;
 
+  const DirectionalLight& GetDirectionalLight() const { return directionalLight_; }
+
+  // Flatten all render items into a world space scene for the CPU reference renderers.
+  CpuScene MakeCpuScene() const;
+
+  // Keep the CPU copies of the meshes after the PRT bake took its scene from them, so that
+  // MakeCpuScene() still works later on. Call before the scene streams in.
+  void RetainCpuMeshes() { retainCpuMeshes_ = true; }
+
+  // Transfer vectors of the vertices of MakeCpuScene(), baked or loaded once the whole scene is
+  // resident.
+  const PrtTransfer& GetPrtTransfer() const { return prtTransfer_; }
+
+  // Blend between the shadow mapped direct light (0) and the PRT vertex radiance (1).
+  void SetPrtBlend(float blend) { prtBlend_ = blend; }
+
   float GetViewportWidth() const;
 
   float GetViewportHeight() const;
@@ -126,8 +198,13 @@ private:
   // [3]: RSM normal texture (write)
   // [4]: RSM flux texture (write)
   // [5]: RSM world pos texture (write)
+  // [6]: camera depth texture (write)
+  // [7]: camera normal texture (write)
+  // [8]: SSAO texture (write)
+  // [9]: blurred SSAO texture (write)
   std::unique_ptr<DescriptorHeap> rtvHeap_;
   static constexpr int s_rsmRtvStartIndex = 2;
+  static constexpr int s_ssaoRtvStartIndex = 6;
 
 
   // Depth stencil views
@@ -142,39 +219,74 @@ private:
   // Pipeline related
   //   Root signature:
   //   param[0]: descriptor table (1x cbv), register(b0)
-  //   param[1]: descriptor table (1x cbv), register(b1)
+  //   param[1]: root constants (DrawConstant), register(b1)
   //   param[2]: descriptor table (4x srv), register(t0-t3)
+  //   param[3]: descriptor table (4x srv), register(t4-t7)
+  //   param[4]: root srv (instance buffer), register(t8)
+  //   param[5]: root srv (PRT colors), register(t9)
   Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature_;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineStatePass1_;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineStatePass2_;
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineStateGBuffer_;
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineStateSsao_;
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineStateSsaoBlur_;
 
-  // Scene and constants
-  std::unique_ptr<DefaultBuffer> vBuffer_;
-  D3D12_VERTEX_BUFFER_VIEW vbv_{};
-
-  std::unique_ptr<DefaultBuffer> iBuffer_;
-  D3D12_INDEX_BUFFER_VIEW ibv_{};
+  // Meshes of the scene, every one in its own vertex and index buffer
+  std::unique_ptr<AssetStreamer> streamer_;
+  bool retainCpuMeshes_ = false;
 
   // Constant buffer views and shader resource views
   // [0] cbv: pass constant
-  // [1-4] cbv: model constants (bunny, RectXZ, RectXY, RectYZ)
-  // [5] srv: RSM depth texture(read)
-  // [6] srv: RSM normal texture (read)
-  // [7] srv: RSM flux texture (read)
-  // [8] srv: RSM world pos texture (read)
+  // [1] srv: RSM depth texture(read)
+  // [2] srv: RSM normal texture (read)
+  // [3] srv: RSM flux texture (read)
+  // [4] srv: RSM world pos texture (read)
+  // [5] srv: camera depth texture (read)
+  // [6] srv: camera normal texture (read)
+  // [7] srv: SSAO texture (read)
+  // [8] srv: blurred SSAO texture (read)
   std::unique_ptr<DescriptorHeap> cbvSrvHeap_;
-  static constexpr int s_rsmSrvStartIndex = 5;
+  static constexpr int s_rsmSrvStartIndex = 1;
+  static constexpr int s_ssaoSrvStartIndex = 5;
 
   std::unique_ptr<ConstantBuffer<PassConstant>> passCBuffer_;
-  std::unique_ptr<ConstantBuffer<ModelConstant>> modelCBuffer_;
 
+  // Read in the constructor. The instances of a mesh become render items once it is resident.
+  SceneDesc scene_;
+  std::vector<std::vector<size_t>> assetInstances_;  // Instances of every streamed asset
+  std::vector<std::shared_ptr<Diffuse>> sceneMaterials_;  // Shared by their instances
+  std::vector<RegisteredMesh> meshes_;  // Mesh registry, the submeshes of resident assets
   std::vector<RenderItem> renderItems_;
 
+  // Draws of the frame built by BuildBatches(), the instances of one mesh at one LOD in one
+  // instanced draw. The instance buffer holds the instances of the light pass, then those of the
+  // camera passes, and "instanceItems_" their render items.
+  std::vector<InstanceData> itemInstances_;  // Of every render item, by UpdateScene()
+  std::vector<DrawBatch> lightBatches_;
+  std::vector<DrawBatch> cameraBatches_;
+  std::vector<std::uint32_t> instanceItems_;
+  std::vector<InstanceData> instances_;
+  std::unique_ptr<UploadBuffer<InstanceData>> instanceBuffer_;
+
   DirectionalLight directionalLight_ = MakeSceneDefaultDirectionalLight();
 
+  // Precomputed radiance transfer, cached in "cache/" across launches. It is baked or loaded on
+  // the thread pool from the scene in "prtScene_" once every mesh is resident.
+  PrtSettings prtSettings_;
+  PrtTransfer prtTransfer_;
+  std::shared_ptr<const CpuScene> prtScene_;
+  std::future<PrtTransfer> prtBake_;
+
+  // Vertex radiance relit from the transfer every frame, read by the vertex shader from the
+  // offset of its instance. A single element stands in until the bake is done.
+  std::unique_ptr<PrtRelighter> prtRelighter_;
+  std::vector<DirectX::XMFLOAT4> prtColors_;
+  std::unique_ptr<UploadBuffer<DirectX::XMFLOAT4>> prtColorBuffer_;
+  float prtBlend_ = 0.f;
+
   // Reflective shadow map
   static constexpr size_t s_rsmSize = 512;
-  using Rsm = RenderTarget<s_rsmSize, s_rsmSize, DXGI_FORMAT_R32G32B32A32_FLOAT>;
+  using Rsm = RenderTarget<DXGI_FORMAT_R32G32B32A32_FLOAT>;
 
   std::unique_ptr<Rsm> rsmDepth_;
   std::unique_ptr<Rsm> rsmNormal_;
@@ -183,12 +295,26 @@ private:
 
   Microsoft::WRL::ComPtr<ID3D12Resource> shadowDepthBuffer_;
 
+  // Largest simplification error in pixels the camera passes and in RSM texels the light pass
+  // draw LODs with. The RSM only samples the scene for indirect light at a lower resolution than
+  // the screen, so the light pass gets away with coarser LODs.
+  static constexpr float s_cameraLodTolerance = 1.f;
+  static constexpr float s_lightLodTolerance = 4.f;
+
+  // Screen-space ambient occlusion. Depth and normal are full size, occlusion is half size.
+  SsaoSettings ssaoSettings_;
+
+  std::unique_ptr<RenderTarget<DXGI_FORMAT_R32_FLOAT>> cameraDepth_;
+  std::unique_ptr<RenderTarget<DXGI_FORMAT_R16G16B16A16_FLOAT>> cameraNormal_;
+  std::unique_ptr<RenderTarget<DXGI_FORMAT_R16_FLOAT>> ssao_;
+  std::unique_ptr<RenderTarget<DXGI_FORMAT_R16_FLOAT>> ssaoBlurred_;
 
   // Synchronization
   Microsoft::WRL::ComPtr<ID3D12Fence> fence_;
   UINT64 nextFenceValue_ = 0;
 
   void PopulateCommandListFirstPass();
+  void PopulateCommandListAmbientOcclusion();
   void PopulateCommandListSecondPass();
 
   void WaitForGpuCompletion();
@@ -196,8 +322,17 @@ private:
                   D3D12_RESOURCE_STATES after);
 
   void FrameStatistics();
+  void StreamScene();
+  void AddRenderItems(size_t asset);
+  void StartPrtBake();
+  void FinishPrtBake();
   void UpdateScene();
-  void DrawAllRenderItems();
+  void UpdateLods();
+  void CullRenderItems(const MeshletCullView& cameraView, const MeshletCullView& lightView);
+  void BuildBatches(const MeshletCullView& cameraView, const MeshletCullView& lightView);
+  void UpdatePrtColors();
+  void DrawAllRenderItems(DrawView view);
+  size_t RegisterMesh(size_t asset, const Submesh& submesh);
 };
 
 CD3DX12_VIEWPORT MakeViewport(float w, float h);
@@ -0,0 +1,469 @@
+#include "DracoMesh.h"
+
+#include <draco/compression/decode.h>
+#include <rapidjson/document.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr std::uint32_t s_glbMagic = 0x46546c67;      // "glTF"
+constexpr std::uint32_t s_glbJsonChunk = 0x4e4f534a;  // "JSON"
+constexpr std::uint32_t s_glbBinChunk = 0x004e4942;   // "BIN\0"
+constexpr size_t s_gltfTriangles = 4;
+constexpr size_t s_gltfUnsignedByte = 5121;
+constexpr size_t s_gltfUnsignedShort = 5123;
+constexpr size_t s_gltfUnsignedInt = 5125;
+constexpr size_t s_gltfFloat = 5126;
+constexpr const char* s_dracoExtension = "KHR_draco_mesh_compression";
+
+struct ByteRange {
+  const std::uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+// A glTF document and the buffers its meshes are read from
+struct GltfFile {
+  std::unique_ptr<MappedFile> file;
+  rapidjson::Document json;
+  ByteRange binChunk;  // Buffer without a URI of a .glb file
+  std::vector<std::unique_ptr<MappedFile>> externalBuffers;
+  std::vector<ByteRange> buffers;
+};
+
+// One mesh to read, a Draco compressed one or a plain glTF primitive
+struct MeshSource {
+  ByteRange draco;
+  // Attribute ids of a compressed glTF primitive, -1 for none. A .drc file uses the named
+  // attributes instead.
+  bool gltf = false;
+  std::int64_t positionId = -1;
+  std::int64_t normalId = -1;
+  const rapidjson::Value* primitive = nullptr;  // Plain glTF primitive if "draco" is empty
+};
+
+std::string Extension(const std::string& file) {
+  auto extension = std::filesystem::path{file}.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return extension;
+}
+
+bool IsGltf(const std::string& file) {
+  auto extension = Extension(file);
+  return extension == ".gltf" || extension == ".glb";
+}
+
+// Member "name" of "object", or null
+const rapidjson::Value* FindMember(const rapidjson::Value& object, const char* name) {
+  if (!object.IsObject())
+    return nullptr;
+  auto it = object.FindMember(name);
+  return it == object.MemberEnd() ? nullptr : &it->value;
+}
+
+size_t UintMember(const rapidjson::Value& object, const char* name) {
+  auto value = FindMember(object, name);
+  if (!value || !value->IsUint64())
+    throw std::runtime_error{std::string{"glTF member is missing or not an index: "} + name};
+  return static_cast<size_t>(value->GetUint64());
+}
+
+size_t UintMember(const rapidjson::Value& object, const char* name, size_t fallback) {
+  return FindMember(object, name) ? UintMember(object, name) : fallback;
+}
+
+// Element "index" of the top level array "name"
+const rapidjson::Value& Element(const rapidjson::Value& json, const char* name, size_t index) {
+  auto array = FindMember(json, name);
+  if (!array || !array->IsArray() || index >= array->Size())
+    throw std::runtime_error{std::string{"glTF index out of range: "} + name};
+  return (*array)[static_cast<rapidjson::SizeType>(index)];
+}
+
+// Elements of the array "name" of "object", none if there is no such array
+rapidjson::Value::ConstArray ArrayMember(const rapidjson::Value& object, const char* name) {
+  static const rapidjson::Value s_empty{rapidjson::kArrayType};
+  auto array = FindMember(object, name);
+  return array && array->IsArray() ? array->GetArray() : s_empty.GetArray();
+}
+
+// Map "file" and parse its JSON, which a .glb file holds in its first chunk next to the binary
+// buffer.
+void ParseGltf(const std::string& file, GltfFile* gltf) {
+  gltf->file = std::make_unique<MappedFile>(file);
+  const std::uint8_t* data = gltf->file->Data();
+  size_t size = gltf->file->Size();
+  const char* text = reinterpret_cast<const char*>(data);
+  size_t textSize = size;
+
+  if (Extension(file) == ".glb") {
+    // 12 byte header, then chunks of length, type and data
+    std::uint32_t header[3];
+    if (size < sizeof(header))
+      throw std::runtime_error{"truncated glTF binary file: " + file};
+    std::memcpy(header, data, sizeof(header));
+    if (header[0] != s_glbMagic || header[1] != 2)
+      throw std::runtime_error{"not a glTF 2 binary file: " + file};
+
+    text = nullptr;
+    for (size_t offset = sizeof(header); size - offset >= 8;) {
+      std::uint32_t chunk[2];
+      std::memcpy(chunk, data + offset, sizeof(chunk));
+      offset += sizeof(chunk);
+      if (chunk[0] > size - offset)
+        throw std::runtime_error{"truncated glTF binary file: " + file};
+      if (chunk[1] == s_glbJsonChunk && !text) {
+        text = reinterpret_cast<const char*>(data + offset);
+        textSize = chunk[0];
+      } else if (chunk[1] == s_glbBinChunk && !gltf->binChunk.data) {
+        gltf->binChunk = {data + offset, chunk[0]};
+      }
+      offset += chunk[0];
+    }
+  }
+
+  if (!text || textSize == 0)
+    throw std::runtime_error{"glTF file without JSON: " + file};
+  gltf->json.Parse(text, textSize);
+  if (gltf->json.HasParseError() || !gltf->json.IsObject())
+    throw std::runtime_error{"failed to parse glTF file: " + file};
+}
+
+// URI of every buffer as a path, empty for the binary chunk of a .glb file
+std::vector<std::string> BufferPaths(const std::string& file, const GltfFile& gltf) {
+  auto directory = std::filesystem::path{file}.parent_path();
+  std::vector<std::string> paths;
+  for (const auto& buffer : ArrayMember(gltf.json, "buffers")) {
+    auto uri = FindMember(buffer, "uri");
+    if (!uri) {
+      paths.emplace_back();
+      continue;
+    }
+    if (!uri->IsString() || std::strncmp(uri->GetString(), "data:", 5) == 0)
+      throw std::runtime_error{"glTF buffers must be external files or the binary chunk: " +
+                               file};
+    paths.push_back((directory / uri->GetString()).string());
+  }
+  return paths;
+}
+
+void MapBuffers(const std::string& file, GltfFile* gltf) {
+  for (const auto& path : BufferPaths(file, *gltf)) {
+    if (path.empty()) {
+      gltf->buffers.push_back(gltf->binChunk);
+      continue;
+    }
+    gltf->externalBuffers.push_back(std::make_unique<MappedFile>(path));
+    gltf->buffers.push_back({gltf->externalBuffers.back()->Data(),
+                             gltf->externalBuffers.back()->Size()});
+  }
+}
+
+bool UsesDraco(const GltfFile& gltf) {
+  for (const auto& extension : ArrayMember(gltf.json, "extensionsUsed")) {
+    if (extension.IsString() && std::strcmp(extension.GetString(), s_dracoExtension) == 0)
+      return true;
+  }
+  return false;
+}
+
+ByteRange BufferView(const GltfFile& gltf, size_t index, size_t* stride) {
+  const auto& view = Element(gltf.json, "bufferViews", index);
+  size_t buffer = UintMember(view, "buffer");
+  if (buffer >= gltf.buffers.size())
+    throw std::runtime_error{"glTF buffer index out of range"};
+  ByteRange range = gltf.buffers[buffer];
+  size_t offset = UintMember(view, "byteOffset", 0);
+  size_t length = UintMember(view, "byteLength");
+  if (offset > range.size || length > range.size - offset)
+    throw std::runtime_error{"glTF buffer view out of range"};
+  if (stride)
+    *stride = UintMember(view, "byteStride", 0);
+  return {range.data + offset, length};
+}
+
+// Elements of a plain accessor, each "componentCount" components of "componentType" apart by
+// "stride" bytes
+struct Accessor {
+  const std::uint8_t* data;
+  size_t count;
+  size_t stride;
+  size_t componentType;
+};
+
+Accessor OpenAccessor(const GltfFile& gltf, size_t index, const char* type, size_t componentCount) {
+  const auto& accessor = Element(gltf.json, "accessors", index);
+  auto typeName = FindMember(accessor, "type");
+  if (!typeName || !typeName->IsString() || std::strcmp(typeName->GetString(), type) != 0)
+    throw std::runtime_error{std::string{"glTF accessor is not of type "} + type};
+  if (FindMember(accessor, "sparse") || !FindMember(accessor, "bufferView"))
+    throw std::runtime_error{"sparse glTF accessors are not supported"};
+
+  Accessor result;
+  result.componentType = UintMember(accessor, "componentType");
+  result.count = UintMember(accessor, "count");
+  size_t componentSize = result.componentType == s_gltfUnsignedByte    ? 1
+                         : result.componentType == s_gltfUnsignedShort ? 2
+                                                                       : 4;
+  size_t viewStride;
+  ByteRange view = BufferView(gltf, UintMember(accessor, "bufferView"), &viewStride);
+  size_t offset = UintMember(accessor, "byteOffset", 0);
+  size_t elementSize = componentSize * componentCount;
+  result.stride = viewStride != 0 ? viewStride : elementSize;
+  if (result.count != 0 &&
+      (offset > view.size || result.count > view.size ||
+       (result.count - 1) * result.stride + elementSize > view.size - offset))
+    throw std::runtime_error{"glTF accessor out of range"};
+  result.data = view.data + offset;
+  return result;
+}
+
+void ReadVectors(const Accessor& accessor, std::vector<XMFLOAT3>* vectors) {
+  if (accessor.componentType != s_gltfFloat)
+    throw std::runtime_error{"glTF positions and normals must be floats"};
+  vectors->resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    std::memcpy(&(*vectors)[i], accessor.data + i * accessor.stride, sizeof(XMFLOAT3));
+  }
+}
+
+std::vector<std::uint32_t> ReadIndices(const Accessor& accessor) {
+  std::vector<std::uint32_t> indices(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    const std::uint8_t* p = accessor.data + i * accessor.stride;
+    switch (accessor.componentType) {
+      case s_gltfUnsignedByte: indices[i] = *p; break;
+      case s_gltfUnsignedShort: {
+        std::uint16_t index;
+        std::memcpy(&index, p, sizeof(index));
+        indices[i] = index;
+        break;
+      }
+      case s_gltfUnsignedInt: std::memcpy(&indices[i], p, sizeof(std::uint32_t)); break;
+      default: throw std::runtime_error{"glTF indices must be unsigned integers"};
+    }
+  }
+  return indices;
+}
+
+// Decode into "mesh" and return whether it has normals
+bool DecodeDraco(const MeshSource& source, MeshData* mesh) {
+  draco::DecoderBuffer buffer;
+  buffer.Init(reinterpret_cast<const char*>(source.draco.data), source.draco.size);
+  draco::Decoder decoder;
+  auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+  if (!decoded.ok())
+    throw std::runtime_error{std::string{"failed to decode Draco mesh: "} +
+                             decoded.status().error_msg()};
+  std::unique_ptr<draco::Mesh> dracoMesh = std::move(decoded).value();
+
+  auto attribute = [&](std::int64_t id, draco::GeometryAttribute::Type type) {
+    if (!source.gltf)
+      return dracoMesh->GetNamedAttribute(type);
+    return id < 0 ? nullptr : dracoMesh->GetAttributeByUniqueId(static_cast<std::uint32_t>(id));
+  };
+  const draco::PointAttribute* position =
+      attribute(source.positionId, draco::GeometryAttribute::POSITION);
+  const draco::PointAttribute* normal =
+      attribute(source.normalId, draco::GeometryAttribute::NORMAL);
+  if (!position)
+    throw std::runtime_error{"Draco mesh does not have positions"};
+
+  // Every Draco point is a distinct combination of attribute values, like a vertex
+  mesh->vertices.assign(dracoMesh->num_points(), Vertex{});
+  for (draco::PointIndex::ValueType i = 0; i < dracoMesh->num_points(); ++i) {
+    float value[3];
+    position->ConvertValue<float, 3>(position->mapped_index(draco::PointIndex{i}), value);
+    mesh->vertices[i].pos = {value[0], value[1], value[2]};
+    if (normal) {
+      normal->ConvertValue<float, 3>(normal->mapped_index(draco::PointIndex{i}), value);
+      mesh->vertices[i].normal = {value[0], value[1], value[2]};
+    }
+  }
+
+  mesh->indices.resize(3 * static_cast<size_t>(dracoMesh->num_faces()));
+  for (draco::FaceIndex::ValueType f = 0; f < dracoMesh->num_faces(); ++f) {
+    const auto& face = dracoMesh->face(draco::FaceIndex{f});
+    for (int k = 0; k < 3; ++k) {
+      mesh->indices[3 * f + k] = face[k].value();
+    }
+  }
+  return normal != nullptr;
+}
+
+// Read a plain glTF primitive into "mesh" and return whether it has normals
+bool ReadPrimitive(const GltfFile& gltf, const rapidjson::Value& primitive, MeshData* mesh) {
+  const rapidjson::Value* attributes = FindMember(primitive, "attributes");
+  if (!attributes)
+    throw std::runtime_error{"glTF primitive without attributes"};
+
+  std::vector<XMFLOAT3> positions, normals;
+  ReadVectors(OpenAccessor(gltf, UintMember(*attributes, "POSITION"), "VEC3", 3), &positions);
+  if (FindMember(*attributes, "NORMAL")) {
+    ReadVectors(OpenAccessor(gltf, UintMember(*attributes, "NORMAL"), "VEC3", 3), &normals);
+    if (normals.size() != positions.size())
+      throw std::runtime_error{"glTF primitive with fewer normals than positions"};
+  }
+
+  mesh->vertices.assign(positions.size(), Vertex{});
+  for (size_t i = 0; i < positions.size(); ++i) {
+    mesh->vertices[i].pos = positions[i];
+    if (!normals.empty())
+      mesh->vertices[i].normal = normals[i];
+  }
+
+  if (FindMember(primitive, "indices")) {
+    mesh->indices = ReadIndices(OpenAccessor(gltf, UintMember(primitive, "indices"), "SCALAR", 1));
+  } else {
+    mesh->indices.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      mesh->indices[i] = static_cast<std::uint32_t>(i);
+    }
+  }
+  return !normals.empty();
+}
+
+// Area weighted average of the normals of the triangles around every vertex, counterclockwise
+// triangles facing outward like in glTF.
+void GenerateNormals(MeshData* mesh) {
+  std::vector<XMFLOAT3> sums(mesh->vertices.size(), XMFLOAT3{0.f, 0.f, 0.f});
+  for (size_t t = 0; t < mesh->indices.size(); t += 3) {
+    const std::uint32_t* triangle = &mesh->indices[t];
+    XMVECTOR p0 = XMLoadFloat3(&mesh->vertices[triangle[0]].pos);
+    XMVECTOR p1 = XMLoadFloat3(&mesh->vertices[triangle[1]].pos);
+    XMVECTOR p2 = XMLoadFloat3(&mesh->vertices[triangle[2]].pos);
+    // Twice the area times the unit normal
+    XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+    for (int k = 0; k < 3; ++k) {
+      XMStoreFloat3(&sums[triangle[k]], XMLoadFloat3(&sums[triangle[k]]) + n);
+    }
+  }
+  for (size_t i = 0; i < sums.size(); ++i) {
+    const auto& n = sums[i];
+    float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+    mesh->vertices[i].normal =
+        length > 0.f ? XMFLOAT3{n.x / length, n.y / length, n.z / length} : XMFLOAT3{0.f, 1.f, 0.f};
+  }
+}
+
+MeshData LoadMesh(const GltfFile* gltf, const MeshSource& source) {
+  MeshData mesh;
+  bool hasNormals = source.draco.data ? DecodeDraco(source, &mesh)
+                                      : ReadPrimitive(*gltf, *source.primitive, &mesh);
+
+  if (mesh.indices.size() % 3 != 0)
+    throw std::runtime_error{"mesh index count is not a multiple of 3"};
+  for (auto index : mesh.indices) {
+    if (index >= mesh.vertices.size())
+      throw std::runtime_error{"mesh index out of range"};
+  }
+
+  if (!hasNormals)
+    GenerateNormals(&mesh);
+
+  // The same conversion to left-handed as aiProcess_MakeLeftHanded | aiProcess_FlipWindingOrder
+  for (auto& v : mesh.vertices) {
+    v.pos.z = -v.pos.z;
+    v.normal.z = -v.normal.z;
+  }
+  for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+    std::swap(mesh.indices[t + 1], mesh.indices[t + 2]);
+  }
+  return mesh;
+}
+
+std::vector<MeshData> LoadMeshes(const GltfFile* gltf, const std::vector<MeshSource>& sources) {
+  std::vector<MeshData> meshes(sources.size());
+  std::vector<std::string> errors(sources.size());
+  GlobalThreadPool().ParallelFor(0, sources.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      // The pool does not pass exceptions on to the caller
+      try {
+        meshes[i] = LoadMesh(gltf, sources[i]);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    }
+  });
+  for (const auto& error : errors) {
+    if (!error.empty())
+      throw std::runtime_error{error};
+  }
+  return meshes;
+}
+}  // namespace
+
+bool IsDracoFile(const std::string& file) {
+  if (Extension(file) == ".drc")
+    return true;
+  if (!IsGltf(file))
+    return false;
+  GltfFile gltf;
+  ParseGltf(file, &gltf);
+  return UsesDraco(gltf);
+}
+
+std::vector<MeshData> LoadDracoMeshes(const std::string& file) {
+  if (Extension(file) == ".drc") {
+    MappedFile drc{file};
+    MeshSource source;
+    source.draco = {drc.Data(), drc.Size()};
+    return LoadMeshes(nullptr, {source});
+  }
+
+  GltfFile gltf;
+  ParseGltf(file, &gltf);
+  MapBuffers(file, &gltf);
+
+  std::vector<MeshSource> sources;
+  for (const auto& mesh : ArrayMember(gltf.json, "meshes")) {
+    for (const auto& primitive : ArrayMember(mesh, "primitives")) {
+      // Points and lines are not drawn
+      if (UintMember(primitive, "mode", s_gltfTriangles) != s_gltfTriangles)
+        continue;
+
+      MeshSource source;
+      source.gltf = true;
+      const rapidjson::Value* extensions = FindMember(primitive, "extensions");
+      const rapidjson::Value* draco = extensions ? FindMember(*extensions, s_dracoExtension)
+                                                 : nullptr;
+      if (draco) {
+        source.draco = BufferView(gltf, UintMember(*draco, "bufferView"), nullptr);
+        const rapidjson::Value* attributes = FindMember(*draco, "attributes");
+        if (!attributes)
+          throw std::runtime_error{"Draco primitive without attributes: " + file};
+        source.positionId = static_cast<std::int64_t>(UintMember(*attributes, "POSITION"));
+        if (FindMember(*attributes, "NORMAL"))
+          source.normalId = static_cast<std::int64_t>(UintMember(*attributes, "NORMAL"));
+      } else {
+        source.primitive = &primitive;
+      }
+      sources.push_back(source);
+    }
+  }
+  return LoadMeshes(&gltf, sources);
+}
+
+std::vector<std::string> GltfBufferFiles(const std::string& file) {
+  if (!IsGltf(file))
+    return {};
+  GltfFile gltf;
+  ParseGltf(file, &gltf);
+  std::vector<std::string> files;
+  for (auto& path : BufferPaths(file, gltf)) {
+    if (!path.empty())
+      files.push_back(std::move(path));
+  }
+  return files;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Model.h"
+
+/**
+ * Meshes compressed with Draco, either a .drc file with one mesh or a glTF file (.gltf or .glb)
+ * whose primitives use KHR_draco_mesh_compression. The meshes of a file are decoded in parallel
+ * on the shared thread pool. They end up like the Assimp import of ObjModel: z is negated for the
+ * left-handed engine, the winding order is flipped, and missing normals are generated smooth.
+ */
+
+// Whether "file" is a .drc file or a glTF file that uses Draco compression.
+bool IsDracoFile(const std::string& file);
+
+// Triangle meshes of "file", one per triangle primitive of a glTF file. Primitives of the file
+// without compression are read as well.
+std::vector<MeshData> LoadDracoMeshes(const std::string& file);
+
+// External buffers of a glTF file, which its meshes are read from besides the file itself. Empty
+// for any other file.
+std::vector<std::string> GltfBufferFiles(const std::string& file);
@@ -0,0 +1,36 @@
+#include "DrawBatch.h"
+
+#include <unordered_map>
+
+std::vector<DrawBatch> BuildDrawBatches(const DrawKey* keys, size_t count,
+                                        std::vector<std::uint32_t>* instances) {
+  // Batch of every instance, the batches numbered by first appearance
+  std::vector<DrawBatch> batches;
+  std::vector<std::uint32_t> instanceBatches(count);
+  std::unordered_map<std::uint64_t, std::uint32_t> keyBatches;
+  for (size_t i = 0; i < count; ++i) {
+    auto packed = static_cast<std::uint64_t>(keys[i].mesh) << 32 | keys[i].lod;
+    auto it = keyBatches.emplace(packed, static_cast<std::uint32_t>(batches.size())).first;
+    if (it->second == batches.size())
+      batches.push_back({keys[i], 0, 0});
+    instanceBatches[i] = it->second;
+    ++batches[it->second].instanceCount;
+  }
+
+  std::uint32_t first = 0;
+  for (auto& batch : batches) {
+    batch.firstInstance = first;
+    first += batch.instanceCount;
+  }
+
+  // Counting sort of the instances by batch, stable within a batch
+  instances->resize(count);
+  std::vector<std::uint32_t> next(batches.size());
+  for (size_t b = 0; b < batches.size(); ++b) {
+    next[b] = batches[b].firstInstance;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    (*instances)[next[instanceBatches[i]]++] = static_cast<std::uint32_t>(i);
+  }
+  return batches;
+}
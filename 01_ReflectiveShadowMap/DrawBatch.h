@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What an instance is drawn with. Instances with equal keys are drawn by one instanced draw.
+struct DrawKey {
+  std::uint32_t mesh = 0;  // Into the mesh registry
+  std::uint32_t lod = 0;
+};
+
+// Instances [firstInstance, firstInstance + instanceCount) of the instance order, of one key.
+struct DrawBatch {
+  DrawKey key;
+  std::uint32_t firstInstance = 0;
+  std::uint32_t instanceCount = 0;
+};
+
+/**
+ * Group "count" instances by their keys. "instances" receives the indices of the instances batch
+ * after batch, each batch in the order of its instances. Batches are in the order of their first
+ * instance, so the draws roughly follow the order of the instances.
+ */
+std::vector<DrawBatch> BuildDrawBatches(const DrawKey* keys, size_t count,
+                                        std::vector<std::uint32_t>* instances);
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FNV-1a over the bytes of everything added, for the keys of the disk caches.
+class Hasher {
+public:
+  void Add(const void* data, size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+
+  template<typename T>
+  void Add(const std::vector<T>& values) {
+    Add(values.data(), values.size() * sizeof(T));
+  }
+
+  std::uint64_t Value() const { return hash_; }
+
+private:
+  std::uint64_t hash_ = 14695981039346656037ull;
+};
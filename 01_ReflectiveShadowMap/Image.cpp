@@ -0,0 +1,56 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#define STBI_MSC_SECURE_CRT
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+void SavePng(const Image& image, const std::string& file) {
+  std::vector<std::uint8_t> bytes(image.pixels.size() * 3);
+  auto toByte = [](float v) {
+    return static_cast<std::uint8_t>(std::clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+  };
+  for (size_t i = 0; i < image.pixels.size(); ++i) {
+    bytes[3 * i] = toByte(image.pixels[i].x);
+    bytes[3 * i + 1] = toByte(image.pixels[i].y);
+    bytes[3 * i + 2] = toByte(image.pixels[i].z);
+  }
+  if (!stbi_write_png(file.c_str(), image.width, image.height, 3, bytes.data(), image.width * 3))
+    throw std::runtime_error{"failed to write image: " + file};
+}
+
+void SaveHdr(const Image& image, const std::string& file) {
+  if (!stbi_write_hdr(file.c_str(), image.width, image.height, 3,
+                      reinterpret_cast<const float*>(image.pixels.data())))
+    throw std::runtime_error{"failed to write image: " + file};
+}
+
+Image Add(const Image& a, const Image& b) {
+  if (a.width != b.width || a.height != b.height)
+    throw std::runtime_error{"image sizes do not match"};
+
+  Image sum{a.width, a.height};
+  for (size_t i = 0; i < sum.pixels.size(); ++i) {
+    sum.pixels[i] = {a.pixels[i].x + b.pixels[i].x, a.pixels[i].y + b.pixels[i].y,
+                     a.pixels[i].z + b.pixels[i].z};
+  }
+  return sum;
+}
+
+double RmsError(const Image& a, const Image& b) {
+  if (a.width != b.width || a.height != b.height)
+    throw std::runtime_error{"image sizes do not match"};
+
+  double sum = 0.0;
+  for (size_t i = 0; i < a.pixels.size(); ++i) {
+    double dx = a.pixels[i].x - b.pixels[i].x;
+    double dy = a.pixels[i].y - b.pixels[i].y;
+    double dz = a.pixels[i].z - b.pixels[i].z;
+    sum += dx * dx + dy * dy + dz * dz;
+  }
+  return a.pixels.empty() ? 0.0 : std::sqrt(sum / (3.0 * a.pixels.size()));
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <string>
+#include <vector>
+
+// Linear RGB float image written by the CPU reference renderers.
+struct Image {
+  Image() = default;
+
+  Image(int width, int height)
+      : width(width),
+        height(height),
+        pixels(static_cast<size_t>(width) * height, {0.f, 0.f, 0.f}) {}
+
+  int width = 0;
+  int height = 0;
+  std::vector<DirectX::XMFLOAT3> pixels;
+
+  DirectX::XMFLOAT3& At(int x, int y) { return pixels[static_cast<size_t>(y) * width + x]; }
+
+  const DirectX::XMFLOAT3& At(int x, int y) const {
+    return pixels[static_cast<size_t>(y) * width + x];
+  }
+};
+
+// Clamped to [0, 1] without gamma, the same as writing to the R8G8B8A8_UNORM back buffer.
+void SavePng(const Image& image, const std::string& file);
+
+void SaveHdr(const Image& image, const std::string& file);
+
+// Per-pixel sum of two images of the same size.
+Image Add(const Image& a, const Image& b);
+
+// Root mean square difference over all channels.
+double RmsError(const Image& a, const Image& b);
@@ -0,0 +1,285 @@
+#include "IrradianceProbes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+// Real SH basis up to band 2, in the usual (l, m) order.
+void ShBasis(float x, float y, float z, float out[IrradianceProbeGrid::s_coefficientCount]) {
+  out[0] = 0.282095f;
+  out[1] = 0.488603f * y;
+  out[2] = 0.488603f * z;
+  out[3] = 0.488603f * x;
+  out[4] = 1.092548f * x * y;
+  out[5] = 1.092548f * y * z;
+  out[6] = 0.315392f * (3.f * z * z - 1.f);
+  out[7] = 1.092548f * x * z;
+  out[8] = 0.546274f * (x * x - y * y);
+}
+
+// Clamped cosine lobe convolution per band [Ramamoorthi and Hanrahan 2001]
+constexpr float s_cosineLobe[IrradianceProbeGrid::s_coefficientCount] = {
+    XM_PI,
+    2.f * XM_PI / 3.f, 2.f * XM_PI / 3.f, 2.f * XM_PI / 3.f,
+    XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f, XM_PI / 4.f,
+};
+}  // namespace
+
+IrradianceProbeGrid::IrradianceProbeGrid(const DirectionalLight& light, const Bounds& sceneBounds,
+                                         const IrradianceProbeSettings& settings)
+    : settings_{settings}, lightWidth_{light.width}, lightHeight_{light.height} {
+  if (settings.countX < 1 || settings.countY < 1 || settings.countZ < 1)
+    throw std::runtime_error{"irradiance probe grid needs at least one probe per axis"};
+
+  auto view = MatLightView(&light);
+  lightView_ = ToXMFloat4x4(view);
+  invLightView_ = ToXMFloat4x4(XMMatrixInverse(nullptr, view));
+
+  // Scene bounds in light space, clipped to the light cuboid
+  Bounds lightSpace;
+  for (int i = 0; i < 8; ++i) {
+    XMFLOAT3 corner = {i & 1 ? sceneBounds.max.x : sceneBounds.min.x,
+                       i & 2 ? sceneBounds.max.y : sceneBounds.min.y,
+                       i & 4 ? sceneBounds.max.z : sceneBounds.min.z};
+    lightSpace.Expand(ToXMFloat3(XMVector3TransformCoord(ToXMVector(corner), view)));
+  }
+  float zFar = light.epsilon + light.affectedDepth;
+  gridMin_ = {std::max(lightSpace.min.x, -light.width / 2),
+              std::max(lightSpace.min.y, -light.height / 2),
+              std::max(lightSpace.min.z, light.epsilon)};
+  XMFLOAT3 gridMax = {std::min(lightSpace.max.x, light.width / 2),
+                      std::min(lightSpace.max.y, light.height / 2),
+                      std::min(lightSpace.max.z, zFar)};
+  if (gridMax.x <= gridMin_.x || gridMax.y <= gridMin_.y || gridMax.z <= gridMin_.z)
+    throw std::runtime_error{"scene does not intersect the light cuboid"};
+
+  cellSize_ = {(gridMax.x - gridMin_.x) / settings.countX,
+               (gridMax.y - gridMin_.y) / settings.countY,
+               (gridMax.z - gridMin_.z) / settings.countZ};
+
+  probeCount_ = static_cast<size_t>(settings.countX) * settings.countY * settings.countZ;
+  for (auto& c : coefficients_) {
+    c.assign(probeCount_, 0.f);
+  }
+  lastUpdateFrame_.assign(probeCount_, 0);
+  lastChange_.assign(probeCount_, 1.f);
+}
+
+size_t IrradianceProbeGrid::ProbeIndex(int x, int y, int z) const {
+  return (static_cast<size_t>(z) * settings_.countY + y) * settings_.countX + x;
+}
+
+XMFLOAT3 IrradianceProbeGrid::ProbePosition(size_t probe) const {
+  int x = static_cast<int>(probe % settings_.countX);
+  int y = static_cast<int>(probe / settings_.countX % settings_.countY);
+  int z = static_cast<int>(probe / settings_.countX / settings_.countY);
+  auto p = XMVectorSet(gridMin_.x + (x + 0.5f) * cellSize_.x,
+                       gridMin_.y + (y + 0.5f) * cellSize_.y,
+                       gridMin_.z + (z + 0.5f) * cellSize_.z, 1.f);
+  return ToXMFloat3(XMVector3TransformCoord(p, ToXMMatrix(invLightView_)));
+}
+
+size_t IrradianceProbeGrid::MemoryByteSize() const {
+  return coefficients_.size() * probeCount_ * sizeof(float);
+}
+
+IrradianceProbeGrid::Vpls IrradianceProbeGrid::CollectVpls(const CpuRsm& rsm) const {
+  // PSLight writes albedo * light flux, i.e. pi times the outgoing radiance in the units PS uses
+  // for direct light. A texel covers "texelArea" of the plane perpendicular to the light.
+  int size = rsm.Size();
+  int stride = std::max(settings_.vplStride, 1);
+  float texelArea = (lightWidth_ / size) * (lightHeight_ / size) * static_cast<float>(stride) *
+                    static_cast<float>(stride);
+  float scale = texelArea / XM_PI;
+
+  Vpls vpls;
+  for (int y = 0; y < size; y += stride) {
+    for (int x = 0; x < size; x += stride) {
+      size_t i = static_cast<size_t>(y) * size + x;
+      if (!rsm.texels.IsCovered(i))
+        continue;
+
+      const auto& p = rsm.texels.position[i];
+      const auto& n = rsm.texels.normal[i];
+      const auto& f = rsm.flux[i];
+      vpls.px.push_back(p.x);
+      vpls.py.push_back(p.y);
+      vpls.pz.push_back(p.z);
+      vpls.nx.push_back(n.x);
+      vpls.ny.push_back(n.y);
+      vpls.nz.push_back(n.z);
+      vpls.r.push_back(f.x * scale);
+      vpls.g.push_back(f.y * scale);
+      vpls.b.push_back(f.z * scale);
+    }
+  }
+  return vpls;
+}
+
+std::vector<std::uint32_t> IrradianceProbeGrid::SelectProbes() {
+  size_t count = std::min(static_cast<size_t>(std::max(settings_.probesPerUpdate, 0)), probeCount_);
+  std::vector<std::uint32_t> probes(count);
+
+  if (settings_.order == ProbeUpdateOrder::RoundRobin) {
+    for (size_t i = 0; i < count; ++i) {
+      probes[i] = static_cast<std::uint32_t>((nextProbe_ + i) % probeCount_);
+    }
+    nextProbe_ = (nextProbe_ + count) % probeCount_;
+    return probes;
+  }
+
+  // Stale probes whose lighting changed on their last update come first. Every probe ages, so
+  // none of them starves.
+  std::vector<float> score(probeCount_);
+  for (size_t i = 0; i < probeCount_; ++i) {
+    auto age = static_cast<float>(frame_ - lastUpdateFrame_[i]);
+    score[i] = age * (0.1f + lastChange_[i]);
+  }
+  std::vector<std::uint32_t> order(probeCount_);
+  for (size_t i = 0; i < probeCount_; ++i) {
+    order[i] = static_cast<std::uint32_t>(i);
+  }
+  auto higherFirst = [&](std::uint32_t a, std::uint32_t b) {
+    return score[a] != score[b] ? score[a] > score[b] : a < b;
+  };
+  std::nth_element(order.begin(), order.begin() + count, order.end(), higherFirst);
+  std::copy(order.begin(), order.begin() + count, probes.begin());
+  return probes;
+}
+
+void IrradianceProbeGrid::UpdateProbes(const Vpls& vpls,
+                                       const std::vector<std::uint32_t>& probes) {
+  size_t vplCount = vpls.px.size();
+
+  GlobalThreadPool().ParallelFor(0, probes.size(), 4, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      std::uint32_t probe = probes[i];
+      auto pos = ProbePosition(probe);
+
+      float sh[3][s_coefficientCount] = {};
+      for (size_t j = 0; j < vplCount; ++j) {
+        float dx = vpls.px[j] - pos.x;
+        float dy = vpls.py[j] - pos.y;
+        float dz = vpls.pz[j] - pos.z;
+        float dist2 = std::max(dx * dx + dy * dy + dz * dz, 0.01f);
+        float invDist = 1.f / std::sqrt(dist2);
+
+        // Only the front side of a VPL emits, with a cosine falloff like in PS
+        float cosLight = -(vpls.nx[j] * dx + vpls.ny[j] * dy + vpls.nz[j] * dz) * invDist;
+        if (cosLight <= 0.f)
+          continue;
+
+        float basis[s_coefficientCount];
+        ShBasis(dx * invDist, dy * invDist, dz * invDist, basis);
+
+        float w = cosLight / dist2;
+        float r = vpls.r[j] * w;
+        float g = vpls.g[j] * w;
+        float b = vpls.b[j] * w;
+        for (int k = 0; k < s_coefficientCount; ++k) {
+          sh[0][k] += r * basis[k];
+          sh[1][k] += g * basis[k];
+          sh[2][k] += b * basis[k];
+        }
+      }
+
+      float oldDc = coefficients_[0][probe] + coefficients_[s_coefficientCount][probe] +
+                    coefficients_[2 * s_coefficientCount][probe];
+      for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < s_coefficientCount; ++k) {
+          coefficients_[c * s_coefficientCount + k][probe] = sh[c][k] * s_cosineLobe[k];
+        }
+      }
+      float newDc = coefficients_[0][probe] + coefficients_[s_coefficientCount][probe] +
+                    coefficients_[2 * s_coefficientCount][probe];
+
+      lastChange_[probe] = std::abs(newDc - oldDc) / std::max(std::max(newDc, oldDc), 1e-4f);
+      lastUpdateFrame_[probe] = frame_;
+    }
+  });
+}
+
+void IrradianceProbeGrid::Update(const CpuRsm& rsm) {
+  ++frame_;
+  UpdateProbes(CollectVpls(rsm), SelectProbes());
+}
+
+void IrradianceProbeGrid::UpdateAll(const CpuRsm& rsm) {
+  ++frame_;
+  std::vector<std::uint32_t> probes(probeCount_);
+  for (size_t i = 0; i < probeCount_; ++i) {
+    probes[i] = static_cast<std::uint32_t>(i);
+  }
+  UpdateProbes(CollectVpls(rsm), probes);
+  nextProbe_ = 0;
+}
+
+XMFLOAT3 IrradianceProbeGrid::Irradiance(XMFLOAT3 p, XMFLOAT3 n) const {
+  auto pl = ToXMFloat3(XMVector3TransformCoord(ToXMVector(p), ToXMMatrix(lightView_)));
+
+  // Continuous grid coordinates, probes sit at cell centers
+  const int counts[3] = {settings_.countX, settings_.countY, settings_.countZ};
+  const float g[3] = {(pl.x - gridMin_.x) / cellSize_.x - 0.5f,
+                      (pl.y - gridMin_.y) / cellSize_.y - 0.5f,
+                      (pl.z - gridMin_.z) / cellSize_.z - 0.5f};
+  int i0[3];
+  int i1[3];
+  float f[3];
+  for (int a = 0; a < 3; ++a) {
+    float c = std::clamp(g[a], 0.f, static_cast<float>(counts[a] - 1));
+    i0[a] = static_cast<int>(std::floor(c));
+    i1[a] = std::min(i0[a] + 1, counts[a] - 1);
+    f[a] = c - static_cast<float>(i0[a]);
+  }
+
+  float blended[3 * s_coefficientCount] = {};
+  for (int corner = 0; corner < 8; ++corner) {
+    int x = corner & 1 ? i1[0] : i0[0];
+    int y = corner & 2 ? i1[1] : i0[1];
+    int z = corner & 4 ? i1[2] : i0[2];
+    float w = (corner & 1 ? f[0] : 1.f - f[0]) * (corner & 2 ? f[1] : 1.f - f[1]) *
+              (corner & 4 ? f[2] : 1.f - f[2]);
+    if (w == 0.f)
+      continue;
+
+    size_t probe = ProbeIndex(x, y, z);
+    for (size_t k = 0; k < coefficients_.size(); ++k) {
+      blended[k] += w * coefficients_[k][probe];
+    }
+  }
+
+  auto nn = ToXMFloat3(XMVector3Normalize(ToXMVector(n)));
+  float basis[s_coefficientCount];
+  ShBasis(nn.x, nn.y, nn.z, basis);
+
+  float e[3] = {};
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < s_coefficientCount; ++k) {
+      e[c] += blended[c * s_coefficientCount + k] * basis[k];
+    }
+  }
+  return {std::max(e[0], 0.f), std::max(e[1], 0.f), std::max(e[2], 0.f)};
+}
+
+Image ShadeIrradianceProbes(const GBuffer& camera, const IrradianceProbeGrid& probes) {
+  Image image{camera.width, camera.height};
+  GlobalThreadPool().ParallelFor(0, camera.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+      for (size_t x = 0; x < static_cast<size_t>(camera.width); ++x) {
+        size_t i = y * camera.width + x;
+        if (!camera.IsCovered(i))
+          continue;
+
+        auto e = probes.Irradiance(camera.position[i], camera.normal[i]);
+        const auto& a = camera.albedo[i];
+        image.pixels[i] = {a.x * e.x, a.y * e.y, a.z * e.z};
+      }
+    }
+  });
+  return image;
+}
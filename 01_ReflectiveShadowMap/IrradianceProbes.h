@@ -0,0 +1,104 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "CpuRaster.h"
+#include "CpuScene.h"
+#include "DirectionalLight.h"
+#include "Image.h"
+#include "RsmReference.h"
+
+enum class ProbeUpdateOrder {
+  RoundRobin,  // Refresh probes in index order, wrapping around
+  Priority,    // Refresh the probes that have been stale the longest and change the most
+};
+
+struct IrradianceProbeSettings {
+  int countX = 16;  // Probes across the light's width
+  int countY = 16;  // Probes across the light's height
+  int countZ = 16;  // Probes along the light direction
+  int probesPerUpdate = 256;
+  ProbeUpdateOrder order = ProbeUpdateOrder::RoundRobin;
+  int vplStride = 2;  // Use every n-th RSM texel in both directions as a VPL
+};
+
+/**
+ * Regular grid of L2 spherical harmonics irradiance probes inside the light cuboid
+ * [Greger et al. 1998, Ramamoorthi and Hanrahan 2001].
+ * Along the light direction the grid is cut to the depth range of the scene, the rest of the
+ * cuboid is empty. Every probe projects the VPLs of an RSM into 9 SH coefficients per color
+ * channel, stored as one array per coefficient and channel so lookups and updates stream through
+ * memory. Update() refreshes only a slice of the probes, which keeps the cost per frame fixed.
+ */
+class IrradianceProbeGrid {
+public:
+  static constexpr int s_coefficientCount = 9;  // L2: bands 0, 1 and 2
+
+  IrradianceProbeGrid(const DirectionalLight& light, const Bounds& sceneBounds,
+                      const IrradianceProbeSettings& settings);
+
+  // Refresh "probesPerUpdate" probes from the VPLs of "rsm".
+  void Update(const CpuRsm& rsm);
+
+  // Refresh every probe.
+  void UpdateAll(const CpuRsm& rsm);
+
+  // Irradiance arriving at "p" around normal "n", trilinearly blended from the 8 closest probes.
+  // Multiply by the receiver albedo to get the reflected light in the units of PS.
+  DirectX::XMFLOAT3 Irradiance(DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 n) const;
+
+  size_t ProbeCount() const { return probeCount_; }
+
+  DirectX::XMFLOAT3 ProbePosition(size_t probe) const;
+
+  size_t MemoryByteSize() const;
+
+  // Coefficient k of "channel" of every probe, irradiance already convolved with the cosine lobe.
+  const std::vector<float>& Coefficients(int channel, int k) const {
+    return coefficients_[channel * s_coefficientCount + k];
+  }
+
+  std::vector<float>& Coefficients(int channel, int k) {
+    return coefficients_[channel * s_coefficientCount + k];
+  }
+
+private:
+  // Virtual point lights taken from the RSM, as structure of arrays
+  struct Vpls {
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> r, g, b;  // Flux * texel area / pi
+  };
+
+  IrradianceProbeSettings settings_;
+  float lightWidth_;
+  float lightHeight_;
+  DirectX::XMFLOAT4X4 lightView_;
+  DirectX::XMFLOAT4X4 invLightView_;
+  DirectX::XMFLOAT3 gridMin_;  // Light view space
+  DirectX::XMFLOAT3 cellSize_;
+  size_t probeCount_ = 0;
+
+  // coefficients_[channel * 9 + k][probe], irradiance (already convolved with the cosine lobe)
+  std::array<std::vector<float>, 3 * s_coefficientCount> coefficients_;
+
+  // Scheduling state
+  size_t nextProbe_ = 0;
+  std::uint32_t frame_ = 0;
+  std::vector<std::uint32_t> lastUpdateFrame_;
+  std::vector<float> lastChange_;  // Change of the probe's band 0 irradiance on its last update
+
+  size_t ProbeIndex(int x, int y, int z) const;
+
+  Vpls CollectVpls(const CpuRsm& rsm) const;
+
+  std::vector<std::uint32_t> SelectProbes();
+
+  void UpdateProbes(const Vpls& vpls, const std::vector<std::uint32_t>& probes);
+};
+
+// Indirect term, albedo * probe irradiance, for every covered pixel of "camera".
+Image ShadeIrradianceProbes(const GBuffer& camera, const IrradianceProbeGrid& probes);
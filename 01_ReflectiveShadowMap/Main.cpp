@@ -3,6 +3,7 @@
 #include <string>
 
 #include "CameraInput.h"
+#include "CpuReference.h"
 #include "D3DApp.h"
 #include "Win32Window.h"
 
@@ -21,10 +22,33 @@ void DisplayFramesPerSecond(const Win32Window& window, const D3DApp& app) {
   SetWindowText(window.GetHandle(), title.c_str());
 }
 
+// File after "-scene" on the command line, "scene.json" without one
+std::string SceneFileArgument(PWSTR pCmdLine) {
+  std::wstring cmdLine = pCmdLine ? pCmdLine : L"";
+  auto flag = cmdLine.find(L"-scene");
+  if (flag == std::wstring::npos)
+    return "scene.json";
+  auto begin = cmdLine.find_first_not_of(L' ', flag + 6);
+  if (begin == std::wstring::npos)
+    return "scene.json";
+  auto end = cmdLine[begin] == L'"' ? cmdLine.find(L'"', ++begin) : cmdLine.find(L' ', begin);
+  auto file = cmdLine.substr(begin, end == std::wstring::npos ? end : end - begin);
+  std::string narrowFile;
+  for (auto c : file) {
+    narrowFile += static_cast<char>(c);
+  }
+  return narrowFile;
+}
+
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow) {
   try {
     Win32Window window(hInstance, hPrevInstance, pCmdLine, nCmdShow);
-    D3DApp app{L"RSM Demo", 1280, 720};
+    D3DApp app{L"RSM Demo", 1280, 720, SceneFileArgument(pCmdLine)};
+
+    // "-reference" renders the scene once with the CPU reference renderers into "reference/"
+    bool reference = pCmdLine && std::wstring{pCmdLine}.find(L"-reference") != std::wstring::npos;
+    if (reference)
+      app.RetainCpuMeshes();
 
     auto orbitCameraInput = std::make_unique<OrbitCameraInputHandler>(
         app.GetCamera(),
@@ -38,6 +62,12 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     window.Show();
     window.RunD3DApp(&app);
 
+    if (reference) {
+      app.WaitForScene();
+      RunCpuReference(app.MakeCpuScene(), *app.GetCamera(), app.GetDirectionalLight(),
+                      CpuReferenceSettings{}, "reference");
+    }
+
     while (window.IsRunning()) {
       PollEvent();
       app.Update();
@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& file) {
+  HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE)
+    throw std::runtime_error{"failed to open file: " + file};
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size)) {
+    CloseHandle(handle);
+    throw std::runtime_error{"failed to get the size of file: " + file};
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  // Empty files cannot be mapped
+  if (size_ == 0) {
+    CloseHandle(handle);
+    return;
+  }
+
+  // The mapping keeps the file open
+  mapping_ = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(handle);
+  if (!mapping_)
+    throw std::runtime_error{"failed to map file: " + file};
+
+  data_ = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    CloseHandle(mapping_);
+    throw std::runtime_error{"failed to map file: " + file};
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+}
+#else
+MappedFile::MappedFile(const std::string& file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error{"failed to open file: " + file};
+
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    throw std::runtime_error{"failed to get the size of file: " + file};
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  if (size_ == 0) {
+    close(fd);
+    return;
+  }
+
+  // The mapping keeps the file open
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error{"failed to map file: " + file};
+  data_ = static_cast<const std::uint8_t*>(data);
+}
+
+MappedFile::~MappedFile() {
+  if (data_)
+    munmap(const_cast<std::uint8_t*>(data_), size_);
+}
+#endif
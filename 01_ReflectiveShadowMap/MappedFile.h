@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file. Pages are read from the page cache on first access,
+ * so nothing is copied until the data is used.
+ */
+class MappedFile {
+public:
+  // Throws std::runtime_error if the file cannot be opened or mapped.
+  explicit MappedFile(const std::string& file);
+
+  MappedFile(const MappedFile& other) = delete;
+  MappedFile& operator=(const MappedFile& other) = delete;
+
+  ~MappedFile();
+
+  const std::uint8_t* Data() const { return data_; }
+
+  size_t Size() const { return size_; }
+
+private:
+  const std::uint8_t* data_ = nullptr;  // Null for an empty file
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* mapping_ = nullptr;  // File mapping handle, the file handle is closed after mapping
+#endif
+};
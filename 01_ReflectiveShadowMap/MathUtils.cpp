@@ -1,6 +1,7 @@
 #include "MathUtils.h"
 // ReSharper disable CppInconsistentNaming
 
+#include <algorithm>
 #include <cmath>
 
 using namespace DirectX;
@@ -83,3 +84,41 @@ XMFLOAT4X4 Float4x4Identity() {
   };
   // clang-format on
 }
+
+void Bounds::Expand(const XMFLOAT3& p) {
+  min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+  max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+}
+
+XMFLOAT3 Bounds::Center() const {
+  return {0.5f * (min.x + max.x), 0.5f * (min.y + max.y), 0.5f * (min.z + max.z)};
+}
+
+XMFLOAT3 Bounds::Extent() const {
+  return {max.x - min.x, max.y - min.y, max.z - min.z};
+}
+
+XMFLOAT2 OctahedralEncode(const XMFLOAT3& n) {
+  float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.f)
+    return {0.f, 0.f};
+  float x = n.x / l1;
+  float y = n.y / l1;
+  // The lower half folds over the diagonals
+  if (n.z < 0.f) {
+    float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+    float foldedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+    x = foldedX;
+    y = foldedY;
+  }
+  return {x, y};
+}
+
+XMFLOAT3 OctahedralDecode(const XMFLOAT2& e) {
+  XMFLOAT3 n{e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y)};
+  float t = std::max(-n.z, 0.f);
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+  float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+  return {n.x / length, n.y / length, n.z / length};
+}
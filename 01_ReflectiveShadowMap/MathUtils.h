@@ -2,6 +2,7 @@
 #pragma once
 #include <DirectXMath.h>
 
+#include <cfloat>
 #include <tuple>
 
 DirectX::XMVECTOR ToXMVector(DirectX::XMFLOAT3 v);
@@ -31,4 +32,22 @@ std::tuple<float, float, float> ToSpherical(float x, float y, float z);
 
 DirectX::XMFLOAT4X4 Float4x4Identity();
 
-DirectX::XMFLOAT4X4 Float4x4Inverse(DirectX::XMFLOAT4X4 m);
\ No newline at end of file
+DirectX::XMFLOAT4X4 Float4x4Inverse(DirectX::XMFLOAT4X4 m);
+
+// Axis aligned box, empty until the first Expand().
+struct Bounds {
+  DirectX::XMFLOAT3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+  DirectX::XMFLOAT3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+  void Expand(const DirectX::XMFLOAT3& p);
+
+  DirectX::XMFLOAT3 Center() const;
+
+  DirectX::XMFLOAT3 Extent() const;
+};
+
+// Unit vector to a point of [-1, 1]^2 on the octahedron |x| + |y| + |z| = 1 unfolded onto the
+// plane [Cigolle et al. 2014].
+DirectX::XMFLOAT2 OctahedralEncode(const DirectX::XMFLOAT3& n);
+
+DirectX::XMFLOAT3 OctahedralDecode(const DirectX::XMFLOAT2& e);
@@ -0,0 +1,305 @@
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+#include "Model.h"
+
+using namespace DirectX;
+
+namespace {
+// FIFO post-transform cache, which stores the time every vertex entered it
+class FifoCache {
+public:
+  FifoCache(size_t vertexCount, size_t cacheSize)
+      : entered_(vertexCount, 0), cacheSize_{cacheSize} {}
+
+  // Returns whether "v" had to be transformed
+  bool Access(std::uint32_t v) {
+    if (entered_[v] != 0 && time_ - entered_[v] < cacheSize_)
+      return false;
+    entered_[v] = time_++;
+    return true;
+  }
+
+  // Evict everything
+  void Flush() { time_ += cacheSize_; }
+
+private:
+  std::vector<size_t> entered_;  // 0 for never
+  size_t cacheSize_;
+  size_t time_ = 1;
+};
+
+// Triangles around every vertex, in compressed rows
+struct VertexTriangles {
+  std::vector<std::uint32_t> offsets;  // Triangles of v are [offsets[v], offsets[v + 1])
+  std::vector<std::uint32_t> triangles;
+
+  VertexTriangles(const std::vector<std::uint32_t>& indices, size_t vertexCount)
+      : offsets(vertexCount + 1, 0), triangles(indices.size()) {
+    for (auto v : indices) {
+      ++offsets[v + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      triangles[next[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+    }
+  }
+};
+
+// Tipsify fans around one vertex after another. The next one is a vertex of the last fan that
+// is still in the cache and has few triangles left, or else the vertex most recently used.
+class Tipsify {
+public:
+  Tipsify(const std::vector<std::uint32_t>& indices, size_t vertexCount, size_t cacheSize)
+      : indices_{indices},
+        adjacency_{indices, vertexCount},
+        live_(vertexCount),
+        cacheTime_(vertexCount, 0),
+        emitted_(indices.size() / 3, false),
+        cacheSize_{cacheSize},
+        time_{cacheSize + 1} {
+    for (size_t v = 0; v < vertexCount; ++v) {
+      live_[v] = adjacency_.offsets[v + 1] - adjacency_.offsets[v];
+    }
+  }
+
+  std::vector<std::uint32_t> Run() {
+    std::vector<std::uint32_t> result;
+    result.reserve(indices_.size());
+    std::vector<std::uint32_t> candidates;
+    for (auto fan = SkipDeadEnd(); fan >= 0; fan = NextVertex(candidates)) {
+      candidates.clear();
+      for (auto k = adjacency_.offsets[fan]; k < adjacency_.offsets[fan + 1]; ++k) {
+        auto t = adjacency_.triangles[k];
+        if (emitted_[t])
+          continue;
+        emitted_[t] = true;
+        for (int j = 0; j < 3; ++j) {
+          auto v = indices_[3 * t + j];
+          result.push_back(v);
+          deadEnd_.push_back(v);
+          candidates.push_back(v);
+          --live_[v];
+          if (time_ - cacheTime_[v] > cacheSize_)
+            cacheTime_[v] = time_++;
+        }
+      }
+    }
+    return result;
+  }
+
+private:
+  const std::vector<std::uint32_t>& indices_;
+  VertexTriangles adjacency_;
+  std::vector<std::uint32_t> live_;  // Triangles not emitted yet
+  std::vector<size_t> cacheTime_;
+  std::vector<bool> emitted_;
+  std::vector<std::uint32_t> deadEnd_;
+  size_t cacheSize_;
+  size_t time_;
+  size_t cursor_ = 0;
+
+  std::int64_t NextVertex(const std::vector<std::uint32_t>& candidates) {
+    std::int64_t best = -1;
+    std::int64_t bestPriority = -1;
+    for (auto v : candidates) {
+      if (live_[v] == 0)
+        continue;
+      // Prefer the oldest vertex that stays in the cache while its fan is emitted
+      std::int64_t priority = 0;
+      if (time_ - cacheTime_[v] + 2 * live_[v] <= cacheSize_)
+        priority = static_cast<std::int64_t>(time_ - cacheTime_[v]);
+      if (priority > bestPriority) {
+        best = v;
+        bestPriority = priority;
+      }
+    }
+    return best >= 0 ? best : SkipDeadEnd();
+  }
+
+  std::int64_t SkipDeadEnd() {
+    while (!deadEnd_.empty()) {
+      auto v = deadEnd_.back();
+      deadEnd_.pop_back();
+      if (live_[v] > 0)
+        return v;
+    }
+    for (; cursor_ < live_.size(); ++cursor_) {
+      if (live_[cursor_] > 0)
+        return static_cast<std::int64_t>(cursor_);
+    }
+    return -1;
+  }
+};
+
+// Run of triangles of the index order
+struct Cluster {
+  size_t firstTriangle;
+  size_t triangleCount;
+  float sortKey = 0.f;
+};
+}  // namespace
+
+float VertexCacheStats::Acmr() const {
+  return triangleCount ? static_cast<float>(transformCount) / triangleCount : 0.f;
+}
+
+float VertexCacheStats::Atvr() const {
+  return vertexCount ? static_cast<float>(transformCount) / vertexCount : 0.f;
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+  triangleCount += other.triangleCount;
+  vertexCount += other.vertexCount;
+  transformCount += other.transformCount;
+  return *this;
+}
+
+MeshOptimizationStats& MeshOptimizationStats::operator+=(const MeshOptimizationStats& other) {
+  before += other.before;
+  after += other.after;
+  return *this;
+}
+
+VertexCacheStats AnalyzeVertexCache(const MeshData& mesh, size_t cacheSize) {
+  VertexCacheStats stats;
+  stats.triangleCount = mesh.indices.size() / 3;
+  std::vector<bool> used(mesh.vertices.size(), false);
+  FifoCache cache{mesh.vertices.size(), cacheSize};
+  for (auto v : mesh.indices) {
+    if (!used[v]) {
+      used[v] = true;
+      ++stats.vertexCount;
+    }
+    if (cache.Access(v))
+      ++stats.transformCount;
+  }
+  return stats;
+}
+
+void OptimizeVertexCache(MeshData* mesh, size_t cacheSize) {
+  mesh->indices = OptimizeVertexCache(mesh->indices, mesh->vertices.size(), cacheSize);
+}
+
+std::vector<std::uint32_t> OptimizeVertexCache(const std::vector<std::uint32_t>& indices,
+                                               size_t vertexCount, size_t cacheSize) {
+  return Tipsify{indices, vertexCount, cacheSize}.Run();
+}
+
+void OptimizeOverdraw(MeshData* mesh, float threshold, size_t cacheSize) {
+  size_t triangleCount = mesh->indices.size() / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Misses of every triangle in the current order
+  std::vector<int> misses(triangleCount, 0);
+  FifoCache cache{mesh->vertices.size(), cacheSize};
+  for (size_t t = 0; t < triangleCount; ++t) {
+    for (int j = 0; j < 3; ++j) {
+      misses[t] += cache.Access(mesh->indices[3 * t + j]);
+    }
+  }
+
+  // Hard boundaries at triangles that miss all three vertices, the cache restarts there anyway.
+  // Within those, soft boundaries once a cluster drawn with an empty cache is about as cache
+  // friendly as the triangles around it.
+  std::vector<Cluster> clusters;
+  auto cut = [&](size_t begin, size_t end) {
+    float hardAcmr =
+        static_cast<float>(std::accumulate(misses.begin() + begin, misses.begin() + end, 0)) /
+        (end - begin);
+    cache.Flush();
+    size_t clusterMisses = 0;
+    for (size_t t = begin; t < end; ++t) {
+      for (int j = 0; j < 3; ++j) {
+        clusterMisses += cache.Access(mesh->indices[3 * t + j]);
+      }
+      if (t + 1 == end || clusterMisses <= threshold * hardAcmr * (t + 1 - begin)) {
+        clusters.push_back({begin, t + 1 - begin});
+        begin = t + 1;
+        clusterMisses = 0;
+        cache.Flush();
+      }
+    }
+  };
+  size_t hardBegin = 0;
+  for (size_t t = 1; t <= triangleCount; ++t) {
+    if (t == triangleCount || misses[t] == 3) {
+      cut(hardBegin, t);
+      hardBegin = t;
+    }
+  }
+
+  // Sort key is how far the cluster faces away from the center of the mesh, clusters on the
+  // outside facing outward are drawn first
+  auto position = [&](size_t t, int j) {
+    return XMLoadFloat3(&mesh->vertices[mesh->indices[3 * t + j]].pos);
+  };
+  XMVECTOR meshCentroid = XMVectorZero();
+  float meshArea = 0.f;
+  std::vector<XMFLOAT3> centroids(clusters.size()), normals(clusters.size());
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    XMVECTOR centroid = XMVectorZero();
+    XMVECTOR normal = XMVectorZero();
+    float area = 0.f;
+    for (size_t t = clusters[c].firstTriangle;
+         t < clusters[c].firstTriangle + clusters[c].triangleCount; ++t) {
+      XMVECTOR p0 = position(t, 0), p1 = position(t, 1), p2 = position(t, 2);
+      XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+      float triangleArea = 0.5f * XMVectorGetX(XMVector3Length(n));
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+      normal += n;
+      area += triangleArea;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    XMStoreFloat3(&centroids[c], area > 0.f ? centroid / area : centroid);
+    XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+  }
+  if (meshArea > 0.f)
+    meshCentroid = meshCentroid / meshArea;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    clusters[c].sortKey = XMVectorGetX(
+        XMVector3Dot(XMLoadFloat3(&centroids[c]) - meshCentroid, XMLoadFloat3(&normals[c])));
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+  std::vector<std::uint32_t> indices;
+  indices.reserve(mesh->indices.size());
+  for (const auto& cluster : clusters) {
+    indices.insert(indices.end(), mesh->indices.begin() + 3 * cluster.firstTriangle,
+                   mesh->indices.begin() + 3 * (cluster.firstTriangle + cluster.triangleCount));
+  }
+  mesh->indices = std::move(indices);
+}
+
+void OptimizeVertexFetch(MeshData* mesh) {
+  constexpr std::uint32_t unused = UINT32_MAX;
+  std::vector<std::uint32_t> remap(mesh->vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh->vertices.size());
+  for (auto& v : mesh->indices) {
+    if (remap[v] == unused) {
+      remap[v] = static_cast<std::uint32_t>(vertices.size());
+      vertices.push_back(mesh->vertices[v]);
+    }
+    v = remap[v];
+  }
+  mesh->vertices = std::move(vertices);
+}
+
+MeshOptimizationStats OptimizeMesh(MeshData* mesh) {
+  MeshOptimizationStats stats;
+  stats.before = AnalyzeVertexCache(*mesh);
+  OptimizeVertexCache(mesh);
+  OptimizeOverdraw(mesh);
+  OptimizeVertexFetch(mesh);
+  stats.after = AnalyzeVertexCache(*mesh);
+  return stats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MeshData;
+
+// Entries of the FIFO post-transform cache the optimizations and the statistics assume.
+constexpr size_t s_vertexCacheSize = 16;
+
+// Vertex shader invocations of an index order, simulated with a FIFO post-transform cache.
+struct VertexCacheStats {
+  size_t triangleCount = 0;
+  size_t vertexCount = 0;  // Vertices used by the triangles
+  size_t transformCount = 0;
+
+  // Average cache miss ratio, transforms per triangle: 3 without a cache and 0.5 at best
+  float Acmr() const;
+
+  // Average transform to vertex ratio, transforms per vertex: 1 at best
+  float Atvr() const;
+
+  VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+VertexCacheStats AnalyzeVertexCache(const MeshData& mesh, size_t cacheSize = s_vertexCacheSize);
+
+// Reorder the triangles for the post-transform cache with Tipsify [Sander et al. 2007].
+void OptimizeVertexCache(MeshData* mesh, size_t cacheSize = s_vertexCacheSize);
+
+// The same for "indices" alone, of vertices below "vertexCount".
+std::vector<std::uint32_t> OptimizeVertexCache(const std::vector<std::uint32_t>& indices,
+                                               size_t vertexCount,
+                                               size_t cacheSize = s_vertexCacheSize);
+
+/**
+ * Reorder clusters of triangles so that the ones facing outward come first, which lets them
+ * occlude the rest from most light and camera directions [Sander et al. 2007]. Clusters split
+ * where the cache is flushed anyway, and further where that costs less than "threshold" times
+ * the ACMR of the order, so the cache order of OptimizeVertexCache() mostly survives.
+ */
+void OptimizeOverdraw(MeshData* mesh, float threshold = 1.05f,
+                      size_t cacheSize = s_vertexCacheSize);
+
+// Renumber the vertices in the order the triangles first use them, and drop unused ones.
+void OptimizeVertexFetch(MeshData* mesh);
+
+struct MeshOptimizationStats {
+  VertexCacheStats before;
+  VertexCacheStats after;
+
+  MeshOptimizationStats& operator+=(const MeshOptimizationStats& other);
+};
+
+// All of the above, in the order cache, overdraw and fetch.
+MeshOptimizationStats OptimizeMesh(MeshData* mesh);
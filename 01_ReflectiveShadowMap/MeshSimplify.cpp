@@ -0,0 +1,324 @@
+#include "MeshSimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+using namespace DirectX;
+
+namespace {
+// The LOD chain ends at a level that keeps more than this share of the triangles before it, or
+// would have fewer than s_minLodTriangleCount triangles
+constexpr float s_maxLodTriangleRatio = 0.9f;
+constexpr size_t s_minLodTriangleCount = 64;
+
+// Collapses that turn a triangle further than this cosine, about 75 degrees, are skipped
+constexpr float s_minTurnCosine = 0.25f;
+
+// Area weighted squared distances to planes, E(p) = p^T A p + 2 b^T p + c. Doubles, because the
+// terms of a sum cancel out close to its planes.
+struct Quadric {
+  double a00 = 0., a01 = 0., a02 = 0., a11 = 0., a12 = 0., a22 = 0.;
+  double b0 = 0., b1 = 0., b2 = 0.;
+  double c = 0.;
+  double weight = 0.;  // E / weight is a squared distance
+
+  // Plane n . p + d = 0 of unit normal "n"
+  static Quadric Plane(const XMFLOAT3& n, double d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x;
+    q.a01 = weight * n.x * n.y;
+    q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y;
+    q.a12 = weight * n.y * n.z;
+    q.a22 = weight * n.z * n.z;
+    q.b0 = weight * d * n.x;
+    q.b1 = weight * d * n.y;
+    q.b2 = weight * d * n.z;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& other) {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a11 += other.a11;
+    a12 += other.a12;
+    a22 += other.a22;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+    return *this;
+  }
+
+  double SquaredDistance(const XMFLOAT3& p) const {
+    if (weight <= 0.)
+      return 0.;
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2. * (a01 * x * y + a02 * x * z + a12 * y * z + b0 * x + b1 * y + b2 * z) + c;
+    return std::max(e, 0.) / weight;
+  }
+};
+
+// Moves vertex "from" onto vertex "to". The stamps tell whether either vertex changed since.
+struct Collapse {
+  double cost;
+  std::uint32_t from;
+  std::uint32_t to;
+  std::uint32_t fromStamp;
+  std::uint32_t toStamp;
+
+  bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+class EdgeCollapser {
+public:
+  EdgeCollapser(const Vertex* vertices, size_t vertexCount,
+                const std::vector<std::uint32_t>& indices, const SimplifySettings& settings)
+      : vertices_{vertices},
+        settings_{settings},
+        indices_{indices},
+        removed_(indices.size() / 3, false),
+        vertexTriangles_(vertexCount),
+        quadrics_(vertexCount),
+        boundary_(vertexCount, false),
+        stamps_(vertexCount, 0),
+        triangleCount_{indices.size() / 3} {
+    for (size_t t = 0; t < triangleCount_; ++t) {
+      for (int j = 0; j < 3; ++j) {
+        vertexTriangles_[indices_[3 * t + j]].push_back(static_cast<std::uint32_t>(t));
+      }
+    }
+
+    for (size_t t = 0; t < triangleCount_; ++t) {
+      const std::uint32_t* triangle = &indices_[3 * t];
+      XMVECTOR p[3];
+      for (int j = 0; j < 3; ++j) {
+        p[j] = Position(triangle[j]);
+      }
+      XMVECTOR cross = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+      float length = XMVectorGetX(XMVector3Length(cross));
+      if (length == 0.f)
+        continue;
+      XMVECTOR normal = cross / length;
+      XMFLOAT3 n;
+      XMStoreFloat3(&n, normal);
+      auto plane = Quadric::Plane(n, -XMVectorGetX(XMVector3Dot(normal, p[0])), 0.5 * length);
+      for (int j = 0; j < 3; ++j) {
+        quadrics_[triangle[j]] += plane;
+      }
+
+      // Edges of one triangle hold on to a plane through them, perpendicular to the triangle
+      for (int j = 0; j < 3; ++j) {
+        auto a = triangle[j], b = triangle[(j + 1) % 3];
+        if (SharedTriangleCount(a, b) != 1)
+          continue;
+        boundary_[a] = boundary_[b] = true;
+        XMVECTOR edge = p[(j + 1) % 3] - p[j];
+        XMVECTOR perpendicular = XMVector3Normalize(XMVector3Cross(edge, normal));
+        XMStoreFloat3(&n, perpendicular);
+        auto border = Quadric::Plane(
+            n, -XMVectorGetX(XMVector3Dot(perpendicular, p[j])),
+            settings_.boundaryWeight * XMVectorGetX(XMVector3LengthSq(edge)));
+        quadrics_[a] += border;
+        quadrics_[b] += border;
+      }
+    }
+
+    for (size_t t = 0; t < triangleCount_; ++t) {
+      for (int j = 0; j < 3; ++j) {
+        Push(indices_[3 * t + j], indices_[3 * t + (j + 1) % 3]);
+        Push(indices_[3 * t + (j + 1) % 3], indices_[3 * t + j]);
+      }
+    }
+  }
+
+  std::vector<std::uint32_t> Run(size_t targetIndexCount, float* error) {
+    double maxCost = 0.;
+    while (3 * triangleCount_ > targetIndexCount && !queue_.empty()) {
+      auto collapse = queue_.top();
+      queue_.pop();
+      if (collapse.fromStamp != stamps_[collapse.from] ||
+          collapse.toStamp != stamps_[collapse.to] || !CanCollapse(collapse.from, collapse.to))
+        continue;
+      Apply(collapse.from, collapse.to);
+      maxCost = std::max(maxCost, collapse.cost);
+    }
+    *error = static_cast<float>(std::sqrt(maxCost));
+
+    std::vector<std::uint32_t> result;
+    result.reserve(3 * triangleCount_);
+    for (size_t t = 0; t < removed_.size(); ++t) {
+      if (!removed_[t])
+        result.insert(result.end(), indices_.begin() + 3 * t, indices_.begin() + 3 * t + 3);
+    }
+    return result;
+  }
+
+private:
+  const Vertex* vertices_;
+  SimplifySettings settings_;
+  std::vector<std::uint32_t> indices_;  // With collapsed vertices replaced
+  std::vector<bool> removed_;  // Triangles that lost their area in a collapse
+  std::vector<std::vector<std::uint32_t>> vertexTriangles_;  // May still list removed ones
+  std::vector<Quadric> quadrics_;
+  std::vector<bool> boundary_;
+  std::vector<std::uint32_t> stamps_;
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue_;
+  size_t triangleCount_;
+  std::vector<std::uint32_t> fromNeighbors_;  // Scratch space of CanCollapse() and Apply()
+  std::vector<std::uint32_t> toNeighbors_;
+
+  XMVECTOR Position(std::uint32_t v) const { return XMLoadFloat3(&vertices_[v].pos); }
+
+  bool Contains(std::uint32_t t, std::uint32_t v) const {
+    return indices_[3 * t] == v || indices_[3 * t + 1] == v || indices_[3 * t + 2] == v;
+  }
+
+  size_t SharedTriangleCount(std::uint32_t a, std::uint32_t b) const {
+    size_t count = 0;
+    for (auto t : vertexTriangles_[a]) {
+      count += !removed_[t] && Contains(t, b);
+    }
+    return count;
+  }
+
+  void Neighbors(std::uint32_t v, std::vector<std::uint32_t>* neighbors) const {
+    neighbors->clear();
+    for (auto t : vertexTriangles_[v]) {
+      if (removed_[t])
+        continue;
+      for (int j = 0; j < 3; ++j) {
+        auto w = indices_[3 * t + j];
+        if (w != v && std::find(neighbors->begin(), neighbors->end(), w) == neighbors->end())
+          neighbors->push_back(w);
+      }
+    }
+  }
+
+  void Push(std::uint32_t from, std::uint32_t to) {
+    // Vertices on a border only move along it
+    if (boundary_[from] && SharedTriangleCount(from, to) != 1)
+      return;
+
+    Quadric quadric = quadrics_[from];
+    quadric += quadrics_[to];
+    double cost = quadric.SquaredDistance(vertices_[to].pos);
+    float cosine = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&vertices_[from].normal),
+                                             XMLoadFloat3(&vertices_[to].normal)));
+    float edgeLengthSq = XMVectorGetX(XMVector3LengthSq(Position(to) - Position(from)));
+    cost += settings_.normalWeight * std::max(1.f - cosine, 0.f) * edgeLengthSq;
+    queue_.push({cost, from, to, stamps_[from], stamps_[to]});
+  }
+
+  bool CanCollapse(std::uint32_t from, std::uint32_t to) {
+    size_t shared = SharedTriangleCount(from, to);
+    if (shared == 0 || (boundary_[from] && shared != 1))
+      return false;
+
+    // The only vertices next to both are the third ones of the shared triangles, otherwise the
+    // collapse pinches the surface into a non-manifold edge
+    Neighbors(from, &fromNeighbors_);
+    Neighbors(to, &toNeighbors_);
+    size_t common = 0;
+    for (auto w : fromNeighbors_) {
+      common += std::find(toNeighbors_.begin(), toNeighbors_.end(), w) != toNeighbors_.end();
+    }
+    if (common != shared)
+      return false;
+
+    for (auto t : vertexTriangles_[from]) {
+      if (removed_[t] || Contains(t, to))
+        continue;
+      XMVECTOR before[3], after[3];
+      for (int j = 0; j < 3; ++j) {
+        auto v = indices_[3 * t + j];
+        before[j] = Position(v);
+        after[j] = Position(v == from ? to : v);
+      }
+      XMVECTOR n0 = XMVector3Cross(before[1] - before[0], before[2] - before[0]);
+      XMVECTOR n1 = XMVector3Cross(after[1] - after[0], after[2] - after[0]);
+      float dot = XMVectorGetX(XMVector3Dot(n0, n1));
+      float lengths = XMVectorGetX(XMVector3Length(n0) * XMVector3Length(n1));
+      if (dot <= s_minTurnCosine * lengths)
+        return false;
+    }
+    return true;
+  }
+
+  void Apply(std::uint32_t from, std::uint32_t to) {
+    for (auto t : vertexTriangles_[from]) {
+      if (removed_[t])
+        continue;
+      if (Contains(t, to)) {
+        removed_[t] = true;
+        --triangleCount_;
+        continue;
+      }
+      for (int j = 0; j < 3; ++j) {
+        if (indices_[3 * t + j] == from)
+          indices_[3 * t + j] = to;
+      }
+      vertexTriangles_[to].push_back(t);
+    }
+    vertexTriangles_[from].clear();
+    auto& triangles = vertexTriangles_[to];
+    triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+                                   [&](std::uint32_t t) { return removed_[t]; }),
+                    triangles.end());
+
+    quadrics_[to] += quadrics_[from];
+    ++stamps_[from];
+    ++stamps_[to];
+    Neighbors(to, &toNeighbors_);
+    for (auto w : toNeighbors_) {
+      Push(to, w);
+      Push(w, to);
+    }
+  }
+};
+}  // namespace
+
+std::vector<std::uint32_t> SimplifyIndices(const Vertex* vertices, size_t vertexCount,
+                                           const std::vector<std::uint32_t>& indices,
+                                           size_t targetIndexCount, float* error,
+                                           const SimplifySettings& settings) {
+  return EdgeCollapser{vertices, vertexCount, indices, settings}.Run(targetIndexCount, error);
+}
+
+std::vector<MeshLod> BuildLodChain(const MeshData& mesh, const SimplifySettings& settings) {
+  std::vector<MeshLod> lods;
+  lods.reserve(s_maxSubmeshLodCount);  // "previous" points into it
+  const std::vector<std::uint32_t>* previous = &mesh.indices;
+  float error = 0.f;
+  while (lods.size() < s_maxSubmeshLodCount) {
+    size_t triangleCount = previous->size() / 3;
+    if (triangleCount / 2 < s_minLodTriangleCount)
+      break;
+
+    // Each level simplifies the one before, so the errors add up to a bound for the full mesh
+    float levelError = 0.f;
+    auto indices = SimplifyIndices(mesh.vertices.data(), mesh.vertices.size(), *previous,
+                                   triangleCount / 2 * 3, &levelError, settings);
+    if (indices.size() > s_maxLodTriangleRatio * previous->size())
+      break;
+    error += levelError;
+    lods.push_back({OptimizeVertexCache(indices, mesh.vertices.size()), error});
+    previous = &lods.back().indices;
+  }
+  return lods;
+}
+
+size_t SelectLod(const Submesh& submesh, float pixelsPerUnit, float tolerance) {
+  size_t lod = 0;
+  while (lod < submesh.lodCount && submesh.lods[lod].error * pixelsPerUnit <= tolerance) {
+    ++lod;
+  }
+  return lod;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Model.h"
+
+/**
+ * Simplification by edge collapses in the order of their quadric error [Garland and Heckbert
+ * 1997]. A collapse moves a vertex onto one of its neighbors, so the simplified triangles index a
+ * subset of the original vertices and every LOD of a submesh shares its vertex buffer.
+ * The cost of a collapse is the squared distance of the quadric, plus "normalWeight" times one
+ * minus the cosine between the normals of the two vertices times the squared edge length, which
+ * keeps the collapses away from creases where the shading would change. Boundary edges add planes
+ * perpendicular to their triangle, weighted by "boundaryWeight", so that open borders keep their
+ * shape. Collapses that turn a triangle by more than about 75 degrees are skipped.
+ */
+struct SimplifySettings {
+  float normalWeight = 1.f;
+  float boundaryWeight = 10.f;
+};
+
+// "indices" of triangles over "vertices" reduced to at most "targetIndexCount" indices, or as far
+// as the collapses go. "error" receives the largest cost of a collapse as a distance in model
+// units.
+std::vector<std::uint32_t> SimplifyIndices(const Vertex* vertices, size_t vertexCount,
+                                           const std::vector<std::uint32_t>& indices,
+                                           size_t targetIndexCount, float* error,
+                                           const SimplifySettings& settings = {});
+
+struct MeshLod {
+  std::vector<std::uint32_t> indices;
+  float error = 0.f;  // Bound of the distance to the full mesh, in model units
+};
+
+// Up to s_maxSubmeshLodCount LODs of "mesh", each with about half the triangles of the one before
+// and optimized for the vertex cache. The chain stops early once simplification stalls.
+std::vector<MeshLod> BuildLodChain(const MeshData& mesh, const SimplifySettings& settings = {});
+
+// Coarsest LOD of "submesh" whose error stays within "tolerance" once multiplied with
+// "pixelsPerUnit", the screen size of one model unit, 0 for the full submesh.
+size_t SelectLod(const Submesh& submesh, float pixelsPerUnit, float tolerance);
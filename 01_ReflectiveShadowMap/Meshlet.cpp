@@ -0,0 +1,267 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "Model.h"
+
+using namespace DirectX;
+
+namespace {
+// Cones wider than this, the cosine of about 84 degrees, hardly ever face away
+constexpr float s_minConeCosine = 0.1f;
+
+// Front face normal in the winding the rasterizer culls by, of length twice the area
+XMVECTOR TriangleNormal(const MeshData& mesh, const std::uint32_t* triangle) {
+  XMVECTOR p0 = XMLoadFloat3(&mesh.vertices[triangle[0]].pos);
+  XMVECTOR p1 = XMLoadFloat3(&mesh.vertices[triangle[1]].pos);
+  XMVECTOR p2 = XMLoadFloat3(&mesh.vertices[triangle[2]].pos);
+  return XMVector3Cross(p1 - p0, p2 - p0);
+}
+
+// Bounding sphere and normal cone of the triangles of "meshlet" in "indices"
+void ComputeMeshletBounds(const MeshData& mesh, const std::vector<std::uint32_t>& indices,
+                          Meshlet* meshlet) {
+  Bounds bounds;
+  XMVECTOR axis = XMVectorZero();
+  for (size_t i = meshlet->firstIndex; i < meshlet->firstIndex + meshlet->indexCount; i += 3) {
+    for (int j = 0; j < 3; ++j) {
+      bounds.Expand(mesh.vertices[indices[i + j]].pos);
+    }
+    axis += XMVector3Normalize(TriangleNormal(mesh, &indices[i]));
+  }
+  meshlet->center = bounds.Center();
+  XMVECTOR center = XMLoadFloat3(&meshlet->center);
+  float radius = 0.f;
+  for (size_t i = meshlet->firstIndex; i < meshlet->firstIndex + meshlet->indexCount; ++i) {
+    XMVECTOR p = XMLoadFloat3(&mesh.vertices[indices[i]].pos);
+    radius = std::max(radius, XMVectorGetX(XMVector3Length(p - center)));
+  }
+  meshlet->radius = radius;
+
+  // Degenerate triangles have no normal and do not narrow the cone
+  axis = XMVector3Normalize(axis);
+  float minCosine = 1.f;
+  for (size_t i = meshlet->firstIndex; i < meshlet->firstIndex + meshlet->indexCount; i += 3) {
+    XMVECTOR n = TriangleNormal(mesh, &indices[i]);
+    if (XMVectorGetX(XMVector3LengthSq(n)) > 0.f)
+      minCosine = std::min(minCosine, XMVectorGetX(XMVector3Dot(XMVector3Normalize(n), axis)));
+  }
+  XMStoreFloat3(&meshlet->coneAxis, axis);
+  meshlet->coneCutoff =
+      minCosine < s_minConeCosine ? 1.f : std::sqrt(1.f - minCosine * minCosine);
+}
+
+// Planes of the clip space box 0 <= z <= w of a row vector matrix, normalized
+void FrustumPlanes(FXMMATRIX viewProj, XMFLOAT4* planes) {
+  XMMATRIX columns = XMMatrixTranspose(viewProj);
+  XMVECTOR p[6] = {
+      columns.r[3] + columns.r[0], columns.r[3] - columns.r[0], columns.r[3] + columns.r[1],
+      columns.r[3] - columns.r[1], columns.r[2],                columns.r[3] - columns.r[2],
+  };
+  for (int i = 0; i < 6; ++i) {
+    XMStoreFloat4(&planes[i], XMPlaneNormalize(p[i]));
+  }
+}
+}  // namespace
+
+std::vector<Meshlet> BuildMeshlets(MeshData* mesh) {
+  size_t triangleCount = mesh->indices.size() / 3;
+  size_t vertexCount = mesh->vertices.size();
+  const auto& indices = mesh->indices;
+
+  // Triangles around every vertex, in compressed rows
+  std::vector<std::uint32_t> offsets(vertexCount + 1, 0);
+  for (auto v : indices) {
+    ++offsets[v + 1];
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<std::uint32_t> vertexTriangles(indices.size());
+  {
+    std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      vertexTriangles[next[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<XMFLOAT3> normals(triangleCount), centroids(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    XMStoreFloat3(&normals[t], XMVector3Normalize(TriangleNormal(*mesh, &indices[3 * t])));
+    XMVECTOR sum = XMVectorZero();
+    for (int j = 0; j < 3; ++j) {
+      sum += XMLoadFloat3(&mesh->vertices[indices[3 * t + j]].pos);
+    }
+    XMStoreFloat3(&centroids[t], sum / 3.f);
+  }
+
+  std::vector<Meshlet> meshlets;
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<bool> assigned(triangleCount, false);
+  // Meshlet that last used every vertex, + 1, so membership is one lookup
+  std::vector<size_t> vertexMeshlet(vertexCount, 0);
+  std::vector<std::uint32_t> candidates;
+  size_t seed = 0;
+  for (;;) {
+    while (seed < triangleCount && assigned[seed]) {
+      ++seed;
+    }
+    if (seed == triangleCount)
+      break;
+
+    Meshlet meshlet;
+    meshlet.firstIndex = static_cast<std::uint32_t>(result.size());
+    size_t mark = meshlets.size() + 1;
+    XMVECTOR normalSum = XMVectorZero();
+    XMVECTOR centroidSum = XMVectorZero();
+    candidates.clear();
+    auto newVertices = [&](size_t t) {
+      size_t count = 0;
+      for (int j = 0; j < 3; ++j) {
+        count += vertexMeshlet[indices[3 * t + j]] != mark;
+      }
+      return count;
+    };
+    auto add = [&](size_t t) {
+      assigned[t] = true;
+      for (int j = 0; j < 3; ++j) {
+        auto v = indices[3 * t + j];
+        result.push_back(v);
+        if (vertexMeshlet[v] != mark) {
+          vertexMeshlet[v] = mark;
+          ++meshlet.vertexCount;
+          for (auto k = offsets[v]; k < offsets[v + 1]; ++k) {
+            if (!assigned[vertexTriangles[k]])
+              candidates.push_back(vertexTriangles[k]);
+          }
+        }
+      }
+      meshlet.indexCount += 3;
+      normalSum += XMLoadFloat3(&normals[t]);
+      centroidSum += XMLoadFloat3(&centroids[t]);
+    };
+
+    add(seed);
+    while (meshlet.indexCount < 3 * s_maxMeshletTriangleCount) {
+      // Fewest new vertices first, then closest to the meshlet's centroid, with triangles
+      // facing away from it pushed further out so the cone stays narrow
+      std::int64_t best = -1;
+      size_t bestNew = 4;
+      float bestScore = 0.f;
+      XMVECTOR centroid = centroidSum / static_cast<float>(meshlet.indexCount / 3);
+      XMVECTOR normal = XMVector3Normalize(normalSum);
+      size_t kept = 0;
+      for (auto t : candidates) {
+        if (assigned[t])
+          continue;
+        candidates[kept++] = t;
+        size_t added = newVertices(t);
+        if (meshlet.vertexCount + added > s_maxMeshletVertexCount || added > bestNew)
+          continue;
+        float distance =
+            XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&centroids[t]) - centroid));
+        float cosine = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&normals[t]), normal));
+        float score = distance * (2.f - cosine);
+        if (added < bestNew || score < bestScore) {
+          best = t;
+          bestNew = added;
+          bestScore = score;
+        }
+      }
+      candidates.resize(kept);
+      if (best < 0)
+        break;
+      add(static_cast<size_t>(best));
+    }
+    meshlets.push_back(meshlet);
+  }
+
+  // Growing by neighbors ignores the cache, so each meshlet goes through Tipsify over its own
+  // vertices
+  std::vector<std::uint32_t> local, global;
+  for (auto& meshlet : meshlets) {
+    local.clear();
+    global.clear();
+    for (size_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i) {
+      auto it = std::find(global.begin(), global.end(), result[i]);
+      local.push_back(static_cast<std::uint32_t>(it - global.begin()));
+      if (it == global.end())
+        global.push_back(result[i]);
+    }
+    auto optimized = OptimizeVertexCache(local, global.size());
+    for (size_t i = 0; i < optimized.size(); ++i) {
+      result[meshlet.firstIndex + i] = global[optimized[i]];
+    }
+  }
+
+  mesh->indices = std::move(result);
+  for (auto& meshlet : meshlets) {
+    ComputeMeshletBounds(*mesh, mesh->indices, &meshlet);
+  }
+  return meshlets;
+}
+
+MeshletCullView MakePerspectiveCullView(FXMMATRIX viewProj, FXMVECTOR eye) {
+  MeshletCullView view;
+  FrustumPlanes(viewProj, view.planes);
+  XMStoreFloat3(&view.eye, eye);
+  view.direction = {0.f, 0.f, 0.f};
+  return view;
+}
+
+MeshletCullView MakeOrthographicCullView(FXMMATRIX viewProj, FXMVECTOR direction) {
+  MeshletCullView view;
+  FrustumPlanes(viewProj, view.planes);
+  view.eye = {0.f, 0.f, 0.f};
+  XMStoreFloat3(&view.direction, XMVector3Normalize(direction));
+  view.orthographic = true;
+  return view;
+}
+
+bool IsSphereInView(const MeshletCullView& view, FXMVECTOR center, float radius) {
+  for (const auto& plane : view.planes) {
+    if (XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), center)) < -radius)
+      return false;
+  }
+  return true;
+}
+
+void CullMeshlets(const Meshlet* meshlets, size_t count, const XMFLOAT4X4& model,
+                  const MeshletCullView& view, std::vector<IndexRange>* ranges) {
+  XMMATRIX m = XMLoadFloat4x4(&model);
+  float scale = XMVectorGetX(XMVector3Length(m.r[0]));
+  XMVECTOR eye = XMLoadFloat3(&view.eye);
+  XMVECTOR direction = XMLoadFloat3(&view.direction);
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto& meshlet = meshlets[i];
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&meshlet.center), m);
+    float radius = meshlet.radius * scale;
+
+    bool visible = IsSphereInView(view, center, radius);
+
+    // Back facing when every direction from the viewer to the sphere is within 90 degrees of
+    // every normal in the cone
+    if (visible && meshlet.coneCutoff < 1.f) {
+      XMVECTOR axis =
+          XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&meshlet.coneAxis), m));
+      if (view.orthographic) {
+        visible = XMVectorGetX(XMVector3Dot(direction, axis)) < meshlet.coneCutoff;
+      } else {
+        XMVECTOR toCenter = center - eye;
+        visible = XMVectorGetX(XMVector3Dot(toCenter, axis)) <
+                  meshlet.coneCutoff * XMVectorGetX(XMVector3Length(toCenter)) + radius;
+      }
+    }
+    if (!visible)
+      continue;
+
+    if (!ranges->empty() &&
+        ranges->back().firstIndex + ranges->back().indexCount == meshlet.firstIndex) {
+      ranges->back().indexCount += meshlet.indexCount;
+    } else {
+      ranges->push_back({meshlet.firstIndex, meshlet.indexCount});
+    }
+  }
+}
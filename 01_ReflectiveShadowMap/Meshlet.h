@@ -0,0 +1,65 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MeshData;
+
+// Limits of a meshlet, the ones mesh shaders are commonly tuned for.
+constexpr size_t s_maxMeshletVertexCount = 64;
+constexpr size_t s_maxMeshletTriangleCount = 124;
+
+/**
+ * Cluster of neighboring triangles of a submesh, drawn as one range of its indices. The bounding
+ * sphere culls it against a frustum, and the normal cone when all of its triangles face away from
+ * the viewer [Shirman and Abi-Ezzi 1993].
+ */
+struct Meshlet {
+  std::uint32_t firstIndex = 0;  // Relative to the first index of its submesh
+  std::uint32_t indexCount = 0;
+  std::uint32_t vertexCount = 0;  // Distinct vertices of its triangles
+  DirectX::XMFLOAT3 center = {0.f, 0.f, 0.f};  // Bounding sphere in model space
+  float radius = 0.f;
+  DirectX::XMFLOAT3 coneAxis = {0.f, 0.f, 0.f};  // Average front face normal
+  float coneCutoff = 1.f;  // Sine of the cone's half angle, 1 for no cone
+};
+
+/**
+ * Reorder the triangles of "mesh" into meshlets and return them. A meshlet starts at the first
+ * triangle left in the current order and grows by the adjacent triangle adding the fewest
+ * vertices, then facing most like it, so the cache order of OptimizeMesh() roughly survives.
+ */
+std::vector<Meshlet> BuildMeshlets(MeshData* mesh);
+
+// Range of indices of a submesh, in indices from its first one.
+struct IndexRange {
+  size_t firstIndex = 0;
+  size_t indexCount = 0;
+};
+
+// A view meshlets are culled for: the planes of its frustum in world space, and either its eye
+// or the direction it looks in for an orthographic projection.
+struct MeshletCullView {
+  DirectX::XMFLOAT4 planes[6];  // Inside where dot(plane, (p, 1)) >= 0
+  DirectX::XMFLOAT3 eye;
+  DirectX::XMFLOAT3 direction;
+  bool orthographic = false;
+};
+
+MeshletCullView MakePerspectiveCullView(DirectX::FXMMATRIX viewProj, DirectX::FXMVECTOR eye);
+
+MeshletCullView MakeOrthographicCullView(DirectX::FXMMATRIX viewProj,
+                                         DirectX::FXMVECTOR direction);
+
+// Whether the sphere at world space "center" may be inside the frustum of "view"
+bool IsSphereInView(const MeshletCullView& view, DirectX::FXMVECTOR center, float radius);
+
+/**
+ * Append the index ranges of the meshlets that "view" may see to "ranges", merging neighbors
+ * into one range. "model" is the model-to-world transform, rotation, translation and uniform
+ * scale, like every render item of the demo.
+ */
+void CullMeshlets(const Meshlet* meshlets, size_t count, const DirectX::XMFLOAT4X4& model,
+                  const MeshletCullView& view, std::vector<IndexRange>* ranges);
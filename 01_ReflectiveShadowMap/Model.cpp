@@ -5,47 +5,515 @@
 #include <assimp/scene.h>        // Output data structure
 
 #include <assimp/Importer.hpp>  // C++ importer interface
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
 
-ObjModel::ObjModel(std::string file) {
+#include "DracoMesh.h"
+#include "Hasher.h"
+#include "MappedFile.h"
+#include "Meshlet.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+
+namespace {
+constexpr size_t s_maxUint16VertexCount = 65536;
+
+constexpr unsigned s_importFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+                                   aiProcess_FlipWindingOrder | aiProcess_MakeLeftHanded |
+                                   aiProcess_GenSmoothNormals;
+
+// Mesh cache: the header, then the vertices, the quantized vertices, the index data of the
+// submeshes and their LODs, the submeshes and the meshlets, each starting at a multiple of
+// s_cacheAlignment.
+// Everything is little endian, like every target of the demos.
+constexpr std::uint32_t s_cacheMagic = 0x3148534d;  // "MSH1"
+constexpr std::uint32_t s_cacheVersion = 5;
+constexpr size_t s_cacheAlignment = 16;
+
+struct CacheHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t hash;
+  std::uint64_t vertexCount;
+  std::uint64_t indexDataByteSize;
+  std::uint64_t submeshCount;
+  std::uint64_t vertexOffset;  // In bytes from the start of the file
+  std::uint64_t quantizedVertexOffset;
+  std::uint64_t indexOffset;
+  std::uint64_t submeshOffset;
+  std::uint64_t meshletCount;
+  std::uint64_t meshletOffset;
+  Bounds bounds;
+  MeshOptimizationStats optimizationStats;
+};
+
+struct CacheSubmeshLod {
+  std::uint64_t indexByteOffset;
+  std::uint64_t indexCount;
+  float error;
+};
+
+struct CacheSubmesh {
+  std::uint64_t firstVertex;
+  std::uint64_t vertexCount;
+  std::uint64_t indexByteOffset;
+  std::uint64_t indexCount;
+  std::uint32_t indexFormat;  // 0 for 16 bit indices, 1 for 32 bit ones
+  std::uint32_t lodCount;
+  Bounds bounds;
+  CacheSubmeshLod lods[s_maxSubmeshLodCount];
+  std::uint64_t firstMeshlet;
+  std::uint64_t meshletCount;
+};
+
+size_t AlignCacheOffset(size_t offset) {
+  return (offset + s_cacheAlignment - 1) / s_cacheAlignment * s_cacheAlignment;
+}
+
+std::vector<MeshData> ImportMeshes(const std::string& file) {
   Assimp::Importer importer;
 
-  const aiScene* scene = importer.ReadFile(
-      file.c_str(),
-      aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipWindingOrder |
-          aiProcess_MakeLeftHanded | aiProcess_GenSmoothNormals);
+  const aiScene* scene = importer.ReadFile(file.c_str(), s_importFlags);
 
   if (!scene)
     throw std::runtime_error{"failed to load obj model from file: " + file};
 
-  if (scene->HasMeshes()) {
-    for (int i = 0; i < scene->mNumMeshes; ++i) {
-      auto& mesh = scene->mMeshes[i];
+  std::vector<MeshData> meshes(scene->mNumMeshes);
+  for (unsigned i = 0; i < scene->mNumMeshes; ++i) {
+    auto& mesh = scene->mMeshes[i];
 
-      assert(mesh->HasPositions(), "mesh does not have positions");
-      assert(mesh->HasNormals(), "mesh does not have normals");
-      assert(mesh->HasFaces(), "mesh does not have faces");
+    assert(mesh->HasPositions() && "mesh does not have positions");
+    assert(mesh->HasNormals() && "mesh does not have normals");
+    assert(mesh->HasFaces() && "mesh does not have faces");
 
-      // Populate vertices
-      for (int j = 0; j < mesh->mNumVertices; ++j) {
-        Vertex v;
+    // Populate vertices
+    for (unsigned j = 0; j < mesh->mNumVertices; ++j) {
+      Vertex v;
 
-        const auto& v0 = mesh->mVertices[j];
-        v.pos = {v0.x, v0.y, v0.z};
+      const auto& v0 = mesh->mVertices[j];
+      v.pos = {v0.x, v0.y, v0.z};
 
-        const auto& n0 = mesh->mNormals[j];
-        v.normal = {n0.x, n0.y, n0.z};
+      const auto& n0 = mesh->mNormals[j];
+      v.normal = {n0.x, n0.y, n0.z};
 
-        vertices_.push_back(v);
-      }
+      meshes[i].vertices.push_back(v);
+    }
+
+    // Populate indices, relative to the first vertex of the mesh. Points and lines, which
+    // aiProcess_Triangulate leaves alone, are not drawn.
+    for (unsigned j = 0; j < mesh->mNumFaces; ++j) {
+      const auto& f = mesh->mFaces[j];
+      if (f.mNumIndices != 3)
+        continue;
+      meshes[i].indices.insert(meshes[i].indices.end(), f.mIndices, f.mIndices + 3);
+    }
+  }
+  return meshes;
+}
+
+// Contents of the source file and everything else the imported data depends on
+std::uint64_t HashSource(const std::string& file) {
+  Hasher hasher;
+  {
+    MappedFile source{file};
+    hasher.Add(source.Data(), source.Size());
+  }
+  for (const auto& buffer : GltfBufferFiles(file)) {
+    MappedFile source{buffer};
+    hasher.Add(source.Data(), source.Size());
+  }
+  hasher.Add(&s_importFlags, sizeof(s_importFlags));
+  hasher.Add(&s_cacheVersion, sizeof(s_cacheVersion));
+  return hasher.Value();
+}
+
+std::string CacheFile(const std::string& cacheDir, std::uint64_t hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "mesh_%016llx.bin", static_cast<unsigned long long>(hash));
+  return cacheDir + "/" + name;
+}
+
+// Whether [offset, offset + count * size) lies within "fileSize", without overflowing
+bool InFile(std::uint64_t offset, std::uint64_t count, std::uint64_t size,
+            std::uint64_t fileSize) {
+  return offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+template<typename Index>
+void AppendIndices(const std::uint32_t* indices, size_t indexCount,
+                   std::vector<std::uint8_t>* indexData) {
+  size_t offset = indexData->size();
+  indexData->resize(offset + indexCount * sizeof(Index));
+  for (size_t i = 0; i < indexCount; ++i) {
+    auto index = static_cast<Index>(indices[i]);
+    std::memcpy(indexData->data() + offset + i * sizeof(Index), &index, sizeof(Index));
+  }
+}
+
+// Append "indices" in "format" at the next multiple of 4 and return their byte offset. An odd
+// count of 16 bit indices would leave the next ones misaligned for 32 bit ones.
+size_t AppendIndexRange(const std::uint32_t* indices, size_t indexCount, IndexFormat format,
+                        std::vector<std::uint8_t>* indexData) {
+  indexData->resize((indexData->size() + 3) / 4 * 4);
+  size_t offset = indexData->size();
+  if (format == IndexFormat::Uint16) {
+    AppendIndices<std::uint16_t>(indices, indexCount, indexData);
+  } else {
+    AppendIndices<std::uint32_t>(indices, indexCount, indexData);
+  }
+  return offset;
+}
+
+// The submesh of AppendSubmesh() with its vertices from "firstVertex" on, and its indices
+// appended to "indexData"
+Submesh AppendSubmeshIndices(const Vertex* meshVertices, size_t vertexCount,
+                             const std::uint32_t* indices, size_t indexCount, size_t firstVertex,
+                             std::vector<std::uint8_t>* indexData) {
+  for (size_t i = 0; i < indexCount; ++i) {
+    if (indices[i] >= vertexCount)
+      throw std::runtime_error{"index out of the vertex range of its mesh"};
+  }
+
+  Submesh submesh;
+  submesh.firstVertex = firstVertex;
+  submesh.vertexCount = vertexCount;
+  submesh.indexCount = indexCount;
+  submesh.indexFormat =
+      vertexCount <= s_maxUint16VertexCount ? IndexFormat::Uint16 : IndexFormat::Uint32;
+  for (size_t i = 0; i < vertexCount; ++i) {
+    submesh.bounds.Expand(meshVertices[i].pos);
+  }
+  submesh.dequantization = MakeVertexDequantization(submesh.bounds);
+  submesh.indexByteOffset = AppendIndexRange(indices, indexCount, submesh.indexFormat, indexData);
+  return submesh;
+}
+
+template<typename Index>
+void ReadIndices(const std::uint8_t* data, size_t indexCount, std::uint32_t* indices) {
+  for (size_t i = 0; i < indexCount; ++i) {
+    Index index;
+    std::memcpy(&index, data + i * sizeof(Index), sizeof(Index));
+    indices[i] = index;
+  }
+}
+}  // namespace
+
+VertexDequantization MakeVertexDequantization(const Bounds& bounds) {
+  if (bounds.min.x > bounds.max.x)
+    return {};
+  return {bounds.min, bounds.Extent()};
+}
+
+void QuantizeVertices(const Vertex* vertices, size_t count,
+                      const VertexDequantization& dequantization, QuantizedVertex* out) {
+  const float* offset = &dequantization.offset.x;
+  const float* scale = &dequantization.scale.x;
+  for (size_t i = 0; i < count; ++i) {
+    const float* pos = &vertices[i].pos.x;
+    for (int k = 0; k < 3; ++k) {
+      // A flat submesh has no extent along its normal, there every vertex is at the offset
+      float unorm = scale[k] > 0.f ? (pos[k] - offset[k]) / scale[k] : 0.f;
+      out[i].position[k] =
+          static_cast<std::uint16_t>(std::lround(std::clamp(unorm, 0.f, 1.f) * 65535.f));
+    }
+    out[i].position[3] = 0;
+
+    auto e = OctahedralEncode(vertices[i].normal);
+    out[i].normal[0] = static_cast<std::int16_t>(std::lround(std::clamp(e.x, -1.f, 1.f) * 32767.f));
+    out[i].normal[1] = static_cast<std::int16_t>(std::lround(std::clamp(e.y, -1.f, 1.f) * 32767.f));
+  }
+}
+
+void DequantizeVertices(const QuantizedVertex* vertices, size_t count,
+                        const VertexDequantization& dequantization, Vertex* out) {
+  const auto& offset = dequantization.offset;
+  const auto& scale = dequantization.scale;
+  for (size_t i = 0; i < count; ++i) {
+    const auto& v = vertices[i];
+    // Like the input assembler: unorm is q / 65535, snorm max(q / 32767, -1)
+    out[i] = Vertex{};
+    out[i].pos = {offset.x + scale.x * (v.position[0] / 65535.f),
+                  offset.y + scale.y * (v.position[1] / 65535.f),
+                  offset.z + scale.z * (v.position[2] / 65535.f)};
+    out[i].normal = OctahedralDecode(
+        {std::max(v.normal[0] / 32767.f, -1.f), std::max(v.normal[1] / 32767.f, -1.f)});
+  }
+}
+
+size_t IndexSize(IndexFormat format) {
+  return format == IndexFormat::Uint16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+}
 
-      // Populate indices
-      for (int j = 0; j < mesh->mNumFaces; ++j) {
-        const auto& f = mesh->mFaces[j];
-        for (int k = 0; k < f.mNumIndices; ++k) {
-          indices_.push_back(static_cast<std::uint16_t>(f.mIndices[k]));
-        }
+Submesh AppendSubmesh(const Vertex* meshVertices, size_t vertexCount,
+                      const std::uint32_t* indices, size_t indexCount,
+                      std::vector<Vertex>* vertices, std::vector<std::uint8_t>* indexData) {
+  auto submesh = AppendSubmeshIndices(meshVertices, vertexCount, indices, indexCount,
+                                      vertices->size(), indexData);
+  vertices->insert(vertices->end(), meshVertices, meshVertices + vertexCount);
+  return submesh;
+}
+
+Submesh AppendSubmesh(const Vertex* meshVertices, size_t vertexCount,
+                      const std::uint32_t* indices, size_t indexCount,
+                      std::vector<QuantizedVertex>* vertices,
+                      std::vector<std::uint8_t>* indexData) {
+  auto submesh = AppendSubmeshIndices(meshVertices, vertexCount, indices, indexCount,
+                                      vertices->size(), indexData);
+  vertices->resize(vertices->size() + vertexCount);
+  QuantizeVertices(meshVertices, vertexCount, submesh.dequantization,
+                   vertices->data() + submesh.firstVertex);
+  return submesh;
+}
+
+void AppendSubmeshLod(const std::uint32_t* indices, size_t indexCount, float error,
+                      Submesh* submesh, std::vector<std::uint8_t>* indexData) {
+  if (submesh->lodCount == s_maxSubmeshLodCount)
+    throw std::runtime_error{"too many LODs for one submesh"};
+  for (size_t i = 0; i < indexCount; ++i) {
+    if (indices[i] >= submesh->vertexCount)
+      throw std::runtime_error{"index out of the vertex range of its mesh"};
+  }
+
+  auto& lod = submesh->lods[submesh->lodCount++];
+  lod.indexByteOffset = AppendIndexRange(indices, indexCount, submesh->indexFormat, indexData);
+  lod.indexCount = indexCount;
+  lod.error = error;
+}
+
+Submesh SubmeshAtLod(const Submesh& submesh, size_t lod) {
+  Submesh result = submesh;
+  if (lod > 0) {
+    result.indexByteOffset = submesh.lods[lod - 1].indexByteOffset;
+    result.indexCount = submesh.lods[lod - 1].indexCount;
+  }
+  return result;
+}
+
+std::vector<std::uint32_t> SubmeshIndices(const std::uint8_t* indexData, const Submesh& submesh) {
+  std::vector<std::uint32_t> indices(submesh.indexCount);
+  const std::uint8_t* data = indexData + submesh.indexByteOffset;
+  if (submesh.indexFormat == IndexFormat::Uint16) {
+    ReadIndices<std::uint16_t>(data, submesh.indexCount, indices.data());
+  } else {
+    ReadIndices<std::uint32_t>(data, submesh.indexCount, indices.data());
+  }
+  return indices;
+}
+
+ObjModel::ObjModel(std::string file) {
+  auto meshes = IsDracoFile(file) ? LoadDracoMeshes(file) : ImportMeshes(file);
+  for (auto& mesh : meshes) {
+    // Meshlets take the triangles apart into clusters, the statistics are of their order
+    auto stats = OptimizeMesh(&mesh);
+    auto meshlets = BuildMeshlets(&mesh);
+    stats.after = AnalyzeVertexCache(mesh);
+    optimizationStats_ += stats;
+
+    submeshes_.push_back(AppendSubmesh(mesh.vertices.data(), mesh.vertices.size(),
+                                       mesh.indices.data(), mesh.indices.size(), &ownedVertices_,
+                                       &ownedIndexData_));
+    submeshes_.back().firstMeshlet = ownedMeshlets_.size();
+    submeshes_.back().meshletCount = meshlets.size();
+    ownedMeshlets_.insert(ownedMeshlets_.end(), meshlets.begin(), meshlets.end());
+    for (const auto& lod : BuildLodChain(mesh)) {
+      AppendSubmeshLod(lod.indices.data(), lod.indices.size(), lod.error, &submeshes_.back(),
+                       &ownedIndexData_);
+    }
+    bounds_.Expand(submeshes_.back().bounds.min);
+    bounds_.Expand(submeshes_.back().bounds.max);
+  }
+
+  ownedQuantizedVertices_.resize(ownedVertices_.size());
+  for (const auto& submesh : submeshes_) {
+    QuantizeVertices(ownedVertices_.data() + submesh.firstVertex, submesh.vertexCount,
+                     submesh.dequantization,
+                     ownedQuantizedVertices_.data() + submesh.firstVertex);
+  }
+
+  vertices_ = ownedVertices_.data();
+  quantizedVertices_ = ownedQuantizedVertices_.data();
+  vertexCount_ = ownedVertices_.size();
+  indexData_ = ownedIndexData_.data();
+  indexDataByteSize_ = ownedIndexData_.size();
+  meshlets_ = ownedMeshlets_.data();
+  meshletCount_ = ownedMeshlets_.size();
+}
+
+// Moving the vectors keeps their buffers, so the pointers stay valid
+ObjModel::ObjModel(ObjModel&& other) noexcept = default;
+
+ObjModel& ObjModel::operator=(ObjModel&& other) noexcept = default;
+
+ObjModel::~ObjModel() = default;
+
+ObjModel ObjModel::LoadCached(const std::string& file, const std::string& cacheDir) {
+  auto hash = HashSource(file);
+  auto cacheFile = CacheFile(cacheDir, hash);
+
+  ObjModel model;
+  if (MapCache(cacheFile, hash, &model))
+    return model;
+
+  model = ObjModel{file};
+  std::error_code error;
+  std::filesystem::create_directories(cacheDir, error);
+  model.StoreCache(cacheFile, hash);
+  return model;
+}
+
+bool ObjModel::MapCache(const std::string& file, std::uint64_t hash, ObjModel* model) {
+  std::error_code error;
+  if (!std::filesystem::exists(file, error))
+    return false;
+
+  std::unique_ptr<MappedFile> mapping;
+  try {
+    mapping = std::make_unique<MappedFile>(file);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+
+  // A cache that is stale, truncated or from another version is imported again
+  const std::uint8_t* data = mapping->Data();
+  size_t size = mapping->Size();
+  CacheHeader header;
+  if (size < sizeof(header))
+    return false;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != s_cacheMagic || header.version != s_cacheVersion || header.hash != hash ||
+      header.vertexOffset % s_cacheAlignment != 0 || header.submeshOffset % s_cacheAlignment != 0 ||
+      header.quantizedVertexOffset % s_cacheAlignment != 0 ||
+      header.meshletOffset % s_cacheAlignment != 0 ||
+      !InFile(header.vertexOffset, header.vertexCount, sizeof(Vertex), size) ||
+      !InFile(header.quantizedVertexOffset, header.vertexCount, sizeof(QuantizedVertex), size) ||
+      !InFile(header.indexOffset, header.indexDataByteSize, 1, size) ||
+      !InFile(header.submeshOffset, header.submeshCount, sizeof(CacheSubmesh), size) ||
+      !InFile(header.meshletOffset, header.meshletCount, sizeof(Meshlet), size))
+    return false;
+  auto meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+
+  std::vector<Submesh> submeshes;
+  for (std::uint64_t i = 0; i < header.submeshCount; ++i) {
+    CacheSubmesh cached;
+    std::memcpy(&cached, data + header.submeshOffset + i * sizeof(CacheSubmesh), sizeof(cached));
+    if (cached.indexFormat > 1 || cached.lodCount > s_maxSubmeshLodCount)
+      return false;
+
+    Submesh submesh;
+    submesh.firstVertex = cached.firstVertex;
+    submesh.vertexCount = cached.vertexCount;
+    submesh.indexByteOffset = cached.indexByteOffset;
+    submesh.indexCount = cached.indexCount;
+    submesh.indexFormat = cached.indexFormat == 0 ? IndexFormat::Uint16 : IndexFormat::Uint32;
+    submesh.bounds = cached.bounds;
+    submesh.dequantization = MakeVertexDequantization(submesh.bounds);
+    if (!InFile(submesh.firstVertex, submesh.vertexCount, 1, header.vertexCount) ||
+        !InFile(submesh.indexByteOffset, submesh.indexCount, IndexSize(submesh.indexFormat),
+                header.indexDataByteSize))
+      return false;
+    for (std::uint32_t l = 0; l < cached.lodCount; ++l) {
+      auto& lod = submesh.lods[l];
+      lod.indexByteOffset = cached.lods[l].indexByteOffset;
+      lod.indexCount = cached.lods[l].indexCount;
+      lod.error = cached.lods[l].error;
+      if (!InFile(lod.indexByteOffset, lod.indexCount, IndexSize(submesh.indexFormat),
+                  header.indexDataByteSize))
+        return false;
+    }
+    submesh.lodCount = cached.lodCount;
+
+    submesh.firstMeshlet = cached.firstMeshlet;
+    submesh.meshletCount = cached.meshletCount;
+    if (!InFile(submesh.firstMeshlet, submesh.meshletCount, 1, header.meshletCount))
+      return false;
+    for (size_t m = submesh.firstMeshlet; m < submesh.firstMeshlet + submesh.meshletCount; ++m) {
+      if (!InFile(meshlets[m].firstIndex, meshlets[m].indexCount, 1, submesh.indexCount))
+        return false;
+    }
+    submeshes.push_back(submesh);
+  }
+
+  model->vertices_ = reinterpret_cast<const Vertex*>(data + header.vertexOffset);
+  model->quantizedVertices_ =
+      reinterpret_cast<const QuantizedVertex*>(data + header.quantizedVertexOffset);
+  model->vertexCount_ = header.vertexCount;
+  model->indexData_ = data + header.indexOffset;
+  model->indexDataByteSize_ = header.indexDataByteSize;
+  model->meshlets_ = meshlets;
+  model->meshletCount_ = header.meshletCount;
+  model->submeshes_ = std::move(submeshes);
+  model->bounds_ = header.bounds;
+  model->optimizationStats_ = header.optimizationStats;
+  model->mapping_ = std::move(mapping);
+  return true;
+}
+
+void ObjModel::StoreCache(const std::string& file, std::uint64_t hash) const {
+  CacheHeader header{};
+  header.magic = s_cacheMagic;
+  header.version = s_cacheVersion;
+  header.hash = hash;
+  header.vertexCount = vertexCount_;
+  header.indexDataByteSize = indexDataByteSize_;
+  header.submeshCount = submeshes_.size();
+  header.vertexOffset = AlignCacheOffset(sizeof(header));
+  header.quantizedVertexOffset = AlignCacheOffset(header.vertexOffset + VerticesByteSize());
+  header.indexOffset =
+      AlignCacheOffset(header.quantizedVertexOffset + QuantizedVerticesByteSize());
+  header.submeshOffset = AlignCacheOffset(header.indexOffset + indexDataByteSize_);
+  header.meshletCount = meshletCount_;
+  header.meshletOffset =
+      AlignCacheOffset(header.submeshOffset + submeshes_.size() * sizeof(CacheSubmesh));
+  header.bounds = bounds_;
+  header.optimizationStats = optimizationStats_;
+
+  // Written next to the cache and renamed, so that no launch maps a half written file
+  auto temporary = file + ".tmp";
+  {
+    std::ofstream out{temporary, std::ios::binary};
+    // Without a cache the next launch imports again, which is slow but correct
+    if (!out)
+      return;
+
+    auto write = [&](std::uint64_t offset, const void* data, size_t size) {
+      static const char padding[s_cacheAlignment] = {};
+      out.write(padding, offset - static_cast<std::uint64_t>(out.tellp()));
+      out.write(static_cast<const char*>(data), size);
+    };
+    write(0, &header, sizeof(header));
+    write(header.vertexOffset, vertices_, VerticesByteSize());
+    write(header.quantizedVertexOffset, quantizedVertices_, QuantizedVerticesByteSize());
+    write(header.indexOffset, indexData_, indexDataByteSize_);
+    for (size_t i = 0; i < submeshes_.size(); ++i) {
+      const auto& submesh = submeshes_[i];
+      CacheSubmesh cached{};
+      cached.firstVertex = submesh.firstVertex;
+      cached.vertexCount = submesh.vertexCount;
+      cached.indexByteOffset = submesh.indexByteOffset;
+      cached.indexCount = submesh.indexCount;
+      cached.indexFormat = submesh.indexFormat == IndexFormat::Uint16 ? 0 : 1;
+      cached.lodCount = static_cast<std::uint32_t>(submesh.lodCount);
+      cached.bounds = submesh.bounds;
+      for (size_t l = 0; l < submesh.lodCount; ++l) {
+        cached.lods[l] = {submesh.lods[l].indexByteOffset, submesh.lods[l].indexCount,
+                          submesh.lods[l].error};
       }
+      cached.firstMeshlet = submesh.firstMeshlet;
+      cached.meshletCount = submesh.meshletCount;
+      write(header.submeshOffset + i * sizeof(CacheSubmesh), &cached, sizeof(cached));
     }
+    write(header.meshletOffset, meshlets_, meshletCount_ * sizeof(Meshlet));
+    if (!out)
+      return;
   }
-}
\ No newline at end of file
+
+  std::error_code error;
+  std::filesystem::rename(temporary, file, error);
+  if (error)
+    std::filesystem::remove(temporary, error);
+}
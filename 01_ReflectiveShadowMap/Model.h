@@ -1,8 +1,12 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "MathUtils.h"
+#include "Meshlet.h"
+#include "MeshOptimize.h"
 
 struct Vertex {
   DirectX::XMFLOAT3 pos;
@@ -10,23 +14,177 @@ struct Vertex {
   DirectX::XMFLOAT3 normal;
 };
 
+/**
+ * Vertex for the GPU in 12 instead of 28 bytes. The position is 16 bit unorm within the bounds of
+ * its submesh, with w unused, and the normal is octahedral in 16 bit snorm. The input assembler
+ * reads them as DXGI_FORMAT_R16G16B16A16_UNORM and DXGI_FORMAT_R16G16_SNORM.
+ */
+struct QuantizedVertex {
+  std::uint16_t position[4];
+  std::int16_t normal[2];
+};
+static_assert(sizeof(QuantizedVertex) == 12, "QuantizedVertex must match the input layout");
+
+// Position = offset + scale * unorm position, per submesh.
+struct VertexDequantization {
+  DirectX::XMFLOAT3 offset = {0.f, 0.f, 0.f};
+  DirectX::XMFLOAT3 scale = {0.f, 0.f, 0.f};
+};
+
+VertexDequantization MakeVertexDequantization(const Bounds& bounds);
+
+void QuantizeVertices(const Vertex* vertices, size_t count,
+                      const VertexDequantization& dequantization, QuantizedVertex* out);
+
+// The vertices as the GPU sees them, for the CPU reference renderers and the bakes.
+void DequantizeVertices(const QuantizedVertex* vertices, size_t count,
+                        const VertexDequantization& dequantization, Vertex* out);
+
+enum class IndexFormat {
+  Uint16,
+  Uint32,
+};
+
+size_t IndexSize(IndexFormat format);
+
+// LODs a submesh may have besides itself.
+constexpr size_t s_maxSubmeshLodCount = 4;
+
+// Coarser triangles of a submesh, over the same vertices and in the same index format.
+struct SubmeshLod {
+  size_t indexByteOffset = 0;
+  size_t indexCount = 0;
+  float error = 0.f;  // How far the LOD may be from the submesh, in model units
+};
+
+// Range of a vertex and an index buffer drawn with one call, such as one mesh of a file.
+struct Submesh {
+  size_t firstVertex = 0;  // Base vertex of the draw, the indices are relative to it
+  size_t vertexCount = 0;
+  size_t indexByteOffset = 0;  // Multiple of 4, so that any index format can start there
+  size_t indexCount = 0;
+  IndexFormat indexFormat = IndexFormat::Uint16;  // 16 bits whenever the vertices allow it
+  Bounds bounds;
+  VertexDequantization dequantization;  // Of its quantized vertices, spanning "bounds"
+  SubmeshLod lods[s_maxSubmeshLodCount];  // LOD 1 on, each coarser than the one before
+  size_t lodCount = 0;
+  size_t firstMeshlet = 0;  // Meshlets of its model covering its indices, none for LODs
+  size_t meshletCount = 0;
+};
+
+// The submesh with the indices of LOD "lod", where 0 is the submesh itself.
+Submesh SubmeshAtLod(const Submesh& submesh, size_t lod);
+
+// Vertices and indices of one triangle mesh, as read from a file.
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;  // Three per triangle
+};
+
+/**
+ * Append a submesh to "vertices" and "indexData" and return its range. "indices" are relative to
+ * "meshVertices" and are stored with 16 bits if the submesh has at most 65536 vertices, with 32
+ * bits otherwise.
+ */
+Submesh AppendSubmesh(const Vertex* meshVertices, size_t vertexCount,
+                      const std::uint32_t* indices, size_t indexCount,
+                      std::vector<Vertex>* vertices, std::vector<std::uint8_t>* indexData);
+
+// The same with the vertices quantized.
+Submesh AppendSubmesh(const Vertex* meshVertices, size_t vertexCount,
+                      const std::uint32_t* indices, size_t indexCount,
+                      std::vector<QuantizedVertex>* vertices,
+                      std::vector<std::uint8_t>* indexData);
+
+// Append "indices", relative to the first vertex of "submesh", to "indexData" as its next LOD.
+void AppendSubmeshLod(const std::uint32_t* indices, size_t indexCount, float error,
+                      Submesh* submesh, std::vector<std::uint8_t>* indexData);
+
+// Indices of "submesh" widened to 32 bits, still relative to its first vertex.
+std::vector<std::uint32_t> SubmeshIndices(const std::uint8_t* indexData, const Submesh& submesh);
+
+class MappedFile;
+
+/**
+ * Triangle meshes of a file, one submesh per mesh. The vertices of all meshes are in one array
+ * and so are their indices, ready to be copied into one vertex and one index buffer.
+ * Draco compressed files (see DracoMesh.h) are decoded with Draco, anything else is imported with
+ * Assimp. Every mesh then goes through OptimizeMesh() for the vertex cache, overdraw and vertex
+ * fetch, BuildMeshlets() splits it into meshlets and BuildLodChain() (see MeshSimplify.h) adds
+ * its LODs.
+ */
 class ObjModel {
 public:
+  // Import "file" with Assimp, or decode it with Draco.
   explicit ObjModel(std::string file);
 
-  const Vertex* VerticesBegin() const { return vertices_.data(); }
+  /**
+   * Load "file" through a binary cache in "cacheDir", keyed by the hash of the file contents and
+   * the import flags. A cached model is memory mapped and its vertices and indices are read in
+   * place, so they go from the page cache into upload buffers without Assimp or a copy. Otherwise
+   * the file is imported and the cache written for the next launch.
+   */
+  static ObjModel LoadCached(const std::string& file, const std::string& cacheDir);
+
+  ObjModel(ObjModel&& other) noexcept;
+  ObjModel& operator=(ObjModel&& other) noexcept;
+
+  ~ObjModel();
+
+  const Vertex* VerticesBegin() const { return vertices_; }
+
+  size_t VerticesByteSize() const { return vertexCount_ * sizeof(Vertex); }
+
+  size_t VertexCount() const { return vertexCount_; }
 
-  size_t VerticesByteSize() const { return vertices_.size() * sizeof(Vertex); }
+  // The same vertices quantized with the dequantization of their submesh, for the GPU
+  const QuantizedVertex* QuantizedVerticesBegin() const { return quantizedVertices_; }
 
-  size_t VertexCount() const { return vertices_.size(); }
+  size_t QuantizedVerticesByteSize() const { return vertexCount_ * sizeof(QuantizedVertex); }
 
-  const std::uint16_t* IndicesBegin() const { return indices_.data(); }
+  // Indices of all submeshes, each in its own format from its indexByteOffset on
+  const std::uint8_t* IndexData() const { return indexData_; }
 
-  size_t IndicesByteSize() const { return indices_.size() * sizeof(std::uint16_t); }
+  size_t IndexDataByteSize() const { return indexDataByteSize_; }
 
-  size_t IndexCount() const { return indices_.size(); }
+  const std::vector<Submesh>& Submeshes() const { return submeshes_; }
+
+  // Meshlets of all submeshes, see Submesh::firstMeshlet
+  const Meshlet* Meshlets() const { return meshlets_; }
+
+  size_t MeshletCount() const { return meshletCount_; }
+
+  // Bounds of all submeshes, in model space
+  const Bounds& ModelBounds() const { return bounds_; }
+
+  bool IsMapped() const { return mapping_ != nullptr; }
+
+  // Vertex cache statistics of the import, before OptimizeMesh() and in meshlet order, of all
+  // submeshes
+  const MeshOptimizationStats& OptimizationStats() const { return optimizationStats_; }
 
 private:
-  std::vector<Vertex> vertices_;
-  std::vector<std::uint16_t> indices_;
+  // Either owned by the vectors after an import, or pointing into "mapping_"
+  const Vertex* vertices_ = nullptr;
+  const QuantizedVertex* quantizedVertices_ = nullptr;
+  size_t vertexCount_ = 0;
+  const std::uint8_t* indexData_ = nullptr;
+  size_t indexDataByteSize_ = 0;
+  const Meshlet* meshlets_ = nullptr;
+  size_t meshletCount_ = 0;
+
+  std::vector<Submesh> submeshes_;
+  Bounds bounds_;
+  MeshOptimizationStats optimizationStats_;
+
+  std::vector<Vertex> ownedVertices_;
+  std::vector<QuantizedVertex> ownedQuantizedVertices_;
+  std::vector<std::uint8_t> ownedIndexData_;
+  std::vector<Meshlet> ownedMeshlets_;
+  std::unique_ptr<MappedFile> mapping_;
+
+  ObjModel() = default;
+
+  static bool MapCache(const std::string& file, std::uint64_t hash, ObjModel* model);
+  void StoreCache(const std::string& file, std::uint64_t hash) const;
 };
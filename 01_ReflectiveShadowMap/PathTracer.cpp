@@ -0,0 +1,238 @@
+#include "PathTracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+using namespace DirectX;
+
+namespace {
+struct Surface {
+  XMVECTOR position;
+  XMVECTOR normal;          // Interpolated vertex normal
+  XMVECTOR geometryNormal;  // Facing against the incoming ray
+  XMFLOAT3 albedo;
+};
+
+Surface MakeSurface(const CpuScene& scene, const Ray& ray, const RayHit& hit) {
+  auto i0 = scene.indices[3 * hit.triangle];
+  auto i1 = scene.indices[3 * hit.triangle + 1];
+  auto i2 = scene.indices[3 * hit.triangle + 2];
+
+  Surface s;
+  s.position = ToXMVector(ray.origin) + ToXMVector(ray.direction) * hit.t;
+
+  float w = 1.f - hit.u - hit.v;
+  auto n = ToXMVector(scene.normals[i0]) * w + ToXMVector(scene.normals[i1]) * hit.u +
+           ToXMVector(scene.normals[i2]) * hit.v;
+  s.normal = XMVector3Normalize(n);
+
+  auto p0 = ToXMVector(scene.positions[i0]);
+  auto ng = XMVector3Normalize(
+      XMVector3Cross(ToXMVector(scene.positions[i1]) - p0, ToXMVector(scene.positions[i2]) - p0));
+  if (XMVectorGetX(XMVector3Dot(ng, ToXMVector(ray.direction))) > 0.f)
+    ng = -ng;
+  s.geometryNormal = ng;
+
+  s.albedo = scene.albedos[hit.triangle];
+  return s;
+}
+
+// Start secondary rays slightly off the surface to avoid hitting it again
+XMVECTOR OffsetOrigin(FXMVECTOR p, FXMVECTOR geometryNormal, FXMVECTOR direction) {
+  float scale = 1e-4f * (1.f + XMVectorGetX(XMVector3Length(p)));
+  float side = XMVectorGetX(XMVector3Dot(direction, geometryNormal)) >= 0.f ? 1.f : -1.f;
+  return p + geometryNormal * (scale * side);
+}
+
+// Cosine weighted direction around "n"
+XMVECTOR SampleCosineHemisphere(FXMVECTOR n, XMFLOAT2 u) {
+  auto local = MapToDirection(SampleDomain::CosineHemisphere, u.x, u.y);
+
+  auto helper = std::abs(XMVectorGetX(n)) < 0.9f ? XMVectorSet(1.f, 0.f, 0.f, 0.f)
+                                                  : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+  auto t = XMVector3Normalize(XMVector3Cross(helper, n));
+  auto b = XMVector3Cross(n, t);
+  return XMVector3Normalize(t * local.x + b * local.y + n * local.z);
+}
+
+XMFLOAT3 Mul(const XMFLOAT3& a, const XMFLOAT3& b) {
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+}  // namespace
+
+PathTracer::PathTracer(const CpuScene& scene, const Bvh& bvh, const DirectionalLight& light,
+                       const Camera& camera, int width, int height,
+                       const PathTracerSettings& settings)
+    : scene_{scene},
+      bvh_{bvh},
+      light_{light},
+      settings_{settings},
+      width_{width},
+      height_{height} {
+  if (settings.samplesPerPass < 1 || settings.tileSize < 1)
+    throw std::runtime_error{"path tracer needs at least one sample per pass and pixel per tile"};
+
+  auto viewProj = XMMatrixMultiply(MatView(&camera), MatProj(&camera));
+  invViewProj_ = ToXMFloat4x4(XMMatrixInverse(nullptr, viewProj));
+  lightView_ = ToXMFloat4x4(MatLightView(&light));
+  toLight_ = ToXMFloat3(-XMVector3Normalize(ToXMVector(light.dir)));
+
+  size_t pixelCount = static_cast<size_t>(width) * height;
+  directSum_.assign(pixelCount, {0.f, 0.f, 0.f});
+  indirectSum_.assign(pixelCount, {0.f, 0.f, 0.f});
+}
+
+XMFLOAT3 PathTracer::DirectIrradiance(FXMVECTOR p, FXMVECTOR n, std::uint64_t* rays) const {
+  auto l = ToXMVector(toLight_);
+  float cosTheta = XMVectorGetX(XMVector3Dot(n, l));
+  if (cosTheta <= 0.f)
+    return {0.f, 0.f, 0.f};
+
+  // Outside of the light cuboid nothing arrives
+  auto pl = ToXMFloat3(XMVector3TransformCoord(p, ToXMMatrix(lightView_)));
+  if (std::abs(pl.x) > light_.width / 2 || std::abs(pl.y) > light_.height / 2 ||
+      pl.z < light_.epsilon || pl.z > light_.epsilon + light_.affectedDepth)
+    return {0.f, 0.f, 0.f};
+
+  Ray shadow;
+  shadow.origin = ToXMFloat3(p);
+  shadow.direction = toLight_;
+  shadow.tMax = pl.z - light_.epsilon;
+  ++*rays;
+  if (bvh_.Occluded(shadow))
+    return {0.f, 0.f, 0.f};
+
+  const auto& c = light_.color;
+  return {c.x * cosTheta, c.y * cosTheta, c.z * cosTheta};
+}
+
+void PathTracer::SamplePixel(int x, int y, int sampleIndex, XMFLOAT3* direct, XMFLOAT3* indirect,
+                             std::uint64_t* rays) const {
+  auto pixel = static_cast<std::uint32_t>(y * width_ + x);
+  Rng rng{Hash(pixel ^ Hash(static_cast<std::uint32_t>(sampleIndex) ^ Hash(settings_.seed)))};
+
+  // Primary ray from the near plane through a jittered point of the pixel
+  float ndcX = (x + rng.Next()) / width_ * 2.f - 1.f;
+  float ndcY = 1.f - (y + rng.Next()) / height_ * 2.f;
+  auto invViewProj = ToXMMatrix(invViewProj_);
+  auto nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.f, 1.f), invViewProj);
+  auto farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.f, 1.f), invViewProj);
+
+  Ray primary;
+  primary.origin = ToXMFloat3(nearPoint);
+  primary.direction = ToXMFloat3(XMVector3Normalize(farPoint - nearPoint));
+
+  RayHit hit;
+  ++*rays;
+  if (!bvh_.Intersect(primary, &hit)) {
+    *direct = *indirect = {0.f, 0.f, 0.f};
+    return;
+  }
+  auto x0 = MakeSurface(scene_, primary, hit);
+
+  auto l = ToXMVector(toLight_);
+  auto e = DirectIrradiance(OffsetOrigin(x0.position, x0.geometryNormal, l), x0.normal, rays);
+  *direct = Mul(x0.albedo, e);
+
+  // One bounce. With cosine sampling the estimator of the irradiance is pi * radiance, and the
+  // radiance reflected by x1 is albedo * E / pi, so the pi cancels.
+  auto u = Sample2D(settings_.bounceSequence, static_cast<std::uint32_t>(sampleIndex),
+                    static_cast<std::uint32_t>(settings_.samplesPerPixel),
+                    Hash(pixel ^ Hash(settings_.seed)));
+  auto dir = SampleCosineHemisphere(x0.normal, u);
+  Ray bounce;
+  bounce.origin = ToXMFloat3(OffsetOrigin(x0.position, x0.geometryNormal, dir));
+  bounce.direction = ToXMFloat3(dir);
+
+  RayHit bounceHit;
+  ++*rays;
+  if (!bvh_.Intersect(bounce, &bounceHit)) {
+    *indirect = {0.f, 0.f, 0.f};
+    return;
+  }
+  auto x1 = MakeSurface(scene_, bounce, bounceHit);
+
+  // Like the RSM's VPLs, surfaces only reflect from their front side
+  if (XMVectorGetX(XMVector3Dot(x1.normal, dir)) >= 0.f) {
+    *indirect = {0.f, 0.f, 0.f};
+    return;
+  }
+  auto e1 = DirectIrradiance(OffsetOrigin(x1.position, x1.geometryNormal, l), x1.normal, rays);
+  *indirect = Mul(x0.albedo, Mul(x1.albedo, e1));
+}
+
+bool PathTracer::RenderPass() {
+  if (sampleCount_ >= settings_.samplesPerPixel)
+    return false;
+
+  Timer<FloatMilliseconds> timer;
+  timer.Start();
+
+  int samples = std::min(settings_.samplesPerPass, settings_.samplesPerPixel - sampleCount_);
+  int tilesX = (width_ + settings_.tileSize - 1) / settings_.tileSize;
+  int tilesY = (height_ + settings_.tileSize - 1) / settings_.tileSize;
+  std::atomic<std::uint64_t> rays{0};
+
+  GlobalThreadPool().ParallelFor(0, static_cast<size_t>(tilesX) * tilesY, 1,
+                                 [&](size_t tileBegin, size_t tileEnd) {
+    std::uint64_t tileRays = 0;
+    for (size_t tile = tileBegin; tile < tileEnd; ++tile) {
+      int x0 = static_cast<int>(tile % tilesX) * settings_.tileSize;
+      int y0 = static_cast<int>(tile / tilesX) * settings_.tileSize;
+      int x1 = std::min(x0 + settings_.tileSize, width_);
+      int y1 = std::min(y0 + settings_.tileSize, height_);
+
+      for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+          size_t i = static_cast<size_t>(y) * width_ + x;
+          for (int s = 0; s < samples; ++s) {
+            XMFLOAT3 direct, indirect;
+            SamplePixel(x, y, sampleCount_ + s, &direct, &indirect, &tileRays);
+            directSum_[i].x += direct.x;
+            directSum_[i].y += direct.y;
+            directSum_[i].z += direct.z;
+            indirectSum_[i].x += indirect.x;
+            indirectSum_[i].y += indirect.y;
+            indirectSum_[i].z += indirect.z;
+          }
+        }
+      }
+    }
+    rays += tileRays;
+  });
+
+  sampleCount_ += samples;
+  rayCount_ += rays;
+
+  timer.Pause();
+  seconds_ += timer.TimeElapsed().count() / 1000.0;
+  return true;
+}
+
+void PathTracer::Render() {
+  while (RenderPass()) {
+  }
+}
+
+Image PathTracer::Average(const std::vector<XMFLOAT3>& sums) const {
+  Image image{width_, height_};
+  float scale = sampleCount_ > 0 ? 1.f / static_cast<float>(sampleCount_) : 0.f;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    image.pixels[i] = {sums[i].x * scale, sums[i].y * scale, sums[i].z * scale};
+  }
+  return image;
+}
+
+Image PathTracer::Direct() const {
+  return Average(directSum_);
+}
+
+Image PathTracer::Indirect() const {
+  return Average(indirectSum_);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "Camera.h"
+#include "CpuScene.h"
+#include "DirectionalLight.h"
+#include "Image.h"
+#include "Sampling.h"
+
+struct PathTracerSettings {
+  int samplesPerPixel = 64;
+  int samplesPerPass = 4;  // Samples added to every pixel by one RenderPass()
+  int tileSize = 16;
+  SampleSequence bounceSequence = SampleSequence::Sobol;  // Scrambled per pixel
+  std::uint32_t seed = 0;
+};
+
+/**
+ * Ground truth for the direct and one-bounce indirect terms, traced against a Bvh.
+ * Uses the units of PS: direct = albedo * flux * cos, and the indirect term is the receiver albedo
+ * times the irradiance reflected once off the scene. Light only arrives inside the light cuboid,
+ * as with the RSM.
+ * Rendering is progressive: every pass adds a few samples to all pixels, tile by tile on the
+ * shared thread pool. Every sample draws its random numbers from its pixel and sample index, so
+ * the images do not depend on the thread count or the pass size.
+ */
+class PathTracer {
+public:
+  PathTracer(const CpuScene& scene, const Bvh& bvh, const DirectionalLight& light,
+             const Camera& camera, int width, int height, const PathTracerSettings& settings);
+
+  // Add one pass of samples. Returns false once "samplesPerPixel" samples have been taken.
+  bool RenderPass();
+
+  // Run passes until "samplesPerPixel" is reached.
+  void Render();
+
+  int SampleCount() const { return sampleCount_; }
+
+  std::uint64_t RayCount() const { return rayCount_; }
+
+  // Wall clock time spent in RenderPass().
+  double Seconds() const { return seconds_; }
+
+  Image Direct() const;
+
+  Image Indirect() const;
+
+private:
+  const CpuScene& scene_;
+  const Bvh& bvh_;
+  DirectionalLight light_;
+  PathTracerSettings settings_;
+  int width_;
+  int height_;
+
+  DirectX::XMFLOAT4X4 invViewProj_;
+  DirectX::XMFLOAT4X4 lightView_;
+  DirectX::XMFLOAT3 toLight_;
+
+  std::vector<DirectX::XMFLOAT3> directSum_;
+  std::vector<DirectX::XMFLOAT3> indirectSum_;
+  int sampleCount_ = 0;
+  std::uint64_t rayCount_ = 0;
+  double seconds_ = 0.0;
+
+  // Irradiance from the light at a surface point, with a shadow ray. Adds traced rays to "rays".
+  DirectX::XMFLOAT3 DirectIrradiance(DirectX::FXMVECTOR p, DirectX::FXMVECTOR n,
+                                     std::uint64_t* rays) const;
+
+  void SamplePixel(int x, int y, int sampleIndex, DirectX::XMFLOAT3* direct,
+                   DirectX::XMFLOAT3* indirect, std::uint64_t* rays) const;
+
+  Image Average(const std::vector<DirectX::XMFLOAT3>& sums) const;
+};
@@ -0,0 +1,229 @@
+#include "ProbeStorage.h"
+
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace {
+constexpr int s_channelCount = 3;
+constexpr int s_coefficientCount = IrradianceProbeGrid::s_coefficientCount;
+constexpr int s_probeCoefficientCount = s_channelCount * s_coefficientCount;
+constexpr int s_bandOrder = 3;  // L2
+
+constexpr std::uint32_t s_fileMagic = 0x31425250;  // "PRB1"
+constexpr std::uint32_t s_fileVersion = 1;
+constexpr size_t s_chunkProbeCount = 4096;
+
+struct HalfRecord {
+  HALF coefficients[s_probeCoefficientCount];
+};
+
+struct ScaledRecord {
+  HALF dc[s_channelCount];
+  HALF scale;
+  std::int8_t bands[s_channelCount][s_coefficientCount - 1];
+};
+
+static_assert(sizeof(HalfRecord) == 54, "unexpected padding in HalfRecord");
+static_assert(sizeof(ScaledRecord) == 32, "unexpected padding in ScaledRecord");
+
+struct FileHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t format;
+  std::uint32_t window;
+  std::uint64_t probeCount;
+};
+
+// Coefficients of one probe, windowed
+void GatherProbe(const IrradianceProbeGrid& probes, ShWindow window, size_t probe, float* out) {
+  for (int c = 0; c < s_channelCount; ++c) {
+    float* channel = out + c * s_coefficientCount;
+    for (int k = 0; k < s_coefficientCount; ++k) {
+      channel[k] = probes.Coefficients(c, k)[probe];
+    }
+    ApplyShWindow(window, s_bandOrder, channel);
+  }
+}
+
+void EncodeHalf(const float* coefficients, HalfRecord* record) {
+  for (int i = 0; i < s_probeCoefficientCount; ++i) {
+    record->coefficients[i] = XMConvertFloatToHalf(coefficients[i]);
+  }
+}
+
+void DecodeHalf(const HalfRecord& record, float* coefficients) {
+  for (int i = 0; i < s_probeCoefficientCount; ++i) {
+    coefficients[i] = XMConvertHalfToFloat(record.coefficients[i]);
+  }
+}
+
+void EncodeScaled(const float* coefficients, ScaledRecord* record) {
+  float largest = 0.f;
+  for (int c = 0; c < s_channelCount; ++c) {
+    record->dc[c] = XMConvertFloatToHalf(coefficients[c * s_coefficientCount]);
+    for (int k = 1; k < s_coefficientCount; ++k) {
+      largest = std::max(largest, std::abs(coefficients[c * s_coefficientCount + k]));
+    }
+  }
+
+  // Quantize against the scale as it will be decoded. If it was rounded down, the largest values
+  // clamp to 127.
+  record->scale = XMConvertFloatToHalf(largest);
+  float scale = XMConvertHalfToFloat(record->scale);
+  float toUnits = scale > 0.f ? 127.f / scale : 0.f;
+  for (int c = 0; c < s_channelCount; ++c) {
+    for (int k = 1; k < s_coefficientCount; ++k) {
+      float q = std::round(coefficients[c * s_coefficientCount + k] * toUnits);
+      record->bands[c][k - 1] = static_cast<std::int8_t>(std::clamp(q, -127.f, 127.f));
+    }
+  }
+}
+
+void DecodeScaled(const ScaledRecord& record, float* coefficients) {
+  float fromUnits = XMConvertHalfToFloat(record.scale) / 127.f;
+  for (int c = 0; c < s_channelCount; ++c) {
+    coefficients[c * s_coefficientCount] = XMConvertHalfToFloat(record.dc[c]);
+    for (int k = 1; k < s_coefficientCount; ++k) {
+      coefficients[c * s_coefficientCount + k] = record.bands[c][k - 1] * fromUnits;
+    }
+  }
+}
+
+// Compress probes [begin, end) into consecutive records at "out"
+void CompressRange(const IrradianceProbeGrid& probes, const ProbeCompressionSettings& settings,
+                   size_t begin, size_t end, std::uint8_t* out) {
+  float coefficients[s_probeCoefficientCount];
+  for (size_t probe = begin; probe < end; ++probe) {
+    GatherProbe(probes, settings.window, probe, coefficients);
+    if (settings.format == ProbeFormat::Half) {
+      EncodeHalf(coefficients, reinterpret_cast<HalfRecord*>(out));
+      out += sizeof(HalfRecord);
+    } else {
+      EncodeScaled(coefficients, reinterpret_cast<ScaledRecord*>(out));
+      out += sizeof(ScaledRecord);
+    }
+  }
+}
+}  // namespace
+
+CompressedProbeGrid::CompressedProbeGrid(ProbeFormat format, ShWindow window, size_t probeCount)
+    : format_{format},
+      window_{window},
+      probeCount_{probeCount},
+      data_(probeCount * RecordByteSize(format)) {}
+
+size_t CompressedProbeGrid::RecordByteSize(ProbeFormat format) {
+  switch (format) {
+    case ProbeFormat::Half: return sizeof(HalfRecord);
+    case ProbeFormat::HalfScaled: return sizeof(ScaledRecord);
+  }
+  throw std::runtime_error{"unknown probe format"};
+}
+
+void CompressedProbeGrid::Decompress(size_t probe, float* coefficients) const {
+  const std::uint8_t* record = data_.data() + probe * RecordByteSize(format_);
+  if (format_ == ProbeFormat::Half)
+    DecodeHalf(*reinterpret_cast<const HalfRecord*>(record), coefficients);
+  else
+    DecodeScaled(*reinterpret_cast<const ScaledRecord*>(record), coefficients);
+}
+
+CompressedProbeGrid CompressProbes(const IrradianceProbeGrid& probes,
+                                   const ProbeCompressionSettings& settings) {
+  CompressedProbeGrid compressed{settings.format, settings.window, probes.ProbeCount()};
+  CompressRange(probes, settings, 0, probes.ProbeCount(), compressed.Data());
+  return compressed;
+}
+
+void DecompressProbes(const CompressedProbeGrid& compressed, IrradianceProbeGrid* probes) {
+  if (compressed.ProbeCount() != probes->ProbeCount())
+    throw std::runtime_error{"compressed probes do not match the probe grid"};
+
+  float coefficients[s_probeCoefficientCount];
+  for (size_t probe = 0; probe < compressed.ProbeCount(); ++probe) {
+    compressed.Decompress(probe, coefficients);
+    for (int c = 0; c < s_channelCount; ++c) {
+      for (int k = 0; k < s_coefficientCount; ++k) {
+        probes->Coefficients(c, k)[probe] = coefficients[c * s_coefficientCount + k];
+      }
+    }
+  }
+}
+
+ProbeCompressionError MeasureProbeError(const IrradianceProbeGrid& probes,
+                                        const CompressedProbeGrid& compressed) {
+  if (compressed.ProbeCount() != probes.ProbeCount())
+    throw std::runtime_error{"compressed probes do not match the probe grid"};
+
+  ProbeCompressionError error;
+  double squaredError = 0.0;
+  double squaredValue = 0.0;
+  float decoded[s_probeCoefficientCount];
+  for (size_t probe = 0; probe < probes.ProbeCount(); ++probe) {
+    compressed.Decompress(probe, decoded);
+    for (int c = 0; c < s_channelCount; ++c) {
+      for (int k = 0; k < s_coefficientCount; ++k) {
+        float original = probes.Coefficients(c, k)[probe];
+        float e = std::abs(decoded[c * s_coefficientCount + k] - original);
+        error.maxError = std::max(error.maxError, e);
+        squaredError += static_cast<double>(e) * e;
+        squaredValue += static_cast<double>(original) * original;
+      }
+    }
+  }
+
+  double n = static_cast<double>(probes.ProbeCount()) * s_probeCoefficientCount;
+  if (n > 0.0)
+    error.rmsError = static_cast<float>(std::sqrt(squaredError / n));
+  if (squaredValue > 0.0)
+    error.relativeRmsError = static_cast<float>(std::sqrt(squaredError / squaredValue));
+  return error;
+}
+
+void WriteCompressedProbes(const IrradianceProbeGrid& probes,
+                           const ProbeCompressionSettings& settings, std::ostream& out) {
+  FileHeader header{s_fileMagic, s_fileVersion, static_cast<std::uint32_t>(settings.format),
+                    static_cast<std::uint32_t>(settings.window), probes.ProbeCount()};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  size_t recordSize = CompressedProbeGrid::RecordByteSize(settings.format);
+  std::vector<std::uint8_t> chunk(s_chunkProbeCount * recordSize);
+  for (size_t begin = 0; begin < probes.ProbeCount(); begin += s_chunkProbeCount) {
+    size_t end = std::min(begin + s_chunkProbeCount, probes.ProbeCount());
+    CompressRange(probes, settings, begin, end, chunk.data());
+    out.write(reinterpret_cast<const char*>(chunk.data()),
+              static_cast<std::streamsize>((end - begin) * recordSize));
+  }
+
+  if (!out)
+    throw std::runtime_error{"failed to write compressed probes"};
+}
+
+CompressedProbeGrid ReadCompressedProbes(std::istream& in) {
+  FileHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != s_fileMagic)
+    throw std::runtime_error{"not a compressed probe file"};
+  if (header.version != s_fileVersion)
+    throw std::runtime_error{"unsupported compressed probe file version"};
+  if (header.format > static_cast<std::uint32_t>(ProbeFormat::HalfScaled) ||
+      header.window > static_cast<std::uint32_t>(ShWindow::Lanczos))
+    throw std::runtime_error{"corrupt compressed probe file header"};
+
+  CompressedProbeGrid compressed{static_cast<ProbeFormat>(header.format),
+                                 static_cast<ShWindow>(header.window),
+                                 static_cast<size_t>(header.probeCount)};
+  in.read(reinterpret_cast<char*>(compressed.Data()),
+          static_cast<std::streamsize>(compressed.MemoryByteSize()));
+  if (!in)
+    throw std::runtime_error{"compressed probe file is truncated"};
+  return compressed;
+}
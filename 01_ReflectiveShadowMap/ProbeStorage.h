@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "IrradianceProbes.h"
+#include "SphericalHarmonics.h"
+
+enum class ProbeFormat {
+  Half,        // All 27 coefficients as half floats, 54 bytes per probe
+  HalfScaled,  // Band 0 as half floats, bands 1 and 2 as 8 bit fractions of a scale, 32 bytes
+};
+
+struct ProbeCompressionSettings {
+  ProbeFormat format = ProbeFormat::HalfScaled;
+  ShWindow window = ShWindow::None;  // Applied before quantization
+};
+
+/**
+ * Irradiance probe coefficients packed for storage and upload, one fixed size record per probe in
+ * the probe order of the grid. The uncompressed grid takes 108 bytes per probe.
+ * HalfScaled keeps band 0, which carries the light level, at half precision. Bands 1 and 2 of a
+ * probe share one half float scale, their largest magnitude, and are stored as signed 8 bit
+ * fractions of it. Irradiance of non-negative light keeps bands 1 and 2 within about 1.2 times
+ * band 0, so the shared scale costs little precision.
+ */
+class CompressedProbeGrid {
+public:
+  CompressedProbeGrid(ProbeFormat format, ShWindow window, size_t probeCount);
+
+  static size_t RecordByteSize(ProbeFormat format);
+
+  ProbeFormat Format() const { return format_; }
+
+  ShWindow Window() const { return window_; }
+
+  size_t ProbeCount() const { return probeCount_; }
+
+  // The 27 coefficients of "probe", channel after channel like IrradianceProbeGrid::Coefficients().
+  void Decompress(size_t probe, float* coefficients) const;
+
+  std::uint8_t* Data() { return data_.data(); }
+
+  const std::uint8_t* Data() const { return data_.data(); }
+
+  size_t MemoryByteSize() const { return data_.size(); }
+
+private:
+  ProbeFormat format_;
+  ShWindow window_;
+  size_t probeCount_;
+  std::vector<std::uint8_t> data_;
+};
+
+struct ProbeCompressionError {
+  float maxError = 0.f;  // Largest coefficient error
+  float rmsError = 0.f;
+  float relativeRmsError = 0.f;  // rmsError over the RMS of the coefficients
+};
+
+CompressedProbeGrid CompressProbes(const IrradianceProbeGrid& probes,
+                                   const ProbeCompressionSettings& settings);
+
+// Overwrite the coefficients of "probes", which must have as many probes as "compressed".
+void DecompressProbes(const CompressedProbeGrid& compressed, IrradianceProbeGrid* probes);
+
+// Coefficient error of the round trip, including the window.
+ProbeCompressionError MeasureProbeError(const IrradianceProbeGrid& probes,
+                                        const CompressedProbeGrid& compressed);
+
+/**
+ * Write a header and the compressed records of "probes" to "out". Probes are compressed a chunk at
+ * a time, so a large grid is never held compressed in memory as a whole.
+ */
+void WriteCompressedProbes(const IrradianceProbeGrid& probes,
+                           const ProbeCompressionSettings& settings, std::ostream& out);
+
+// Read what WriteCompressedProbes() wrote. The records come in with a single read.
+CompressedProbeGrid ReadCompressedProbes(std::istream& in);
@@ -0,0 +1,157 @@
+#include "PrtBake.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "Hasher.h"
+#include "Sampling.h"
+#include "SphericalHarmonics.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr std::uint32_t s_cacheMagic = 0x31545250;  // "PRT1"
+constexpr std::uint32_t s_cacheVersion = 1;
+
+struct CacheHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t hash;
+  std::int32_t order;
+  std::uint32_t vertexCount;
+};
+
+std::string CacheFile(const std::string& cacheDir, std::uint64_t hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "prt_%016llx.bin", static_cast<unsigned long long>(hash));
+  return cacheDir + "/" + name;
+}
+
+bool LoadCache(const std::string& file, std::uint64_t hash, size_t vertexCount, int order,
+               PrtTransfer* transfer) {
+  std::ifstream in{file, std::ios::binary};
+  if (!in)
+    return false;
+
+  CacheHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != s_cacheMagic || header.version != s_cacheVersion ||
+      header.hash != hash || header.order != order || header.vertexCount != vertexCount)
+    return false;
+
+  transfer->order = order;
+  transfer->vertexCount = vertexCount;
+  transfer->coefficients.resize(vertexCount * ShCoefficientCount(order));
+  in.read(reinterpret_cast<char*>(transfer->coefficients.data()),
+          transfer->coefficients.size() * sizeof(float));
+  return static_cast<bool>(in);
+}
+
+void StoreCache(const std::string& file, std::uint64_t hash, const PrtTransfer& transfer) {
+  std::ofstream out{file, std::ios::binary};
+  // Without a cache the next launch bakes again, which is slow but correct
+  if (!out)
+    return;
+
+  CacheHeader header{s_cacheMagic, s_cacheVersion, hash, transfer.order,
+                     static_cast<std::uint32_t>(transfer.vertexCount)};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(transfer.coefficients.data()),
+            transfer.coefficients.size() * sizeof(float));
+}
+}  // namespace
+
+std::uint64_t HashPrtInput(const CpuScene& scene, const PrtSettings& settings) {
+  Hasher hasher;
+  hasher.Add(scene.positions);
+  hasher.Add(scene.normals);
+  hasher.Add(scene.indices);
+  hasher.Add(&settings.order, sizeof(settings.order));
+  hasher.Add(&settings.sampleCount, sizeof(settings.sampleCount));
+  hasher.Add(&settings.sequence, sizeof(settings.sequence));
+  hasher.Add(&settings.seed, sizeof(settings.seed));
+  return hasher.Value();
+}
+
+PrtTransfer BakePrtTransfer(const CpuScene& scene, const Bvh& bvh, const PrtSettings& settings) {
+  if (settings.sampleCount < 1)
+    throw std::runtime_error{"PRT bake needs at least one sample"};
+
+  int coefficientCount = ShCoefficientCount(settings.order);
+
+  // One set of directions for all vertices, with the basis evaluated once
+  DirectionIntegrator integrator{GenerateDirections(SampleDomain::Sphere, settings.sequence,
+                                                    settings.sampleCount, settings.seed)};
+  const auto& d = integrator.Directions();
+  std::vector<float> basis(static_cast<size_t>(coefficientCount) * d.Count());
+  ShEvaluateBatch(settings.order, d.x.data(), d.y.data(), d.z.data(), d.Count(), basis.data());
+  integrator.SetBasis(coefficientCount, basis);
+
+  PrtTransfer transfer;
+  transfer.order = settings.order;
+  transfer.vertexCount = scene.positions.size();
+  transfer.coefficients.resize(transfer.vertexCount * coefficientCount);
+
+  // Cosine weighted visibility, with the 1 / pi of the diffuse BRDF
+  integrator.Integrate(transfer.vertexCount, 1, [&](size_t v, size_t first, size_t count,
+                                                    float* values) {
+    auto p = ToXMVector(scene.positions[v]);
+    auto n = ToXMVector(scene.normals[v]);
+    float offset = 1e-4f * (1.f + XMVectorGetX(XMVector3Length(p)));
+    auto origin = ToXMFloat3(p + n * offset);
+    const auto& normal = scene.normals[v];
+
+    RayPacket packet;
+    size_t packetSamples[RayPacket::s_size];
+    int packetSize = 0;
+    auto flush = [&] {
+      int occluded = bvh.OccludedPacket(packet, (1 << packetSize) - 1);
+      for (int i = 0; i < packetSize; ++i) {
+        if (occluded & (1 << i))
+          values[packetSamples[i]] = 0.f;
+      }
+      packetSize = 0;
+    };
+    for (size_t k = 0; k < count; ++k) {
+      size_t s = first + k;
+      float cosTheta = normal.x * d.x[s] + normal.y * d.y[s] + normal.z * d.z[s];
+      values[k] = std::max(cosTheta, 0.f) / XM_PI;
+      if (cosTheta <= 0.f)
+        continue;
+
+      Ray ray;
+      ray.origin = origin;
+      ray.direction = {d.x[s], d.y[s], d.z[s]};
+      packet.Set(packetSize, ray);
+      packetSamples[packetSize] = k;
+      if (++packetSize == RayPacket::s_size)
+        flush();
+    }
+    if (packetSize > 0)
+      flush();
+  }, transfer.coefficients.data());
+
+  return transfer;
+}
+
+PrtTransfer LoadOrBakePrtTransfer(const CpuScene& scene, const PrtSettings& settings,
+                                  const std::string& cacheDir) {
+  auto hash = HashPrtInput(scene, settings);
+  auto file = CacheFile(cacheDir, hash);
+
+  PrtTransfer transfer;
+  if (LoadCache(file, hash, scene.positions.size(), settings.order, &transfer))
+    return transfer;
+
+  Bvh bvh{scene};
+  transfer = BakePrtTransfer(scene, bvh, settings);
+
+  std::error_code error;
+  std::filesystem::create_directories(cacheDir, error);
+  StoreCache(file, hash, transfer);
+  return transfer;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bvh.h"
+#include "CpuScene.h"
+#include "Sampling.h"
+
+struct PrtSettings {
+  int order = 4;  // SH order of the transfer vectors
+  int sampleCount = 1024;
+  SampleSequence sequence = SampleSequence::Stratified;
+  std::uint32_t seed = 0;
+};
+
+/**
+ * Shadowed diffuse transfer vectors [Sloan et al. 2002], one per vertex of a CpuScene.
+ * Vertex v stores T_i = 1 / pi * integral of V(w) max(n . w, 0) Y_i(w) dw, so the radiance leaving
+ * it under distant lighting L is albedo * dot(T, L), with L in SH coefficients.
+ */
+struct PrtTransfer {
+  int order = 0;
+  size_t vertexCount = 0;
+  std::vector<float> coefficients;  // order^2 per vertex, vertex after vertex
+
+  int CoefficientCount() const { return order * order; }
+
+  const float* Vertex(size_t vertex) const {
+    return coefficients.data() + vertex * CoefficientCount();
+  }
+};
+
+// Hash of the scene geometry and the bake settings, which keys the disk cache.
+std::uint64_t HashPrtInput(const CpuScene& scene, const PrtSettings& settings);
+
+/**
+ * Integrate the transfer of every vertex with the same set of directions over the sphere, whose
+ * basis values are evaluated once, with DirectionIntegrator. Vertices are spread over the shared
+ * thread pool, and the shadow rays of a vertex are traced four at a time.
+ */
+PrtTransfer BakePrtTransfer(const CpuScene& scene, const Bvh& bvh, const PrtSettings& settings);
+
+// Read the transfer from "cacheDir" if this scene was baked before, otherwise bake and store it.
+PrtTransfer LoadOrBakePrtTransfer(const CpuScene& scene, const PrtSettings& settings,
+                                  const std::string& cacheDir);
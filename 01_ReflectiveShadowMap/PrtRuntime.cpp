@@ -0,0 +1,146 @@
+#include "PrtRuntime.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "ShRotation.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr int s_blockSize = Float4::s_width;
+
+// Radiance of "blockCount" blocks into "out", which holds "vertexCount" vertices. "light" holds
+// count red, count green and then count blue coefficients, premultiplied by the albedo.
+template<int count>
+void RelightBlocks(const float* blocks, size_t blockCount, const Float4* light,
+                   XMFLOAT4* out, size_t vertexCount) {
+  for (size_t b = 0; b < blockCount; ++b) {
+    const float* t = blocks + b * count * s_blockSize;
+    Float4 r = 0.f, g = 0.f, bl = 0.f;
+    for (int i = 0; i < count; ++i) {
+      auto ti = Float4::Load(t + i * s_blockSize);
+      r += ti * light[i];
+      g += ti * light[count + i];
+      bl += ti * light[2 * count + i];
+    }
+
+    // Ringing of the band-limited light gives slightly negative radiance
+    r = Max(r, 0.f);
+    g = Max(g, 0.f);
+    bl = Max(bl, 0.f);
+    __m128 a = _mm_set1_ps(1.f);
+    _MM_TRANSPOSE4_PS(r.v, g.v, bl.v, a);
+
+    __m128 vertices[s_blockSize] = {r.v, g.v, bl.v, a};
+    size_t first = b * s_blockSize;
+    size_t n = std::min<size_t>(s_blockSize, vertexCount - first);
+    for (size_t k = 0; k < n; ++k) {
+      _mm_storeu_ps(&out[first + k].x, vertices[k]);
+    }
+  }
+}
+}  // namespace
+
+ShRgb ProjectDirectionalLight(const DirectionalLight& light, int order) {
+  XMFLOAT3 toLight = ToXMFloat3(-XMVector3Normalize(ToXMVector(light.dir)));
+  std::vector<float> basis(ShCoefficientCount(order));
+  ShEvaluate(order, toLight, basis.data());
+
+  ShRgb sh{order};
+  const float color[] = {light.color.x, light.color.y, light.color.z};
+  for (int c = 0; c < 3; ++c) {
+    for (size_t i = 0; i < basis.size(); ++i) {
+      sh.channels[c][i] = XM_PI * color[c] * basis[i];
+    }
+  }
+  return sh;
+}
+
+PrtRelighter::PrtRelighter(const PrtTransfer& transfer, const std::vector<CpuMesh>& meshes)
+    : order_{transfer.order},
+      vertexCount_{transfer.vertexCount} {
+  int count = transfer.CoefficientCount();
+
+  size_t blockCount = 0;
+  for (const auto& range : meshes) {
+    if (range.firstVertex + range.vertexCount > transfer.vertexCount)
+      throw std::runtime_error{"PRT mesh is out of the range of the baked vertices"};
+
+    Mesh mesh;
+    mesh.range = range;
+    mesh.firstBlock = blockCount;
+    size_t meshBlocks = (range.vertexCount + s_blockSize - 1) / s_blockSize;
+    for (size_t b = 0; b < meshBlocks; b += s_blocksPerJob) {
+      jobs_.push_back({meshes_.size(), b, std::min(s_blocksPerJob, meshBlocks - b)});
+    }
+    meshes_.push_back(mesh);
+    blockCount += meshBlocks;
+  }
+
+  // Padding vertices have zero transfer
+  blocks_.assign(blockCount * count * s_blockSize, 0.f);
+  for (const auto& mesh : meshes_) {
+    for (size_t v = 0; v < mesh.range.vertexCount; ++v) {
+      const float* t = transfer.Vertex(mesh.range.firstVertex + v);
+      float* block = blocks_.data() + (mesh.firstBlock + v / s_blockSize) * count * s_blockSize;
+      for (int i = 0; i < count; ++i) {
+        block[i * s_blockSize + v % s_blockSize] = t[i];
+      }
+    }
+  }
+}
+
+void PrtRelighter::SetMeshRotation(size_t mesh, const XMFLOAT4X4& rotation) {
+  meshes_.at(mesh).rotation = rotation;
+  meshes_[mesh].rotated = !XMMatrixIsIdentity(ToXMMatrix(rotation));
+}
+
+void PrtRelighter::Relight(const ShRgb& light, bool parallel,
+                           std::vector<XMFLOAT4>* colors) const {
+  if (light.order < order_)
+    throw std::runtime_error{"light has a lower SH order than the transfer"};
+
+  int count = ShCoefficientCount(order_);
+  colors->resize(vertexCount_);
+
+  // Light of every mesh in its bake frame, times its albedo, with every coefficient broadcast
+  std::vector<Float4> meshLights(meshes_.size() * 3 * count);
+  for (size_t m = 0; m < meshes_.size(); ++m) {
+    const auto& mesh = meshes_[m];
+    ShRgb local = light;
+    if (mesh.rotated) {
+      // The inverse rotation takes world directions back to the bake frame
+      ShRotation rotation{XMMatrixTranspose(ToXMMatrix(mesh.rotation)), light.order};
+      local = rotation.Apply(light);
+    }
+    const float albedo[] = {mesh.range.albedo.x, mesh.range.albedo.y, mesh.range.albedo.z};
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < count; ++i) {
+        meshLights[(m * 3 + c) * count + i] = albedo[c] * local.channels[c][i];
+      }
+    }
+  }
+
+  auto relightJobs = [&](size_t jobBegin, size_t jobEnd) {
+    ShDispatchOrder(order_, [&](auto order) {
+      constexpr int n = decltype(order)::value * decltype(order)::value;
+      for (size_t j = jobBegin; j < jobEnd; ++j) {
+        const auto& job = jobs_[j];
+        const auto& mesh = meshes_[job.mesh];
+        size_t firstVertex = job.firstBlock * s_blockSize;
+        RelightBlocks<n>(blocks_.data() + (mesh.firstBlock + job.firstBlock) * n * s_blockSize,
+                         job.blockCount, meshLights.data() + job.mesh * 3 * n,
+                         colors->data() + mesh.range.firstVertex + firstVertex,
+                         mesh.range.vertexCount - firstVertex);
+      }
+    });
+  };
+
+  if (parallel)
+    GlobalThreadPool().ParallelFor(0, jobs_.size(), 1, relightJobs);
+  else
+    relightJobs(0, jobs_.size());
+}
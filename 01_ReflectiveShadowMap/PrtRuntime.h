@@ -0,0 +1,66 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <vector>
+
+#include "CpuScene.h"
+#include "DirectionalLight.h"
+#include "PrtBake.h"
+#include "SphericalHarmonics.h"
+
+/**
+ * SH coefficients of a directional light: a delta in direction -light.dir with the irradiance
+ * "light.color". Scaled by pi so that relighting with the transfer of PrtBake gives the units of
+ * PS, albedo * flux * cos. The delta rings at low orders, which the relighter clamps away.
+ */
+ShRgb ProjectDirectionalLight(const DirectionalLight& light, int order);
+
+/**
+ * Per-vertex relighting with baked transfer vectors. The radiance of vertex v under lighting L is
+ * albedo * dot(T_v, L), so relighting a mesh is a matrix-vector product of its transfer matrix and
+ * the light, one per color channel.
+ * The transfer is copied into blocks of four vertices, coefficient after coefficient, so that one
+ * SSE multiply-add handles one coefficient of four vertices. Meshes are padded to whole blocks.
+ * Transfer vectors are in the frame the scene was baked in. A mesh that was rotated since, by
+ * SetMeshRotation(), has the light rotated into its bake frame instead, which keeps its self
+ * shadowing but not the shadows it casts on or receives from other meshes.
+ */
+class PrtRelighter {
+public:
+  PrtRelighter(const PrtTransfer& transfer, const std::vector<CpuMesh>& meshes);
+
+  int Order() const { return order_; }
+
+  size_t VertexCount() const { return vertexCount_; }
+
+  // Rotation of mesh "mesh" since the bake, in the DirectXMath convention (v' = v * rotation).
+  void SetMeshRotation(size_t mesh, const DirectX::XMFLOAT4X4& rotation);
+
+  // Radiance of every vertex in "colors" (alpha is 1), in the vertex order of the baked scene.
+  // "light" is in world space. With "parallel" the meshes are spread over the shared thread pool,
+  // large ones in several pieces.
+  void Relight(const ShRgb& light, bool parallel, std::vector<DirectX::XMFLOAT4>* colors) const;
+
+private:
+  struct Mesh {
+    CpuMesh range;
+    size_t firstBlock = 0;
+    bool rotated = false;
+    DirectX::XMFLOAT4X4 rotation = Float4x4Identity();
+  };
+
+  // Consecutive blocks of one mesh, the unit of work of Relight()
+  struct Job {
+    size_t mesh = 0;
+    size_t firstBlock = 0;  // Relative to the mesh
+    size_t blockCount = 0;
+  };
+
+  static constexpr size_t s_blocksPerJob = 256;
+
+  int order_;
+  size_t vertexCount_;
+  std::vector<Mesh> meshes_;
+  std::vector<Job> jobs_;
+  std::vector<float> blocks_;  // order^2 x 4 floats per block
+};
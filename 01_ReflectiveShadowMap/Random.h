@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+// PCG hash [Jarzynski and Olano 2020]
+inline std::uint32_t Hash(std::uint32_t x) {
+  std::uint32_t state = x * 747796405u + 2891336453u;
+  std::uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+// Uniform in [0, 1) from a hash
+inline float HashToFloat(std::uint32_t x) {
+  return static_cast<float>(Hash(x) >> 8) * (1.f / 16777216.f);
+}
+
+class Rng {
+public:
+  explicit Rng(std::uint32_t seed) : state_{seed} {}
+
+  // Uniform in [0, 1)
+  float Next() {
+    state_ = Hash(state_);
+    return static_cast<float>(state_ >> 8) * (1.f / 16777216.f);
+  }
+
+private:
+  std::uint32_t state_;
+};
@@ -31,6 +31,6 @@ std::vector<Vertex> RectXZVertices(const RectXZ& rect) {
   return vertices;
 }
 
-std::vector<std::int16_t> RectXZIndices(const RectXZ& rect) {
+std::vector<std::uint32_t> RectXZIndices(const RectXZ& rect) {
   return {0, 1, 2, 2, 1, 3};
 }
\ No newline at end of file
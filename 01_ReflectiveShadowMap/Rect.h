@@ -10,5 +10,5 @@ struct RectXZ {
 
 std::vector<Vertex> RectXZVertices(const RectXZ& rect);
 
-std::vector<std::int16_t> RectXZIndices(const RectXZ& rect);
+std::vector<std::uint32_t> RectXZIndices(const RectXZ& rect);
 
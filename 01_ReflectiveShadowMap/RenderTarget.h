@@ -9,17 +9,17 @@
 
 #include "D3DUtils.h"
 
-template<size_t width, size_t height, DXGI_FORMAT format>
+template<DXGI_FORMAT format>
 class RenderTarget {
 public:
-  static constexpr size_t Width() { return width; }
+  size_t Width() const { return width_; }
 
-  static constexpr size_t Height() { return height; }
+  size_t Height() const { return height_; }
 
   static constexpr DXGI_FORMAT Format() { return format; }
 
-  explicit RenderTarget(ID3D12Device* device, CD3DX12_CPU_DESCRIPTOR_HANDLE rtv,
-                        CD3DX12_CPU_DESCRIPTOR_HANDLE srv,
+  explicit RenderTarget(ID3D12Device* device, size_t width, size_t height,
+                        CD3DX12_CPU_DESCRIPTOR_HANDLE rtv, CD3DX12_CPU_DESCRIPTOR_HANDLE srv,
                         DirectX::XMFLOAT4 clearColor = {0.f, 0.f, 0.f, 1.f});
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE Srv() const { return srv_; }
@@ -34,6 +34,9 @@ public:
 private:
   Microsoft::WRL::ComPtr<ID3D12Resource> texture_;
 
+  size_t width_;
+  size_t height_;
+
   FLOAT clearColor_[4];
 
   D3D12_RESOURCE_STATES state_;
@@ -42,17 +45,19 @@ private:
   CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_;
 };
 
-template<size_t width, size_t height, DXGI_FORMAT format>
-RenderTarget<width, height, format>::RenderTarget(ID3D12Device* device,
-                                                  CD3DX12_CPU_DESCRIPTOR_HANDLE rtv,
-                                                  CD3DX12_CPU_DESCRIPTOR_HANDLE srv,
-                                                  DirectX::XMFLOAT4 clearColor)
-    : clearColor_{clearColor.x, clearColor.y, clearColor.z, clearColor.w},
+template<DXGI_FORMAT format>
+RenderTarget<format>::RenderTarget(ID3D12Device* device, size_t width, size_t height,
+                                   CD3DX12_CPU_DESCRIPTOR_HANDLE rtv,
+                                   CD3DX12_CPU_DESCRIPTOR_HANDLE srv, DirectX::XMFLOAT4 clearColor)
+    : width_{width},
+      height_{height},
+      clearColor_{clearColor.x, clearColor.y, clearColor.z, clearColor.w},
       state_{D3D12_RESOURCE_STATE_GENERIC_READ} {
 
   auto heapProp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-  auto resDesc = CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, 1, 1, 1, 0,
-                                              D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+  auto resDesc =
+      CD3DX12_RESOURCE_DESC::Tex2D(format, static_cast<UINT64>(width), static_cast<UINT>(height), 1,
+                                   1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
 
   auto clearVal = CD3DX12_CLEAR_VALUE(format, clearColor_);
   DX::ThrowIfFailed(
@@ -80,15 +85,15 @@ RenderTarget<width, height, format>::RenderTarget(ID3D12Device* device,
   srv_ = srv;
 }
 
-template<size_t width, size_t height, DXGI_FORMAT format>
-void RenderTarget<width, height, format>::TransitionTo(ID3D12GraphicsCommandList* commandList,
-                                                       D3D12_RESOURCE_STATES to) {
+template<DXGI_FORMAT format>
+void RenderTarget<format>::TransitionTo(ID3D12GraphicsCommandList* commandList,
+                                        D3D12_RESOURCE_STATES to) {
   auto transition = CD3DX12_RESOURCE_BARRIER::Transition(texture_.Get(), state_, to);
   commandList->ResourceBarrier(1, &transition);
   state_ = to;
 }
 
-template<size_t width, size_t height, DXGI_FORMAT format>
-void RenderTarget<width, height, format>::Clear(ID3D12GraphicsCommandList* commandList) {
+template<DXGI_FORMAT format>
+void RenderTarget<format>::Clear(ID3D12GraphicsCommandList* commandList) {
   commandList->ClearRenderTargetView(rtv_, clearColor_, 0, nullptr);
 }
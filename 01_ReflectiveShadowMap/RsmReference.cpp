@@ -0,0 +1,135 @@
+#include "RsmReference.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+void CpuRsm::Project(XMFLOAT3 p, float* tx, float* ty, float* depth) const {
+  auto clip = XMVector3TransformCoord(ToXMVector(p), ToXMMatrix(lightViewProj));
+  float u = (XMVectorGetX(clip) + 1.f) * 0.5f;
+  float v = 1.f - (XMVectorGetY(clip) + 1.f) * 0.5f;
+  *tx = u * Size();
+  *ty = v * Size();
+  *depth = zNear + XMVectorGetZ(clip) * (zFar - zNear);
+}
+
+CpuRsm RenderCpuRsm(const CpuScene& scene, const DirectionalLight& light, int size) {
+  auto view = MatLightView(&light);
+  auto ortho = MatLightOrtho(&light);
+
+  CpuRsm rsm;
+  rsm.texels = RasterizeGBuffer(scene, view, ortho, size, size);
+  rsm.lightViewProj = ToXMFloat4x4(XMMatrixMultiply(view, ortho));
+  rsm.lightDirection = ToXMFloat3(XMVector3Normalize(ToXMVector(light.dir)));
+  rsm.zNear = light.epsilon;
+  rsm.zFar = light.epsilon + light.affectedDepth;
+
+  rsm.shadowDepth.assign(rsm.texels.PixelCount(), 0.f);
+  rsm.flux.assign(rsm.texels.PixelCount(), {0.f, 0.f, 0.f});
+  for (size_t i = 0; i < rsm.texels.PixelCount(); ++i) {
+    if (!rsm.texels.IsCovered(i)) {
+      rsm.shadowDepth[i] = rsm.zFar;
+      continue;
+    }
+    auto pos = ToXMVector(rsm.texels.position[i]);
+    auto l = XMVector3Normalize(ToXMVector(light.pos) - pos);
+    float slopeFactor = 1.f - XMVectorGetX(XMVector3Dot(ToXMVector(rsm.texels.normal[i]), l));
+    rsm.shadowDepth[i] = rsm.texels.depth[i] + 0.05f * slopeFactor * (rsm.zFar - rsm.zNear);
+
+    const auto& a = rsm.texels.albedo[i];
+    rsm.flux[i] = {a.x * light.color.x, a.y * light.color.y, a.z * light.color.z};
+  }
+  return rsm;
+}
+
+XMFLOAT3 ShadeDirect(const CpuRsm& rsm, const DirectionalLight& light, XMFLOAT3 p, XMFLOAT3 n,
+                     XMFLOAT3 albedo) {
+  auto l = -ToXMVector(rsm.lightDirection);
+  float cosTheta = std::max(0.f, XMVectorGetX(XMVector3Dot(l, XMVector3Normalize(ToXMVector(n)))));
+
+  float tx, ty, depth;
+  rsm.Project(p, &tx, &ty, &depth);
+  int px = static_cast<int>(std::floor(tx));
+  int py = static_cast<int>(std::floor(ty));
+
+  // Texels outside the map read as 0 (opaque black border), i.e. shadowed.
+  int size = rsm.Size();
+  float shadowed = 0.f;
+  for (int dy = 0; dy < 2; ++dy) {
+    for (int dx = 0; dx < 2; ++dx) {
+      int qx = px + dx;
+      int qy = py + dy;
+      float d = 0.f;
+      if (qx >= 0 && qx < size && qy >= 0 && qy < size)
+        d = rsm.shadowDepth[static_cast<size_t>(qy) * size + qx];
+      shadowed += d < depth ? 1.f : 0.f;
+    }
+  }
+  float lit = (1.f - shadowed / 4.f) * cosTheta;
+
+  return {albedo.x * light.color.x * lit, albedo.y * light.color.y * lit,
+          albedo.z * light.color.z * lit};
+}
+
+XMFLOAT3 GatherRsmIndirect(const CpuRsm& rsm, XMFLOAT3 p, XMFLOAT3 n,
+                           const RsmGatherSettings& settings) {
+  float tx, ty, depth;
+  rsm.Project(p, &tx, &ty, &depth);
+  int px = static_cast<int>(std::floor(tx));
+  int py = static_cast<int>(std::floor(ty));
+
+  int size = rsm.Size();
+  int count = settings.neighborCount;
+  auto shadingPoint = ToXMVector(p);
+  auto normal = XMVector3Normalize(ToXMVector(n));
+
+  XMVECTOR indirect = XMVectorZero();
+  for (int qy = std::max(py - count, 0); qy < std::min(py + count, size); ++qy) {
+    for (int qx = std::max(px - count, 0); qx < std::min(px + count, size); ++qx) {
+      size_t texel = static_cast<size_t>(qy) * size + qx;
+      if (!rsm.texels.IsCovered(texel))
+        continue;
+
+      auto vplPos = ToXMVector(rsm.texels.position[texel]);
+      auto vplNormal = ToXMVector(rsm.texels.normal[texel]);
+
+      // Unnormalized directions as in the shader, so the falloff is effectively 1 / dist^2.
+      auto dirOut = shadingPoint - vplPos;
+      float dist = std::max(XMVectorGetX(XMVector3Length(dirOut)), 0.1f);
+      float cosLight = std::max(0.f, XMVectorGetX(XMVector3Dot(vplNormal, dirOut)));
+      float cosShadingPoint = std::max(0.f, XMVectorGetX(XMVector3Dot(normal, -dirOut)));
+      float dist2 = dist * dist;
+      float weight = cosLight * cosShadingPoint / (dist2 * dist2);
+
+      indirect += ToXMVector(rsm.flux[texel]) * weight;
+    }
+  }
+
+  float sampleCount = static_cast<float>((2 * count + 1) * (2 * count + 1));
+  return ToXMFloat3(indirect / sampleCount);
+}
+
+ShadedImages ShadeRsmGather(const GBuffer& camera, const CpuRsm& rsm,
+                            const DirectionalLight& light, const RsmGatherSettings& settings) {
+  ShadedImages images{Image{camera.width, camera.height}, Image{camera.width, camera.height}};
+
+  GlobalThreadPool().ParallelFor(0, camera.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+      for (size_t x = 0; x < static_cast<size_t>(camera.width); ++x) {
+        size_t i = y * camera.width + x;
+        if (!camera.IsCovered(i))
+          continue;
+
+        images.direct.pixels[i] =
+            ShadeDirect(rsm, light, camera.position[i], camera.normal[i], camera.albedo[i]);
+        images.indirect.pixels[i] =
+            GatherRsmIndirect(rsm, camera.position[i], camera.normal[i], settings);
+      }
+    }
+  });
+
+  return images;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <vector>
+
+#include "CpuRaster.h"
+#include "CpuScene.h"
+#include "DirectionalLight.h"
+#include "Image.h"
+
+/**
+ * CPU copy of the reflective shadow map, rendered with the light view and orthogonal projection
+ * of the first pass. Texel (0, 0) is the top-left one, as in the RSM render targets.
+ */
+struct CpuRsm {
+  GBuffer texels;
+  std::vector<float> shadowDepth;      // Linear depth plus the slope bias PSLight adds
+  std::vector<DirectX::XMFLOAT3> flux;  // Albedo * light flux, as PSLight writes it
+  DirectX::XMFLOAT4X4 lightViewProj;
+  DirectX::XMFLOAT3 lightDirection;
+  float zNear = 0.f;
+  float zFar = 1.f;
+
+  int Size() const { return texels.width; }
+
+  // Texel coordinates (possibly outside the map) and linear light depth of a world position.
+  void Project(DirectX::XMFLOAT3 p, float* tx, float* ty, float* depth) const;
+};
+
+CpuRsm RenderCpuRsm(const CpuScene& scene, const DirectionalLight& light, int size);
+
+struct RsmGatherSettings {
+  int neighborCount = 30;  // Gather a (2n x 2n) block around the projected texel, as PS does
+};
+
+// Lambert term with the 2x2 shadow test of PS.
+DirectX::XMFLOAT3 ShadeDirect(const CpuRsm& rsm, const DirectionalLight& light,
+                              DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 n, DirectX::XMFLOAT3 albedo);
+
+// Indirect term of PS. Like the shader this is not multiplied by the receiver albedo.
+DirectX::XMFLOAT3 GatherRsmIndirect(const CpuRsm& rsm, DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 n,
+                                    const RsmGatherSettings& settings);
+
+struct ShadedImages {
+  Image direct;
+  Image indirect;
+};
+
+// CPU counterpart of the second pass for every covered pixel of "camera".
+ShadedImages ShadeRsmGather(const GBuffer& camera, const CpuRsm& rsm,
+                            const DirectionalLight& light, const RsmGatherSettings& settings);
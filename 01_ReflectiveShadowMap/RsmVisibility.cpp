@@ -0,0 +1,226 @@
+#include "RsmVisibility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "Random.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+// Contributions waiting for the shadow rays of one packet
+struct PendingVpls {
+  RayPacket packet;
+  XMVECTOR contribution[RayPacket::s_size];
+  int index[RayPacket::s_size];  // Gather order, selects the visibility bit
+  int count = 0;
+};
+
+bool TestBit(const std::vector<std::uint64_t>& bits, int i) {
+  return (bits[i / 64] >> (i % 64)) & 1u;
+}
+
+void SetBit(std::vector<std::uint64_t>* bits, int i) {
+  if (static_cast<size_t>(i / 64) >= bits->size())
+    bits->resize(i / 64 + 1, 0);
+  (*bits)[i / 64] |= std::uint64_t{1} << (i % 64);
+}
+
+// Visible contributions of the pending VPLs. Their bits are set in "bits", which is null for a
+// pixel that is not cached.
+XMVECTOR Flush(const Bvh& bvh, bool usePackets, PendingVpls* pending,
+               std::vector<std::uint64_t>* bits, std::uint64_t* rays) {
+  int occluded = 0;
+  if (usePackets) {
+    occluded = bvh.OccludedPacket(pending->packet, (1 << pending->count) - 1);
+  } else {
+    for (int i = 0; i < pending->count; ++i) {
+      Ray ray;
+      ray.origin = {pending->packet.originX[i], pending->packet.originY[i],
+                    pending->packet.originZ[i]};
+      ray.direction = {pending->packet.directionX[i], pending->packet.directionY[i],
+                       pending->packet.directionZ[i]};
+      ray.tMax = pending->packet.tMax[i];
+      if (bvh.Occluded(ray))
+        occluded |= 1 << i;
+    }
+  }
+  *rays += pending->count;
+
+  XMVECTOR visible = XMVectorZero();
+  for (int i = 0; i < pending->count; ++i) {
+    if (occluded & (1 << i))
+      continue;
+    visible += pending->contribution[i];
+    if (bits)
+      SetBit(bits, pending->index[i]);
+  }
+  pending->count = 0;
+  return visible;
+}
+}  // namespace
+
+void VplVisibilityCache::Prepare(const GBuffer& camera, const CpuRsm& rsm,
+                                 const RsmGatherSettings& gather,
+                                 const RsmVisibilitySettings& settings) {
+  bool same = entries_.size() == camera.PixelCount() && rsmSize_ == rsm.Size() &&
+              neighborCount_ == gather.neighborCount &&
+              sampleFraction_ == settings.sampleFraction && seed_ == settings.seed &&
+              std::memcmp(&lightViewProj_, &rsm.lightViewProj, sizeof(lightViewProj_)) == 0;
+  if (same)
+    return;
+
+  entries_.assign(camera.PixelCount(), Entry{});
+  lightViewProj_ = rsm.lightViewProj;
+  rsmSize_ = rsm.Size();
+  neighborCount_ = gather.neighborCount;
+  sampleFraction_ = settings.sampleFraction;
+  seed_ = settings.seed;
+}
+
+void VplVisibilityCache::Invalidate() {
+  for (auto& entry : entries_) {
+    entry.valid = false;
+  }
+}
+
+size_t VplVisibilityCache::MemoryByteSize() const {
+  size_t size = entries_.capacity() * sizeof(Entry);
+  for (const auto& entry : entries_) {
+    size += entry.bits.capacity() * sizeof(std::uint64_t);
+  }
+  return size;
+}
+
+Image ShadeRsmGatherVisible(const GBuffer& camera, const CpuRsm& rsm, const Bvh& bvh,
+                            const RsmGatherSettings& gather, const RsmVisibilitySettings& settings,
+                            VplVisibilityCache* cache, RsmVisibilityStats* stats) {
+  if (settings.sampleFraction <= 0.f || settings.sampleFraction > 1.f)
+    throw std::runtime_error{"VPL sample fraction must be in (0, 1]"};
+
+  if (cache)
+    cache->Prepare(camera, rsm, gather, settings);
+
+  Image indirect{camera.width, camera.height};
+  int size = rsm.Size();
+  int count = gather.neighborCount;
+  float sampleCount = static_cast<float>((2 * count + 1) * (2 * count + 1));
+  float scale = 1.f / (sampleCount * settings.sampleFraction);
+  std::uint32_t seed = Hash(settings.seed);
+
+  std::atomic<std::uint64_t> rays{0};
+  std::atomic<std::uint64_t> tracedPixels{0};
+  std::atomic<std::uint64_t> cachedPixels{0};
+
+  GlobalThreadPool().ParallelFor(0, camera.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    std::uint64_t rowRays = 0;
+    std::uint64_t rowTraced = 0;
+    std::uint64_t rowCached = 0;
+    PendingVpls pending;
+
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+      for (size_t x = 0; x < static_cast<size_t>(camera.width); ++x) {
+        size_t i = y * camera.width + x;
+        if (!camera.IsCovered(i))
+          continue;
+
+        auto p = camera.position[i];
+        float tx, ty, depth;
+        rsm.Project(p, &tx, &ty, &depth);
+        int px = static_cast<int>(std::floor(tx));
+        int py = static_cast<int>(std::floor(ty));
+
+        auto shadingPoint = ToXMVector(p);
+        auto normal = XMVector3Normalize(ToXMVector(camera.normal[i]));
+        float offset = 1e-4f * (1.f + XMVectorGetX(XMVector3Length(shadingPoint)));
+        auto origin = shadingPoint + normal * offset;
+
+        VplVisibilityCache::Entry* entry = cache ? &cache->At(i) : nullptr;
+        bool cached = entry && entry->valid && entry->texelX == px && entry->texelY == py &&
+                      XMVector3NearEqual(ToXMVector(entry->position), shadingPoint,
+                                         XMVectorReplicate(offset));
+        std::vector<std::uint64_t>* bits = nullptr;
+        if (entry && !cached) {
+          entry->valid = true;
+          entry->position = p;
+          entry->texelX = px;
+          entry->texelY = py;
+          entry->bits.clear();
+          bits = &entry->bits;
+        }
+
+        // Same loop as GatherRsmIndirect(), but only over the VPLs picked for tracing
+        XMVECTOR sum = XMVectorZero();
+        int candidate = 0;
+        auto pixelSeed = Hash(static_cast<std::uint32_t>(i) ^ seed);
+        for (int qy = std::max(py - count, 0); qy < std::min(py + count, size); ++qy) {
+          for (int qx = std::max(px - count, 0); qx < std::min(px + count, size); ++qx) {
+            size_t texel = static_cast<size_t>(qy) * size + qx;
+            if (!rsm.texels.IsCovered(texel))
+              continue;
+            if (settings.sampleFraction < 1.f &&
+                HashToFloat(pixelSeed ^ static_cast<std::uint32_t>(texel)) >=
+                    settings.sampleFraction)
+              continue;
+
+            auto vplPos = ToXMVector(rsm.texels.position[texel]);
+            auto vplNormal = ToXMVector(rsm.texels.normal[texel]);
+
+            auto dirOut = shadingPoint - vplPos;
+            float dist = std::max(XMVectorGetX(XMVector3Length(dirOut)), 0.1f);
+            float cosLight = std::max(0.f, XMVectorGetX(XMVector3Dot(vplNormal, dirOut)));
+            float cosShadingPoint = std::max(0.f, XMVectorGetX(XMVector3Dot(normal, -dirOut)));
+            float dist2 = dist * dist;
+            float weight = cosLight * cosShadingPoint / (dist2 * dist2);
+            if (weight <= 0.f)
+              continue;
+
+            auto contribution = ToXMVector(rsm.flux[texel]) * weight;
+            int index = candidate++;
+            if (cached) {
+              if (TestBit(entry->bits, index))
+                sum += contribution;
+              continue;
+            }
+
+            // Shadow ray between the two surfaces, both ends lifted off along their normals
+            auto target = vplPos + XMVector3Normalize(vplNormal) * offset;
+            Ray ray;
+            ray.origin = ToXMFloat3(origin);
+            ray.direction = ToXMFloat3(target - origin);
+            ray.tMax = 1.f - 1e-3f;
+            pending.packet.Set(pending.count, ray);
+            pending.contribution[pending.count] = contribution;
+            pending.index[pending.count] = index;
+            if (++pending.count == RayPacket::s_size)
+              sum += Flush(bvh, settings.usePackets, &pending, bits, &rowRays);
+          }
+        }
+        if (pending.count > 0)
+          sum += Flush(bvh, settings.usePackets, &pending, bits, &rowRays);
+
+        // Bits past the last visible VPL are zero
+        if (bits)
+          bits->resize((candidate + 63) / 64, 0);
+
+        indirect.pixels[i] = ToXMFloat3(sum * scale);
+        ++(cached ? rowCached : rowTraced);
+      }
+    }
+
+    rays += rowRays;
+    tracedPixels += rowTraced;
+    cachedPixels += rowCached;
+  });
+
+  if (stats) {
+    stats->rays = rays;
+    stats->tracedPixels = tracedPixels;
+    stats->cachedPixels = cachedPixels;
+  }
+  return indirect;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "CpuRaster.h"
+#include "Image.h"
+#include "RsmReference.h"
+
+struct RsmVisibilitySettings {
+  float sampleFraction = 0.25f;  // Probability of tracing a VPL, traced ones are weighted by 1 / p
+  bool usePackets = true;        // Trace the shadow rays of a pixel four at a time
+  std::uint32_t seed = 0;
+};
+
+struct RsmVisibilityStats {
+  std::uint64_t rays = 0;
+  std::uint64_t tracedPixels = 0;
+  std::uint64_t cachedPixels = 0;  // Pixels whose visibility was taken from the cache
+};
+
+/**
+ * VPL visibility of every pixel, kept across frames. A pixel stores one bit per VPL it traced, in
+ * gather order. Its entry stays valid while it shows the same surface point and the RSM is
+ * rendered from the same light transform; anything else moving needs Invalidate().
+ */
+class VplVisibilityCache {
+public:
+  struct Entry {
+    DirectX::XMFLOAT3 position;
+    int texelX = -1;  // RSM texel the gather was centered on
+    int texelY = -1;
+    bool valid = false;
+    std::vector<std::uint64_t> bits;
+  };
+
+  // Drop every entry if the frame differs from the cached one in anything but the pixels.
+  void Prepare(const GBuffer& camera, const CpuRsm& rsm, const RsmGatherSettings& gather,
+               const RsmVisibilitySettings& settings);
+
+  void Invalidate();
+
+  Entry& At(size_t pixel) { return entries_[pixel]; }
+
+  size_t MemoryByteSize() const;
+
+private:
+  std::vector<Entry> entries_;
+  DirectX::XMFLOAT4X4 lightViewProj_ = {};
+  int rsmSize_ = 0;
+  int neighborCount_ = 0;
+  float sampleFraction_ = 0.f;
+  std::uint32_t seed_ = 0;
+};
+
+/**
+ * Indirect term of the RSM gather with every VPL contribution tested by a shadow ray against
+ * "bvh", in the units of GatherRsmIndirect(). Only a random "sampleFraction" of the VPLs is
+ * traced, so the image is noisier but unbiased. "cache" may be null.
+ */
+Image ShadeRsmGatherVisible(const GBuffer& camera, const CpuRsm& rsm, const Bvh& bvh,
+                            const RsmGatherSettings& gather, const RsmVisibilitySettings& settings,
+                            VplVisibilityCache* cache, RsmVisibilityStats* stats);
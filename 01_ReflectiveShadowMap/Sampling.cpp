@@ -0,0 +1,226 @@
+#include "Sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "Random.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr std::uint32_t s_goldenRatio32 = 0x9e3779b9u;  // 2^32 / golden ratio
+
+std::uint32_t ReverseBits(std::uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+  x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+  x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+  x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+  return x;
+}
+
+// Second Sobol dimension, whose generator matrix is Pascal's triangle mod 2. The first dimension
+// is the bit reversed index.
+std::uint32_t Sobol1(std::uint32_t index) {
+  std::uint32_t result = 0;
+  for (std::uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+    if (index & 1)
+      result ^= v;
+  }
+  return result;
+}
+
+// Owen scrambling of a 32 bit fraction: every bit is flipped depending on the bits above it
+// [Laine and Karras 2011, Burley 2020].
+std::uint32_t OwenScramble(std::uint32_t x, std::uint32_t seed) {
+  x = ReverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return ReverseBits(x);
+}
+
+float ToUnit(std::uint32_t x) {
+  // Keep 24 bits so that the result is below 1 after rounding to float
+  return static_cast<float>(x >> 8) * (1.f / 16777216.f);
+}
+
+float Fraction(double x) {
+  return static_cast<float>(std::min(x - std::floor(x), 1.0 - 1e-7));
+}
+
+XMFLOAT2 RandomPoint(std::uint32_t index, std::uint32_t seed) {
+  std::uint32_t h = Hash(index ^ Hash(seed));
+  return {HashToFloat(h), HashToFloat(h ^ s_goldenRatio32)};
+}
+}  // namespace
+
+XMFLOAT2 Sample2D(SampleSequence sequence, std::uint32_t index, std::uint32_t count,
+                  std::uint32_t seed) {
+  switch (sequence) {
+    case SampleSequence::Random: return RandomPoint(index, seed);
+
+    case SampleSequence::Stratified: {
+      // rows x columns strata, at most "count" of them
+      std::uint32_t rows =
+          std::max(1u, static_cast<std::uint32_t>(std::sqrt(static_cast<double>(count))));
+      std::uint32_t columns = std::max(1u, count / rows);
+      if (index >= rows * columns)
+        return RandomPoint(index, seed);
+      auto jitter = RandomPoint(index, seed);
+      return {(index / columns + jitter.x) / rows, (index % columns + jitter.y) / columns};
+    }
+
+    case SampleSequence::Sobol:
+      return {ToUnit(OwenScramble(ReverseBits(index), Hash(seed))),
+              ToUnit(OwenScramble(Sobol1(index), Hash(seed ^ s_goldenRatio32)))};
+
+    case SampleSequence::Fibonacci: {
+      // Rank-1 lattice ((i + 0.5) / count, i / golden ratio), randomly shifted modulo 1
+      auto shift = RandomPoint(0, seed);
+      double golden = 0.5 * (std::sqrt(5.0) - 1.0);
+      return {Fraction((index + 0.5) / std::max(count, 1u) + shift.x),
+              Fraction(index * golden + shift.y)};
+    }
+  }
+  throw std::runtime_error{"unknown sample sequence"};
+}
+
+XMFLOAT3 MapToDirection(SampleDomain domain, float u, float v) {
+  float phi = XM_2PI * v;
+  float z;
+  switch (domain) {
+    case SampleDomain::Sphere: z = 1.f - 2.f * u; break;
+    case SampleDomain::Hemisphere: z = 1.f - u; break;
+    case SampleDomain::CosineHemisphere: z = std::sqrt(1.f - u); break;
+    default: throw std::runtime_error{"unknown sample domain"};
+  }
+  float r = std::sqrt(std::max(0.f, 1.f - z * z));
+  return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+SampleDirections GenerateDirections(SampleDomain domain, SampleSequence sequence, size_t count,
+                                    std::uint32_t seed) {
+  if (count == 0)
+    throw std::runtime_error{"sample directions need at least one sample"};
+
+  SampleDirections d;
+  d.x.resize(count);
+  d.y.resize(count);
+  d.z.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto u = Sample2D(sequence, static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(count),
+                      seed);
+    auto w = MapToDirection(domain, u.x, u.y);
+    d.x[i] = w.x;
+    d.y[i] = w.y;
+    d.z[i] = w.z;
+  }
+
+  float measure = domain == SampleDomain::Sphere       ? 4.f * XM_PI
+                  : domain == SampleDomain::Hemisphere ? XM_2PI
+                                                       : XM_PI;
+  d.weight = measure / static_cast<float>(count);
+  return d;
+}
+
+DirectionIntegrator::DirectionIntegrator(SampleDirections directions)
+    : directions_{std::move(directions)},
+      paddedCount_{(directions_.Count() + Float4::s_width - 1) / Float4::s_width *
+                   Float4::s_width},
+      basis_(paddedCount_, 0.f) {
+  std::fill(basis_.begin(), basis_.begin() + directions_.Count(), 1.f);
+}
+
+void DirectionIntegrator::SetBasis(int functionCount, const std::vector<float>& basis) {
+  size_t count = directions_.Count();
+  if (functionCount < 1 || basis.size() != functionCount * count)
+    throw std::runtime_error{"basis does not match the sample directions"};
+
+  functionCount_ = functionCount;
+  basis_.assign(functionCount * paddedCount_, 0.f);
+  for (int j = 0; j < functionCount; ++j) {
+    std::copy_n(basis.begin() + j * count, count, basis_.begin() + j * paddedCount_);
+  }
+}
+
+void DirectionIntegrator::IntegrateBatch(size_t item, size_t first, size_t count,
+                                         int channelCount, const Integrand& integrand,
+                                         float* values, float* sums) const {
+  integrand(item, first, count, values);
+
+  // Zero the lanes past the batch, the basis is zero there as well
+  size_t padded = (count + Float4::s_width - 1) / Float4::s_width * Float4::s_width;
+  for (int c = 0; c < channelCount; ++c) {
+    std::fill(values + c * s_batchSize + count, values + c * s_batchSize + padded, 0.f);
+  }
+
+  for (int c = 0; c < channelCount; ++c) {
+    const float* v = values + c * s_batchSize;
+    for (int j = 0; j < functionCount_; ++j) {
+      const float* b = basis_.data() + j * paddedCount_ + first;
+      Float4 sum = 0.f;
+      for (size_t k = 0; k < padded; k += Float4::s_width) {
+        sum += Float4::Load(b + k) * Float4::Load(v + k);
+      }
+      alignas(16) float lanes[Float4::s_width];
+      sum.Store(lanes);
+      sums[c * functionCount_ + j] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+  }
+}
+
+void DirectionIntegrator::Integrate(size_t itemCount, int channelCount,
+                                    const Integrand& integrand, float* results) const {
+  if (channelCount < 1)
+    throw std::runtime_error{"integrand needs at least one channel"};
+
+  size_t count = directions_.Count();
+  size_t batchCount = (count + s_batchSize - 1) / s_batchSize;
+  size_t resultCount = static_cast<size_t>(channelCount) * functionCount_;
+
+  auto scale = [&](float* sums) {
+    for (size_t i = 0; i < resultCount; ++i) {
+      sums[i] *= directions_.weight;
+    }
+  };
+
+  if (itemCount == 1) {
+    std::vector<float> partial(batchCount * resultCount, 0.f);
+    GlobalThreadPool().ParallelFor(0, batchCount, 1, [&](size_t batchBegin, size_t batchEnd) {
+      std::vector<float> values(channelCount * s_batchSize);
+      for (size_t batch = batchBegin; batch < batchEnd; ++batch) {
+        size_t first = batch * s_batchSize;
+        IntegrateBatch(0, first, std::min(s_batchSize, count - first), channelCount, integrand,
+                       values.data(), partial.data() + batch * resultCount);
+      }
+    });
+    std::fill(results, results + resultCount, 0.f);
+    for (size_t batch = 0; batch < batchCount; ++batch) {
+      for (size_t i = 0; i < resultCount; ++i) {
+        results[i] += partial[batch * resultCount + i];
+      }
+    }
+    scale(results);
+    return;
+  }
+
+  GlobalThreadPool().ParallelFor(0, itemCount, 16, [&](size_t itemBegin, size_t itemEnd) {
+    std::vector<float> values(channelCount * s_batchSize);
+    for (size_t item = itemBegin; item < itemEnd; ++item) {
+      float* sums = results + item * resultCount;
+      std::fill(sums, sums + resultCount, 0.f);
+      for (size_t first = 0; first < count; first += s_batchSize) {
+        IntegrateBatch(item, first, std::min(s_batchSize, count - first), channelCount,
+                       integrand, values.data(), sums);
+      }
+      scale(sums);
+    }
+  });
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+enum class SampleSequence {
+  Random,      // Independent uniform points
+  Stratified,  // Jittered grid, the points that do not fill a whole grid are uniform
+  Sobol,       // First two Sobol dimensions with hash-based Owen scrambling [Burley 2020]
+  Fibonacci,   // Fibonacci lattice with a random shift [Keinert et al. 2015]
+};
+
+enum class SampleDomain {
+  Sphere,            // Uniform in solid angle
+  Hemisphere,        // Uniform in solid angle over z >= 0
+  CosineHemisphere,  // Density cos(theta) / pi over z >= 0
+};
+
+/**
+ * Point "index" of "count" of a sequence in the unit square. "seed" picks the randomization, so
+ * every pixel or vertex can take its own copy of the same sequence.
+ * Stratified and Fibonacci points depend on "count". Sobol points do not, and the first 2^k of them
+ * put one point into every cell of any 2^a x 2^b grid with a + b = k.
+ */
+DirectX::XMFLOAT2 Sample2D(SampleSequence sequence, std::uint32_t index, std::uint32_t count,
+                           std::uint32_t seed);
+
+// Map a point of the unit square to a direction of "domain". Hemispheres are around +z.
+DirectX::XMFLOAT3 MapToDirection(SampleDomain domain, float u, float v);
+
+// Directions in structure of arrays layout, like the input of ShEvaluateBatch().
+struct SampleDirections {
+  std::vector<float> x, y, z;
+  // Integral of f over the domain is about weight * the sum of f at the directions. For
+  // CosineHemisphere the integral is that of f * cos(theta).
+  float weight = 0.f;
+
+  size_t Count() const { return x.size(); }
+};
+
+SampleDirections GenerateDirections(SampleDomain domain, SampleSequence sequence, size_t count,
+                                    std::uint32_t seed);
+
+/**
+ * Integrals of many functions over one set of directions, such as the visibility of every vertex
+ * of a bake, optionally projected onto basis functions like SH.
+ * The integrand is called for batches of up to s_batchSize directions and fills one value per
+ * direction and channel, so it can trace rays in packets or evaluate with SIMD. The integrator
+ * multiplies the values with the basis and reduces them four directions at a time with SSE.
+ * Items are spread over the shared thread pool. A single item is split over its batches instead,
+ * whose partial sums are added in batch order, so results do not depend on the thread count.
+ */
+class DirectionIntegrator {
+public:
+  static constexpr size_t s_batchSize = 256;
+
+  // fn(item, first, count, values) writes the integrand of "item" at directions
+  // [first, first + count) to values[channel * s_batchSize + k].
+  using Integrand = std::function<void(size_t, size_t, size_t, float*)>;
+
+  explicit DirectionIntegrator(SampleDirections directions);
+
+  const SampleDirections& Directions() const { return directions_; }
+
+  int FunctionCount() const { return functionCount_; }
+
+  // Project onto "functionCount" functions, "basis" holds function j at direction k at
+  // [j * count + k], the layout of ShEvaluateBatch(). Without a basis the integrator integrates
+  // the plain integrand, as if it had the single function 1.
+  void SetBasis(int functionCount, const std::vector<float>& basis);
+
+  // Integral of channel c of item i times basis function j into
+  // results[(i * channelCount + c) * FunctionCount() + j].
+  void Integrate(size_t itemCount, int channelCount, const Integrand& integrand,
+                 float* results) const;
+
+private:
+  SampleDirections directions_;
+  size_t paddedCount_;  // Count rounded up to whole Float4s
+  int functionCount_ = 1;
+  std::vector<float> basis_;  // functionCount_ rows of paddedCount_, zero past the directions
+
+  // Add the integrals of "item" over batch [first, first + count) to "sums", using "values" as
+  // scratch space of channelCount * s_batchSize floats.
+  void IntegrateBatch(size_t item, size_t first, size_t count, int channelCount,
+                      const Integrand& integrand, float* values, float* sums) const;
+};
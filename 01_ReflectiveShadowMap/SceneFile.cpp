@@ -0,0 +1,347 @@
+#include "SceneFile.h"
+
+#include <rapidjson/error/en.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
+
+#include <stdexcept>
+#include <unordered_map>
+
+#include "MappedFile.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr const char* s_rootError = "the root is not an object";
+
+// Arrays of objects, one per mesh, material, instance or light. Any other array is a vector of
+// numbers.
+bool IsElementArray(const std::string& path) {
+  return path == "meshes" || path == "materials" || path == "instances" || path == "lights";
+}
+
+// Objects that are not elements of the arrays above
+bool IsNestedObject(const std::string& path) {
+  return path.empty() || path == "camera" || path == "settings" || path == "settings.ssao" ||
+         path == "settings.prt" || path == "instances.rotation";
+}
+
+/**
+ * SAX handler that tracks the keys from the root to the current value as a dotted path, with
+ * the indices of arrays left out, and stores every value by its path. Whatever rapidjson reads
+ * goes into the scene right away.
+ */
+class SceneReader : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, SceneReader> {
+public:
+  explicit SceneReader(SceneDesc* scene) : scene_{scene} {}
+
+  const std::string& Error() const { return error_; }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    key_.assign(str, length);
+    return true;
+  }
+
+  bool StartObject() {
+    bool element = !levels_.empty() && levels_.back().array;
+    Enter(false);
+    if (element)
+      return StartElement();
+    if (!IsNestedObject(path_))
+      return Fail("unknown object \"" + path_ + "\"");
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType) {
+    bool element = levels_.size() > 1 && levels_[levels_.size() - 2].array;
+    if (element && !EndElement())
+      return false;
+    Leave();
+    return true;
+  }
+
+  bool StartArray() {
+    if (levels_.empty())
+      return Fail(s_rootError);
+    if (levels_.back().array)
+      return Fail("nested array in \"" + path_ + "\"");
+    Enter(true);
+    numbers_.clear();
+    return true;
+  }
+
+  bool EndArray(rapidjson::SizeType) {
+    bool ok = IsElementArray(path_) || SetVector();
+    Leave();
+    return ok;
+  }
+
+  bool Int(int i) { return Number(i); }
+  bool Uint(unsigned u) { return Number(u); }
+  bool Int64(std::int64_t i) { return Number(static_cast<double>(i)); }
+  bool Uint64(std::uint64_t u) { return Number(static_cast<double>(u)); }
+  bool Double(double d) { return Number(d); }
+
+  bool String(const char* str, rapidjson::SizeType length, bool) {
+    if (levels_.empty())
+      return Fail(s_rootError);
+    if (levels_.back().array)
+      return Fail("unexpected string in \"" + path_ + "\"");
+    std::string value{str, length};
+    auto path = ValuePath();
+    if (path == "meshes.name") {
+      scene_->meshes.back().name = std::move(value);
+    } else if (path == "meshes.file") {
+      scene_->meshes.back().file = std::move(value);
+    } else if (path == "materials.name") {
+      scene_->materials.back().name = std::move(value);
+    } else if (path == "instances.mesh") {
+      instanceMeshes_.back() = std::move(value);
+    } else if (path == "instances.material") {
+      instanceMaterials_.back() = std::move(value);
+    } else if (path == "lights.type") {
+      if (value != "directional")
+        return Fail("unsupported light type \"" + value + "\"");
+    } else {
+      return Fail("unknown string \"" + path + "\"");
+    }
+    return true;
+  }
+
+  bool Default() {
+    if (levels_.empty())
+      return Fail(s_rootError);
+    return Fail("unexpected value at \"" + ValuePath() + "\"");
+  }
+
+  // Names of the meshes and materials of the instances into indices
+  bool ResolveInstances() {
+    std::unordered_map<std::string, size_t> meshes, materials;
+    for (size_t i = 0; i < scene_->meshes.size(); ++i) {
+      if (!meshes.emplace(scene_->meshes[i].name, i).second)
+        return Fail("duplicate mesh \"" + scene_->meshes[i].name + "\"");
+    }
+    for (size_t i = 0; i < scene_->materials.size(); ++i) {
+      // "" names the default material below
+      if (scene_->materials[i].name.empty())
+        return Fail("material without a name");
+      if (!materials.emplace(scene_->materials[i].name, i).second)
+        return Fail("duplicate material \"" + scene_->materials[i].name + "\"");
+    }
+
+    for (size_t i = 0; i < scene_->instances.size(); ++i) {
+      auto mesh = meshes.find(instanceMeshes_[i]);
+      if (mesh == meshes.end())
+        return Fail("instance of unknown mesh \"" + instanceMeshes_[i] + "\"");
+      scene_->instances[i].mesh = mesh->second;
+
+      // Instances without a material share one of the default Diffuse, named ""
+      auto material = materials.find(instanceMaterials_[i]);
+      if (material == materials.end()) {
+        if (!instanceMaterials_[i].empty())
+          return Fail("instance of unknown material \"" + instanceMaterials_[i] + "\"");
+        material = materials.emplace("", scene_->materials.size()).first;
+        scene_->materials.push_back({});
+      }
+      scene_->instances[i].material = material->second;
+    }
+    return true;
+  }
+
+private:
+  struct Level {
+    bool array;
+    size_t pathLength;  // Of "path_" before the level
+  };
+
+  SceneDesc* scene_;
+  std::vector<Level> levels_;
+  std::string path_;  // Keys of the levels
+  std::string key_;   // Of the next value in an object
+  std::vector<double> numbers_;
+  std::string error_;
+
+  // Of the element being read
+  std::vector<std::string> instanceMeshes_;
+  std::vector<std::string> instanceMaterials_;
+  XMFLOAT3 rotationAxis_ = {0.f, 1.f, 0.f};
+  float rotationDegrees_ = 0.f;
+  bool rect_ = false;
+  size_t lightCount_ = 0;
+
+  bool Fail(std::string message) {
+    error_ = std::move(message);
+    return false;
+  }
+
+  void Enter(bool array) {
+    levels_.push_back({array, path_.size()});
+    // Elements of arrays keep the path of their array
+    bool inObject = levels_.size() > 1 && !levels_[levels_.size() - 2].array;
+    if (inObject)
+      path_ += (path_.empty() ? "" : ".") + key_;
+  }
+
+  void Leave() {
+    path_.resize(levels_.back().pathLength);
+    levels_.pop_back();
+  }
+
+  std::string ValuePath() const {
+    if (levels_.empty() || levels_.back().array)
+      return path_;
+    return path_.empty() ? key_ : path_ + "." + key_;
+  }
+
+  bool StartElement() {
+    if (path_ == "meshes") {
+      scene_->meshes.emplace_back();
+      rect_ = false;
+    } else if (path_ == "materials") {
+      scene_->materials.emplace_back();
+    } else if (path_ == "instances") {
+      scene_->instances.emplace_back();
+      instanceMeshes_.emplace_back();
+      instanceMaterials_.emplace_back();
+      rotationAxis_ = {0.f, 1.f, 0.f};
+      rotationDegrees_ = 0.f;
+    } else if (path_ == "lights") {
+      if (++lightCount_ > 1)
+        return Fail("more than one light, the demo has one directional light");
+    } else {
+      return Fail("unexpected object in \"" + path_ + "\"");
+    }
+    return true;
+  }
+
+  bool EndElement() {
+    if (path_ == "meshes") {
+      const auto& mesh = scene_->meshes.back();
+      if (mesh.file.empty() == !rect_)
+        return Fail("mesh \"" + mesh.name + "\" needs either a \"file\" or a \"rect\"");
+    } else if (path_ == "instances" && rotationDegrees_ != 0.f) {
+      XMVECTOR axis = XMVector3Normalize(XMLoadFloat3(&rotationAxis_));
+      if (XMVectorGetX(XMVector3LengthSq(axis)) == 0.f)
+        return Fail("instance rotation about a zero axis");
+      XMStoreFloat4(&scene_->instances.back().rotation,
+                    XMQuaternionRotationAxis(axis, XMConvertToRadians(rotationDegrees_)));
+    }
+    return true;
+  }
+
+  bool Number(double value) {
+    if (levels_.empty())
+      return Fail(s_rootError);
+    if (levels_.back().array) {
+      if (IsElementArray(path_))
+        return Fail("unexpected number in \"" + path_ + "\"");
+      numbers_.push_back(value);
+      return true;
+    }
+
+    auto path = ValuePath();
+    auto f = static_cast<float>(value);
+    auto i = static_cast<int>(value);
+    auto& light = scene_->light;
+    auto& camera = scene_->camera;
+    auto& ssao = scene_->ssao;
+    auto& prt = scene_->prt;
+    if (path == "instances.scale") {
+      scene_->instances.back().scale = f;
+    } else if (path == "instances.rotation.degrees") {
+      rotationDegrees_ = f;
+    } else if (path == "lights.width") {
+      light.width = f;
+    } else if (path == "lights.height") {
+      light.height = f;
+    } else if (path == "lights.depth") {
+      light.affectedDepth = f;
+    } else if (path == "camera.fov") {
+      camera.vFovDeg = f;
+    } else if (path == "camera.near") {
+      camera.zNear = f;
+    } else if (path == "camera.far") {
+      camera.zFar = f;
+    } else if (path == "settings.ssao.radius") {
+      ssao.radius = f;
+    } else if (path == "settings.ssao.bias") {
+      ssao.bias = f;
+    } else if (path == "settings.ssao.intensity") {
+      ssao.intensity = f;
+    } else if (path == "settings.ssao.sampleCount") {
+      ssao.sampleCount = i;
+    } else if (path == "settings.ssao.blurRadius") {
+      ssao.blurRadius = i;
+    } else if (path == "settings.ssao.blurSharpness") {
+      ssao.blurSharpness = f;
+    } else if (path == "settings.prt.order") {
+      prt.order = i;
+    } else if (path == "settings.prt.sampleCount") {
+      prt.sampleCount = i;
+    } else if (path == "settings.prt.seed") {
+      prt.seed = static_cast<std::uint32_t>(value);
+    } else {
+      return Fail("unknown number \"" + path + "\"");
+    }
+    return true;
+  }
+
+  // The numbers of the array just read, at "path_"
+  bool SetVector() {
+    XMFLOAT3* target = nullptr;
+    if (path_ == "meshes.rect") {
+      if (numbers_.size() != 2)
+        return Fail("\"meshes.rect\" needs 2 numbers");
+      scene_->meshes.back().rectSpanX = static_cast<float>(numbers_[0]);
+      scene_->meshes.back().rectSpanZ = static_cast<float>(numbers_[1]);
+      rect_ = true;
+      return true;
+    } else if (path_ == "materials.albedo") {
+      target = &scene_->materials.back().diffuse.albedo;
+    } else if (path_ == "instances.translation") {
+      target = &scene_->instances.back().translation;
+    } else if (path_ == "instances.rotation.axis") {
+      target = &rotationAxis_;
+    } else if (path_ == "lights.position") {
+      target = &scene_->light.pos;
+    } else if (path_ == "lights.direction") {
+      target = &scene_->light.dir;
+    } else if (path_ == "lights.color") {
+      target = &scene_->light.color;
+    } else if (path_ == "camera.position") {
+      target = &scene_->camera.position;
+    } else if (path_ == "camera.lookTo") {
+      target = &scene_->camera.lookTo;
+    } else {
+      return Fail("unknown array \"" + path_ + "\"");
+    }
+    if (numbers_.size() != 3)
+      return Fail("\"" + path_ + "\" needs 3 numbers");
+    *target = {static_cast<float>(numbers_[0]), static_cast<float>(numbers_[1]),
+               static_cast<float>(numbers_[2])};
+    return true;
+  }
+};
+}  // namespace
+
+SceneDesc LoadSceneFile(const std::string& file) {
+  MappedFile mapping{file};
+  rapidjson::MemoryStream stream{reinterpret_cast<const char*>(mapping.Data()), mapping.Size()};
+
+  SceneDesc scene;
+  SceneReader handler{&scene};
+  rapidjson::Reader reader;
+  // Hand written scenes may have comments and trailing commas
+  constexpr unsigned flags = rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag;
+  auto result = reader.Parse<flags>(stream, handler);
+  if (!result) {
+    if (!handler.Error().empty())
+      throw std::runtime_error{"scene file " + file + ": " + handler.Error()};
+    throw std::runtime_error{"failed to parse scene file " + file + ": " +
+                             rapidjson::GetParseError_En(result.Code()) + " at offset " +
+                             std::to_string(result.Offset())};
+  }
+  if (!handler.ResolveInstances())
+    throw std::runtime_error{"scene file " + file + ": " + handler.Error()};
+  return scene;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "AmbientOcclusion.h"
+#include "DirectionalLight.h"
+#include "Material.h"
+#include "PrtBake.h"
+
+// Mesh of a scene file, loaded once however many instances use it.
+struct SceneMesh {
+  std::string name;
+  std::string file;  // Loaded with ObjModel::LoadCached(), empty for a rect
+  float rectSpanX = 1.f;  // Size of the RectXZ otherwise
+  float rectSpanZ = 1.f;
+};
+
+struct SceneMaterial {
+  std::string name;
+  Diffuse diffuse;
+};
+
+// Placement of a mesh, scaled, then rotated, then translated. The scale is uniform, which the
+// LOD selection and the meshlet culling rely on.
+struct SceneInstance {
+  size_t mesh = 0;  // Into SceneDesc::meshes
+  size_t material = 0;  // Into SceneDesc::materials
+  DirectX::XMFLOAT3 translation = {0.f, 0.f, 0.f};
+  DirectX::XMFLOAT4 rotation = {0.f, 0.f, 0.f, 1.f};  // Quaternion
+  float scale = 1.f;
+};
+
+struct SceneCamera {
+  DirectX::XMFLOAT3 position = {0.f, 2.f, -10.f};
+  DirectX::XMFLOAT3 lookTo = {0.f, 0.f, 1.f};
+  float vFovDeg = 60.f;
+  float zNear = 1.f;
+  float zFar = 100.f;
+};
+
+struct SceneDesc {
+  std::vector<SceneMesh> meshes;
+  std::vector<SceneMaterial> materials;
+  std::vector<SceneInstance> instances;
+  DirectionalLight light = MakeSceneDefaultDirectionalLight();
+  SceneCamera camera;
+  SsaoSettings ssao;
+  PrtSettings prt;
+};
+
+/**
+ * Read a scene from a JSON file, with rapidjson's SAX reader straight from the mapped file, so
+ * that a scene of many instances is never held as a document. The format:
+ *
+ *   {
+ *     "meshes": [{"name": "bunny", "file": "stanford-bunny.obj"},
+ *                {"name": "rect", "rect": [1, 1]}],
+ *     "materials": [{"name": "green", "albedo": [0, 0.8, 0]}],
+ *     "instances": [{"mesh": "rect", "material": "green", "translation": [0, 0, 0],
+ *                    "rotation": {"axis": [1, 0, 0], "degrees": -90}, "scale": 5}],
+ *     "lights": [{"type": "directional", "position": [6, 6, -6], "direction": [-1, -1, 1],
+ *                 "color": [1, 1, 1], "width": 15, "height": 15, "depth": 50}],
+ *     "camera": {"position": [0, 2, -10], "lookTo": [0, 0, 1], "fov": 60, "near": 1,
+ *                "far": 100},
+ *     "settings": {"ssao": {"radius": 0.5, "bias": 0.05, "intensity": 1.5, "sampleCount": 16,
+ *                           "blurRadius": 2, "blurSharpness": 8},
+ *                  "prt": {"order": 4, "sampleCount": 1024, "seed": 0}}
+ *   }
+ *
+ * Instances name their mesh and material, which may come later in the file. Anything left out
+ * keeps its default, an instance without a material gets the default Diffuse. Unknown keys and
+ * more than one light, unnamed materials and a root that is not an object are errors, thrown as
+ * std::runtime_error with the file name.
+ */
+SceneDesc LoadSceneFile(const std::string& file);
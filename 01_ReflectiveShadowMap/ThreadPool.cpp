@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  threadCount = std::max<size_t>(threadCount, 1);
+  workers_.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    workers_.emplace_back([this] { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& w : workers_) {
+    w.join();
+  }
+}
+
+void ThreadPool::Enqueue(std::function<void()> task) {
+  {
+    std::lock_guard lock{mutex_};
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{mutex_};
+      cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (stopping_ && tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain,
+                             const std::function<void(size_t, size_t)>& fn) {
+  if (end <= begin)
+    return;
+
+  grain = std::max<size_t>(grain, 1);
+  size_t chunkCount = (end - begin + grain - 1) / grain;
+  if (chunkCount == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  // Helpers may start after this call has returned, so the shared state outlives the stack frame.
+  struct State {
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> doneChunks{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<State>();
+
+  auto run = [state, begin, end, grain, chunkCount, &fn] {
+    size_t chunk;
+    while ((chunk = state->nextChunk.fetch_add(1)) < chunkCount) {
+      size_t b = begin + chunk * grain;
+      size_t e = std::min(b + grain, end);
+      fn(b, e);
+      if (state->doneChunks.fetch_add(1) + 1 == chunkCount) {
+        std::lock_guard lock{state->mutex};
+        state->cv.notify_all();
+      }
+    }
+  };
+
+  // "fn" is only touched while a chunk is still unclaimed, i.e. before this call returns.
+  size_t helperCount = std::min(chunkCount - 1, ThreadCount());
+  for (size_t i = 0; i < helperCount; ++i) {
+    Enqueue(run);
+  }
+
+  run();
+
+  std::unique_lock lock{state->mutex};
+  state->cv.wait(lock, [&] { return state->doneChunks.load() == chunkCount; });
+}
+
+ThreadPool& GlobalThreadPool() {
+  static ThreadPool s_pool;
+  return s_pool;
+}
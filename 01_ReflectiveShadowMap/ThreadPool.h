@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads shared by the CPU reference renderers.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+  ~ThreadPool();
+
+  size_t ThreadCount() const { return workers_.size(); }
+
+  void Enqueue(std::function<void()> task);
+
+  // Calls fn(chunkBegin, chunkEnd) over [begin, end) split into chunks of at most "grain" items.
+  // The calling thread takes chunks as well, so nested calls from inside a task cannot deadlock.
+  // Chunks are handed out in order but may finish in any order.
+  void ParallelFor(size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)>& fn);
+
+private:
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+
+  void WorkerLoop();
+};
+
+// Pool sized to the hardware, created on first use.
+ThreadPool& GlobalThreadPool();
@@ -3,6 +3,7 @@
 
 using Milliseconds = std::chrono::milliseconds;
 using Seconds = std::chrono::seconds;
+using FloatMilliseconds = std::chrono::duration<double, std::milli>;
 
 template<typename Duration = std::chrono::milliseconds>
 class Timer {
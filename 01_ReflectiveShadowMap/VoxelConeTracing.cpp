@@ -0,0 +1,488 @@
+#include "VoxelConeTracing.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+bool IsPowerOfTwo(int x) {
+  return x > 0 && (x & (x - 1)) == 0;
+}
+
+// Separating axis data of one triangle against boxes of half size "h" [Akenine-Moller 2001].
+// Projections onto an axis are linear, so dot(axis, v - c) = dot(axis, v) - dot(axis, c) and
+// everything but dot(axis, c) is computed once per triangle. The three box normals are not needed
+// because only voxels inside the triangle's bounding box are tested.
+struct TriangleSat {
+  static constexpr int s_axisCount = 10;  // 9 edge cross products and the triangle normal
+
+  float ax[s_axisCount];
+  float ay[s_axisCount];
+  float az[s_axisCount];
+  float minP[s_axisCount];
+  float maxP[s_axisCount];
+  float r[s_axisCount];
+};
+
+TriangleSat MakeTriangleSat(const XMFLOAT3 v[3], float h) {
+  TriangleSat sat{};
+  XMFLOAT3 e[3] = {
+      {v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z},
+      {v[2].x - v[1].x, v[2].y - v[1].y, v[2].z - v[1].z},
+      {v[0].x - v[2].x, v[0].y - v[2].y, v[0].z - v[2].z},
+  };
+
+  XMFLOAT3 axes[TriangleSat::s_axisCount];
+  for (int i = 0; i < 3; ++i) {
+    axes[3 * i] = {0.f, -e[i].z, e[i].y};      // X x e
+    axes[3 * i + 1] = {e[i].z, 0.f, -e[i].x};  // Y x e
+    axes[3 * i + 2] = {-e[i].y, e[i].x, 0.f};  // Z x e
+  }
+  axes[9] = ToXMFloat3(XMVector3Cross(ToXMVector(e[0]), ToXMVector(e[1])));
+
+  for (int k = 0; k < TriangleSat::s_axisCount; ++k) {
+    const auto& a = axes[k];
+    float p0 = a.x * v[0].x + a.y * v[0].y + a.z * v[0].z;
+    float p1 = a.x * v[1].x + a.y * v[1].y + a.z * v[1].z;
+    float p2 = a.x * v[2].x + a.y * v[2].y + a.z * v[2].z;
+    sat.ax[k] = a.x;
+    sat.ay[k] = a.y;
+    sat.az[k] = a.z;
+    sat.minP[k] = std::min({p0, p1, p2});
+    sat.maxP[k] = std::max({p0, p1, p2});
+    sat.r[k] = h * (std::abs(a.x) + std::abs(a.y) + std::abs(a.z));
+  }
+  return sat;
+}
+
+// Overlap test of one triangle against four boxes in a row along x. Bit i of the result is set if
+// the box centered at (cx[i], cy, cz) overlaps the triangle.
+int OverlapMask4(const TriangleSat& sat, __m128 cx, float cy, float cz) {
+  __m128 separated = _mm_setzero_ps();
+  for (int k = 0; k < TriangleSat::s_axisCount; ++k) {
+    __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sat.ax[k]), cx),
+                          _mm_set1_ps(sat.ay[k] * cy + sat.az[k] * cz));
+    __m128 r = _mm_set1_ps(sat.r[k]);
+    __m128 lo = _mm_sub_ps(_mm_set1_ps(sat.minP[k]), d);
+    __m128 hi = _mm_sub_ps(_mm_set1_ps(sat.maxP[k]), d);
+    separated = _mm_or_ps(separated, _mm_cmpgt_ps(lo, r));
+    separated = _mm_or_ps(separated, _mm_cmplt_ps(hi, _mm_sub_ps(_mm_setzero_ps(), r)));
+  }
+  return ~_mm_movemask_ps(separated) & 0xF;
+}
+
+float Component(FXMVECTOR v, int axis) {
+  return axis == 0 ? XMVectorGetX(v) : (axis == 1 ? XMVectorGetY(v) : XMVectorGetZ(v));
+}
+}  // namespace
+
+SparseVoxelGrid::SparseVoxelGrid(const Bounds& sceneBounds,
+                                 const VoxelConeTracingSettings& settings)
+    : settings_{settings} {
+  if (!IsPowerOfTwo(settings.resolution) || !IsPowerOfTwo(settings.brickSize) ||
+      settings.brickSize > settings.resolution)
+    throw std::runtime_error{"voxel resolution and brick size must be powers of two"};
+
+  // Cube around the scene with a little padding so that boundary triangles stay inside.
+  auto ext = sceneBounds.Extent();
+  float extent = std::max({ext.x, ext.y, ext.z}) * 1.02f + 1e-3f;
+  auto c = sceneBounds.Center();
+  origin_ = {c.x - 0.5f * extent, c.y - 0.5f * extent, c.z - 0.5f * extent};
+  voxelSize_ = extent / static_cast<float>(settings.resolution);
+
+  for (int res = settings.resolution; res >= settings.brickSize; res /= 2) {
+    Level level;
+    level.resolution = res;
+    level.bricksPerAxis = res / settings.brickSize;
+    level.brickSlots.assign(static_cast<size_t>(level.bricksPerAxis) * level.bricksPerAxis *
+                                level.bricksPerAxis,
+                            -1);
+    levels_.push_back(std::move(level));
+  }
+}
+
+size_t SparseVoxelGrid::BrickValueCount() const {
+  size_t b = settings_.brickSize;
+  return b * b * b * s_directionCount;
+}
+
+std::int32_t SparseVoxelGrid::AllocateBrick(Level& level, int bx, int by, int bz) {
+  size_t slot = (static_cast<size_t>(bz) * level.bricksPerAxis + by) * level.bricksPerAxis + bx;
+  if (level.brickSlots[slot] < 0) {
+    level.brickSlots[slot] = static_cast<std::int32_t>(level.brickCount++);
+    level.pool.resize(level.brickCount * BrickValueCount(), {0.f, 0.f, 0.f, 0.f});
+  }
+  return level.brickSlots[slot];
+}
+
+std::ptrdiff_t SparseVoxelGrid::VoxelOffset(const Level& level, int x, int y, int z) const {
+  int b = settings_.brickSize;
+  size_t slot = (static_cast<size_t>(z / b) * level.bricksPerAxis + y / b) * level.bricksPerAxis +
+                x / b;
+  auto brick = level.brickSlots[slot];
+  if (brick < 0)
+    return -1;
+
+  size_t local = (static_cast<size_t>(z % b) * b + y % b) * b + x % b;
+  return static_cast<std::ptrdiff_t>(brick * BrickValueCount() + local * s_directionCount);
+}
+
+XMFLOAT4* SparseVoxelGrid::Voxel(Level& level, int x, int y, int z) {
+  auto offset = VoxelOffset(level, x, y, z);
+  return offset < 0 ? nullptr : &level.pool[offset];
+}
+
+XMFLOAT4 SparseVoxelGrid::Fetch(int levelIndex, int x, int y, int z, int channel) const {
+  const auto& level = levels_[levelIndex];
+  if (x < 0 || y < 0 || z < 0 || x >= level.resolution || y >= level.resolution ||
+      z >= level.resolution)
+    return {0.f, 0.f, 0.f, 0.f};
+
+  auto offset = VoxelOffset(level, x, y, z);
+  return offset < 0 ? XMFLOAT4{0.f, 0.f, 0.f, 0.f} : level.pool[offset + channel];
+}
+
+void SparseVoxelGrid::Voxelize(const CpuScene& scene) {
+  auto& level0 = levels_[0];
+  int res = level0.resolution;
+  float h = 0.5f * voxelSize_;
+
+  constexpr size_t grain = 256;
+  size_t triangleCount = scene.TriangleCount();
+  std::vector<std::vector<std::uint32_t>> chunkVoxels((triangleCount + grain - 1) / grain);
+
+  GlobalThreadPool().ParallelFor(0, triangleCount, grain, [&](size_t begin, size_t end) {
+    auto& out = chunkVoxels[begin / grain];
+    for (size_t t = begin; t < end; ++t) {
+      XMFLOAT3 v[3];
+      for (int k = 0; k < 3; ++k) {
+        const auto& p = scene.positions[scene.indices[3 * t + k]];
+        v[k] = {p.x - origin_.x, p.y - origin_.y, p.z - origin_.z};
+      }
+
+      int lo[3], hi[3];
+      for (int axis = 0; axis < 3; ++axis) {
+        auto get = [axis](const XMFLOAT3& p) { return axis == 0 ? p.x : (axis == 1 ? p.y : p.z); };
+        float mn = std::min({get(v[0]), get(v[1]), get(v[2])});
+        float mx = std::max({get(v[0]), get(v[1]), get(v[2])});
+        lo[axis] = Clamp(static_cast<int>(std::floor(mn / voxelSize_)), 0, res - 1);
+        hi[axis] = Clamp(static_cast<int>(std::floor(mx / voxelSize_)), 0, res - 1);
+      }
+
+      auto sat = MakeTriangleSat(v, h);
+      for (int z = lo[2]; z <= hi[2]; ++z) {
+        float cz = (z + 0.5f) * voxelSize_;
+        for (int y = lo[1]; y <= hi[1]; ++y) {
+          float cy = (y + 0.5f) * voxelSize_;
+          for (int x = lo[0]; x <= hi[0]; x += 4) {
+            __m128 cx = _mm_mul_ps(_mm_setr_ps(x + 0.5f, x + 1.5f, x + 2.5f, x + 3.5f),
+                                   _mm_set1_ps(voxelSize_));
+            int mask = OverlapMask4(sat, cx, cy, cz);
+            for (int lane = 0; lane < 4 && x + lane <= hi[0]; ++lane) {
+              if (mask & (1 << lane))
+                out.push_back((static_cast<std::uint32_t>(z) * res + y) * res + x + lane);
+            }
+          }
+        }
+      }
+    }
+  });
+
+  std::vector<std::uint32_t> voxels;
+  for (const auto& chunk : chunkVoxels) {
+    voxels.insert(voxels.end(), chunk.begin(), chunk.end());
+  }
+  std::sort(voxels.begin(), voxels.end());
+  voxels.erase(std::unique(voxels.begin(), voxels.end()), voxels.end());
+
+  int b = settings_.brickSize;
+  for (auto index : voxels) {
+    int x = static_cast<int>(index % res);
+    int y = static_cast<int>(index / res % res);
+    int z = static_cast<int>(index / res / res);
+    AllocateBrick(level0, x / b, y / b, z / b);
+    auto* v = Voxel(level0, x, y, z);
+    for (int d = 0; d < s_directionCount; ++d) {
+      v[d].w = 1.f;
+    }
+  }
+}
+
+void SparseVoxelGrid::InjectRsm(const CpuRsm& rsm, const DirectionalLight& light) {
+  auto& level0 = levels_[0];
+  for (auto& v : level0.pool) {
+    v.x = v.y = v.z = 0.f;
+  }
+
+  // Flux of a texel is albedo * light flux per unit area perpendicular to the light. Spread over
+  // one voxel face this gives radiance in the same units PS uses for direct lighting.
+  int size = rsm.Size();
+  float texelArea = (light.width / size) * (light.height / size);
+  float scale = texelArea / (voxelSize_ * voxelSize_);
+
+  for (size_t i = 0; i < rsm.texels.PixelCount(); ++i) {
+    if (!rsm.texels.IsCovered(i))
+      continue;
+
+    // Step slightly below the surface so the texel lands in the voxel holding its triangle.
+    const auto& p = rsm.texels.position[i];
+    const auto& n = rsm.texels.normal[i];
+    float offset = 0.25f * voxelSize_;
+    int x = static_cast<int>(std::floor((p.x - n.x * offset - origin_.x) / voxelSize_));
+    int y = static_cast<int>(std::floor((p.y - n.y * offset - origin_.y) / voxelSize_));
+    int z = static_cast<int>(std::floor((p.z - n.z * offset - origin_.z) / voxelSize_));
+    if (x < 0 || y < 0 || z < 0 || x >= level0.resolution || y >= level0.resolution ||
+        z >= level0.resolution)
+      continue;
+
+    auto* v = Voxel(level0, x, y, z);
+    if (!v || v->w == 0.f)
+      continue;
+
+    // Seen along direction d the surface covers |dot(n, d)| of the voxel face, and only its front
+    // side emits.
+    const float axisNormal[3] = {n.x, n.y, n.z};
+    const auto& f = rsm.flux[i];
+    for (int d = 0; d < s_directionCount; ++d) {
+      float sign = d % 2 == 0 ? 1.f : -1.f;
+      float facing = std::max(0.f, -sign * axisNormal[d / 2]) * scale;
+      v[d].x += f.x * facing;
+      v[d].y += f.y * facing;
+      v[d].z += f.z * facing;
+    }
+  }
+}
+
+void SparseVoxelGrid::BuildMips() {
+  int b = settings_.brickSize;
+
+  for (int l = 1; l < LevelCount(); ++l) {
+    auto& parent = levels_[l];
+    const auto& child = levels_[l - 1];
+
+    std::fill(parent.brickSlots.begin(), parent.brickSlots.end(), -1);
+    parent.pool.clear();
+    parent.brickCount = 0;
+
+    // A parent brick covers 2x2x2 child bricks
+    std::vector<size_t> parentSlots;
+    for (int bz = 0; bz < child.bricksPerAxis; ++bz) {
+      for (int by = 0; by < child.bricksPerAxis; ++by) {
+        for (int bx = 0; bx < child.bricksPerAxis; ++bx) {
+          size_t slot = (static_cast<size_t>(bz) * child.bricksPerAxis + by) *
+                            child.bricksPerAxis + bx;
+          if (child.brickSlots[slot] < 0)
+            continue;
+          auto before = parent.brickCount;
+          AllocateBrick(parent, bx / 2, by / 2, bz / 2);
+          if (parent.brickCount != before) {
+            parentSlots.push_back(
+                (static_cast<size_t>(bz / 2) * parent.bricksPerAxis + by / 2) *
+                    parent.bricksPerAxis + bx / 2);
+          }
+        }
+      }
+    }
+
+    GlobalThreadPool().ParallelFor(0, parentSlots.size(), 4, [&](size_t begin, size_t end) {
+      for (size_t s = begin; s < end; ++s) {
+        int bx = static_cast<int>(parentSlots[s] % parent.bricksPerAxis);
+        int by = static_cast<int>(parentSlots[s] / parent.bricksPerAxis % parent.bricksPerAxis);
+        int bz = static_cast<int>(parentSlots[s] / parent.bricksPerAxis / parent.bricksPerAxis);
+
+        for (int lz = 0; lz < b; ++lz) {
+          for (int ly = 0; ly < b; ++ly) {
+            for (int lx = 0; lx < b; ++lx) {
+              int x = bx * b + lx;
+              int y = by * b + ly;
+              int z = bz * b + lz;
+              auto* out = Voxel(parent, x, y, z);
+
+              for (int d = 0; d < s_directionCount; ++d) {
+                int axis = d / 2;
+                int front = d % 2 == 0 ? 0 : 1;  // Child met first when travelling along d
+
+                // Composite front to back along the axis, then average the four columns.
+                XMVECTOR sum = XMVectorZero();
+                for (int j = 0; j < 2; ++j) {
+                  for (int k = 0; k < 2; ++k) {
+                    int o0[3], o1[3];
+                    o0[axis] = front;
+                    o1[axis] = 1 - front;
+                    o0[(axis + 1) % 3] = o1[(axis + 1) % 3] = j;
+                    o0[(axis + 2) % 3] = o1[(axis + 2) % 3] = k;
+                    auto f = ToXMVector(
+                        Fetch(l - 1, 2 * x + o0[0], 2 * y + o0[1], 2 * z + o0[2], d));
+                    auto bk = ToXMVector(
+                        Fetch(l - 1, 2 * x + o1[0], 2 * y + o1[1], 2 * z + o1[2], d));
+                    sum += f + bk * (1.f - XMVectorGetW(f));
+                  }
+                }
+                out[d] = ToXMFloat4(sum * 0.25f);
+              }
+            }
+          }
+        }
+      }
+    });
+  }
+}
+
+XMVECTOR SparseVoxelGrid::SampleLevel(int levelIndex, FXMVECTOR pos, const float dirWeights[3],
+                                      const int dirChannels[3]) const {
+  float size = voxelSize_ * static_cast<float>(1 << levelIndex);
+
+  float f[3];
+  int i0[3];
+  float t[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    f[axis] = Component(pos, axis) / size - 0.5f;
+    i0[axis] = static_cast<int>(std::floor(f[axis]));
+    t[axis] = f[axis] - i0[axis];
+  }
+
+  XMVECTOR result = XMVectorZero();
+  for (int corner = 0; corner < 8; ++corner) {
+    int dx = corner & 1;
+    int dy = (corner >> 1) & 1;
+    int dz = (corner >> 2) & 1;
+    float w = (dx ? t[0] : 1.f - t[0]) * (dy ? t[1] : 1.f - t[1]) * (dz ? t[2] : 1.f - t[2]);
+    if (w <= 0.f)
+      continue;
+
+    int x = i0[0] + dx;
+    int y = i0[1] + dy;
+    int z = i0[2] + dz;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (dirWeights[axis] > 0.f)
+        result += ToXMVector(Fetch(levelIndex, x, y, z, dirChannels[axis])) * (w * dirWeights[axis]);
+    }
+  }
+  return result;
+}
+
+XMVECTOR SparseVoxelGrid::TraceCone(FXMVECTOR origin, FXMVECTOR normal, FXMVECTOR dir,
+                                    float aperture) const {
+  float dirWeights[3];
+  int dirChannels[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    float c = Component(dir, axis);
+    dirWeights[axis] = c * c;
+    dirChannels[axis] = 2 * axis + (c >= 0.f ? 0 : 1);
+  }
+
+  float extent = voxelSize_ * levels_[0].resolution;
+  float maxDistance = settings_.maxDistanceFactor * extent;
+  float diameterPerDistance = 2.f * std::tan(0.5f * aperture);
+  float maxLod = static_cast<float>(LevelCount() - 1);
+
+  XMVECTOR color = XMVectorZero();
+  float alpha = 0.f;
+  float dist = voxelSize_;  // Skip the voxels of the surface itself
+  while (dist < maxDistance && alpha < settings_.opacityThreshold) {
+    float diameter = std::max(voxelSize_, diameterPerDistance * dist);
+    auto pos = origin + dir * dist + normal * (0.5f * diameter);
+    if (XMVectorGetX(pos) < 0.f || XMVectorGetY(pos) < 0.f || XMVectorGetZ(pos) < 0.f ||
+        XMVectorGetX(pos) > extent || XMVectorGetY(pos) > extent || XMVectorGetZ(pos) > extent)
+      break;
+
+    float lod = std::min(std::log2(diameter / voxelSize_), maxLod);
+    int l0 = static_cast<int>(lod);
+    int l1 = std::min(l0 + 1, LevelCount() - 1);
+    float t = lod - l0;
+
+    auto s = SampleLevel(l0, pos, dirWeights, dirChannels);
+    if (t > 0.f && l1 != l0)
+      s = XMVectorLerp(s, SampleLevel(l1, pos, dirWeights, dirChannels), t);
+
+    // Mips are filtered for crossing a whole voxel of the level. Correct for the shorter step.
+    float step = 0.5f * diameter;
+    float a = XMVectorGetW(s);
+    if (a > 0.f) {
+      float voxelOfLod = voxelSize_ * std::exp2(lod);
+      float corrected = 1.f - std::pow(1.f - std::min(a, 0.9999f), step / voxelOfLod);
+      s = s * (corrected / a);
+      a = corrected;
+    }
+
+    color += s * (1.f - alpha);
+    alpha += (1.f - alpha) * a;
+    dist += step;
+  }
+  return color;
+}
+
+XMFLOAT3 SparseVoxelGrid::TraceDiffuse(XMFLOAT3 p, XMFLOAT3 n) const {
+  auto normal = XMVector3Normalize(ToXMVector(n));
+  auto origin = ToXMVector(p) - ToXMVector(origin_) + normal * voxelSize_;
+
+  auto helper = std::abs(XMVectorGetY(normal)) < 0.99f ? XMVectorSet(0.f, 1.f, 0.f, 0.f)
+                                                       : XMVectorSet(1.f, 0.f, 0.f, 0.f);
+  auto tangent = XMVector3Normalize(XMVector3Cross(helper, normal));
+  auto bitangent = XMVector3Cross(normal, tangent);
+
+  // One cone along the normal and five tilted by 60 degrees. The weights approximate the cosine
+  // lobe and sum to one.
+  float aperture = XMConvertToRadians(settings_.coneApertureDeg);
+  XMVECTOR sum = TraceCone(origin, normal, normal, aperture) * 0.25f;
+
+  float tilt = XM_PI / 3.f;
+  for (int i = 0; i < 5; ++i) {
+    float phi = XM_2PI * i / 5.f;
+    auto side = tangent * std::cos(phi) + bitangent * std::sin(phi);
+    auto dir = XMVector3Normalize(normal * std::cos(tilt) + side * std::sin(tilt));
+    sum += TraceCone(origin, normal, dir, aperture) * 0.15f;
+  }
+  return ToXMFloat3(sum);
+}
+
+size_t SparseVoxelGrid::BrickCount() const {
+  size_t count = 0;
+  for (const auto& level : levels_) {
+    count += level.brickCount;
+  }
+  return count;
+}
+
+size_t SparseVoxelGrid::MemoryByteSize() const {
+  size_t bytes = 0;
+  for (const auto& level : levels_) {
+    bytes += level.pool.size() * sizeof(XMFLOAT4) + level.brickSlots.size() * sizeof(std::int32_t);
+  }
+  return bytes;
+}
+
+size_t SparseVoxelGrid::DenseByteSize() const {
+  size_t bytes = 0;
+  for (const auto& level : levels_) {
+    size_t r = level.resolution;
+    bytes += r * r * r * s_directionCount * sizeof(XMFLOAT4);
+  }
+  return bytes;
+}
+
+Image ShadeVoxelConeTracing(const GBuffer& camera, const SparseVoxelGrid& grid) {
+  Image indirect{camera.width, camera.height};
+
+  GlobalThreadPool().ParallelFor(0, camera.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+      for (size_t x = 0; x < static_cast<size_t>(camera.width); ++x) {
+        size_t i = y * camera.width + x;
+        if (!camera.IsCovered(i))
+          continue;
+
+        auto radiance = grid.TraceDiffuse(camera.position[i], camera.normal[i]);
+        const auto& a = camera.albedo[i];
+        indirect.pixels[i] = {a.x * radiance.x, a.y * radiance.y, a.z * radiance.z};
+      }
+    }
+  });
+
+  return indirect;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CpuRaster.h"
+#include "CpuScene.h"
+#include "Image.h"
+#include "RsmReference.h"
+
+struct VoxelConeTracingSettings {
+  int resolution = 128;             // Voxels per axis on the finest level, power of two
+  int brickSize = 4;                // Voxels per brick edge, power of two
+  float coneApertureDeg = 60.f;     // Full aperture of each of the diffuse cones
+  float maxDistanceFactor = 1.f;    // Cone length as a fraction of the grid extent
+  float opacityThreshold = 0.95f;   // Stop marching once a cone is this opaque
+};
+
+/**
+ * Sparse voxel representation of the scene for voxel cone tracing [Crassin et al. 2011].
+ * Space is a cube of "resolution^3" voxels split into bricks of "brickSize^3" voxels. Every mip
+ * level keeps a table of brick slots and a pool holding only the bricks that contain geometry.
+ * Every voxel stores six RGBA values (premultiplied radiance, opacity), one per axis direction a
+ * cone can travel in. On level 0 this keeps a surface from lighting cones that leave it; on the
+ * coarser levels it keeps the occlusion order of the children.
+ */
+class SparseVoxelGrid {
+public:
+  SparseVoxelGrid(const Bounds& sceneBounds, const VoxelConeTracingSettings& settings);
+
+  // Mark every voxel overlapped by a triangle of the scene as opaque.
+  void Voxelize(const CpuScene& scene);
+
+  // Turn the flux of every RSM texel into outgoing radiance of the voxel it lies in.
+  void InjectRsm(const CpuRsm& rsm, const DirectionalLight& light);
+
+  // Filter level 0 down into anisotropic mips. Call after injection.
+  void BuildMips();
+
+  // Cosine weighted average radiance arriving at "p" from the hemisphere around "n".
+  // Multiply by the receiver albedo to get the reflected radiance.
+  DirectX::XMFLOAT3 TraceDiffuse(DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 n) const;
+
+  int LevelCount() const { return static_cast<int>(levels_.size()); }
+
+  size_t BrickCount() const;
+
+  size_t MemoryByteSize() const;
+
+  // Size of the same data stored as dense 3D textures, for comparison.
+  size_t DenseByteSize() const;
+
+private:
+  static constexpr int s_directionCount = 6;  // +X, -X, +Y, -Y, +Z, -Z
+
+  struct Level {
+    int resolution = 0;     // Voxels per axis
+    int bricksPerAxis = 0;
+    std::vector<std::int32_t> brickSlots;  // Brick index into pool, -1 if empty
+    std::vector<DirectX::XMFLOAT4> pool;
+    size_t brickCount = 0;
+  };
+
+  VoxelConeTracingSettings settings_;
+  DirectX::XMFLOAT3 origin_ = {0.f, 0.f, 0.f};
+  float voxelSize_ = 1.f;
+  std::vector<Level> levels_;
+
+  // Values of a brick, alike at every level
+  size_t BrickValueCount() const;
+
+  // Returns the brick index, allocating it if needed.
+  std::int32_t AllocateBrick(Level& level, int bx, int by, int bz);
+
+  // Offset of the voxel's first value in the level's pool, or -1 if its brick is empty.
+  std::ptrdiff_t VoxelOffset(const Level& level, int x, int y, int z) const;
+
+  DirectX::XMFLOAT4* Voxel(Level& level, int x, int y, int z);
+
+  DirectX::XMFLOAT4 Fetch(int levelIndex, int x, int y, int z, int channel) const;
+
+  // Trilinear sample of one level, blending the directional values by "dirWeights".
+  DirectX::XMVECTOR SampleLevel(int levelIndex, DirectX::FXMVECTOR pos, const float dirWeights[3],
+                                const int dirChannels[3]) const;
+
+  // Samples are lifted by half their footprint along "normal" so that wide cones do not see the
+  // surface they start from.
+  DirectX::XMVECTOR TraceCone(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR normal,
+                              DirectX::FXMVECTOR dir, float aperture) const;
+};
+
+// Indirect lighting of every covered camera pixel: receiver albedo times the traced radiance.
+Image ShadeVoxelConeTracing(const GBuffer& camera, const SparseVoxelGrid& grid);
@@ -17,14 +17,31 @@ cbuffer PassConstant : register(b0) {
   float g_height;
   float g_rsmSize;
   float g_timeElapsed;
+  float g_ssaoRadius;
+  float g_ssaoBias;
+  float g_ssaoIntensity;
+  int g_ssaoSampleCount;
+  int g_ssaoBlurRadius;
+  float g_ssaoBlurSharpness;
+  float g_prtBlend;
 };
 
-cbuffer ModelConstant : register(b1) {
-  float4x4 g_model;
-  float4x4 g_invModel;
-  float3 g_albedo;
+// Root constants
+cbuffer DrawConstant : register(b1) {
+  float3 g_positionOffset;  // Dequantization of the submesh
+  uint g_firstInstance;     // Of the draw in "g_instances"
+  float3 g_positionScale;
 };
 
+struct Instance {
+  float4x4 model;
+  float4x4 invModel;
+  float3 albedo;
+  uint prtColorOffset;  // Of its first vertex in "g_prtColors", or s_noPrtColors
+};
+
+static const uint s_noPrtColors = 0xffffffff;
+
 SamplerState g_samp : register(s0);
 
 
@@ -33,11 +50,33 @@ Texture2D g_normalMap : register(t1);
 Texture2D g_fluxMap : register(t2);
 Texture2D g_posMap : register(t3);
 
+Texture2D g_cameraDepthMap : register(t4);   // Post-projection depth seen from the camera
+Texture2D g_cameraNormalMap : register(t5);  // View space normal
+Texture2D g_ssaoMap : register(t6);          // Half resolution, before blur
+Texture2D g_ssaoBlurredMap : register(t7);   // Half resolution, after blur
+
+StructuredBuffer<Instance> g_instances : register(t8);
+StructuredBuffer<float4> g_prtColors : register(t9);  // Relit on the CPU from precomputed transfer
+
 struct Vin {
-  float3 pos : POSITION;
-  float3 normal : NORMAL;
+  float4 pos : POSITION;  // 16 bit unorm within the bounds of the submesh, w unused
+  float2 normal : NORMAL;  // Octahedral, 16 bit snorm
+  uint vertexId : SV_VertexID;  // Within the submesh, the vertex buffer view starts at it
+  uint instanceId : SV_InstanceID;
 };
 
+float3 DecodePosition(float4 pos) {
+  return g_positionOffset + g_positionScale * pos.xyz;
+}
+
+// [Cigolle et al. 2014], like OctahedralDecode() on the CPU
+float3 DecodeNormal(float2 e) {
+  float3 n = float3(e, 1.f - abs(e.x) - abs(e.y));
+  float t = saturate(-n.z);
+  n.xy += n.xy >= 0.f ? -t : t;
+  return normalize(n);
+}
+
 // ==========
 // First pass
 // ==========
@@ -46,24 +85,30 @@ struct VOutLight {
   float3 worldNormal : NORMAL;
   float normalizedLinearDepth : DEPTH;
   float3 worldPos : POS;
+  nointerpolation float3 albedo : ALBEDO;
   float4 pos : SV_Position;
 };
 
 VOutLight VSLight(Vin vin) {
   VOutLight vout;
+  Instance instance = g_instances[g_firstInstance + vin.instanceId];
+
+  float3 pos = DecodePosition(vin.pos);
+  float3 normal = DecodeNormal(vin.normal);
 
-  float4x4 mv = mul(g_lightView, g_model);
+  float4x4 mv = mul(g_lightView, instance.model);
   float4x4 mvp = mul(g_lightOrtho, mv);
 
-  vout.pos = mul(mvp, float4(vin.pos, 1.f));
+  vout.pos = mul(mvp, float4(pos, 1.f));
 
-  vout.worldNormal = normalize(mul(transpose(g_invModel), float4(normalize(vin.normal), 0.f)).xyz);
+  vout.worldNormal = normalize(mul(transpose(instance.invModel), float4(normal, 0.f)).xyz);
 
 
-  float lightDepth = mul(mv, float4(vin.pos, 1.f)).z;
+  float lightDepth = mul(mv, float4(pos, 1.f)).z;
   vout.normalizedLinearDepth = (lightDepth - g_lightZNear) / (g_lightZFar - g_lightZNear);
 
-  vout.worldPos = mul(g_model, float4(vin.pos, 1.f)).xyz;
+  vout.worldPos = mul(instance.model, float4(pos, 1.f)).xyz;
+  vout.albedo = instance.albedo;
 
   return vout;
 }
@@ -72,6 +117,7 @@ struct PinLight {
   float3 worldNormal : NORMAL;
   float linearDepth : DEPTH;
   float3 worldPos : POS;
+  nointerpolation float3 albedo : ALBEDO;
 };
 
 // clang-format off
@@ -91,11 +137,144 @@ void PSLight(PinLight pin, out float4 depth : SV_Target0,
   normal = float4(pin.worldNormal, 1.f);
 
   // Flux texture
-  flux = float4(g_albedo * g_lightFlux, 1.f);
+  flux = float4(pin.albedo * g_lightFlux, 1.f);
 
   worldPos = float4(pin.worldPos, 1.f);
 }
 
+// =========================
+// Camera depth/normal buffer
+// =========================
+
+struct VOutGBuffer {
+  float3 viewNormal : NORMAL;
+  float4 pos : SV_Position;
+};
+
+VOutGBuffer VSGBuffer(Vin vin) {
+  VOutGBuffer vout;
+  Instance instance = g_instances[g_firstInstance + vin.instanceId];
+
+  float3 pos = DecodePosition(vin.pos);
+  float3 normal = DecodeNormal(vin.normal);
+
+  float4x4 mvp = mul(g_proj, mul(g_view, instance.model));
+  vout.pos = mul(mvp, float4(pos, 1.f));
+
+  float3 worldNormal = mul(transpose(instance.invModel), float4(normal, 0.f)).xyz;
+  vout.viewNormal = mul(g_view, float4(worldNormal, 0.f)).xyz;
+
+  return vout;
+}
+
+void PSGBuffer(VOutGBuffer pin, out float4 depth : SV_Target0, out float4 normal : SV_Target1) {
+  // SV_Position.z is the same post-projection depth that ends up in the depth buffer
+  depth = float4(pin.pos.z, 0.f, 0.f, 0.f);
+  normal = float4(normalize(pin.viewNormal), 0.f);
+}
+
+// ==========================================
+// Screen-space ambient occlusion (half size)
+// ==========================================
+
+struct VOutFullscreen {
+  float2 uv : TEXCOORD;
+  float4 pos : SV_Position;
+};
+
+// One triangle covering the whole viewport, no vertex buffer needed
+VOutFullscreen VSFullscreen(uint id : SV_VertexID) {
+  VOutFullscreen vout;
+  vout.uv = float2((id << 1) & 2, id & 2);
+  vout.pos = float4(vout.uv * float2(2.f, -2.f) + float2(-1.f, 1.f), 0.f, 1.f);
+  return vout;
+}
+
+float3 ViewPosFromDepth(float2 uv, float ndcDepth) {
+  float4 ndc = float4(uv.x * 2.f - 1.f, 1.f - uv.y * 2.f, ndcDepth, 1.f);
+  float4 v = mul(g_invProj, ndc);
+  return v.xyz / v.w;
+}
+
+float InterleavedGradientNoise(float2 pixel) {
+  return frac(52.9829189f * frac(dot(pixel, float2(0.06711056f, 0.00583715f))));
+}
+
+// Cosine weighted golden angle spiral over the hemisphere, denser close to the shading point.
+float3 SsaoKernel(int i, int count, float rotation) {
+  float u = (i + 0.5f) / count;
+  float phi = i * 2.39996323f + rotation;
+  float sinTheta = sqrt(u);
+  float cosTheta = sqrt(1.f - u);
+  float scale = 0.1f + 0.9f * u * u;
+  return float3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta) * scale;
+}
+
+float PSSsao(VOutFullscreen pin) : SV_Target {
+  float ndcDepth = g_cameraDepthMap.SampleLevel(g_samp, pin.uv, 0).r;
+  if (ndcDepth >= 1.f)
+    return 1.f;
+
+  float3 p = ViewPosFromDepth(pin.uv, ndcDepth);
+  float3 n = normalize(g_cameraNormalMap.SampleLevel(g_samp, pin.uv, 0).xyz);
+
+  float3 helper = abs(n.y) < 0.99f ? float3(0.f, 1.f, 0.f) : float3(1.f, 0.f, 0.f);
+  float3 t = normalize(cross(helper, n));
+  float3 b = cross(n, t);
+  float rotation = InterleavedGradientNoise(floor(pin.pos.xy)) * 6.28318531f;
+
+  float occlusion = 0.f;
+  for (int i = 0; i < g_ssaoSampleCount; ++i) {
+    float3 k = SsaoKernel(i, g_ssaoSampleCount, rotation);
+    float3 s = p + (t * k.x + b * k.y + n * k.z) * g_ssaoRadius;
+
+    float4 clip = mul(g_proj, float4(s, 1.f));
+    float2 suv = float2(clip.x / clip.w * 0.5f + 0.5f, 0.5f - clip.y / clip.w * 0.5f);
+    if (any(suv < 0.f) || any(suv > 1.f))
+      continue;
+
+    float sceneZ = ViewPosFromDepth(suv, g_cameraDepthMap.SampleLevel(g_samp, suv, 0).r).z;
+    float rangeCheck = saturate(g_ssaoRadius / abs(p.z - sceneZ));
+    occlusion += (sceneZ <= s.z - g_ssaoBias ? 1.f : 0.f) * rangeCheck;
+  }
+
+  return pow(saturate(1.f - occlusion / g_ssaoSampleCount), g_ssaoIntensity);
+}
+
+float ViewDepth(float2 uv) {
+  return ViewPosFromDepth(uv, g_cameraDepthMap.SampleLevel(g_samp, uv, 0).r).z;
+}
+
+// Spatial Gaussian, weighted down across depth discontinuities so occlusion does not bleed
+// from foreground objects onto the background.
+float PSSsaoBlur(VOutFullscreen pin) : SV_Target {
+  if (g_cameraDepthMap.SampleLevel(g_samp, pin.uv, 0).r >= 1.f)
+    return 1.f;
+
+  float2 halfSize = floor(float2(g_width, g_height) * 0.5f);
+  float2 texel = 1.f / halfSize;
+  float centerZ = ViewDepth(pin.uv);
+  float sigma = 0.5f * g_ssaoBlurRadius + 0.5f;
+
+  float sum = 0.f;
+  float weightSum = 0.f;
+  for (int dy = -g_ssaoBlurRadius; dy <= g_ssaoBlurRadius; ++dy) {
+    for (int dx = -g_ssaoBlurRadius; dx <= g_ssaoBlurRadius; ++dx) {
+      float2 uv = pin.uv + float2(dx, dy) * texel;
+      if (any(uv < 0.f) || any(uv > 1.f) || g_cameraDepthMap.SampleLevel(g_samp, uv, 0).r >= 1.f)
+        continue;
+
+      float z = ViewDepth(uv);
+      float w = exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma)) *
+                exp(-abs(z - centerZ) * g_ssaoBlurSharpness / centerZ);
+      sum += w * g_ssaoMap.SampleLevel(g_samp, uv, 0).r;
+      weightSum += w;
+    }
+  }
+
+  return sum / weightSum;
+}
+
 // ===========
 // Second pass
 // ===========
@@ -105,14 +284,20 @@ struct VOut {
   float3 worldNormal : NORMAL;          // World normal
   float normalizedLinearDepth : DEPTH;  // Depth to light
   float3 shadingPoint : POSITION;       // World position of shading point
+  float3 prtRadiance : COLOR;           // Direct light with PRT shadows
+  nointerpolation float3 albedo : ALBEDO;
   float4 pos : SV_Position;
 };
 
 VOut VS(Vin vin) {
   VOut vout;
+  Instance instance = g_instances[g_firstInstance + vin.instanceId];
 
-  float4x4 mvp = mul(g_proj, mul(g_view, g_model));
-  float4 pWorld = float4(vin.pos, 1.f);
+  float3 pos = DecodePosition(vin.pos);
+  float3 normal = DecodeNormal(vin.normal);
+
+  float4x4 mvp = mul(g_proj, mul(g_view, instance.model));
+  float4 pWorld = float4(pos, 1.f);
   float4 pNdc = mul(mvp, pWorld);
 
   // No need for perspective division. Hardware will do that for us later.
@@ -127,15 +312,15 @@ VOut VS(Vin vin) {
   vout.pos = pNdc;
 
   // Normal transformation: transpose(inverse(T))
-  vout.worldNormal = normalize(mul(transpose(g_invModel), float4(vin.normal, 0.f)).xyz);
+  vout.worldNormal = normalize(mul(transpose(instance.invModel), float4(normal, 0.f)).xyz);
 
-  float4x4 mvLight = mul(g_lightView, g_model);
+  float4x4 mvLight = mul(g_lightView, instance.model);
   float4x4 mvpLight = mul(g_lightOrtho, mvLight);
 
   float lightDepth = mul(mvLight, pWorld).z;
   vout.normalizedLinearDepth = (lightDepth - g_lightZNear) / (g_lightZFar - g_lightZNear);
 
-  float4 worldPos = mul(g_model, float4(vin.pos, 1.f)).xyzw;
+  float4 worldPos = mul(instance.model, float4(pos, 1.f)).xyzw;
   vout.shadingPoint = worldPos.xyz;
 
   float4 pRsm = mul(mvpLight, pWorld);
@@ -144,6 +329,13 @@ VOut VS(Vin vin) {
   float v = 1.f - (pRsm.y / pRsm.w + 1.f) * 0.5f;
   vout.rsmUV = float2(u, v);
 
+  // Black until the PRT transfer is ready
+  vout.prtRadiance = 0.f;
+  [branch] if (instance.prtColorOffset != s_noPrtColors) {
+    vout.prtRadiance = g_prtColors[instance.prtColorOffset + vin.vertexId].rgb;
+  }
+  vout.albedo = instance.albedo;
+
   return vout;
 }
 
@@ -155,7 +347,10 @@ struct PSOut {
 PSOut PS(float2 rsmUV : TEXCOORD,               //
           float3 worldNormal : NORMAL,          //
           float normalizedLinearDepth : DEPTH,  //
-          float3 shadingPoint : POSITION) {
+          float3 shadingPoint : POSITION,       //
+          float3 prtRadiance : COLOR,           //
+          nointerpolation float3 albedo : ALBEDO,  //
+          float4 pos : SV_Position) {
   // clang-format on
 
   float3 l = normalize(-g_lightDirection);
@@ -163,7 +358,7 @@ PSOut PS(float2 rsmUV : TEXCOORD,               //
 
   // Direct lighting
 
-  float3 direct = g_albedo * g_lightFlux * saturate(dot(l, n));
+  float3 direct = albedo * g_lightFlux * saturate(dot(l, n));
 
   float rsmPixelSize = 1.f / g_rsmSize;
   float2 duv0 = {0.f, 0.f};
@@ -184,6 +379,9 @@ PSOut PS(float2 rsmUV : TEXCOORD,               //
 
   direct *= 1.f - shadowFactor;
 
+  // PRT vertex radiance instead of the shadow mapped light. Soft shadows, but only at vertices.
+  direct = lerp(direct, prtRadiance, g_prtBlend);
+
   // Indirect lighting
 
   float3 indirect = {0.f, 0.f, 0.f};
@@ -216,9 +414,13 @@ PSOut PS(float2 rsmUV : TEXCOORD,               //
 
   int sampleCount = (2 * neighborCount + 1) * (2 * neighborCount + 1);
 
+  // Contact occlusion the RSM cannot resolve. Half resolution, point sampled.
+  float2 screenUV = pos.xy / float2(g_width, g_height);
+  float ao = g_ssaoBlurredMap.Sample(g_samp, screenUV).r;
+
   float3 finalColor = float3(0.f, 0.f, 0.f);
   finalColor += direct;
-  finalColor += indirect / sampleCount;
+  finalColor += ao * indirect / sampleCount;
 
   PSOut res;
   res.finalColor = float4(finalColor, 1.f);
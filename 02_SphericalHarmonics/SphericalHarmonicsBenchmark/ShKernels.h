@@ -0,0 +1,41 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+
+/**
+ * The SH kernels of the benchmark for one instruction set. Every set is compiled from the same
+ * templates in ShKernelsImpl.h, with float, Float4 or Float8 lanes, so the sets differ in their
+ * width only.
+ * SoA directions are three arrays x, y and z, AoS directions one array of XMFLOAT3. Evaluation
+ * writes basis function i of direction k to out[i * count + k] for SoA and to
+ * out[k * order^2 + i] for AoS, projection writes the order^2 sums of value times basis. Rotation
+ * takes the blocks of ShRotation::Blocks(), with coefficient i of vector v at [i * count + v] for
+ * SoA and at [v * order^2 + i] for AoS.
+ */
+struct ShKernels {
+  const char* isa;
+  int width;  // Directions or vectors per step
+
+  void (*evaluateSoA)(int order, const float* x, const float* y, const float* z, size_t count,
+                      float* out);
+  void (*evaluateAoS)(int order, const DirectX::XMFLOAT3* directions, size_t count, float* out);
+
+  void (*projectSoA)(int order, const float* x, const float* y, const float* z,
+                     const float* values, size_t count, float* out);
+  void (*projectAoS)(int order, const DirectX::XMFLOAT3* directions, const float* values,
+                     size_t count, float* out);
+
+  void (*rotateSoA)(int order, const float* blocks, const float* in, float* out, size_t count);
+  void (*rotateAoS)(int order, const float* blocks, const float* in, float* out, size_t count);
+};
+
+ShKernels ScalarShKernels();
+
+ShKernels SseShKernels();
+
+// Only callable when CpuSupportsAvx2() is true, the unit is compiled with /arch:AVX2.
+ShKernels Avx2ShKernels();
+
+// AVX2 support of both the CPU and the OS, which has to save the YMM registers.
+bool CpuSupportsAvx2();
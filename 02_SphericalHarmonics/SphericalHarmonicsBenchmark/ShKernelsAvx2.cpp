@@ -0,0 +1,43 @@
+#include "ShKernels.h"
+
+#include <immintrin.h>
+
+#include "ShKernelsImpl.h"
+
+// The project compiles this unit alone with /arch:AVX2.
+namespace {
+// Eight floats in an AVX register, Float4 of Simd.h one size up
+struct Float8 {
+  static constexpr int s_width = 8;
+
+  __m256 v;
+
+  Float8() = default;
+  Float8(float s) : v{_mm256_set1_ps(s)} {}
+  explicit Float8(__m256 m) : v{m} {}
+
+  static Float8 Load(const float* p) { return Float8{_mm256_loadu_ps(p)}; }
+
+  void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+Float8 operator+(Float8 a, Float8 b) {
+  return Float8{_mm256_add_ps(a.v, b.v)};
+}
+
+Float8 operator-(Float8 a, Float8 b) {
+  return Float8{_mm256_sub_ps(a.v, b.v)};
+}
+
+Float8 operator*(Float8 a, Float8 b) {
+  return Float8{_mm256_mul_ps(a.v, b.v)};
+}
+
+Float8& operator+=(Float8& a, Float8 b) {
+  return a = a + b;
+}
+}  // namespace
+
+ShKernels Avx2ShKernels() {
+  return MakeShKernels<Float8>("avx2");
+}
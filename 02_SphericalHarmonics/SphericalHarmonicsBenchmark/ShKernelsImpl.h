@@ -0,0 +1,238 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+
+#include "ShKernels.h"
+#include "ShRotation.h"
+#include "SphericalHarmonics.h"
+
+/**
+ * Kernel templates over the lane type T, which is float or has the interface of Float4. Every
+ * ShKernels*.cpp includes this file once and instantiates MakeShKernels<T>().
+ * All of it lives in an anonymous namespace: the AVX2 unit is compiled with /arch:AVX2, and a
+ * shared inline function emitted there could be picked by the linker for the other units too.
+ * For the same reason the wide kernels pad their tails instead of falling back to float.
+ */
+namespace {
+template<typename T>
+constexpr size_t s_laneCount = T::s_width;
+template<>
+constexpr size_t s_laneCount<float> = 1;
+
+template<typename T>
+T LoadLanes(const float* p) {
+  return T::Load(p);
+}
+template<>
+inline float LoadLanes<float>(const float* p) {
+  return *p;
+}
+
+template<typename T>
+void StoreLanes(T v, float* p) {
+  v.Store(p);
+}
+template<>
+inline void StoreLanes<float>(float v, float* p) {
+  *p = v;
+}
+
+// Lanes from k on that hold data, at most the width of T
+template<typename T>
+size_t ValidLanes(size_t k, size_t count) {
+  return count - k < s_laneCount<T> ? count - k : s_laneCount<T>;
+}
+
+// Lanes from "p" on, with "fill" past the first "valid" of them
+template<typename T>
+T LoadPadded(const float* p, size_t valid, float fill) {
+  if (valid == s_laneCount<T>)
+    return LoadLanes<T>(p);
+  float lanes[s_laneCount<T>];
+  for (size_t j = 0; j < s_laneCount<T>; ++j) {
+    lanes[j] = j < valid ? p[j] : fill;
+  }
+  return LoadLanes<T>(lanes);
+}
+
+// The first "valid" lanes of v to p .. p + (valid - 1) * stride
+template<typename T>
+void StorePartial(T v, float* p, size_t valid, size_t stride) {
+  if (valid == s_laneCount<T> && stride == 1) {
+    StoreLanes(v, p);
+    return;
+  }
+  float lanes[s_laneCount<T>];
+  StoreLanes(v, lanes);
+  for (size_t j = 0; j < valid; ++j) {
+    p[j * stride] = lanes[j];
+  }
+}
+
+template<typename T>
+float SumLanes(T v) {
+  float lanes[s_laneCount<T>];
+  StoreLanes(v, lanes);
+  float sum = 0.f;
+  for (size_t j = 0; j < s_laneCount<T>; ++j) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+// Directions k .. k + width - 1, padded with +z past "count"
+template<typename T>
+struct DirectionLanes {
+  T x, y, z;
+};
+
+template<typename T>
+DirectionLanes<T> LoadSoA(const float* x, const float* y, const float* z, size_t k,
+                          size_t count) {
+  size_t valid = ValidLanes<T>(k, count);
+  return {LoadPadded<T>(x + k, valid, 0.f), LoadPadded<T>(y + k, valid, 0.f),
+          LoadPadded<T>(z + k, valid, 1.f)};
+}
+
+// Transposes the directions into lanes, which is the cost of the AoS layout
+template<typename T>
+DirectionLanes<T> LoadAoS(const DirectX::XMFLOAT3* d, size_t k, size_t count) {
+  float x[s_laneCount<T>], y[s_laneCount<T>], z[s_laneCount<T>];
+  for (size_t j = 0; j < s_laneCount<T>; ++j) {
+    bool valid = k + j < count;
+    x[j] = valid ? d[k + j].x : 0.f;
+    y[j] = valid ? d[k + j].y : 0.f;
+    z[j] = valid ? d[k + j].z : 1.f;
+  }
+  return {LoadLanes<T>(x), LoadLanes<T>(y), LoadLanes<T>(z)};
+}
+
+template<int order, typename T>
+void EvaluateSoA(const float* x, const float* y, const float* z, size_t count, float* out) {
+  constexpr int coefficientCount = ShCoefficientCount(order);
+  for (size_t k = 0; k < count; k += s_laneCount<T>) {
+    auto d = LoadSoA<T>(x, y, z, k, count);
+    T basis[coefficientCount];
+    ShEvaluate<order>(d.x, d.y, d.z, basis);
+    size_t valid = ValidLanes<T>(k, count);
+    for (int i = 0; i < coefficientCount; ++i) {
+      StorePartial(basis[i], out + i * count + k, valid, 1);
+    }
+  }
+}
+
+template<int order, typename T>
+void EvaluateAoS(const DirectX::XMFLOAT3* directions, size_t count, float* out) {
+  constexpr int coefficientCount = ShCoefficientCount(order);
+  for (size_t k = 0; k < count; k += s_laneCount<T>) {
+    auto d = LoadAoS<T>(directions, k, count);
+    T basis[coefficientCount];
+    ShEvaluate<order>(d.x, d.y, d.z, basis);
+    size_t valid = ValidLanes<T>(k, count);
+    for (int i = 0; i < coefficientCount; ++i) {
+      StorePartial(basis[i], out + k * coefficientCount + i, valid, coefficientCount);
+    }
+  }
+}
+
+template<int order, typename T, typename LoadDirections>
+void Project(const LoadDirections& load, const float* values, size_t count, float* out) {
+  constexpr int coefficientCount = ShCoefficientCount(order);
+  T sums[coefficientCount];
+  for (int i = 0; i < coefficientCount; ++i) {
+    sums[i] = 0.f;
+  }
+  for (size_t k = 0; k < count; k += s_laneCount<T>) {
+    DirectionLanes<T> d = load(k);
+    // Padded lanes have the value 0, so they add nothing
+    T value = LoadPadded<T>(values + k, ValidLanes<T>(k, count), 0.f);
+    T basis[coefficientCount];
+    ShEvaluate<order>(d.x, d.y, d.z, basis);
+    for (int i = 0; i < coefficientCount; ++i) {
+      sums[i] += basis[i] * value;
+    }
+  }
+  for (int i = 0; i < coefficientCount; ++i) {
+    out[i] = SumLanes(sums[i]);
+  }
+}
+
+template<typename T>
+void RotateSoA(int order, const float* blocks, const float* in, float* out, size_t count) {
+  int coefficientCount = ShCoefficientCount(order);
+  // Zeroed once, only the first "coefficientCount" entries are used
+  T source[ShCoefficientCount(s_shMaxOrder)]{};
+  T result[ShCoefficientCount(s_shMaxOrder)]{};
+  for (size_t v = 0; v < count; v += s_laneCount<T>) {
+    size_t valid = ValidLanes<T>(v, count);
+    for (int i = 0; i < coefficientCount; ++i) {
+      source[i] = LoadPadded<T>(in + i * count + v, valid, 0.f);
+    }
+    ShRotateBands(order, blocks, source, result);
+    for (int i = 0; i < coefficientCount; ++i) {
+      StorePartial(result[i], out + i * count + v, valid, 1);
+    }
+  }
+}
+
+template<typename T>
+void RotateAoS(int order, const float* blocks, const float* in, float* out, size_t count) {
+  int coefficientCount = ShCoefficientCount(order);
+  T source[ShCoefficientCount(s_shMaxOrder)]{};
+  T result[ShCoefficientCount(s_shMaxOrder)]{};
+  for (size_t v = 0; v < count; v += s_laneCount<T>) {
+    size_t valid = ValidLanes<T>(v, count);
+    for (int i = 0; i < coefficientCount; ++i) {
+      float lanes[s_laneCount<T>];
+      for (size_t j = 0; j < s_laneCount<T>; ++j) {
+        lanes[j] = j < valid ? in[(v + j) * coefficientCount + i] : 0.f;
+      }
+      source[i] = LoadLanes<T>(lanes);
+    }
+    ShRotateBands(order, blocks, source, result);
+    for (int i = 0; i < coefficientCount; ++i) {
+      StorePartial(result[i], out + v * coefficientCount + i, valid, coefficientCount);
+    }
+  }
+}
+
+template<typename T>
+ShKernels MakeShKernels(const char* isa) {
+  using DirectX::XMFLOAT3;
+  ShKernels kernels;
+  kernels.isa = isa;
+  kernels.width = static_cast<int>(s_laneCount<T>);
+
+  kernels.evaluateSoA = [](int order, const float* x, const float* y, const float* z,
+                           size_t count, float* out) {
+    ShDispatchOrder(order, [&](auto n) {
+      EvaluateSoA<decltype(n)::value, T>(x, y, z, count, out);
+    });
+  };
+  kernels.evaluateAoS = [](int order, const XMFLOAT3* directions, size_t count, float* out) {
+    ShDispatchOrder(order, [&](auto n) {
+      EvaluateAoS<decltype(n)::value, T>(directions, count, out);
+    });
+  };
+
+  kernels.projectSoA = [](int order, const float* x, const float* y, const float* z,
+                          const float* values, size_t count, float* out) {
+    auto load = [&](size_t k) { return LoadSoA<T>(x, y, z, k, count); };
+    ShDispatchOrder(order, [&](auto n) {
+      Project<decltype(n)::value, T>(load, values, count, out);
+    });
+  };
+  kernels.projectAoS = [](int order, const XMFLOAT3* directions, const float* values,
+                          size_t count, float* out) {
+    auto load = [&](size_t k) { return LoadAoS<T>(directions, k, count); };
+    ShDispatchOrder(order, [&](auto n) {
+      Project<decltype(n)::value, T>(load, values, count, out);
+    });
+  };
+
+  kernels.rotateSoA = RotateSoA<T>;
+  kernels.rotateAoS = RotateAoS<T>;
+  return kernels;
+}
+}  // namespace
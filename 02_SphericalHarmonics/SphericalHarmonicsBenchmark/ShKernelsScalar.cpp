@@ -0,0 +1,26 @@
+#include "ShKernels.h"
+
+#include <intrin.h>
+
+#include "ShKernelsImpl.h"
+
+ShKernels ScalarShKernels() {
+  return MakeShKernels<float>("scalar");
+}
+
+// Here rather than in the AVX2 unit, which may not run at all on the CPUs this has to reject
+bool CpuSupportsAvx2() {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // AVX and OSXSAVE, then the XMM and YMM state enabled by the OS
+  __cpuid(info, 1);
+  constexpr int osxsaveAndAvx = (1 << 27) | (1 << 28);
+  if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
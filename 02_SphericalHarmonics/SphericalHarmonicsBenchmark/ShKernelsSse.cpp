@@ -0,0 +1,8 @@
+#include "ShKernels.h"
+
+#include "ShKernelsImpl.h"
+#include "Simd.h"
+
+ShKernels SseShKernels() {
+  return MakeShKernels<Float4>("sse");
+}
@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ShKernels.h"
+#include "ShRotation.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace {
+constexpr double s_minSeconds = 0.01;  // Every timed run repeats its work for at least this long
+constexpr int s_runCount = 3;          // The fastest run counts
+
+constexpr size_t s_directionCount = 1 << 14;
+constexpr size_t s_evaluationBatches[] = {4, 16, 64, 1024};
+constexpr size_t s_projectionBatch = 1024;  // Samples per projected function
+constexpr size_t s_vectorCount = 1 << 12;
+constexpr size_t s_rotationBatch = 256;
+
+struct Data {
+  std::vector<float> x, y, z;
+  std::vector<XMFLOAT3> directions;  // The same directions in AoS layout
+  std::vector<float> values;         // One per direction, the function to project
+  std::vector<float> coefficients;   // s_vectorCount vectors of order s_shMaxOrder
+};
+
+Data MakeData(size_t directionCount, size_t vectorCount) {
+  std::mt19937 rng{1};
+  std::normal_distribution<float> normal;
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+
+  Data data;
+  for (size_t k = 0; k < directionCount; ++k) {
+    XMFLOAT3 d;
+    XMStoreFloat3(&d, XMVector3Normalize(XMVectorSet(normal(rng), normal(rng), normal(rng), 0.f)));
+    data.x.push_back(d.x);
+    data.y.push_back(d.y);
+    data.z.push_back(d.z);
+    data.directions.push_back(d);
+    data.values.push_back(uniform(rng));
+  }
+  data.coefficients.resize(vectorCount * ShCoefficientCount(s_shMaxOrder));
+  for (auto& c : data.coefficients) {
+    c = uniform(rng);
+  }
+  return data;
+}
+
+bool Check(bool passed, const char* isa, const char* what) {
+  // stdout may be the JSON, so the checks go to stderr
+  std::cerr << (passed ? "[ OK ] " : "[FAIL] ") << isa << ": " << what << "\n";
+  return passed;
+}
+
+float MaxError(const std::vector<float>& a, const std::vector<float>& b) {
+  float maxError = 0.f;
+  for (size_t i = 0; i < a.size(); ++i) {
+    maxError = std::max(maxError, std::abs(a[i] - b[i]));
+  }
+  return maxError;
+}
+
+// The kernels against the library, with a count that leaves tails for every width
+bool CheckKernels(const ShKernels& kernels) {
+  constexpr size_t count = 37;
+  auto data = MakeData(count, count);
+  auto rotation = XMMatrixRotationRollPitchYaw(0.3f, -1.2f, 2.5f);
+
+  float evaluationError = 0.f, projectionError = 0.f, rotationError = 0.f;
+  for (int order = 1; order <= s_shMaxOrder; ++order) {
+    int n = ShCoefficientCount(order);
+
+    std::vector<float> expected(n * count), soa(n * count), aos(n * count);
+    ShEvaluateBatch(order, data.x.data(), data.y.data(), data.z.data(), count, expected.data());
+    kernels.evaluateSoA(order, data.x.data(), data.y.data(), data.z.data(), count, soa.data());
+    kernels.evaluateAoS(order, data.directions.data(), count, aos.data());
+    std::vector<float> aosAsSoa(n * count);
+    for (size_t k = 0; k < count; ++k) {
+      for (int i = 0; i < n; ++i) {
+        aosAsSoa[i * count + k] = aos[k * n + i];
+      }
+    }
+    evaluationError = std::max({evaluationError, MaxError(soa, expected),
+                                MaxError(aosAsSoa, expected)});
+
+    std::vector<float> sums(n, 0.f), projectedSoa(n), projectedAos(n);
+    for (int i = 0; i < n; ++i) {
+      for (size_t k = 0; k < count; ++k) {
+        sums[i] += data.values[k] * expected[i * count + k];
+      }
+    }
+    kernels.projectSoA(order, data.x.data(), data.y.data(), data.z.data(), data.values.data(),
+                       count, projectedSoa.data());
+    kernels.projectAoS(order, data.directions.data(), data.values.data(), count,
+                       projectedAos.data());
+    projectionError = std::max({projectionError, MaxError(projectedSoa, sums),
+                                MaxError(projectedAos, sums)});
+
+    ShRotation shRotation{rotation, order};
+    std::vector<float> in(data.coefficients.begin(), data.coefficients.begin() + n * count);
+    std::vector<float> rotated(n * count), rotatedAos(n * count);
+    for (size_t v = 0; v < count; ++v) {
+      shRotation.Apply(&in[v * n], &rotated[v * n]);
+    }
+    kernels.rotateAoS(order, shRotation.Blocks().data(), in.data(), rotatedAos.data(), count);
+    std::vector<float> inSoa(n * count), rotatedSoa(n * count), rotatedSoaAsAos(n * count);
+    for (size_t v = 0; v < count; ++v) {
+      for (int i = 0; i < n; ++i) {
+        inSoa[i * count + v] = in[v * n + i];
+      }
+    }
+    kernels.rotateSoA(order, shRotation.Blocks().data(), inSoa.data(), rotatedSoa.data(), count);
+    for (size_t v = 0; v < count; ++v) {
+      for (int i = 0; i < n; ++i) {
+        rotatedSoaAsAos[v * n + i] = rotatedSoa[i * count + v];
+      }
+    }
+    rotationError = std::max({rotationError, MaxError(rotatedAos, rotated),
+                              MaxError(rotatedSoaAsAos, rotated)});
+  }
+
+  bool passed = Check(evaluationError < 1e-5f, kernels.isa, "evaluation matches the library");
+  passed &= Check(projectionError < 1e-4f, kernels.isa, "projection matches the library");
+  passed &= Check(rotationError < 1e-5f, kernels.isa, "rotation matches the library");
+  return passed;
+}
+
+struct Result {
+  const char* benchmark;  // "evaluate", "project" or "rotate"
+  const char* isa;
+  const char* layout;  // "soa" or "aos"
+  int order;
+  size_t batch;  // Directions or vectors per kernel call
+  size_t threads;
+  double nsPerItem;
+};
+
+// Fastest of s_runCount runs of fn, in nanoseconds per item
+template<typename Fn>
+double NanosecondsPerItem(size_t itemCount, Fn&& fn) {
+  using Clock = std::chrono::high_resolution_clock;
+  fn();
+  double best = std::numeric_limits<double>::max();
+  for (int run = 0; run < s_runCount; ++run) {
+    size_t repeats = 0;
+    auto start = Clock::now();
+    std::chrono::duration<double> seconds{0.0};
+    do {
+      fn();
+      ++repeats;
+      seconds = Clock::now() - start;
+    } while (seconds.count() < s_minSeconds);
+    best = std::min(best, seconds.count() * 1e9 / (static_cast<double>(repeats) * itemCount));
+  }
+  return best;
+}
+
+// fn(batch) for every batch, on the calling thread alone or spread over the shared pool
+template<typename Fn>
+void RunBatches(size_t batchCount, size_t threads, const Fn& fn) {
+  if (threads == 1) {
+    for (size_t batch = 0; batch < batchCount; ++batch) {
+      fn(batch);
+    }
+    return;
+  }
+  size_t grain = std::max<size_t>(1, batchCount / (4 * threads));
+  GlobalThreadPool().ParallelFor(0, batchCount, grain, [&](size_t begin, size_t end) {
+    for (size_t batch = begin; batch < end; ++batch) {
+      fn(batch);
+    }
+  });
+}
+
+class Benchmark {
+public:
+  explicit Benchmark(const Data& data) : data_{data} {}
+
+  const std::vector<Result>& Results() const { return results_; }
+
+  void Run(const ShKernels& kernels, int order, size_t threads) {
+    size_t n = ShCoefficientCount(order);
+    std::vector<float> out(ShCoefficientCount(s_shMaxOrder) * s_directionCount);
+
+    for (size_t batch : s_evaluationBatches) {
+      // The batch size sweep is single threaded, all cores only run the largest batch
+      if (threads > 1 && batch != std::end(s_evaluationBatches)[-1])
+        continue;
+      Time("evaluate", kernels, "soa", order, batch, threads, s_directionCount, [&](size_t b) {
+        size_t first = b * batch;
+        kernels.evaluateSoA(order, &data_.x[first], &data_.y[first], &data_.z[first], batch,
+                            &out[first * n]);
+      });
+      Time("evaluate", kernels, "aos", order, batch, threads, s_directionCount, [&](size_t b) {
+        size_t first = b * batch;
+        kernels.evaluateAoS(order, &data_.directions[first], batch, &out[first * n]);
+      });
+    }
+
+    // Every batch projects a function of its own, as when filling many probes
+    Time("project", kernels, "soa", order, s_projectionBatch, threads, s_directionCount,
+         [&](size_t b) {
+           size_t first = b * s_projectionBatch;
+           kernels.projectSoA(order, &data_.x[first], &data_.y[first], &data_.z[first],
+                              &data_.values[first], s_projectionBatch, &out[b * n]);
+         });
+    Time("project", kernels, "aos", order, s_projectionBatch, threads, s_directionCount,
+         [&](size_t b) {
+           size_t first = b * s_projectionBatch;
+           kernels.projectAoS(order, &data_.directions[first], &data_.values[first],
+                              s_projectionBatch, &out[b * n]);
+         });
+
+    // The coefficients are read as SoA or AoS batches alike, only the access pattern differs
+    ShRotation rotation{XMMatrixRotationRollPitchYaw(0.3f, -1.2f, 2.5f), order};
+    const float* blocks = rotation.Blocks().data();
+    Time("rotate", kernels, "soa", order, s_rotationBatch, threads, s_vectorCount, [&](size_t b) {
+      size_t first = b * s_rotationBatch * n;
+      kernels.rotateSoA(order, blocks, &data_.coefficients[first], &out[first], s_rotationBatch);
+    });
+    Time("rotate", kernels, "aos", order, s_rotationBatch, threads, s_vectorCount, [&](size_t b) {
+      size_t first = b * s_rotationBatch * n;
+      kernels.rotateAoS(order, blocks, &data_.coefficients[first], &out[first], s_rotationBatch);
+    });
+  }
+
+private:
+  const Data& data_;
+  std::vector<Result> results_;
+
+  template<typename Fn>
+  void Time(const char* benchmark, const ShKernels& kernels, const char* layout, int order,
+            size_t batch, size_t threads, size_t itemCount, const Fn& fn) {
+    double ns = NanosecondsPerItem(itemCount, [&] { RunBatches(itemCount / batch, threads, fn); });
+    results_.push_back({benchmark, kernels.isa, layout, order, batch, threads, ns});
+  }
+};
+
+const Result* FindResult(const std::vector<Result>& results, const Result& like, const char* isa,
+                         int order) {
+  for (const auto& r : results) {
+    if (std::strcmp(r.benchmark, like.benchmark) == 0 && std::strcmp(r.layout, like.layout) == 0 &&
+        r.batch == like.batch && r.threads == like.threads && std::strcmp(r.isa, isa) == 0 &&
+        r.order == order)
+      return &r;
+  }
+  return nullptr;
+}
+
+// Lowest order from which "isa" beats "baseline" at every higher order as well, 0 if it loses
+// at s_shMaxOrder
+int CrossoverOrder(const std::vector<Result>& results, const Result& like, const char* isa,
+                   const char* baseline) {
+  int crossover = 0;
+  for (int order = s_shMaxOrder; order >= 1; --order) {
+    const Result* a = FindResult(results, like, isa, order);
+    const Result* b = FindResult(results, like, baseline, order);
+    if (!a || !b || a->nsPerItem >= b->nsPerItem)
+      break;
+    crossover = order;
+  }
+  return crossover;
+}
+
+void WriteJson(std::ostream& os, const std::vector<Result>& results,
+               const std::vector<ShKernels>& kernels) {
+  os << "{\n  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+  os << "  \"isa\": [";
+  for (size_t i = 0; i < kernels.size(); ++i) {
+    os << (i ? ", " : "") << "\"" << kernels[i].isa << "\"";
+  }
+  os << "],\n";
+
+  os << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    os << "    {\"benchmark\": \"" << r.benchmark << "\", \"isa\": \"" << r.isa
+       << "\", \"layout\": \"" << r.layout << "\", \"order\": " << r.order
+       << ", \"batch\": " << r.batch << ", \"threads\": " << r.threads
+       << ", \"ns_per_item\": " << r.nsPerItem << ", \"mitems_per_s\": " << 1e3 / r.nsPerItem
+       << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  os << "  ],\n";
+
+  // One entry per benchmark, layout, batch and thread count, from the rows of order 1
+  os << "  \"crossover\": [";
+  bool first = true;
+  for (const auto& r : results) {
+    if (r.order != 1 || std::strcmp(r.isa, kernels[0].isa) != 0)
+      continue;
+    for (size_t i = 1; i < kernels.size(); ++i) {
+      int order = CrossoverOrder(results, r, kernels[i].isa, kernels[i - 1].isa);
+      os << (first ? "\n" : ",\n") << "    {\"benchmark\": \"" << r.benchmark
+         << "\", \"layout\": \"" << r.layout << "\", \"batch\": " << r.batch
+         << ", \"threads\": " << r.threads << ", \"isa\": \"" << kernels[i].isa
+         << "\", \"baseline\": \"" << kernels[i - 1].isa << "\", \"from_order\": ";
+      if (order == 0) {
+        os << "null}";
+      } else {
+        os << order << "}";
+      }
+      first = false;
+    }
+  }
+  os << "\n  ]\n}\n";
+}
+}  // namespace
+
+/**
+ * Throughput of SH evaluation, projection and rotation at orders 1 to 8, for scalar, SSE and
+ * AVX2 kernels on SoA and AoS data, on one thread and on all of them. Writes JSON to the file
+ * given as the argument, or to stdout. Exits with 1 if a kernel disagrees with the library.
+ * "crossover" lists the lowest order from which each instruction set stays faster than the next
+ * narrower one.
+ */
+int main(int argc, char** argv) {
+  std::vector<ShKernels> kernels{ScalarShKernels(), SseShKernels()};
+  if (CpuSupportsAvx2())
+    kernels.push_back(Avx2ShKernels());
+
+  bool passed = true;
+  for (const auto& k : kernels) {
+    passed &= CheckKernels(k);
+  }
+  if (!passed)
+    return 1;
+
+  size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<size_t> threadCounts{1};
+  if (hardwareThreads > 1)
+    threadCounts.push_back(hardwareThreads);
+
+  auto data = MakeData(s_directionCount, s_vectorCount);
+  Benchmark benchmark{data};
+  for (int order = 1; order <= s_shMaxOrder; ++order) {
+    std::cerr << "order " << order << "\n";
+    for (size_t threads : threadCounts) {
+      for (const auto& k : kernels) {
+        benchmark.Run(k, order, threads);
+      }
+    }
+  }
+
+  if (argc > 1) {
+    std::ofstream file{argv[1]};
+    WriteJson(file, benchmark.Results(), kernels);
+    if (!file) {
+      std::cerr << "cannot write " << argv[1] << "\n";
+      return 1;
+    }
+  } else {
+    WriteJson(std::cout, benchmark.Results(), kernels);
+  }
+  return 0;
+}
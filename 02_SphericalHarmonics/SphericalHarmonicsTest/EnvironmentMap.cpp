@@ -0,0 +1,137 @@
+#include "EnvironmentMap.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#define STBI_MSC_SECURE_CRT
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+using namespace DirectX;
+
+namespace {
+enum CubeFace { PositiveX, NegativeX, PositiveY, NegativeY, PositiveZ, NegativeZ, None };
+
+// Face of the cross at face cell (column, row)
+CubeFace CrossFace(EnvironmentLayout layout, int column, int row) {
+  if (column == 1 && row == 0)
+    return PositiveY;
+  if (column == 1 && row == 2)
+    return NegativeY;
+  if (row == 1) {
+    constexpr CubeFace middleRow[] = {NegativeX, PositiveZ, PositiveX, NegativeZ};
+    return middleRow[column];
+  }
+  if (layout == EnvironmentLayout::VerticalCross && column == 1 && row == 3)
+    return NegativeZ;
+  return None;
+}
+
+// Direction of face coordinates (s, t) in [-1, 1], t pointing down, as D3D cube maps address it
+XMFLOAT3 FaceDirection(CubeFace face, float s, float t) {
+  switch (face) {
+    case PositiveX: return {1.f, -t, -s};
+    case NegativeX: return {-1.f, -t, s};
+    case PositiveY: return {s, 1.f, t};
+    case NegativeY: return {s, -1.f, -t};
+    case PositiveZ: return {s, -t, 1.f};
+    default: return {-s, -t, -1.f};
+  }
+}
+
+// Solid angle of the face area from (0, 0) to (s, t) [Driscoll 2012]
+float AreaElement(float s, float t) {
+  return std::atan2(s * t, std::sqrt(s * s + t * t + 1.f));
+}
+}  // namespace
+
+EnvironmentMap::EnvironmentMap(int width, int height, EnvironmentLayout layout)
+    : width{width}, height{height}, layout{layout} {
+  bool valid = false;
+  switch (layout) {
+    case EnvironmentLayout::Equirectangular: valid = width == 2 * height; break;
+    case EnvironmentLayout::HorizontalCross: valid = 3 * width == 4 * height; break;
+    case EnvironmentLayout::VerticalCross: valid = 4 * width == 3 * height; break;
+  }
+  if (!valid || width <= 0)
+    throw std::runtime_error{"environment map size does not match its layout"};
+
+  pixels.assign(static_cast<size_t>(width) * height, {0.f, 0.f, 0.f});
+}
+
+int EnvironmentMap::FaceSize() const {
+  switch (layout) {
+    case EnvironmentLayout::HorizontalCross: return width / 4;
+    case EnvironmentLayout::VerticalCross: return width / 3;
+    default: return 0;
+  }
+}
+
+bool EnvironmentMap::IsCovered(int x, int y) const {
+  if (layout == EnvironmentLayout::Equirectangular)
+    return true;
+  int size = FaceSize();
+  return CrossFace(layout, x / size, y / size) != None;
+}
+
+XMFLOAT3 EnvironmentMap::Direction(int x, int y) const {
+  if (layout == EnvironmentLayout::Equirectangular) {
+    float theta = XM_PI * (y + 0.5f) / height;
+    float phi = XM_2PI * ((x + 0.5f) / width - 0.5f);
+    float r = std::sin(theta);
+    return {r * std::sin(phi), std::cos(theta), r * std::cos(phi)};
+  }
+
+  int size = FaceSize();
+  auto face = CrossFace(layout, x / size, y / size);
+  float s = 2.f * (x % size + 0.5f) / size - 1.f;
+  float t = 2.f * (y % size + 0.5f) / size - 1.f;
+  if (layout == EnvironmentLayout::VerticalCross && face == NegativeZ) {
+    s = -s;
+    t = -t;
+  }
+  auto d = FaceDirection(face, s, t);
+  XMStoreFloat3(&d, XMVector3Normalize(XMLoadFloat3(&d)));
+  return d;
+}
+
+float EnvironmentMap::SolidAngle(int x, int y) const {
+  if (layout == EnvironmentLayout::Equirectangular) {
+    float theta0 = XM_PI * y / height;
+    float theta1 = XM_PI * (y + 1) / height;
+    return XM_2PI / width * (std::cos(theta0) - std::cos(theta1));
+  }
+
+  int size = FaceSize();
+  float s0 = 2.f * (x % size) / size - 1.f;
+  float t0 = 2.f * (y % size) / size - 1.f;
+  float s1 = s0 + 2.f / size;
+  float t1 = t0 + 2.f / size;
+  return AreaElement(s0, t0) - AreaElement(s0, t1) - AreaElement(s1, t0) + AreaElement(s1, t1);
+}
+
+EnvironmentMap LoadEnvironmentMap(const std::string& file) {
+  int width, height, channels;
+  float* data = stbi_loadf(file.c_str(), &width, &height, &channels, 3);
+  if (!data)
+    throw std::runtime_error{"failed to load environment map " + file};
+
+  EnvironmentLayout layout;
+  if (width == 2 * height) {
+    layout = EnvironmentLayout::Equirectangular;
+  } else if (3 * width == 4 * height) {
+    layout = EnvironmentLayout::HorizontalCross;
+  } else if (4 * width == 3 * height) {
+    layout = EnvironmentLayout::VerticalCross;
+  } else {
+    stbi_image_free(data);
+    throw std::runtime_error{"unknown environment map layout of " + file};
+  }
+
+  EnvironmentMap map{width, height, layout};
+  for (size_t i = 0; i < map.pixels.size(); ++i) {
+    map.pixels[i] = {data[3 * i], data[3 * i + 1], data[3 * i + 2]};
+  }
+  stbi_image_free(data);
+  return map;
+}
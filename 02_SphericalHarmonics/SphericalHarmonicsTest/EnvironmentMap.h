@@ -0,0 +1,43 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <string>
+#include <vector>
+
+enum class EnvironmentLayout {
+  Equirectangular,  // 2:1, top row is +y and the center column looks down +z
+  HorizontalCross,  // 4:3, -x +z +x -z in the middle row, +y above and -y below +z
+  VerticalCross,    // 3:4, like the horizontal cross with -z below -y, turned upside down
+};
+
+/**
+ * Linear RGB environment in the world frame of the demos (left-handed, +y up).
+ * For the cube crosses the faces follow the D3D cube map convention, and texels outside of the
+ * six faces are not part of the environment.
+ */
+struct EnvironmentMap {
+  int width = 0;
+  int height = 0;
+  EnvironmentLayout layout = EnvironmentLayout::Equirectangular;
+  std::vector<DirectX::XMFLOAT3> pixels;  // Row-major, top row first
+
+  EnvironmentMap() = default;
+  EnvironmentMap(int width, int height, EnvironmentLayout layout);
+
+  int FaceSize() const;
+
+  // Whether texel (x, y) belongs to the sphere. Always true for equirectangular maps.
+  bool IsCovered(int x, int y) const;
+
+  // Unit direction through the center of a covered texel.
+  DirectX::XMFLOAT3 Direction(int x, int y) const;
+
+  // Exact solid angle a covered texel subtends.
+  float SolidAngle(int x, int y) const;
+};
+
+/**
+ * Load an HDR (or LDR, which is linearized) image with stb_image. The layout follows from the
+ * aspect ratio: 2:1 is equirectangular, 4:3 and 3:4 are cube crosses.
+ */
+EnvironmentMap LoadEnvironmentMap(const std::string& file);
@@ -0,0 +1,176 @@
+#include "ShProduct.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Simd.h"
+
+namespace {
+// Nodes and weights of n-point Gauss-Legendre quadrature on [-1, 1], by Newton's method on P_n
+void GaussLegendre(int n, std::vector<double>* nodes, std::vector<double>* weights) {
+  const double pi = 3.14159265358979323846;
+  nodes->resize(n);
+  weights->resize(n);
+  for (int i = 0; i < n; ++i) {
+    double x = std::cos(pi * (i + 0.75) / (n + 0.5));
+    double derivative = 1.0;
+    for (int iteration = 0; iteration < 100; ++iteration) {
+      double p0 = 1.0, p1 = x;
+      for (int k = 2; k <= n; ++k) {
+        double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+        p0 = p1;
+        p1 = p2;
+      }
+      derivative = n * (x * p1 - p0) / (x * x - 1.0);
+      double dx = p1 / derivative;
+      x -= dx;
+      if (std::abs(dx) < 1e-15)
+        break;
+    }
+    (*nodes)[i] = x;
+    (*weights)[i] = 2.0 / ((1.0 - x * x) * derivative * derivative);
+  }
+}
+
+template<int order>
+const ShProductTensor& TensorOfOrder() {
+  static const ShProductTensor tensor{order};
+  return tensor;
+}
+}  // namespace
+
+const ShProductTensor& ShProductTensor::Get(int order) {
+  const ShProductTensor* tensor = nullptr;
+  ShDispatchOrder(order, [&](auto o) { tensor = &TensorOfOrder<decltype(o)::value>(); });
+  return *tensor;
+}
+
+ShProductTensor::ShProductTensor(int order) : order_{order} {
+  if (order < 1 || order > s_shMaxOrder)
+    throw std::runtime_error{"unsupported SH order"};
+
+  // A product of three basis functions is a polynomial of degree 3 (order - 1) in x, y, z. Gauss-
+  // Legendre in z and uniform steps in phi integrate it exactly.
+  int degree = 3 * (order - 1);
+  int zCount = degree / 2 + 1;
+  int phiCount = degree + 1;
+  std::vector<double> zs, zWeights;
+  GaussLegendre(zCount, &zs, &zWeights);
+
+  int count = ShCoefficientCount(order);
+  std::vector<double> tensor(static_cast<size_t>(count) * count * count, 0.0);
+  std::vector<float> basis(count);
+  const double pi = 3.14159265358979323846;
+  for (int a = 0; a < zCount; ++a) {
+    double sinTheta = std::sqrt(std::max(0.0, 1.0 - zs[a] * zs[a]));
+    for (int b = 0; b < phiCount; ++b) {
+      double phi = 2.0 * pi * b / phiCount;
+      DirectX::XMFLOAT3 direction{static_cast<float>(sinTheta * std::cos(phi)),
+                                  static_cast<float>(sinTheta * std::sin(phi)),
+                                  static_cast<float>(zs[a])};
+      ShEvaluate(order, direction, basis.data());
+
+      double weight = zWeights[a] * 2.0 * pi / phiCount;
+      for (int i = 0; i < count; ++i) {
+        for (int j = i; j < count; ++j) {
+          double wij = weight * basis[i] * basis[j];
+          for (int k = 0; k < count; ++k) {
+            tensor[(static_cast<size_t>(i) * count + j) * count + k] += wij * basis[k];
+          }
+        }
+      }
+    }
+  }
+
+  // The basis is evaluated in float, which leaves the zeros below 1e-6. The smallest non-zero
+  // coefficient up to order 8 is about 5e-3.
+  firstEntry_.reserve(count + 1);
+  for (int k = 0; k < count; ++k) {
+    firstEntry_.push_back(static_cast<std::uint32_t>(entries_.size()));
+    for (int i = 0; i < count; ++i) {
+      for (int j = i; j < count; ++j) {
+        double c = tensor[(static_cast<size_t>(i) * count + j) * count + k];
+        if (std::abs(c) < 1e-5)
+          continue;
+        float stored = static_cast<float>(i == j ? 0.5 * c : c);
+        entries_.push_back({static_cast<std::uint16_t>(i), static_cast<std::uint16_t>(j), stored});
+      }
+    }
+  }
+  firstEntry_.push_back(static_cast<std::uint32_t>(entries_.size()));
+}
+
+void ShProductTensor::Product(const float* f, const float* g, float* out) const {
+  int count = ShCoefficientCount(order_);
+  for (int k = 0; k < count; ++k) {
+    float sum = 0.f;
+    for (auto e = firstEntry_[k]; e < firstEntry_[k + 1]; ++e) {
+      const auto& entry = entries_[e];
+      sum += entry.c * (f[entry.i] * g[entry.j] + f[entry.j] * g[entry.i]);
+    }
+    out[k] = sum;
+  }
+}
+
+ShRgb ShProductTensor::Product(const ShRgb& f, const float* g) const {
+  if (f.order != order_)
+    throw std::runtime_error{"SH product tensor and coefficients differ in order"};
+
+  ShRgb product{order_};
+  for (int channel = 0; channel < 3; ++channel) {
+    Product(f.channels[channel].data(), g, product.channels[channel].data());
+  }
+  return product;
+}
+
+float ShProductTensor::TripleProduct(const float* f, const float* g, const float* h) const {
+  int count = ShCoefficientCount(order_);
+  float product[ShCoefficientCount(s_shMaxOrder)];
+  Product(f, g, product);
+
+  float sum = 0.f;
+  for (int k = 0; k < count; ++k) {
+    sum += product[k] * h[k];
+  }
+  return sum;
+}
+
+void ShProductTensor::ProductBatch(const float* f, const float* g, float* out,
+                                   size_t count) const {
+  int coefficientCount = ShCoefficientCount(order_);
+
+  // Transpose four pairs into SoA, so each tensor entry serves four products at once
+  size_t k = 0;
+  for (; k + Float4::s_width <= count; k += Float4::s_width) {
+    Float4 fs[ShCoefficientCount(s_shMaxOrder)];
+    Float4 gs[ShCoefficientCount(s_shMaxOrder)];
+    const float* f0 = f + k * coefficientCount;
+    const float* g0 = g + k * coefficientCount;
+    for (int i = 0; i < coefficientCount; ++i) {
+      fs[i] = Float4{_mm_setr_ps(f0[i], f0[coefficientCount + i], f0[2 * coefficientCount + i],
+                                 f0[3 * coefficientCount + i])};
+      gs[i] = Float4{_mm_setr_ps(g0[i], g0[coefficientCount + i], g0[2 * coefficientCount + i],
+                                 g0[3 * coefficientCount + i])};
+    }
+
+    alignas(16) float lanes[Float4::s_width];
+    float* o = out + k * coefficientCount;
+    for (int c = 0; c < coefficientCount; ++c) {
+      Float4 sum = 0.f;
+      for (auto e = firstEntry_[c]; e < firstEntry_[c + 1]; ++e) {
+        const auto& entry = entries_[e];
+        sum += Float4{entry.c} * (fs[entry.i] * gs[entry.j] + fs[entry.j] * gs[entry.i]);
+      }
+      sum.Store(lanes);
+      o[c] = lanes[0];
+      o[coefficientCount + c] = lanes[1];
+      o[2 * coefficientCount + c] = lanes[2];
+      o[3 * coefficientCount + c] = lanes[3];
+    }
+  }
+
+  for (; k < count; ++k) {
+    Product(f + k * coefficientCount, g + k * coefficientCount, out + k * coefficientCount);
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SphericalHarmonics.h"
+
+/**
+ * Products of SH functions in coefficient space [Ng et al. 2004, Snyder 2006].
+ * The coupling tensor C_ijk = integral of Y_i Y_j Y_k over the sphere holds the Gaunt
+ * coefficients, the real counterpart of the Clebsch-Gordan coefficients. The projection of f * g
+ * is h_k = sum over i, j of C_ijk f_i g_j, truncated to the order of the tensor, and the integral
+ * of f * g * h is sum over k of h_k (f * g)_k.
+ * Selection rules leave only a few percent of the tensor non-zero. Only those are stored, in one
+ * flat array: 6588 entries at order 8, where the dense tensor has 262144.
+ */
+class ShProductTensor {
+public:
+  // The tensor of "order" is integrated once and shared by all callers.
+  static const ShProductTensor& Get(int order);
+
+  explicit ShProductTensor(int order);
+
+  int Order() const { return order_; }
+
+  size_t EntryCount() const { return entries_.size(); }
+
+  // Projection of f * g. All three are order^2 coefficients, "out" must not overlap the others.
+  void Product(const float* f, const float* g, float* out) const;
+
+  // Colored function times a scalar one, such as lighting times visibility.
+  ShRgb Product(const ShRgb& f, const float* g) const;
+
+  // Integral of f * g * h over the sphere.
+  float TripleProduct(const float* f, const float* g, const float* h) const;
+
+  // Products of "count" pairs stored one vector after another, four at a time with SSE.
+  void ProductBatch(const float* f, const float* g, float* out, size_t count) const;
+
+private:
+  // Output k gets c * (f_i g_j + f_j g_i) for i <= j, so the symmetry of the tensor halves the
+  // entries. Entries with i == j hold half the coefficient.
+  struct Entry {
+    std::uint16_t i;
+    std::uint16_t j;
+    float c;
+  };
+
+  int order_;
+  std::vector<Entry> entries_;            // Sorted by output coefficient
+  std::vector<std::uint32_t> firstEntry_;  // Entries of output k are [firstEntry_[k], [k + 1])
+};
@@ -0,0 +1,189 @@
+#include "ShProjection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace {
+// Texels are evaluated in blocks, so the basis values stay in the L1 cache
+constexpr int s_blockSize = 256;
+
+float HorizontalSum(Float4 v) {
+  alignas(16) float lanes[Float4::s_width];
+  v.Store(lanes);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Per-column and per-face-texel terms, so the texel loop needs no trigonometry
+class TexelGeometry {
+public:
+  explicit TexelGeometry(const EnvironmentMap& map) : map_{map} {
+    if (map.layout == EnvironmentLayout::Equirectangular) {
+      for (int x = 0; x < map.width; ++x) {
+        auto d = map.Direction(x, map.height / 2);
+        float r = std::sqrt(d.x * d.x + d.z * d.z);
+        sinPhi_.push_back(d.x / r);
+        cosPhi_.push_back(d.z / r);
+      }
+    } else {
+      // Every face has the same solid angles, those of the face at the top of the cross
+      int size = map.FaceSize();
+      for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+          faceSolidAngles_.push_back(map.SolidAngle(size + x, y));
+        }
+      }
+    }
+  }
+
+  struct Row {
+    int y;
+    float sinTheta;
+    float cosTheta;
+    float solidAngle;
+  };
+
+  Row MakeRow(int y) const {
+    if (map_.layout != EnvironmentLayout::Equirectangular)
+      return {y, 0.f, 0.f, 0.f};
+    auto d = map_.Direction(0, y);
+    return {y, std::sqrt(std::max(0.f, 1.f - d.y * d.y)), d.y, map_.SolidAngle(0, y)};
+  }
+
+  DirectX::XMFLOAT3 Direction(const Row& row, int x) const {
+    if (map_.layout == EnvironmentLayout::Equirectangular)
+      return {row.sinTheta * sinPhi_[x], row.cosTheta, row.sinTheta * cosPhi_[x]};
+    return map_.Direction(x, row.y);
+  }
+
+  float SolidAngle(const Row& row, int x) const {
+    if (map_.layout == EnvironmentLayout::Equirectangular)
+      return row.solidAngle;
+    int size = map_.FaceSize();
+    return faceSolidAngles_[static_cast<size_t>(row.y % size) * size + x % size];
+  }
+
+private:
+  const EnvironmentMap& map_;
+  std::vector<float> sinPhi_;
+  std::vector<float> cosPhi_;
+  std::vector<float> faceSolidAngles_;
+};
+
+template<int order>
+ShRgb Project(const EnvironmentMap& map) {
+  constexpr int coefficientCount = ShCoefficientCount(order);
+  const TexelGeometry geometry{map};
+
+  // Partial sums per row, channel and coefficient
+  std::vector<double> rowSums(static_cast<size_t>(map.height) * 3 * coefficientCount, 0.0);
+
+  GlobalThreadPool().ParallelFor(0, map.height, 4, [&](size_t rowBegin, size_t rowEnd) {
+    // Weighted radiance and direction of a block of texels, padded to a whole number of Float4
+    alignas(16) float x[s_blockSize], y[s_blockSize], z[s_blockSize];
+    alignas(16) float weighted[3][s_blockSize];
+    alignas(16) float basis[coefficientCount * s_blockSize];
+
+    for (size_t row = rowBegin; row < rowEnd; ++row) {
+      int py = static_cast<int>(row);
+      auto texelRow = geometry.MakeRow(py);
+      Float4 sums[3][coefficientCount];
+      for (auto& channel : sums) {
+        std::fill(std::begin(channel), std::end(channel), Float4{0.f});
+      }
+
+      int px = 0;
+      while (px < map.width) {
+        int count = 0;
+        for (; px < map.width && count < s_blockSize; ++px) {
+          if (!map.IsCovered(px, py))
+            continue;
+          auto d = geometry.Direction(texelRow, px);
+          float w = geometry.SolidAngle(texelRow, px);
+          const auto& c = map.pixels[static_cast<size_t>(py) * map.width + px];
+          x[count] = d.x;
+          y[count] = d.y;
+          z[count] = d.z;
+          weighted[0][count] = c.x * w;
+          weighted[1][count] = c.y * w;
+          weighted[2][count] = c.z * w;
+          ++count;
+        }
+        if (count == 0)
+          continue;
+
+        int padded = (count + Float4::s_width - 1) / Float4::s_width * Float4::s_width;
+        for (int k = count; k < padded; ++k) {
+          x[k] = 0.f;
+          y[k] = 0.f;
+          z[k] = 1.f;
+          weighted[0][k] = weighted[1][k] = weighted[2][k] = 0.f;
+        }
+
+        ShEvaluateBatch(order, x, y, z, padded, basis);
+        for (int i = 0; i < coefficientCount; ++i) {
+          const float* b = basis + i * padded;
+          for (int k = 0; k < padded; k += Float4::s_width) {
+            Float4 value = Float4::Load(b + k);
+            sums[0][i] += value * Float4::Load(weighted[0] + k);
+            sums[1][i] += value * Float4::Load(weighted[1] + k);
+            sums[2][i] += value * Float4::Load(weighted[2] + k);
+          }
+        }
+      }
+
+      double* rowSum = &rowSums[row * 3 * coefficientCount];
+      for (int channel = 0; channel < 3; ++channel) {
+        for (int i = 0; i < coefficientCount; ++i) {
+          rowSum[channel * coefficientCount + i] = HorizontalSum(sums[channel][i]);
+        }
+      }
+    }
+  });
+
+  // Reduce in row order, independent of how the rows were scheduled
+  std::vector<double> total(3 * coefficientCount, 0.0);
+  for (int row = 0; row < map.height; ++row) {
+    for (int i = 0; i < 3 * coefficientCount; ++i) {
+      total[i] += rowSums[static_cast<size_t>(row) * 3 * coefficientCount + i];
+    }
+  }
+
+  ShRgb sh{order};
+  for (int channel = 0; channel < 3; ++channel) {
+    for (int i = 0; i < coefficientCount; ++i) {
+      sh.channels[channel][i] = static_cast<float>(total[channel * coefficientCount + i]);
+    }
+  }
+  return sh;
+}
+}  // namespace
+
+ShRgb ProjectEnvironment(const EnvironmentMap& map, int order) {
+  ShRgb sh;
+  ShDispatchOrder(order, [&](auto n) { sh = Project<decltype(n)::value>(map); });
+  return sh;
+}
+
+ShRgb ProjectSampled(int order, SampleDirections directions, const RadianceBatch& radiance) {
+  int count = ShCoefficientCount(order);
+  DirectionIntegrator integrator{std::move(directions)};
+  const auto& d = integrator.Directions();
+  std::vector<float> basis(static_cast<size_t>(count) * d.Count());
+  ShEvaluateBatch(order, d.x.data(), d.y.data(), d.z.data(), d.Count(), basis.data());
+  integrator.SetBasis(count, basis);
+
+  std::vector<float> results(3 * count);
+  integrator.Integrate(1, 3, [&](size_t, size_t first, size_t n, float* rgb) {
+    radiance(d, first, n, rgb);
+  }, results.data());
+
+  ShRgb sh{order};
+  for (int c = 0; c < 3; ++c) {
+    std::copy_n(results.begin() + c * count, count, sh.channels[c].begin());
+  }
+  return sh;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+#include "EnvironmentMap.h"
+#include "Sampling.h"
+#include "SphericalHarmonics.h"
+
+/**
+ * SH coefficients of order "order" of an environment map: the integral of radiance times basis
+ * over the sphere, with every texel weighted by its exact solid angle.
+ * Rows are projected in parallel on the shared thread pool and their partial sums are added in
+ * row order, so the result does not depend on the number of threads.
+ */
+ShRgb ProjectEnvironment(const EnvironmentMap& map, int order);
+
+// fn(directions, first, count, rgb) writes the radiance at directions [first, first + count) to
+// rgb[channel * DirectionIntegrator::s_batchSize + k].
+using RadianceBatch = std::function<void(const SampleDirections&, size_t, size_t, float*)>;
+
+/**
+ * SH coefficients of order "order" of radiance known at any direction, such as an analytic sky,
+ * integrated with DirectionIntegrator over "directions", which must cover the sphere.
+ */
+ShRgb ProjectSampled(int order, SampleDirections directions, const RadianceBatch& radiance);
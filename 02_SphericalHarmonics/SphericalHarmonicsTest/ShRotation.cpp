@@ -0,0 +1,161 @@
+#include "ShRotation.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "Simd.h"
+
+using namespace DirectX;
+
+namespace {
+// Block of band l with rows and columns indexed by m, n in [-l, l]
+class Block {
+public:
+  explicit Block(int l) : l_{l}, values_((2 * l + 1) * (2 * l + 1), 0.0) {}
+
+  double operator()(int m, int n) const { return values_[(m + l_) * (2 * l_ + 1) + n + l_]; }
+
+  double& operator()(int m, int n) { return values_[(m + l_) * (2 * l_ + 1) + n + l_]; }
+
+  int Band() const { return l_; }
+
+private:
+  int l_;
+  std::vector<double> values_;
+};
+
+// Function P of the recurrence
+double P(int i, int a, int b, const Block& r1, const Block& previous) {
+  int l = previous.Band() + 1;
+  if (b == l)
+    return r1(i, 1) * previous(a, l - 1) - r1(i, -1) * previous(a, -l + 1);
+  if (b == -l)
+    return r1(i, 1) * previous(a, -l + 1) + r1(i, -1) * previous(a, l - 1);
+  return r1(i, 0) * previous(a, b);
+}
+
+Block NextBlock(const Block& r1, const Block& previous) {
+  int l = previous.Band() + 1;
+  Block block{l};
+  for (int m = -l; m <= l; ++m) {
+    for (int n = -l; n <= l; ++n) {
+      int absM = std::abs(m);
+      double d = m == 0 ? 1.0 : 0.0;
+      double denominator = std::abs(n) == l ? 2.0 * l * (2.0 * l - 1.0) : (l + n) * (l - n);
+      double u = std::sqrt((l + m) * (l - m) / denominator);
+      double v = 0.5 * std::sqrt((1.0 + d) * (l + absM - 1.0) * (l + absM) / denominator) *
+                 (1.0 - 2.0 * d);
+      double w = -0.5 * std::sqrt((l - absM - 1.0) * (l - absM) / denominator) * (1.0 - d);
+
+      double value = 0.0;
+      if (u != 0.0)
+        value += u * P(0, m, n, r1, previous);
+      if (v != 0.0) {
+        if (m == 0) {
+          value += v * (P(1, 1, n, r1, previous) + P(-1, -1, n, r1, previous));
+        } else if (m > 0) {
+          double d1 = m == 1 ? 1.0 : 0.0;
+          value += v * (P(1, m - 1, n, r1, previous) * std::sqrt(1.0 + d1) -
+                        P(-1, -m + 1, n, r1, previous) * (1.0 - d1));
+        } else {
+          double d1 = m == -1 ? 1.0 : 0.0;
+          value += v * (P(1, m + 1, n, r1, previous) * (1.0 - d1) +
+                        P(-1, -m - 1, n, r1, previous) * std::sqrt(1.0 + d1));
+        }
+      }
+      if (w != 0.0) {
+        if (m > 0)
+          value += w * (P(1, m + 1, n, r1, previous) + P(-1, -m - 1, n, r1, previous));
+        else
+          value += w * (P(1, m - 1, n, r1, previous) - P(-1, -m + 1, n, r1, previous));
+      }
+      block(m, n) = value;
+    }
+  }
+  return block;
+}
+}  // namespace
+
+ShRotation::ShRotation(FXMMATRIX rotation, int order) : order_{order} {
+  if (order < 1 || order > s_shMaxOrder)
+    throw std::runtime_error{"SH order must be in [1, 8]"};
+  if (order == 1)
+    return;
+
+  // r(i, j) maps column vectors, the transpose of the DirectXMath matrix
+  XMFLOAT3X3 m;
+  XMStoreFloat3x3(&m, rotation);
+  auto r = [&m](int i, int j) { return static_cast<double>(m.m[j][i]); };
+
+  // Band 1 is (y, z, x) up to the signs of the Condon-Shortley phase
+  Block r1{1};
+  constexpr int axis[] = {1, 2, 0};  // Axis of m = -1, 0, 1
+  constexpr double sign[] = {-1.0, 1.0, -1.0};
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      r1(i, j) = sign[i + 1] * sign[j + 1] * r(axis[i + 1], axis[j + 1]);
+    }
+  }
+
+  Block previous = r1;
+  for (int l = 1; l < order; ++l) {
+    if (l > 1)
+      previous = NextBlock(r1, previous);
+    for (int m = -l; m <= l; ++m) {
+      for (int n = -l; n <= l; ++n) {
+        blocks_.push_back(static_cast<float>(previous(m, n)));
+      }
+    }
+  }
+}
+
+void ShRotation::Apply(const float* in, float* out) const {
+  ShRotateBands(order_, blocks_.data(), in, out);
+}
+
+ShRgb ShRotation::Apply(const ShRgb& sh) const {
+  if (sh.order != order_)
+    throw std::runtime_error{"SH rotation and coefficients differ in order"};
+
+  ShRgb rotated{order_};
+  for (int channel = 0; channel < 3; ++channel) {
+    Apply(sh.channels[channel].data(), rotated.channels[channel].data());
+  }
+  return rotated;
+}
+
+void ShRotation::ApplyBatch(const float* in, float* out, size_t count) const {
+  int coefficientCount = ShCoefficientCount(order_);
+
+  // Transpose four vectors into SoA, so each block entry multiplies four coefficients at once.
+  // Zeroed once, only the first "coefficientCount" entries are used.
+  Float4 source[ShCoefficientCount(s_shMaxOrder)]{};
+  Float4 result[ShCoefficientCount(s_shMaxOrder)]{};
+  size_t k = 0;
+  for (; k + Float4::s_width <= count; k += Float4::s_width) {
+    const float* v0 = in + k * coefficientCount;
+    const float* v1 = v0 + coefficientCount;
+    const float* v2 = v1 + coefficientCount;
+    const float* v3 = v2 + coefficientCount;
+    for (int i = 0; i < coefficientCount; ++i) {
+      source[i] = Float4{_mm_setr_ps(v0[i], v1[i], v2[i], v3[i])};
+    }
+
+    ShRotateBands(order_, blocks_.data(), source, result);
+
+    alignas(16) float lanes[Float4::s_width];
+    float* o = out + k * coefficientCount;
+    for (int i = 0; i < coefficientCount; ++i) {
+      result[i].Store(lanes);
+      o[i] = lanes[0];
+      o[coefficientCount + i] = lanes[1];
+      o[2 * coefficientCount + i] = lanes[2];
+      o[3 * coefficientCount + i] = lanes[3];
+    }
+  }
+
+  for (; k < count; ++k) {
+    Apply(in + k * coefficientCount, out + k * coefficientCount);
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "SphericalHarmonics.h"
+
+/**
+ * Rotation of SH coefficient vectors [Ivanic and Ruedenberg 1996, with the 1998 errata].
+ * Rotations do not mix bands, so the rotation is one (2l + 1) x (2l + 1) block per band. The
+ * block of band 1 is the rotation matrix itself and every further band follows from the previous
+ * one by a recurrence, which is much cheaper than projecting the rotated function again.
+ * "rotation" uses the DirectXMath convention (row vectors, v' = v * rotation): the coefficients of
+ * f become those of g with g(v * rotation) = f(v).
+ */
+class ShRotation {
+public:
+  ShRotation(DirectX::FXMMATRIX rotation, int order);
+
+  int Order() const { return order_; }
+
+  // Rotate one vector of order^2 coefficients. "in" and "out" must not overlap.
+  void Apply(const float* in, float* out) const;
+
+  ShRgb Apply(const ShRgb& sh) const;
+
+  // Rotate "count" coefficient vectors stored one after another, four at a time with SSE.
+  void ApplyBatch(const float* in, float* out, size_t count) const;
+
+  // Row-major blocks of bands 1 .. order - 1, one after another, for callers with their own
+  // kernels
+  const std::vector<float>& Blocks() const { return blocks_; }
+
+private:
+  int order_;
+  std::vector<float> blocks_;
+};
+
+/**
+ * Rotate one vector of order^2 coefficients band by band with the blocks of ShRotation::Blocks().
+ * T is float or a SIMD type constructible from a float, whose lanes hold as many vectors. "in"
+ * and "out" must not overlap.
+ */
+template<typename T>
+void ShRotateBands(int order, const float* blocks, const T* in, T* out) {
+  out[0] = in[0];
+  const float* block = blocks;
+  for (int l = 1; l < order; ++l) {
+    int size = 2 * l + 1;
+    int base = l * l;
+    for (int row = 0; row < size; ++row) {
+      T sum = 0.f;
+      for (int column = 0; column < size; ++column) {
+        sum += T{block[row * size + column]} * in[base + column];
+      }
+      out[base + row] = sum;
+    }
+    block += size * size;
+  }
+}
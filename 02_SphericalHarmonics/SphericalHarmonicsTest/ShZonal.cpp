@@ -0,0 +1,121 @@
+#include "ShZonal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Simd.h"
+
+namespace {
+// sqrt(4 pi / (2l + 1)), which turns z_l into the weight of Y_l^m(axis)
+const std::array<float, s_shMaxOrder>& ZonalRotationScales() {
+  static const auto scales = [] {
+    std::array<float, s_shMaxOrder> s{};
+    for (int l = 0; l < s_shMaxOrder; ++l) {
+      s[l] = static_cast<float>(std::sqrt(4.0 * detail::s_pi / (2.0 * l + 1.0)));
+    }
+    return s;
+  }();
+  return scales;
+}
+
+// Band of coefficient i
+int ShBand(int i) {
+  return static_cast<int>(std::sqrt(static_cast<float>(i) + 0.5f));
+}
+}  // namespace
+
+void ShZonalDelta(int order, float* zonal) {
+  for (int l = 0; l < order; ++l) {
+    zonal[l] = static_cast<float>(std::sqrt((2.0 * l + 1.0) / (4.0 * detail::s_pi)));
+  }
+}
+
+void ShZonalCone(int order, float cosHalfAngle, float* zonal) {
+  double x = std::clamp(static_cast<double>(cosHalfAngle), -1.0, 1.0);
+
+  // P_0 .. P_order at x
+  double p[s_shMaxOrder + 1];
+  p[0] = 1.0;
+  if (order >= 1)
+    p[1] = x;
+  for (int l = 2; l <= order; ++l) {
+    p[l] = ((2 * l - 1) * x * p[l - 1] - (l - 1) * p[l - 2]) / l;
+  }
+
+  for (int l = 0; l < order; ++l) {
+    double integral = l == 0 ? 1.0 - x : (p[l - 1] - p[l + 1]) / (2.0 * l + 1.0);
+    double k = std::sqrt((2.0 * l + 1.0) / (4.0 * detail::s_pi));
+    zonal[l] = static_cast<float>(2.0 * detail::s_pi * k * integral);
+  }
+}
+
+void ShRotateZonal(int order, const float* zonal, DirectX::XMFLOAT3 axis, float* out) {
+  ShEvaluate(order, axis, out);
+  for (int l = 0; l < order; ++l) {
+    float w = ZonalRotationScales()[l] * zonal[l];
+    for (int m = -l; m <= l; ++m) {
+      out[ShIndex(l, m)] *= w;
+    }
+  }
+}
+
+ShZonalBatch::ShZonalBatch(int order) : order_{order} {
+  if (order < 1 || order > s_shMaxOrder)
+    throw std::runtime_error{"unsupported SH order"};
+}
+
+void ShZonalBatch::Clear() {
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  for (auto& w : weights_) {
+    w.clear();
+  }
+}
+
+void ShZonalBatch::Add(DirectX::XMFLOAT3 axis, DirectX::XMFLOAT3 color, const float* zonal) {
+  x_.push_back(axis.x);
+  y_.push_back(axis.y);
+  z_.push_back(axis.z);
+  const float channels[] = {color.x, color.y, color.z};
+  const auto& scales = ZonalRotationScales();
+  for (int l = 0; l < order_; ++l) {
+    float w = scales[l] * zonal[l];
+    for (int c = 0; c < 3; ++c) {
+      weights_[l * 3 + c].push_back(w * channels[c]);
+    }
+  }
+}
+
+ShRgb ShZonalBatch::Project() const {
+  int count = ShCoefficientCount(order_);
+  ShRgb sh{order_};
+  std::vector<float> basis(count * s_blockSize);
+
+  for (size_t begin = 0; begin < Count(); begin += s_blockSize) {
+    size_t n = std::min(s_blockSize, Count() - begin);
+    ShEvaluateBatch(order_, &x_[begin], &y_[begin], &z_[begin], n, basis.data());
+
+    for (int i = 0; i < count; ++i) {
+      const float* y = basis.data() + i * n;
+      int l = ShBand(i);
+      for (int c = 0; c < 3; ++c) {
+        const float* w = weights_[l * 3 + c].data() + begin;
+        Float4 sum = 0.f;
+        size_t k = 0;
+        for (; k + Float4::s_width <= n; k += Float4::s_width) {
+          sum += Float4::Load(w + k) * Float4::Load(y + k);
+        }
+        alignas(16) float lanes[Float4::s_width];
+        sum.Store(lanes);
+        float total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; k < n; ++k) {
+          total += w[k] * y[k];
+        }
+        sh.channels[c][i] += total;
+      }
+    }
+  }
+  return sh;
+}
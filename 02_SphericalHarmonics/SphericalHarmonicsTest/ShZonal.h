@@ -0,0 +1,56 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "SphericalHarmonics.h"
+
+/**
+ * Zonal harmonics: functions symmetric around +z only have the coefficients z_l = f_l^0. Turned
+ * to an axis "a", their coefficients are f_l^m = sqrt(4 pi / (2l + 1)) z_l Y_l^m(a)
+ * [Sloan et al. 2005], so an analytic light that looks like a disc of the sky projects from a
+ * closed form and one basis evaluation, with no sampling.
+ */
+
+// Unit delta at +z: the direction of a directional or point light, weighted by its irradiance.
+void ShZonalDelta(int order, float* zonal);
+
+// Constant 1 inside the cone around +z whose half angle has the cosine "cosHalfAngle", such as a
+// sphere or disc light seen from a point. Uses the integral of P_l from cosHalfAngle to 1,
+// (P_(l-1) - P_(l+1)) / (2l + 1), so no trigonometry is needed.
+void ShZonalCone(int order, float cosHalfAngle, float* zonal);
+
+// Coefficients of the zonal function "zonal" turned from +z to the unit vector "axis".
+void ShRotateZonal(int order, const float* zonal, DirectX::XMFLOAT3 axis, float* out);
+
+/**
+ * Sum of many colored zonal functions, such as all lights seen from one probe.
+ * Lights are kept in structure of arrays layout. Project() evaluates the basis at a block of axes
+ * at once and reduces every coefficient over the block with SSE.
+ */
+class ShZonalBatch {
+public:
+  explicit ShZonalBatch(int order);
+
+  int Order() const { return order_; }
+
+  size_t Count() const { return x_.size(); }
+
+  void Clear();
+
+  // Add the zonal function "zonal" (order values) times "color", turned to the unit vector "axis".
+  void Add(DirectX::XMFLOAT3 axis, DirectX::XMFLOAT3 color, const float* zonal);
+
+  // Sum of everything added so far.
+  ShRgb Project() const;
+
+private:
+  static constexpr size_t s_blockSize = 256;
+
+  int order_;
+  std::vector<float> x_, y_, z_;
+  // weights_[l * 3 + channel][light] = sqrt(4 pi / (2l + 1)) z_l times the channel's color
+  std::array<std::vector<float>, 3 * s_shMaxOrder> weights_;
+};
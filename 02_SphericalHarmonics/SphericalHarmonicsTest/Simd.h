@@ -0,0 +1,41 @@
+#pragma once
+#include <immintrin.h>
+
+/**
+ * Four floats in an SSE register, with the operators the SH templates need. Code written against
+ * "T" works for both float and Float4, so the scalar and the batched paths share one
+ * implementation.
+ */
+struct Float4 {
+  static constexpr int s_width = 4;
+
+  __m128 v;
+
+  Float4() = default;
+  Float4(float s) : v{_mm_set1_ps(s)} {}
+  explicit Float4(__m128 m) : v{m} {}
+
+  static Float4 Load(const float* p) { return Float4{_mm_loadu_ps(p)}; }
+
+  void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline Float4 operator+(Float4 a, Float4 b) {
+  return Float4{_mm_add_ps(a.v, b.v)};
+}
+
+inline Float4 operator-(Float4 a, Float4 b) {
+  return Float4{_mm_sub_ps(a.v, b.v)};
+}
+
+inline Float4 operator*(Float4 a, Float4 b) {
+  return Float4{_mm_mul_ps(a.v, b.v)};
+}
+
+inline Float4& operator+=(Float4& a, Float4 b) {
+  return a = a + b;
+}
+
+inline Float4 Max(Float4 a, Float4 b) {
+  return Float4{_mm_max_ps(a.v, b.v)};
+}
@@ -0,0 +1,61 @@
+#include "SphericalHarmonics.h"
+
+#include <cmath>
+
+#include "Simd.h"
+
+namespace {
+template<int order>
+void EvaluateBatch(const float* x, const float* y, const float* z, size_t count, float* out) {
+  constexpr int coefficientCount = ShCoefficientCount(order);
+
+  size_t k = 0;
+  for (; k + Float4::s_width <= count; k += Float4::s_width) {
+    Float4 basis[coefficientCount];
+    ShEvaluate<order>(Float4::Load(x + k), Float4::Load(y + k), Float4::Load(z + k), basis);
+    for (int i = 0; i < coefficientCount; ++i) {
+      basis[i].Store(out + i * count + k);
+    }
+  }
+
+  for (; k < count; ++k) {
+    float basis[coefficientCount];
+    ShEvaluate<order>(x[k], y[k], z[k], basis);
+    for (int i = 0; i < coefficientCount; ++i) {
+      out[i * count + k] = basis[i];
+    }
+  }
+}
+}  // namespace
+
+void ShEvaluate(int order, DirectX::XMFLOAT3 direction, float* out) {
+  ShDispatchOrder(order, [&](auto n) {
+    ShEvaluate<decltype(n)::value>(direction.x, direction.y, direction.z, out);
+  });
+}
+
+void ShEvaluateBatch(int order, const float* x, const float* y, const float* z, size_t count,
+                     float* out) {
+  ShDispatchOrder(order, [&](auto n) { EvaluateBatch<decltype(n)::value>(x, y, z, count, out); });
+}
+
+float ShWindowWeight(ShWindow window, int l, int order) {
+  if (l == 0)
+    return 1.f;
+
+  float x = DirectX::XM_PI * static_cast<float>(l) / static_cast<float>(order);
+  switch (window) {
+    case ShWindow::Hanning: return 0.5f * (1.f + std::cos(x));
+    case ShWindow::Lanczos: return std::sin(x) / x;
+    default: return 1.f;
+  }
+}
+
+void ApplyShWindow(ShWindow window, int order, float* coefficients) {
+  for (int l = 0; l < order; ++l) {
+    float w = ShWindowWeight(window, l, order);
+    for (int m = -l; m <= l; ++m) {
+      coefficients[ShIndex(l, m)] *= w;
+    }
+  }
+}
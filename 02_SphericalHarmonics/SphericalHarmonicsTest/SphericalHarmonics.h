@@ -0,0 +1,186 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Real spherical harmonics.
+ * An SH of order n has the bands l = 0 .. n - 1 and n^2 coefficients, coefficient (l, m) being at
+ * index l (l + 1) + m. Directions are unit vectors with theta measured from +z and phi from +x.
+ * The basis includes the Condon-Shortley phase, so Y_1^-1, Y_1^0 and Y_1^1 are -c y, c z and -c x.
+ *
+ * Evaluation avoids trigonometry: with r = sin(theta),
+ *   Y_l^m  = sqrt(2) K_l^m Q_l^m(z) r^m cos(m phi)     for m > 0
+ *   Y_l^-m = sqrt(2) K_l^m Q_l^m(z) r^m sin(m phi)     for m > 0
+ *   Y_l^0  = K_l^0 Q_l^0(z)
+ * where Q_l^m = P_l^m / r^m is a polynomial in z and r^m cos(m phi), r^m sin(m phi) are polynomials
+ * in x and y. All constants of the recurrences are computed at compile time for each order.
+ */
+constexpr int s_shMaxOrder = 8;
+
+constexpr int ShCoefficientCount(int order) {
+  return order * order;
+}
+
+constexpr int ShIndex(int l, int m) {
+  return l * (l + 1) + m;
+}
+
+// Coefficients of an RGB function, one vector of order^2 coefficients per channel.
+struct ShRgb {
+  int order = 0;
+  std::array<std::vector<float>, 3> channels;
+
+  ShRgb() = default;
+  explicit ShRgb(int order) : order{order} {
+    for (auto& channel : channels) {
+      channel.assign(ShCoefficientCount(order), 0.f);
+    }
+  }
+
+  int CoefficientCount() const { return ShCoefficientCount(order); }
+};
+
+namespace detail {
+constexpr double ConstexprSqrt(double x) {
+  if (x <= 0.0)
+    return 0.0;
+  double guess = x < 1.0 ? 1.0 : x;
+  for (int i = 0; i < 64; ++i) {
+    guess = 0.5 * (guess + x / guess);
+  }
+  return guess;
+}
+
+constexpr double s_pi = 3.14159265358979323846;
+}  // namespace detail
+
+template<int order>
+struct ShTables {
+  static_assert(order >= 1 && order <= s_shMaxOrder, "unsupported SH order");
+
+  // K_l^m, times sqrt(2) for m != 0. Indexed like the coefficients, only m >= 0 is used.
+  std::array<float, order * order> normalization{};
+  // Q_l^m = a z Q_(l-1)^m - b Q_(l-2)^m for l >= m + 1, with Q_(m-1)^m = 0
+  std::array<float, order * order> a{};
+  std::array<float, order * order> b{};
+  // Q_m^m = (-1)^m (2m - 1)!!
+  std::array<float, order> diagonal{};
+};
+
+template<int order>
+constexpr ShTables<order> MakeShTables() {
+  ShTables<order> tables;
+  double diagonal = 1.0;
+  for (int m = 0; m < order; ++m) {
+    if (m > 0)
+      diagonal *= -(2.0 * m - 1.0);
+    tables.diagonal[m] = static_cast<float>(diagonal);
+
+    for (int l = m; l < order; ++l) {
+      // (l - m)! / (l + m)!
+      double ratio = 1.0;
+      for (int k = l - m + 1; k <= l + m; ++k) {
+        ratio /= k;
+      }
+      double k = detail::ConstexprSqrt((2.0 * l + 1.0) / (4.0 * detail::s_pi) * ratio);
+      int i = ShIndex(l, m);
+      tables.normalization[i] = static_cast<float>(m == 0 ? k : detail::ConstexprSqrt(2.0) * k);
+      if (l > m) {
+        tables.a[i] = static_cast<float>((2.0 * l - 1.0) / (l - m));
+        tables.b[i] = static_cast<float>((l + m - 1.0) / (l - m));
+      }
+    }
+  }
+  return tables;
+}
+
+template<int order>
+inline constexpr ShTables<order> s_shTables = MakeShTables<order>();
+
+namespace detail {
+// Bands l .. order - 1 of column m. "q1" and "q2" are Q_(l-1)^m and Q_(l-2)^m.
+template<int order, int m, int l, typename T>
+inline void ShEvaluateColumn(T z, T c, T s, T q1, T q2, T* out) {
+  if constexpr (l < order) {
+    constexpr const ShTables<order>& tables = s_shTables<order>;
+    constexpr int i = ShIndex(l, m);
+
+    T q = tables.diagonal[m];
+    if constexpr (l > m)
+      q = T{tables.a[i]} * z * q1 - T{tables.b[i]} * q2;
+
+    T kq = T{tables.normalization[i]} * q;
+    if constexpr (m == 0) {
+      out[i] = kq;
+    } else {
+      out[i] = kq * c;
+      out[ShIndex(l, -m)] = kq * s;
+    }
+    ShEvaluateColumn<order, m, l + 1>(z, c, s, q, q1, out);
+  }
+}
+
+// Columns m .. order - 1, with c = r^m cos(m phi) and s = r^m sin(m phi)
+template<int order, int m, typename T>
+inline void ShEvaluateColumns(T x, T y, T z, T c, T s, T* out) {
+  if constexpr (m < order) {
+    ShEvaluateColumn<order, m, m>(z, c, s, T{0.f}, T{0.f}, out);
+    ShEvaluateColumns<order, m + 1>(x, y, z, x * c - y * s, x * s + y * c, out);
+  }
+}
+}  // namespace detail
+
+/**
+ * All order^2 basis functions at the unit direction (x, y, z). T is float, or Float4 to evaluate
+ * four directions at once. The recursion over l and m is resolved at compile time, so every
+ * constant is folded in and no loop remains.
+ */
+template<int order, typename T>
+void ShEvaluate(T x, T y, T z, T* out) {
+  detail::ShEvaluateColumns<order, 0>(x, y, z, T{1.f}, T{0.f}, out);
+}
+
+// Call fn(std::integral_constant<int, order>{}) to reach the templates from a runtime order.
+template<typename Fn>
+void ShDispatchOrder(int order, Fn&& fn) {
+  switch (order) {
+    case 1: fn(std::integral_constant<int, 1>{}); break;
+    case 2: fn(std::integral_constant<int, 2>{}); break;
+    case 3: fn(std::integral_constant<int, 3>{}); break;
+    case 4: fn(std::integral_constant<int, 4>{}); break;
+    case 5: fn(std::integral_constant<int, 5>{}); break;
+    case 6: fn(std::integral_constant<int, 6>{}); break;
+    case 7: fn(std::integral_constant<int, 7>{}); break;
+    case 8: fn(std::integral_constant<int, 8>{}); break;
+    default: throw std::runtime_error{"SH order must be in [1, 8]"};
+  }
+}
+
+// Basis at a unit direction for any order in [1, s_shMaxOrder]. "out" holds order^2 floats.
+void ShEvaluate(int order, DirectX::XMFLOAT3 direction, float* out);
+
+/**
+ * Basis at "count" unit directions given in SoA layout. The result is SoA as well: basis function
+ * i of direction k is out[i * count + k]. Four directions are evaluated per step with SSE.
+ */
+void ShEvaluateBatch(int order, const float* x, const float* y, const float* z, size_t count,
+                     float* out);
+
+// Windows against ringing [Sloan 2008]. They fade the higher bands out smoothly instead of cutting
+// them off, which trades sharpness for fewer negative lobes.
+enum class ShWindow {
+  None,
+  Hanning,  // (1 + cos(pi l / order)) / 2
+  Lanczos,  // sin(pi l / order) / (pi l / order)
+};
+
+// Weight of band "l" of an SH of "order" under "window".
+float ShWindowWeight(ShWindow window, int l, int order);
+
+// Scale every coefficient of the order^2 in "coefficients" by the weight of its band.
+void ApplyShWindow(ShWindow window, int order, float* coefficients);
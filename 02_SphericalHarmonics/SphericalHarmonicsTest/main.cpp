@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Sampling.h"
+#include "ShProduct.h"
+#include "ShProjection.h"
+#include "ShRotation.h"
+#include "ShZonal.h"
+#include "SphericalHarmonics.h"
+
+namespace {
+struct Directions {
+  std::vector<float> x, y, z;
+
+  size_t Count() const { return x.size(); }
+};
+
+// Points of a spherical Fibonacci lattice, each standing for 4 pi / count of solid angle
+Directions FibonacciDirections(size_t count) {
+  Directions d;
+  const double goldenAngle = 3.14159265358979323846 * (3.0 - std::sqrt(5.0));
+  for (size_t i = 0; i < count; ++i) {
+    double z = 1.0 - (2.0 * i + 1.0) / count;
+    double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+    double phi = goldenAngle * i;
+    d.x.push_back(static_cast<float>(r * std::cos(phi)));
+    d.y.push_back(static_cast<float>(r * std::sin(phi)));
+    d.z.push_back(static_cast<float>(z));
+  }
+  return d;
+}
+
+bool Check(bool passed, const char* what) {
+  std::cout << (passed ? "[ OK ] " : "[FAIL] ") << what << "\n";
+  return passed;
+}
+
+// The first three bands against their closed forms
+bool CheckClosedForms() {
+  std::mt19937 rng{1};
+  std::normal_distribution<float> normal;
+  float maxError = 0.f;
+  for (int n = 0; n < 1000; ++n) {
+    float x = normal(rng), y = normal(rng), z = normal(rng);
+    float length = std::sqrt(x * x + y * y + z * z);
+    x /= length;
+    y /= length;
+    z /= length;
+
+    float expected[9] = {0.282095f,
+                         -0.488603f * y,
+                         0.488603f * z,
+                         -0.488603f * x,
+                         1.092548f * x * y,
+                         -1.092548f * y * z,
+                         0.315392f * (3.f * z * z - 1.f),
+                         -1.092548f * x * z,
+                         0.546274f * (x * x - y * y)};
+    float basis[9];
+    ShEvaluate(3, {x, y, z}, basis);
+    for (int i = 0; i < 9; ++i) {
+      maxError = std::max(maxError, std::abs(basis[i] - expected[i]));
+    }
+  }
+  return Check(maxError < 1e-5f, "bands 0-2 match their closed forms");
+}
+
+// Integral of Y_i Y_j over the sphere is the identity
+bool CheckOrthonormality(const Directions& d) {
+  constexpr int order = s_shMaxOrder;
+  constexpr int count = ShCoefficientCount(order);
+  std::vector<float> basis(count * d.Count());
+  ShEvaluateBatch(order, d.x.data(), d.y.data(), d.z.data(), d.Count(), basis.data());
+
+  double weight = 4.0 * 3.14159265358979323846 / d.Count();
+  double maxError = 0.0;
+  for (int i = 0; i < count; ++i) {
+    for (int j = i; j < count; ++j) {
+      double sum = 0.0;
+      for (size_t k = 0; k < d.Count(); ++k) {
+        sum += static_cast<double>(basis[i * d.Count() + k]) * basis[j * d.Count() + k];
+      }
+      maxError = std::max(maxError, std::abs(sum * weight - (i == j ? 1.0 : 0.0)));
+    }
+  }
+  return Check(maxError < 1e-3, "order 8 basis is orthonormal");
+}
+
+// SSE and scalar paths agree, including the scalar tail of the batch
+bool CheckBatch(const Directions& d) {
+  constexpr int order = s_shMaxOrder;
+  constexpr int count = ShCoefficientCount(order);
+  size_t n = 1003;
+  std::vector<float> batch(count * n);
+  ShEvaluateBatch(order, d.x.data(), d.y.data(), d.z.data(), n, batch.data());
+
+  float maxError = 0.f;
+  for (size_t k = 0; k < n; ++k) {
+    float basis[count];
+    ShEvaluate(order, {d.x[k], d.y[k], d.z[k]}, basis);
+    for (int i = 0; i < count; ++i) {
+      maxError = std::max(maxError, std::abs(basis[i] - batch[i * n + k]));
+    }
+  }
+  return Check(maxError < 1e-5f, "batched evaluation matches the scalar one");
+}
+
+// Project a map whose channels are Y_2^1, a constant and Y_3^-2, in every layout
+bool CheckProjection() {
+  constexpr int order = 4;
+  const EnvironmentMap maps[] = {EnvironmentMap{512, 256, EnvironmentLayout::Equirectangular},
+                                 EnvironmentMap{512, 384, EnvironmentLayout::HorizontalCross},
+                                 EnvironmentMap{384, 512, EnvironmentLayout::VerticalCross}};
+  bool passed = true;
+  for (auto map : maps) {
+    for (int y = 0; y < map.height; ++y) {
+      for (int x = 0; x < map.width; ++x) {
+        if (!map.IsCovered(x, y))
+          continue;
+        float basis[ShCoefficientCount(order)];
+        ShEvaluate(order, map.Direction(x, y), basis);
+        map.pixels[static_cast<size_t>(y) * map.width + x] = {basis[ShIndex(2, 1)], 1.f,
+                                                              basis[ShIndex(3, -2)]};
+      }
+    }
+
+    auto sh = ProjectEnvironment(map, order);
+    float maxError = 0.f;
+    for (int i = 0; i < sh.CoefficientCount(); ++i) {
+      float expected[3] = {i == ShIndex(2, 1) ? 1.f : 0.f, i == 0 ? 3.544908f : 0.f,
+                           i == ShIndex(3, -2) ? 1.f : 0.f};
+      for (int channel = 0; channel < 3; ++channel) {
+        maxError = std::max(maxError, std::abs(sh.channels[channel][i] - expected[channel]));
+      }
+    }
+    passed &= maxError < 2e-3f;
+  }
+  return Check(passed, "environment projection recovers basis functions");
+}
+
+void BenchmarkProjection() {
+  EnvironmentMap map{4096, 2048, EnvironmentLayout::Equirectangular};
+  for (size_t i = 0; i < map.pixels.size(); ++i) {
+    map.pixels[i] = {static_cast<float>(i % 7), static_cast<float>(i % 5), 1.f};
+  }
+  for (int order : {3, 5, 8}) {
+    auto start = std::chrono::high_resolution_clock::now();
+    ProjectEnvironment(map, order);
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::high_resolution_clock::now() - start;
+    std::cout << "4096x2048 projection, order " << order << ": " << ms.count() << " ms\n";
+  }
+}
+
+// A rotated function evaluated at rotated directions equals the original one
+bool CheckRotation(const Directions& d) {
+  constexpr int order = s_shMaxOrder;
+  constexpr int count = ShCoefficientCount(order);
+  std::mt19937 rng{2};
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+
+  auto rotation = DirectX::XMMatrixRotationRollPitchYaw(0.3f, -1.2f, 2.5f);
+  ShRotation shRotation{rotation, order};
+
+  constexpr size_t vectorCount = 7;
+  std::vector<float> f(count * vectorCount);
+  for (auto& c : f) {
+    c = uniform(rng);
+  }
+  std::vector<float> g(f.size());
+  shRotation.ApplyBatch(f.data(), g.data(), vectorCount);
+
+  float maxError = 0.f;
+  for (size_t k = 0; k < 100; ++k) {
+    DirectX::XMFLOAT3 v{d.x[k], d.y[k], d.z[k]};
+    DirectX::XMFLOAT3 rotated;
+    DirectX::XMStoreFloat3(
+        &rotated, DirectX::XMVector3TransformNormal(DirectX::XMLoadFloat3(&v), rotation));
+    float basis[count], rotatedBasis[count];
+    ShEvaluate(order, v, basis);
+    ShEvaluate(order, rotated, rotatedBasis);
+
+    for (size_t vector = 0; vector < vectorCount; ++vector) {
+      float original = 0.f, result = 0.f;
+      for (int i = 0; i < count; ++i) {
+        original += f[vector * count + i] * basis[i];
+        result += g[vector * count + i] * rotatedBasis[i];
+      }
+      maxError = std::max(maxError, std::abs(original - result));
+    }
+  }
+  return Check(maxError < 1e-3f, "rotated coefficients match the rotated function");
+}
+
+void BenchmarkRotation() {
+  constexpr size_t probeCount = 10000;
+  auto rotation = DirectX::XMMatrixRotationRollPitchYaw(0.3f, -1.2f, 2.5f);
+  for (int order : {3, 5, 8}) {
+    std::vector<float> in(ShCoefficientCount(order) * probeCount, 1.f);
+    std::vector<float> out(in.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    ShRotation shRotation{rotation, order};
+    shRotation.ApplyBatch(in.data(), out.data(), probeCount);
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::high_resolution_clock::now() - start;
+    std::cout << "rotation of " << probeCount << " vectors, order " << order << ": " << ms.count()
+              << " ms\n";
+  }
+}
+
+// Functions of order 3 multiply into order 5 without truncation, so the product coefficients must
+// reproduce the product of the values
+bool CheckProduct(const Directions& d) {
+  constexpr int order = 5;
+  constexpr int count = ShCoefficientCount(order);
+  std::mt19937 rng{3};
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+
+  constexpr size_t pairCount = 7;
+  std::vector<float> f(count * pairCount, 0.f), g(count * pairCount, 0.f);
+  for (size_t pair = 0; pair < pairCount; ++pair) {
+    for (int i = 0; i < ShCoefficientCount(3); ++i) {
+      f[pair * count + i] = uniform(rng);
+      g[pair * count + i] = uniform(rng);
+    }
+  }
+  const auto& tensor = ShProductTensor::Get(order);
+  std::vector<float> h(f.size()), batch(f.size());
+  for (size_t pair = 0; pair < pairCount; ++pair) {
+    tensor.Product(&f[pair * count], &g[pair * count], &h[pair * count]);
+  }
+  tensor.ProductBatch(f.data(), g.data(), batch.data(), pairCount);
+
+  float maxError = 0.f, maxBatchError = 0.f;
+  for (size_t i = 0; i < h.size(); ++i) {
+    maxBatchError = std::max(maxBatchError, std::abs(h[i] - batch[i]));
+  }
+  for (size_t k = 0; k < 100; ++k) {
+    float basis[count];
+    ShEvaluate(order, {d.x[k], d.y[k], d.z[k]}, basis);
+    for (size_t pair = 0; pair < pairCount; ++pair) {
+      float fv = 0.f, gv = 0.f, hv = 0.f;
+      for (int i = 0; i < count; ++i) {
+        fv += f[pair * count + i] * basis[i];
+        gv += g[pair * count + i] * basis[i];
+        hv += h[pair * count + i] * basis[i];
+      }
+      maxError = std::max(maxError, std::abs(fv * gv - hv));
+    }
+  }
+
+  // The integral of f * g * f is the integral of the product times f
+  float triple = tensor.TripleProduct(f.data(), g.data(), f.data());
+  float dot = 0.f;
+  for (int i = 0; i < count; ++i) {
+    dot += h[i] * f[i];
+  }
+
+  bool passed = Check(maxError < 1e-4f, "product coefficients match the product of the values");
+  passed &= Check(maxBatchError < 1e-5f, "batched product matches the scalar one");
+  passed &= Check(std::abs(triple - dot) < 1e-5f, "triple product matches the projected product");
+  return passed;
+}
+
+// A windowed delta rings less: its most negative value moves towards zero
+bool CheckWindows() {
+  constexpr int order = 6;
+  constexpr int count = ShCoefficientCount(order);
+  float delta[count];
+  ShEvaluate(order, {0.f, 0.f, 1.f}, delta);
+  auto d = FibonacciDirections(20000);
+
+  float minima[3];
+  const ShWindow windows[] = {ShWindow::None, ShWindow::Hanning, ShWindow::Lanczos};
+  for (int w = 0; w < 3; ++w) {
+    float windowed[count];
+    std::copy(delta, delta + count, windowed);
+    ApplyShWindow(windows[w], order, windowed);
+
+    minima[w] = 0.f;
+    for (size_t k = 0; k < d.Count(); ++k) {
+      float basis[count];
+      ShEvaluate(order, {d.x[k], d.y[k], d.z[k]}, basis);
+      float value = 0.f;
+      for (int i = 0; i < count; ++i) {
+        value += windowed[i] * basis[i];
+      }
+      minima[w] = std::min(minima[w], value);
+    }
+  }
+  return Check(minima[1] > minima[0] && minima[2] > minima[0], "windows reduce ringing");
+}
+
+// A cone projected from its zonal harmonics matches a projection by quadrature, and a batch of
+// lights matches their sum
+bool CheckZonal() {
+  constexpr int order = 6;
+  constexpr int count = ShCoefficientCount(order);
+  DirectX::XMFLOAT3 axis{0.48f, 0.6f, 0.64f};
+  float halfAngle = 0.6f;
+  float zonal[order];
+  ShZonalCone(order, std::cos(halfAngle), zonal);
+  float cone[count];
+  ShRotateZonal(order, zonal, axis, cone);
+
+  auto d = FibonacciDirections(200000);
+  double projected[count] = {};
+  float cosHalfAngle = std::cos(halfAngle);
+  for (size_t k = 0; k < d.Count(); ++k) {
+    if (d.x[k] * axis.x + d.y[k] * axis.y + d.z[k] * axis.z < cosHalfAngle)
+      continue;
+    float basis[count];
+    ShEvaluate(order, {d.x[k], d.y[k], d.z[k]}, basis);
+    for (int i = 0; i < count; ++i) {
+      projected[i] += basis[i] * 4.0 * 3.14159265358979 / d.Count();
+    }
+  }
+  float maxError = 0.f;
+  for (int i = 0; i < count; ++i) {
+    maxError = std::max(maxError, std::abs(cone[i] - static_cast<float>(projected[i])));
+  }
+
+  // Deltas and cones of different colors along random axes
+  std::mt19937 rng{4};
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+  ShZonalBatch batch{order};
+  double sum[3][count] = {};
+  for (int light = 0; light < 37; ++light) {
+    auto a = DirectX::XMVector3Normalize(
+        DirectX::XMVectorSet(uniform(rng), uniform(rng), uniform(rng), 0.f));
+    DirectX::XMFLOAT3 lightAxis;
+    DirectX::XMStoreFloat3(&lightAxis, a);
+    DirectX::XMFLOAT3 color{uniform(rng) + 1.f, uniform(rng) + 1.f, uniform(rng) + 1.f};
+    float z[order];
+    if (light % 2)
+      ShZonalDelta(order, z);
+    else
+      ShZonalCone(order, std::cos(0.1f + 0.02f * light), z);
+    batch.Add(lightAxis, color, z);
+
+    float f[count];
+    ShRotateZonal(order, z, lightAxis, f);
+    const float channels[] = {color.x, color.y, color.z};
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < count; ++i) {
+        sum[c][i] += channels[c] * f[i];
+      }
+    }
+  }
+  auto projectedBatch = batch.Project();
+  float maxBatchError = 0.f;
+  for (int c = 0; c < 3; ++c) {
+    for (int i = 0; i < count; ++i) {
+      maxBatchError = std::max(
+          maxBatchError, std::abs(projectedBatch.channels[c][i] - static_cast<float>(sum[c][i])));
+    }
+  }
+
+  bool passed = Check(maxError < 2e-3f, "zonal cone matches its projection");
+  passed &= Check(maxBatchError < 1e-4f, "batched zonal lights match their sum");
+  return passed;
+}
+
+void BenchmarkZonal() {
+  constexpr int lightCount = 256;
+  constexpr int repeats = 100;
+  for (int order : {3, 5, 8}) {
+    ShZonalBatch batch{order};
+    float zonal[s_shMaxOrder];
+    ShZonalCone(order, std::cos(0.2f), zonal);
+    auto d = FibonacciDirections(lightCount);
+    for (size_t k = 0; k < d.Count(); ++k) {
+      batch.Add({d.x[k], d.y[k], d.z[k]}, {1.f, 0.5f, 0.25f}, zonal);
+    }
+
+    float checksum = 0.f;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+      checksum += batch.Project().channels[0][0];
+    }
+    std::chrono::duration<double, std::micro> us =
+        std::chrono::high_resolution_clock::now() - start;
+    std::cout << "projection of " << lightCount << " zonal lights, order " << order << ": "
+              << us.count() / repeats << " us (checksum " << checksum << ")\n";
+  }
+}
+
+void BenchmarkProduct() {
+  constexpr size_t pairCount = 10000;
+  for (int order : {3, 5, 8}) {
+    const auto& tensor = ShProductTensor::Get(order);
+    std::vector<float> f(ShCoefficientCount(order) * pairCount, 1.f);
+    std::vector<float> out(f.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    tensor.ProductBatch(f.data(), f.data(), out.data(), pairCount);
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::high_resolution_clock::now() - start;
+    std::cout << "product of " << pairCount << " pairs, order " << order << " ("
+              << tensor.EntryCount() << " tensor entries): " << ms.count() << " ms\n";
+  }
+}
+
+const SampleSequence s_sequences[] = {SampleSequence::Random, SampleSequence::Stratified,
+                                      SampleSequence::Sobol, SampleSequence::Fibonacci};
+const char* const s_sequenceNames[] = {"random", "stratified", "sobol", "fibonacci"};
+
+// Test sky: red is the smooth (1 + a . w)^2, green the indicator of a cone around b. Both are
+// zonal, so their exact coefficients are known.
+ShRgb TestSky(int order, DirectX::XMFLOAT3 a, DirectX::XMFLOAT3 b, float cosHalfAngle) {
+  float smooth[s_shMaxOrder] = {};
+  // 2 pi K_l times the integral of (1 + t)^2 P_l(t) over [-1, 1]
+  const float integrals[] = {8.f / 3.f, 4.f / 3.f, 4.f / 15.f};
+  for (int l = 0; l < std::min(order, 3); ++l) {
+    smooth[l] = 2.f * 3.14159265f * std::sqrt((2.f * l + 1.f) / (4.f * 3.14159265f)) *
+                integrals[l];
+  }
+  float cone[s_shMaxOrder];
+  ShZonalCone(order, cosHalfAngle, cone);
+
+  ShRgb sky{order};
+  ShRotateZonal(order, smooth, a, sky.channels[0].data());
+  ShRotateZonal(order, cone, b, sky.channels[1].data());
+  return sky;
+}
+
+RadianceBatch TestSkyRadiance(DirectX::XMFLOAT3 a, DirectX::XMFLOAT3 b, float cosHalfAngle) {
+  return [a, b, cosHalfAngle](const SampleDirections& d, size_t first, size_t count, float* rgb) {
+    for (size_t k = 0; k < count; ++k) {
+      size_t i = first + k;
+      float ta = 1.f + a.x * d.x[i] + a.y * d.y[i] + a.z * d.z[i];
+      float tb = b.x * d.x[i] + b.y * d.y[i] + b.z * d.z[i];
+      rgb[k] = ta * ta;
+      rgb[DirectionIntegrator::s_batchSize + k] = tb >= cosHalfAngle ? 1.f : 0.f;
+      rgb[2 * DirectionIntegrator::s_batchSize + k] = 0.f;
+    }
+  };
+}
+
+// Sequences fill their domains, Sobol points are stratified and sampled projection converges
+bool CheckSampling() {
+  // Owen scrambled Sobol points: one of the first 256 in every cell of a 16 x 16 and a 4 x 64 grid
+  bool stratified = true;
+  for (std::uint32_t seed : {0u, 1u, 2u}) {
+    std::vector<int> square(256, 0), wide(256, 0);
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      auto u = Sample2D(SampleSequence::Sobol, i, 256, seed);
+      ++square[static_cast<int>(u.x * 16) * 16 + static_cast<int>(u.y * 16)];
+      ++wide[static_cast<int>(u.x * 4) * 64 + static_cast<int>(u.y * 64)];
+    }
+    stratified &= std::all_of(square.begin(), square.end(), [](int n) { return n == 1; }) &&
+                  std::all_of(wide.begin(), wide.end(), [](int n) { return n == 1; });
+  }
+
+  // Integral of z^2 over every domain: 4 pi / 3 over the sphere, 2 pi / 3 over the hemisphere and,
+  // with the cosine, pi / 2
+  bool integrals = true;
+  const std::pair<SampleDomain, float> domains[] = {{SampleDomain::Sphere, 4.18879f},
+                                                    {SampleDomain::Hemisphere, 2.09440f},
+                                                    {SampleDomain::CosineHemisphere, 1.57080f}};
+  for (auto [domain, expected] : domains) {
+    for (auto sequence : s_sequences) {
+      auto d = GenerateDirections(domain, sequence, 4096, 3);
+      double sum = 0.0;
+      for (size_t k = 0; k < d.Count(); ++k) {
+        integrals &= domain == SampleDomain::Sphere || d.z[k] >= 0.f;
+        sum += d.z[k] * d.z[k];
+      }
+      integrals &= std::abs(sum * d.weight - expected) < 0.05f * expected;
+    }
+  }
+
+  // Projection of the test sky, on one item split over batches
+  constexpr int order = 4;
+  DirectX::XMFLOAT3 a{0.6f, 0.f, 0.8f}, b{0.f, -0.6f, 0.8f};
+  auto d = GenerateDirections(SampleDomain::Sphere, SampleSequence::Sobol, 1 << 16, 4);
+  auto sh = ProjectSampled(order, d, TestSkyRadiance(a, b, 0.8f));
+  auto expected = TestSky(order, a, b, 0.8f);
+  float maxError = 0.f;
+  for (int c = 0; c < 2; ++c) {
+    for (int i = 0; i < sh.CoefficientCount(); ++i) {
+      maxError = std::max(maxError, std::abs(sh.channels[c][i] - expected.channels[c][i]));
+    }
+  }
+
+  bool passed = Check(stratified, "scrambled Sobol points are stratified");
+  passed &= Check(integrals, "sample directions integrate over their domains");
+  passed &= Check(maxError < 5e-3f, "sampled projection matches the zonal test sky");
+  return passed;
+}
+
+// RMS error over seeds against the sample count: SH projection of the smooth and the
+// discontinuous channel of the test sky, and a cosine weighted visibility like an AO bake
+void BenchmarkSampling() {
+  constexpr int order = 4;
+  constexpr int seedCount = 16;
+  const size_t sampleCounts[] = {16, 64, 256, 1024, 4096, 16384};
+  DirectX::XMFLOAT3 a{0.6f, 0.f, 0.8f}, b{0.f, -0.6f, 0.8f};
+  auto expected = TestSky(order, a, b, 0.8f);
+
+  // Over the cosine weighted hemisphere, the integral of "x > c" is the area of a segment of the
+  // unit disk, acos(c) - c sqrt(1 - c^2)
+  constexpr float edge = 0.2f;
+  const float visibleIntegral = std::acos(edge) - edge * std::sqrt(1.f - edge * edge);
+
+  const char* const integrands[] = {"sphere smooth", "sphere cone", "hemisphere visibility"};
+  for (int integrand = 0; integrand < 3; ++integrand) {
+    std::cout << "convergence, " << integrands[integrand] << " (rms error at";
+    for (size_t n : sampleCounts) {
+      std::cout << " " << n;
+    }
+    std::cout << " samples)\n";
+
+    for (size_t s = 0; s < std::size(s_sequences); ++s) {
+      std::cout << "  " << s_sequenceNames[s] << ":";
+      for (size_t n : sampleCounts) {
+        double squaredError = 0.0;
+        for (std::uint32_t seed = 0; seed < seedCount; ++seed) {
+          if (integrand < 2) {
+            auto d = GenerateDirections(SampleDomain::Sphere, s_sequences[s], n, seed);
+            auto sh = ProjectSampled(order, d, TestSkyRadiance(a, b, 0.8f));
+            for (int i = 0; i < sh.CoefficientCount(); ++i) {
+              double e = sh.channels[integrand][i] - expected.channels[integrand][i];
+              squaredError += e * e;
+            }
+          } else {
+            auto d = GenerateDirections(SampleDomain::CosineHemisphere, s_sequences[s], n, seed);
+            size_t visible = std::count_if(d.x.begin(), d.x.end(), [](float x) {
+              return x > edge;
+            });
+            double e = visible * d.weight - visibleIntegral;
+            squaredError += e * e;
+          }
+        }
+        std::cout << " " << std::sqrt(squaredError / seedCount);
+      }
+      std::cout << "\n";
+    }
+  }
+}
+
+void Benchmark(const Directions& d) {
+  // Directions are evaluated in blocks that stay in cache, as projection loops do
+  constexpr size_t blockSize = 1000;
+  std::vector<float> basis(ShCoefficientCount(s_shMaxOrder) * blockSize);
+  for (int order = 2; order <= s_shMaxOrder; ++order) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t k = 0; k + blockSize <= d.Count(); k += blockSize) {
+      ShEvaluateBatch(order, &d.x[k], &d.y[k], &d.z[k], blockSize, basis.data());
+    }
+    std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "order " << order << ": " << d.Count() / seconds.count() / 1e6
+              << " M directions/s\n";
+  }
+}
+}  // namespace
+
+int main() {
+  auto directions = FibonacciDirections(1000000);
+
+  bool passed = CheckClosedForms();
+  passed &= CheckOrthonormality(FibonacciDirections(20000));
+  passed &= CheckBatch(directions);
+  passed &= CheckProjection();
+  passed &= CheckRotation(directions);
+  passed &= CheckProduct(directions);
+  passed &= CheckWindows();
+  passed &= CheckZonal();
+  passed &= CheckSampling();
+  Benchmark(directions);
+  BenchmarkProjection();
+  BenchmarkRotation();
+  BenchmarkProduct();
+  BenchmarkZonal();
+  BenchmarkSampling();
+
+  return passed ? 0 : 1;
+}